@@ -0,0 +1,880 @@
+#include <time.h>
+#include "exec.h"
+#include "cache.h"
+
+#define BENCH_N		60000
+#define BENCH_REPS	5
+#define BENCH_DISPATCH_N	2000000
+#define BENCH_STR_SIZE	64
+#define BENCH_PARSE_MIN	1000
+#define BENCH_PARSE_MAX	100000
+#define BENCH_PARSE_BUDGET	10.0
+#define BENCH_COMPILE_N	2000
+#define BENCH_OPS_N	5000000
+#define BENCH_SIMD_N	(1l << 13)
+#define BENCH_SIMD_ITERS	1000
+#define BENCH_SCAN_SIZE	(1l << 20)
+#define BENCH_SCAN_REPS	20
+#define BENCH_CONCAT_N	1000000
+#define BENCH_APPEND_MIN	1000
+#define BENCH_APPEND_MAX	100000
+#define BENCH_HASH_MIN	1000
+#define BENCH_HASH_MAX	10000000
+#define BENCH_LOOKUP_KEYS	1024
+#define BENCH_LOOKUP_N	(1l << 22)
+#define BENCH_DEPTH_CALLS	(1l << 21)
+#define BENCH_FIB_N	30
+#define BENCH_FIB_RES	832040l
+#define BENCH_FIB_CALLS	2692537l//the number of calls made to compute fib(BENCH_FIB_N)
+#define BENCH_CALLS_N	1000000l
+
+/**
+ * Helper function which returns the current time in seconds.
+ */
+double bench_time() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + 1e-9*(double)t.tv_nsec;
+}
+
+/**
+ * Helper function which parses the expression expr against the named stack names and evaluates it against the stack st. This mirrors interpreting a line of source text each time it is executed.
+ */
+value bench_eval_str(const char* expr, NamedStack* names, Stack* st, sc_error* err) {
+    char buf[BENCH_STR_SIZE];
+    strncpy(buf, expr, BENCH_STR_SIZE - 1);
+    buf[BENCH_STR_SIZE - 1] = 0;
+    struct Operation* op = gen_optree(buf, names, err);
+    value ret = eval(op, st, err);
+    free_Operation(op);
+    return ret;
+}
+
+/**
+ * Sum the integers from 1 to n by reparsing each expression every time it is evaluated.
+ */
+long bench_reparse(long n, sc_error* err) {
+    NamedStack names = make_NamedStack(err);
+    Stack st = make_Stack(err);
+    char n_a[] = "a";
+    char n_b[] = "b";
+    char n_s[] = "s";
+    //the named stack is only used to resolve stack indices
+    push_n(&names, n_a, v_make_int(1, err), err);
+    push_n(&names, n_b, v_make_int(n, err), err);
+    push_n(&names, n_s, v_make_int(0, err), err);
+    push(&st, v_make_int(1, err), err);
+    push(&st, v_make_int(n, err), err);
+    push(&st, v_make_int(0, err), err);
+    while (bench_eval_str("a <= b", &names, &st, err).val.i) {
+	st.top[0] = bench_eval_str("s + a", &names, &st, err);
+	st.top[2] = bench_eval_str("a + 1", &names, &st, err);
+    }
+    long ret = st.top[0].val.i;
+    names.top = names.bottom;
+    free_NamedStack(&names);
+    free_Stack(&st);
+    return ret;
+}
+
+/**
+ * Sum the integers from 1 to n by evaluating optrees which were generated ahead of time.
+ */
+long bench_optree(long n, sc_error* err) {
+    NamedStack names = make_NamedStack(err);
+    Stack st = make_Stack(err);
+    char n_a[] = "a";
+    char n_b[] = "b";
+    char n_s[] = "s";
+    push_n(&names, n_a, v_make_int(1, err), err);
+    push_n(&names, n_b, v_make_int(n, err), err);
+    push_n(&names, n_s, v_make_int(0, err), err);
+    push(&st, v_make_int(1, err), err);
+    push(&st, v_make_int(n, err), err);
+    push(&st, v_make_int(0, err), err);
+    char cnd_str[] = "a <= b";
+    char sum_str[] = "s + a";
+    char inc_str[] = "a + 1";
+    struct Operation* cnd = gen_optree(cnd_str, &names, err);
+    struct Operation* sum = gen_optree(sum_str, &names, err);
+    struct Operation* inc = gen_optree(inc_str, &names, err);
+    while (eval(cnd, &st, err).val.i) {
+	st.top[0] = eval(sum, &st, err);
+	st.top[2] = eval(inc, &st, err);
+    }
+    long ret = st.top[0].val.i;
+    free_Operation(cnd);
+    free_Operation(sum);
+    free_Operation(inc);
+    names.top = names.bottom;
+    free_NamedStack(&names);
+    free_Stack(&st);
+    return ret;
+}
+
+/**
+ * Sum the integers from 1 to n by evaluating flat expressions which were lowered from optrees ahead of time.
+ */
+long bench_expr(long n, sc_error* err) {
+    NamedStack names = make_NamedStack(err);
+    Stack st = make_Stack(err);
+    char n_a[] = "a";
+    char n_b[] = "b";
+    char n_s[] = "s";
+    push_n(&names, n_a, v_make_int(1, err), err);
+    push_n(&names, n_b, v_make_int(n, err), err);
+    push_n(&names, n_s, v_make_int(0, err), err);
+    push(&st, v_make_int(1, err), err);
+    push(&st, v_make_int(n, err), err);
+    push(&st, v_make_int(0, err), err);
+    char strs[3][BENCH_STR_SIZE] = {"a <= b", "s + a", "a + 1"};
+    expression exprs[3];
+    for (size_t i = 0; i < 3; ++i) {
+	struct Operation* op = gen_optree(strs[i], &names, err);
+	exprs[i] = make_expression(op, NULL, err);
+	free_Operation(op);
+    }
+    while (eval_expression(exprs, &st, err).val.i) {
+	st.top[0] = eval_expression(exprs + 1, &st, err);
+	st.top[2] = eval_expression(exprs + 2, &st, err);
+    }
+    long ret = st.top[0].val.i;
+    for (size_t i = 0; i < 3; ++i) { free_expression(exprs + i); }
+    names.top = names.bottom;
+    free_NamedStack(&names);
+    free_Stack(&st);
+    return ret;
+}
+
+/**
+ * Apply n rounds of the primitive operations add, subtract, multiply and compare to integer and float values. Each round performs four operations and the result is accumulated so that the work can't be skipped.
+ */
+long bench_ops(long n, sc_error* err) {
+    value acc = v_make_int(0, err);
+    value one = v_make_int(1, err);
+    value two = v_make_int(2, err);
+    value half = v_make_float(0.5, err);
+    long n_true = 0;
+    for (long i = 0; i < n; ++i) {
+	acc = op_add(acc, two, err);
+	acc = op_sub(acc, one, err);
+	value f = op_mult(acc, half, err);
+	value cmp = op_grt(f, half, err);
+	n_true += cmp.val.i;
+    }
+    return acc.val.i + n_true;
+}
+
+/**
+ * Apply op BENCH_SIMD_ITERS times to each pair of elements from the boxed value arrays a and b and store the result in out. This is the per-element loop that element-wise array operations replace.
+ * Returns: the time taken in seconds, the best of BENCH_REPS runs
+ */
+double bench_per_element(value (*op)(value, value, sc_error*), const value* a, const value* b, value* out, size_t n, sc_error* err) {
+    double best = 1e9;
+    for (size_t r = 0; r < BENCH_REPS; ++r) {
+	double t0 = bench_time();
+	for (size_t k = 0; k < BENCH_SIMD_ITERS; ++k) {
+	    for (size_t i = 0; i < n; ++i) { out[i] = op(a[i], b[i], err); }
+	}
+	double t1 = bench_time();
+	if (t1 - t0 < best) { best = t1 - t0; }
+    }
+    return best;
+}
+
+/**
+ * Apply op element-wise BENCH_SIMD_ITERS times to the arrays a and b using the SIMD kernels for level. The arrays are small enough to stay in cache so that this measures the kernels rather than memory bandwidth.
+ * Returns: the time taken in seconds, the best of BENCH_REPS runs
+ */
+double bench_elementwise(value (*op)(value, value, sc_error*), value a, value b, int level, sc_error* err) {
+    set_simd_level(level);
+    double best = 1e9;
+    for (size_t r = 0; r < BENCH_REPS; ++r) {
+	double t0 = bench_time();
+	for (size_t k = 0; k < BENCH_SIMD_ITERS; ++k) {
+	    value res = op(a, b, err);
+	    free_value(&res);
+	}
+	double t1 = bench_time();
+	if (t1 - t0 < best) { best = t1 - t0; }
+    }
+    return best;
+}
+
+/**
+ * Helper function which generates roughly n bytes of script text with balanced nesting. The whole text is wrapped in curly braces. The caller is responsible for freeing the result.
+ */
+char* bench_make_script(size_t n) {
+    const char* lines[] = {
+	"\n    total = total + scale(values[i], 2.5) * offset;",
+	"\n    if (total > limit) { print(\"total exceeded the limit, stopping\"); }",
+	"\n    names = [\"first\", \"second\", \"third\"];",
+	"\n    result = compute(alpha, beta, [gamma, delta], {epsilon});"
+    };
+    char* ret = (char*)malloc(sizeof(char)*(n + BENCH_STR_SIZE*2));
+    size_t off = sprintf(ret, "{");
+    for (size_t i = 0; off < n; ++i) { off += sprintf(ret + off, "%s", lines[i % 4]); }
+    sprintf(ret + off, "\n}");
+    return ret;
+}
+
+/**
+ * Time one pass over the script text using the parsing utility selected by kind (0: _search_block, 1: _get_enclosed, 2: csv_to_list, 3: read_dtg_word) with the string scanners for level. Utilities which modify their argument are timed on a fresh copy.
+ * Returns: the throughput in MB/s, the best of BENCH_SCAN_REPS runs
+ */
+double bench_scan(int kind, const char* text, int level, sc_error* err) {
+    set_simd_level(level);
+    size_t len = strlen(text);
+    char* tmp = (char*)malloc(sizeof(char)*(len + 1));
+    char word[BENCH_STR_SIZE];
+    double best = 1e9;
+    size_t check = 0;
+    for (size_t r = 0; r < BENCH_SCAN_REPS; ++r) {
+	memcpy(tmp, text, len + 1);
+	//csv_to_list is given the contents of the outer braces
+	if (kind == 2) { tmp[len - 1] = 0; }
+	double t0 = bench_time();
+	if (kind == 0) {
+	    //the token never appears so the whole text is searched
+	    check = _search_block(tmp, "return", 0);
+	} else if (kind == 1) {
+	    check = strlen(_get_enclosed(tmp, "{", "}"));
+	} else if (kind == 2) {
+	    char** list = csv_to_list(tmp + 1, ';', &check, err);
+	    free(list);
+	} else {
+	    check = 0;
+	    for (size_t off = read_dtg_word(tmp, 0, word, BENCH_STR_SIZE); off != 0; off = read_dtg_word(tmp, off, word, BENCH_STR_SIZE)) { ++check; }
+	}
+	double t1 = bench_time();
+	if (t1 - t0 < best) { best = t1 - t0; }
+    }
+    free(tmp);
+    //this keeps the compiler from discarding the work and catches gross errors
+    if (check == 0 || err->type != E_SUCCESS) { return -1; }
+    return 1e-6*len/best;
+}
+
+/**
+ * Concatenate the strings a and b BENCH_CONCAT_N times and compare each result against the first one, which is how short keys and labels are typically built and used.
+ * Returns: the time taken in seconds, the best of BENCH_REPS runs
+ */
+double bench_concat(const char* a, const char* b, sc_error* err) {
+    value va = v_make_string(a, err);
+    value vb = v_make_string(b, err);
+    value first = op_add(va, vb, err);
+    double best = 1e9;
+    size_t n_eq = 0;
+    for (size_t r = 0; r < BENCH_REPS; ++r) {
+	double t0 = bench_time();
+	for (size_t k = 0; k < BENCH_CONCAT_N; ++k) {
+	    value res = op_add(va, vb, err);
+	    n_eq += op_eq(res, first, err).val.i;
+	    free_value(&res);
+	}
+	double t1 = bench_time();
+	if (t1 - t0 < best) { best = t1 - t0; }
+    }
+    free_value(&first);
+    free_value(&va);
+    free_value(&vb);
+    if (n_eq != BENCH_REPS*BENCH_CONCAT_N) { return -1; }
+    return best;
+}
+
+/**
+ * Build a string by appending a short piece to it n times with s = s + piece, freeing each intermediate result. This is how scripts typically build output in a loop.
+ * Returns: the time taken in seconds, the best of BENCH_REPS runs
+ */
+double bench_append(size_t n, sc_error* err) {
+    value piece = v_make_string("abc", err);
+    double best = 1e9;
+    size_t size = 0;
+    for (size_t r = 0; r < BENCH_REPS; ++r) {
+	value s = v_make_string("", err);
+	double t0 = bench_time();
+	for (size_t k = 0; k < n; ++k) {
+	    value next = op_add(s, piece, err);
+	    free_value(&s);
+	    s = next;
+	}
+	double t1 = bench_time();
+	if (t1 - t0 < best) { best = t1 - t0; }
+	size = s.val.str->size;
+	free_value(&s);
+    }
+    free_value(&piece);
+    if (size != 3*n) { return -1; }
+    return best;
+}
+
+/**
+ * Insert n distinct keys into an empty HashTable, look each of them up by string and by interned pointer, look up n interned keys which aren't in the table, then remove them all. Large tables are only timed once since they take a while to build.
+ * Returns: 0 on success or -1 if the table gave a wrong result. The best time of each phase in seconds is stored in times.
+ */
+int bench_hashtable(size_t n, double times[5], sc_error* err) {
+    //each key gets room for the largest possible index
+    char* key_buf = (char*)malloc(sizeof(char)*n*BENCH_STR_SIZE/2);
+    char** keys = (char**)malloc(sizeof(char*)*n);
+    const char** ikeys = (const char**)malloc(sizeof(char*)*n);
+    const char** misses = (const char**)malloc(sizeof(char*)*n);
+    char miss[BENCH_STR_SIZE];
+    for (size_t i = 0; i < n; ++i) {
+	keys[i] = key_buf + i*BENCH_STR_SIZE/2;
+	snprintf(keys[i], BENCH_STR_SIZE/2, "key_%lu", i);
+	//names from other scopes are interned but absent from the table, which is the common case for the global table
+	snprintf(miss, BENCH_STR_SIZE, "miss_%lu", i);
+	misses[i] = intern_str(miss, err);
+    }
+    size_t reps = (n <= BENCH_HASH_MIN*100)? BENCH_REPS : 1;
+    int ret = 0;
+    for (size_t j = 0; j < 5; ++j) { times[j] = 1e9; }
+    for (size_t r = 0; r < reps; ++r) {
+	HashTable h = make_HashTable(err);
+	double t0 = bench_time();
+	for (size_t i = 0; i < n; ++i) { insert(&h, keys[i], v_make_int(i, err), err); }
+	double t1 = bench_time();
+	for (size_t i = 0; i < n; ++i) {
+	    HashedItem* item = lookup(&h, keys[i]);
+	    if (item == NULL || item->val.val.i != (sc_int)i) { ret = -1; }
+	    ikeys[i] = item->key;
+	}
+	double t2 = bench_time();
+	for (size_t i = 0; i < n; ++i) {
+	    if (lookup_interned(&h, ikeys[i])->val.val.i != (sc_int)i) { ret = -1; }
+	}
+	double t3 = bench_time();
+	for (size_t i = 0; i < n; ++i) {
+	    if (lookup_interned(&h, misses[i]) != NULL) { ret = -1; }
+	}
+	double t4 = bench_time();
+	for (size_t i = 0; i < n; ++i) {
+	    if (h_remove(&h, keys[i]) != 1) { ret = -1; }
+	}
+	double t5 = bench_time();
+	if (h.n_els != 0) { ret = -1; }
+	free_HashTable(&h);
+	double dt[5] = {t1 - t0, t2 - t1, t3 - t2, t4 - t3, t5 - t4};
+	for (size_t j = 0; j < 5; ++j) {
+	    if (dt[j] < times[j]) { times[j] = dt[j]; }
+	}
+    }
+    free(misses);
+    free(ikeys);
+    free(keys);
+    free(key_buf);
+    return ret;
+}
+
+/**
+ * Look up BENCH_LOOKUP_N names from keys in the table h, cycling through the first n_keys. If interned is 1 then the keys must be interned and lookup_interned() is used, otherwise lookup() is used.
+ * Returns: the time taken in seconds, the best of BENCH_REPS runs
+ */
+double bench_lookup(HashTable* h, const char** keys, size_t n_keys, int interned) {
+    double best = 1e9;
+    long check = 0;
+    for (size_t r = 0; r < BENCH_REPS; ++r) {
+	double t0 = bench_time();
+	for (size_t k = 0; k < BENCH_LOOKUP_N; ++k) {
+	    HashedItem* item = (interned)? lookup_interned(h, keys[k % n_keys]) : lookup(h, keys[k % n_keys]);
+	    check += item->val.val.i;
+	}
+	double t1 = bench_time();
+	if (t1 - t0 < best) { best = t1 - t0; }
+    }
+    //this keeps the compiler from discarding the work and catches gross errors
+    if (check != (long)(BENCH_REPS*(BENCH_LOOKUP_N/n_keys)*n_keys*(n_keys - 1)/2)) { return -1; }
+    return best;
+}
+
+/**
+ * Helper function which generates an expression with n_terms terms using the variable x. The caller is responsible for freeing the result.
+ */
+char* bench_make_expr(size_t n_terms) {
+    const char* terms[] = {"x", "3*x", "(x - 2)", "17", "x/4"};
+    char* ret = (char*)malloc(sizeof(char)*(BENCH_STR_SIZE/4)*(n_terms + 1));
+    size_t off = 0;
+    for (size_t i = 0; i < n_terms; ++i) {
+	if (i > 0) { off += sprintf(ret + off, (i % 2)? " + " : " - "); }
+	off += sprintf(ret + off, "%s", terms[i % 5]);
+    }
+    return ret;
+}
+
+/**
+ * Time parsing an expression with n_terms terms using gen_optree (if old is 1) or parse_optree. The best time of BENCH_REPS runs is returned.
+ */
+double bench_parse(size_t n_terms, int old, sc_error* err) {
+    NamedStack names = make_NamedStack(err);
+    char n_x[] = "x";
+    push_n(&names, n_x, v_make_int(1, err), err);
+    char* expr = bench_make_expr(n_terms);
+    char* tmp = (char*)malloc(sizeof(char)*(strlen(expr) + 1));
+    double best = 1e9;
+    for (size_t r = 0; r < BENCH_REPS; ++r) {
+	//gen_optree modifies its argument so we time it on a fresh copy
+	strcpy(tmp, expr);
+	double t0 = bench_time();
+	struct Operation* op = (old)? gen_optree(tmp, &names, err) : parse_optree(expr, &names, NULL, err);
+	double t1 = bench_time();
+	if (op == NULL || err->type != E_SUCCESS) {
+	    printf("failed to parse benchmark expression: %s\n", err->msg);
+	    best = -1;
+	    break;
+	}
+	free_Operation(op);
+	if (t1 - t0 < best) { best = t1 - t0; }
+	//the old parser is quadratic, don't spend forever on it
+	if (old && t1 - t0 > 1.0) { break; }
+    }
+    free(tmp);
+    free(expr);
+    names.top = names.bottom;
+    free_NamedStack(&names);
+    return best;
+}
+
+/**
+ * Helper function which counts the number of instructions executed by each iteration of the first loop in f. The loop is identified by its backwards jump.
+ */
+size_t bench_count_loop_insts(function* f) {
+    size_t start = 0;
+    size_t end = 0;
+    size_t i = 0;
+    while (i < f->buf.n_insts) {
+	size_t op = _ins_opcode(&(f->buf), i);
+	if (op == INS_JUMP && f->buf.buf[i+1].i < i) {
+	    start = f->buf.buf[i+1].i;
+	    end = i;
+	    break;
+	}
+	i += _ins_size(op);
+    }
+    size_t n = 0;
+    for (i = 0; i <= end; i += _ins_size(_ins_opcode(&(f->buf), i))) {
+	if (i >= start) { ++n; }
+    }
+    return n;
+}
+
+/**
+ * Sum the integers from 1 to n by executing the compiled function f.
+ */
+long bench_vm(context* con, function* f, long n, sc_error* err) {
+    push_n(&(con->callstack), NULL, v_make_int(1, err), err);
+    push_n(&(con->callstack), NULL, v_make_int(n, err), err);
+    execute_function(con, f, err);
+    HashedItem res = pop_n(&(con->callstack), err);
+    return res.val.val.i;
+}
+
+/**
+ * Execute the compiled function f which takes the single argument n.
+ */
+long bench_vm_1(context* con, function* f, long n, sc_error* err) {
+    push_n(&(con->callstack), NULL, v_make_int(n, err), err);
+    execute_function(con, f, err);
+    HashedItem res = pop_n(&(con->callstack), err);
+    return res.val.val.i;
+}
+
+/**
+ * Compile the function def into f and insert it into the global table of con under name. f is declared before it is compiled so that it may call itself. Every argument and return value must be an integer.
+ * Returns: 0 on success or -1 on error
+ */
+int bench_make_global(context* con, const char* name, function* f, char* def, sc_error* err) {
+    static Valtype_e int_types[4] = {VT_INT, VT_INT, VT_INT, VT_INT};
+    //the signature is read from the argument and return lists
+    char* rets = strstr(def, "=>");
+    f->n_args = 1;
+    f->n_rets = 1;
+    for (char* p = def; p < rets; ++p) { f->n_args += (*p == ','); }
+    for (char* p = rets; *p != ')'; ++p) { f->n_rets += (*p == ','); }
+    f->argument_types = int_types;
+    f->return_types = int_types;
+    value v = {0};
+    v.type = VT_FUNC;
+    v.val.ptr = f;
+    insert(&(con->global), name, v, err);
+    if (err->type != E_SUCCESS) { return -1; }
+    *f = make_function(con, def, err);
+    return (err->type == E_SUCCESS)? 0 : -1;
+}
+
+/**
+ * Call the recursive function f (see main()) which recurses depth times before returning. The call is repeated so that roughly BENCH_DEPTH_CALLS calls are made in total. If cold is set then the execution stack of con is released before every repetition so that each one has to grow it from scratch.
+ * returns: the best time for a single repetition or a negative value if a wrong result was returned
+ */
+double bench_recursion(context* con, function* f, size_t depth, int cold, sc_error* err) {
+    size_t reps = (depth < BENCH_DEPTH_CALLS)? BENCH_DEPTH_CALLS/depth : 1;
+    double best = 1e9;
+    for (size_t r = 0; r < reps; ++r) {
+	if (cold) { free_Stack(&(con->exec_stack)); }
+	double t0 = bench_time();
+	long res = bench_vm_1(con, f, depth, err);
+	double t1 = bench_time();
+	if (err->type != E_SUCCESS || res != (long)depth) { return -1; }
+	if (t1 - t0 < best) { best = t1 - t0; }
+    }
+    return best;
+}
+
+int main() {
+    sc_error err;
+    sc_reset_error(&err);
+    context con = make_context(&err);
+    char func_def[] = "(int a, int b) => (int) {\nint s = 0\nwhile a <= b {\ns = s + a\na = a + 1\n}\nreturn s\n}";
+    function f = make_function(&con, func_def, &err);
+    if (err.type != E_SUCCESS) {
+	printf("failed to compile benchmark: %s\n", err.msg);
+	return 1;
+    }
+
+    long expect = (long)BENCH_N*(BENCH_N + 1)/2;
+    double best[4] = {1e9, 1e9, 1e9, 1e9};
+    long res[4];
+    for (size_t r = 0; r < BENCH_REPS; ++r) {
+	double t0 = bench_time();
+	res[0] = bench_reparse(BENCH_N, &err);
+	double t1 = bench_time();
+	res[1] = bench_optree(BENCH_N, &err);
+	double t2 = bench_time();
+	res[2] = bench_expr(BENCH_N, &err);
+	double t3 = bench_time();
+	res[3] = bench_vm(&con, &f, BENCH_N, &err);
+	double t4 = bench_time();
+	if (t1 - t0 < best[0]) { best[0] = t1 - t0; }
+	if (t2 - t1 < best[1]) { best[1] = t2 - t1; }
+	if (t3 - t2 < best[2]) { best[2] = t3 - t2; }
+	if (t4 - t3 < best[3]) { best[3] = t4 - t3; }
+    }
+    const char* names[] = {"reparse + eval", "prebuilt optree", "flat expression", "bytecode vm"};
+    printf("sum of 1..%d, best of %d runs\n", BENCH_N, BENCH_REPS);
+    for (size_t i = 0; i < 4; ++i) {
+	printf("%-16s %10.3f ms %8.1f ns/iter %s\n", names[i], 1e3*best[i], 1e9*best[i]/BENCH_N, (res[i] == expect)? "" : "(WRONG RESULT)");
+    }
+
+    //measure dispatch overhead with a loop dominated by cheap stack moves
+    char shuffle_def[] = "(int n) => (int) {\nint i = 0\nint a = 1\nint b = 2\nint c = 3\nwhile i < n {\na = b;b = c;c = a;a = b;b = c;c = a;a = b;b = c;c = a\ni = i + 1\n}\nreturn a\n}";
+    function shuffle_f = make_function(&con, shuffle_def, &err);
+    if (err.type != E_SUCCESS) {
+	printf("failed to compile benchmark: %s\n", err.msg);
+	return 1;
+    }
+    size_t loop_insts = bench_count_loop_insts(&shuffle_f);
+    double best_shuffle = 1e9;
+    for (size_t r = 0; r < BENCH_REPS; ++r) {
+	double t0 = bench_time();
+	bench_vm_1(&con, &shuffle_f, BENCH_DISPATCH_N, &err);
+	double t1 = bench_time();
+	if (t1 - t0 < best_shuffle) { best_shuffle = t1 - t0; }
+    }
+#ifdef SC_COMPUTED_GOTO
+    const char* dispatch_name = "computed goto";
+#else
+    const char* dispatch_name = "switch";
+#endif
+    printf("dispatch (%s): %lu instructions per iteration, %.1f M instructions/s\n", dispatch_name, loop_insts, 1e-6*loop_insts*BENCH_DISPATCH_N/best_shuffle);
+
+    //measure the cost of individual operations where nothing is expected to fail
+    double best_ops = 1e9;
+    long res_ops = 0;
+    for (size_t r = 0; r < BENCH_REPS; ++r) {
+	double t0 = bench_time();
+	res_ops = bench_ops(BENCH_OPS_N, &err);
+	double t1 = bench_time();
+	if (t1 - t0 < best_ops) { best_ops = t1 - t0; }
+    }
+    printf("primitive ops: %.1f M ops/s %s\n", 1e-6*4*BENCH_OPS_N/best_ops, (res_ops == 2*(long)BENCH_OPS_N - 1)? "" : "(WRONG RESULT)");
+
+
+    //compare element-wise array operations against applying the scalar operation to each boxed element
+    value* simd_a = (value*)malloc(sizeof(value)*BENCH_SIMD_N);
+    value* simd_b = (value*)malloc(sizeof(value)*BENCH_SIMD_N);
+    value* simd_out = (value*)malloc(sizeof(value)*BENCH_SIMD_N);
+    const char* simd_names[] = {"scalar", "sse2", "sse4.2", "avx2"};
+    printf("element-wise arrays, %ld elements, M elements/s (best supported: %s)\n", BENCH_SIMD_N, simd_names[simd_supported()]);
+    for (size_t t = 0; t < 2; ++t) {
+	for (long i = 0; i < BENCH_SIMD_N; ++i) {
+	    simd_a[i] = (t == 0)? v_make_float(0.5*i, &err) : v_make_int(i, &err);
+	    simd_b[i] = (t == 0)? v_make_float(1.0 + (i % 7), &err) : v_make_int(3 - (i % 7), &err);
+	}
+	value (*simd_op)(value, value, sc_error*) = (t == 0)? op_mult : op_add;
+	value arr_a = v_make_array(simd_a, BENCH_SIMD_N, &err);
+	value arr_b = v_make_array(simd_b, BENCH_SIMD_N, &err);
+	printf("  %-10s per value %7.1f", (t == 0)? "float a*b" : "int a+b", 1e-6*BENCH_SIMD_N*BENCH_SIMD_ITERS/bench_per_element(simd_op, simd_a, simd_b, simd_out, BENCH_SIMD_N, &err));
+	for (int level = SIMD_NONE; level <= simd_supported(); ++level) {
+	    //SSE4.2 only adds string instructions, the arithmetic kernels are the same as for SSE2
+	    if (level == SIMD_SSE42) { continue; }
+	    printf("  %s %7.1f", simd_names[level], 1e-6*BENCH_SIMD_N*BENCH_SIMD_ITERS/bench_elementwise(simd_op, arr_a, arr_b, level, &err));
+	}
+	printf("\n");
+	free_value(&arr_a);
+	free_value(&arr_b);
+    }
+    free(simd_a);
+    free(simd_b);
+    free(simd_out);
+
+    //compare the string scanners used by the parsing utilities
+    char* scan_text = bench_make_script(BENCH_SCAN_SIZE);
+    const char* scan_names[] = {"_search_block", "_get_enclosed", "csv_to_list", "read_dtg_word"};
+    printf("parsing utilities, %ld KiB of script text, MB/s (best supported: %s)\n", BENCH_SCAN_SIZE >> 10, simd_names[simd_supported()]);
+    for (int kind = 0; kind < 4; ++kind) {
+	printf("  %-14s", scan_names[kind]);
+	for (int level = SIMD_NONE; level <= simd_supported(); ++level) {
+	    //SSE2 doesn't add a string scanner
+	    if (level == SIMD_SSE2) { continue; }
+	    printf("  %s %7.1f", simd_names[level], bench_scan(kind, scan_text, level, &err));
+	}
+	printf("\n");
+    }
+    set_simd_level(simd_supported());
+    free(scan_text);
+
+    //compare concatenating strings that fit in the inline buffer with ones that don't
+    printf("string concat + compare, M concats/s\n");
+    const char* concat_args[2][2] = {{"key_", "label"}, {"a string which is too long to be stored inline ", "and another one"}};
+    for (size_t t = 0; t < 2; ++t) {
+#ifdef SC_COUNT_ALLOCS
+	size_t concat_allocs = sc_n_allocs;
+#endif
+	double t_concat = bench_concat(concat_args[t][0], concat_args[t][1], &err);
+	printf("  %-6s %7.1f", (t == 0)? "short" : "long", 1e-6*BENCH_CONCAT_N/t_concat);
+#ifdef SC_COUNT_ALLOCS
+	printf(", %.1f allocations per concat", (double)(sc_n_allocs - concat_allocs)/(BENCH_REPS*BENCH_CONCAT_N));
+#endif
+	printf("\n");
+    }
+
+    //repeatedly appending to the same string should take constant time per append regardless of its length
+    printf("repeated append (s = s + x), ns per append\n");
+    for (size_t n = BENCH_APPEND_MIN; n <= BENCH_APPEND_MAX; n *= 10) {
+	double t_append = bench_append(n, &err);
+	printf("  %7lu appends %8.1f%s\n", n, 1e9*t_append/n, (t_append < 0)? " (WRONG RESULT)" : "");
+	fflush(stdout);
+    }
+
+    //measure compile throughput on a function with several blocks, calls and expressions
+    char compile_def[] = "(int n, array l) => (int, float) {\nint i = 0\nint s = 0\nfloat m = 0.0\nwhile i < n {\nif (i/2)*2 == i {\ns = s + 3*i - (i - 1)/2\n} else if i > 10 {\ns = s - 1\n} else {\nfloat t = l[i] * 2.5 + 1.0\nm = m + t\n}\ni = i + 1\n}\nreturn s*2 + 1, m\n}";
+    char compile_buf[sizeof(compile_def)];
+#ifdef SC_COUNT_ALLOCS
+    size_t allocs_start = sc_n_allocs;
+#endif
+    double t_compile = bench_time();
+    for (size_t r = 0; r < BENCH_COMPILE_N; ++r) {
+	strcpy(compile_buf, compile_def);
+	function tmp_f = make_function(&con, compile_buf, &err);
+	if (err.type != E_SUCCESS) {
+	    printf("failed to compile benchmark: %s\n", err.msg);
+	    return 1;
+	}
+	free_function(&tmp_f);
+    }
+    t_compile = bench_time() - t_compile;
+    printf("compile: %.1f us per function, %.0f functions/s", 1e6*t_compile/BENCH_COMPILE_N, BENCH_COMPILE_N/t_compile);
+#ifdef SC_COUNT_ALLOCS
+    printf(", %.1f allocations per function", (double)(sc_n_allocs - allocs_start)/BENCH_COMPILE_N);
+#endif
+    printf("\n");
+    printf("intern pool: %lu names, %lu bytes after compiling %d functions\n", n_interned_strs(), interned_bytes(), BENCH_COMPILE_N);
+
+    //measure startup from a bytecode cache. The first call compiles the function and writes its image, every later call loads the image.
+    char cache_dir[] = "/tmp/scripty_benchXXXXXX";
+    if (mkdtemp(cache_dir) == NULL) {
+	printf("failed to create cache directory\n");
+	return 1;
+    }
+    strcpy(compile_buf, compile_def);
+    double t_save = bench_time();
+    function cached_f = make_function_cached(&con, compile_buf, cache_dir, &err);
+    t_save = bench_time() - t_save;
+    if (err.type != E_SUCCESS) {
+	printf("failed to compile benchmark: %s\n", err.msg);
+	return 1;
+    }
+    free_function(&cached_f);
+    double t_load = bench_time();
+    for (size_t r = 0; r < BENCH_COMPILE_N; ++r) {
+	strcpy(compile_buf, compile_def);
+	cached_f = make_function_cached(&con, compile_buf, cache_dir, &err);
+	if (err.type != E_SUCCESS) {
+	    printf("failed to load benchmark: %s\n", err.msg);
+	    return 1;
+	}
+	free_function(&cached_f);
+    }
+    t_load = (bench_time() - t_load)/BENCH_COMPILE_N;
+    printf("bytecode cache: cold %.1f us (compile and save), warm %.1f us per load (%.1fx faster than compiling)\n", 1e6*t_save, 1e6*t_load, t_compile/BENCH_COMPILE_N/t_load);
+    char image_name[sizeof(cache_dir) + 2*sizeof(sc_uint) + sizeof(BC_EXT) + 1];
+    snprintf(image_name, sizeof(image_name), "%s/%016llx%s", cache_dir, (unsigned long long)bc_hash(compile_def), BC_EXT);
+    remove(image_name);
+    remove(cache_dir);
+
+    //measure name lookups in a table holding many globals. Keys are copied into separate buffers so that lookup() has to find the canonical copy of each.
+    HashTable lookup_table = make_HashTable(&err);
+    char (*lookup_bufs)[BENCH_STR_SIZE] = (char(*)[BENCH_STR_SIZE])malloc(sizeof(char)*BENCH_STR_SIZE*BENCH_LOOKUP_KEYS);
+    const char* lookup_names[BENCH_LOOKUP_KEYS];
+    const char* lookup_inames[BENCH_LOOKUP_KEYS];
+    for (size_t i = 0; i < BENCH_LOOKUP_KEYS; ++i) {
+	snprintf(lookup_bufs[i], BENCH_STR_SIZE, "global_name_%lu", i);
+	insert(&lookup_table, lookup_bufs[i], v_make_int(i, &err), &err);
+	lookup_names[i] = lookup_bufs[i];
+	lookup_inames[i] = find_interned(lookup_bufs[i]);
+    }
+    double t_lookup = bench_lookup(&lookup_table, lookup_names, BENCH_LOOKUP_KEYS, 0);
+    double t_ilookup = bench_lookup(&lookup_table, lookup_inames, BENCH_LOOKUP_KEYS, 1);
+    printf("name lookup (%d keys): lookup() %.1f M/s, lookup_interned() %.1f M/s %s\n", BENCH_LOOKUP_KEYS, 1e-6*BENCH_LOOKUP_N/t_lookup, 1e-6*BENCH_LOOKUP_N/t_ilookup, (t_lookup < 0 || t_ilookup < 0)? "(WRONG RESULT)" : "");
+    free_HashTable(&lookup_table);
+    free(lookup_bufs);
+
+    //compare the cost of parsing long expressions
+    printf("parsing long expressions, best of %d runs\n", BENCH_REPS);
+    double t_old = 0;
+    for (size_t n = BENCH_PARSE_MIN; n <= BENCH_PARSE_MAX; n *= 10) {
+	double t_new = bench_parse(n, 0, &err);
+	//gen_optree is quadratic, so when the next size would take too long we report an extrapolated time instead
+	const char* note = "";
+	if (100*t_old < BENCH_PARSE_BUDGET) {
+	    t_old = bench_parse(n, 1, &err);
+	} else {
+	    t_old *= 100;
+	    note = " (extrapolated)";
+	}
+	printf("%6lu terms: gen_optree %10.3f ms%s  parse_optree %8.3f ms  (%.0fx)\n", n, 1e3*t_old, note, 1e3*t_new, t_old/t_new);
+	fflush(stdout);
+    }
+
+    //insert, lookup and remove throughput of the hash table as it grows
+    printf("hash table (load factor %.2f), ns per operation\n", GROW_THRESH);
+    printf("  %9s %8s %8s %8s %8s %8s\n", "keys", "insert", "lookup", "interned", "miss", "remove");
+    for (size_t n = BENCH_HASH_MIN; n <= BENCH_HASH_MAX; n *= 10) {
+	double t_hash[5];
+	int res_hash = bench_hashtable(n, t_hash, &err);
+	printf("  %9lu %8.1f %8.1f %8.1f %8.1f %8.1f%s\n", n, 1e9*t_hash[0]/n, 1e9*t_hash[1]/n, 1e9*t_hash[2]/n, 1e9*t_hash[3]/n, 1e9*t_hash[4]/n, (res_hash < 0)? " (WRONG RESULT)" : "");
+	fflush(stdout);
+    }
+
+    //recursion depth, the execution stack needs one frame per call
+    function depth_f = {0};
+    char depth_def[] = "(int n) => (int) {\nif n <= 0 {\nreturn 0\n}\nreturn depth(n - 1) + 1\n}";
+    if (bench_make_global(&con, "depth", &depth_f, depth_def, &err) < 0) {
+	printf("failed to compile benchmark: %s\n", err.msg);
+	return 1;
+    }
+    printf("recursion depth, ns per call\n");
+    printf("  %9s %8s %8s\n", "depth", "cold", "warm");
+    //the deepest row uses the most nesting that calls allow
+    size_t depths[] = {10, 100, 1000, 10000, 100000, MAX_CALL_DEPTH};
+    for (size_t k = 0; k < sizeof(depths)/sizeof(size_t); ++k) {
+	size_t n = depths[k];
+	double t_cold = bench_recursion(&con, &depth_f, n, 1, &err);
+	double t_warm = bench_recursion(&con, &depth_f, n, 0, &err);
+	printf("  %9lu %8.1f %8.1f%s\n", n, 1e9*t_cold/n, 1e9*t_warm/n, (t_cold < 0 || t_warm < 0)? " (WRONG RESULT)" : "");
+	fflush(stdout);
+    }
+    printf("  execution stack: %lu entries committed, %lu reserved\n", con.exec_stack.cap, con.exec_stack.max);
+
+    //call heavy scripts
+    function fib_f = {0};
+    function add_f = {0};
+    function add_loop_f = {0};
+    char fib_def[] = "(int n) => (int) {\nif n < 2 {\nreturn n\n}\nreturn fib(n - 1) + fib(n - 2)\n}";
+    char add_def[] = "(int a, int b) => (int) {\nreturn a + b\n}";
+    char add_loop_def[] = "(int n) => (int) {\nint i = 0\nint s = 0\nwhile i < n {\ns = add(s, i)\ni = i + 1\n}\nreturn s\n}";
+    if (bench_make_global(&con, "fib", &fib_f, fib_def, &err) < 0 || bench_make_global(&con, "add", &add_f, add_def, &err) < 0 || bench_make_global(&con, "add_loop", &add_loop_f, add_loop_def, &err) < 0) {
+	printf("failed to compile benchmark: %s\n", err.msg);
+	return 1;
+    }
+    double t_fib = 1e9;
+    double t_loop = 1e9;
+    long res_fib = 0;
+    long res_loop = 0;
+    for (size_t r = 0; r < BENCH_REPS; ++r) {
+	double t0 = bench_time();
+	res_fib = bench_vm_1(&con, &fib_f, BENCH_FIB_N, &err);
+	double t1 = bench_time();
+	res_loop = bench_vm_1(&con, &add_loop_f, BENCH_CALLS_N, &err);
+	double t2 = bench_time();
+	if (t1 - t0 < t_fib) { t_fib = t1 - t0; }
+	if (t2 - t1 < t_loop) { t_loop = t2 - t1; }
+    }
+    printf("call heavy scripts, best of %d runs\n", BENCH_REPS);
+    printf("  fib(%d)          %8.1f ms %6.1f ns/call %s\n", BENCH_FIB_N, 1e3*t_fib, 1e9*t_fib/BENCH_FIB_CALLS, (res_fib == BENCH_FIB_RES)? "" : "(WRONG RESULT)");
+    printf("  add() in a loop  %8.1f ms %6.1f ns/call %s\n", 1e3*t_loop, 1e9*t_loop/BENCH_CALLS_N, (res_loop == BENCH_CALLS_N*(BENCH_CALLS_N - 1)/2)? "" : "(WRONG RESULT)");
+
+    //the same calls made from C, once with values and once by name with argument strings
+    double t_native = 1e9;
+    double t_named = 1e9;
+    long res_native = 0;
+    long res_named = 0;
+    value add_args[2];
+    value add_res[1];
+    char arg_a[32];
+    char arg_b[32];
+    char* str_args[2] = {arg_a, arg_b};
+    for (size_t r = 0; r < BENCH_REPS; ++r) {
+	double t0 = bench_time();
+	add_args[0] = v_make_int(0, &err);
+	add_args[1] = v_make_int(0, &err);
+	for (long k = 0; k < BENCH_CALLS_N; ++k) {
+	    add_args[1].val.i = k;
+	    call_function(&con, &add_f, add_args, add_res, &err);
+	    add_args[0] = add_res[0];
+	}
+	res_native = add_args[0].val.i;
+	double t1 = bench_time();
+	res_named = 0;
+	for (long k = 0; k < BENCH_CALLS_N; ++k) {
+	    value* rets = NULL;
+	    snprintf(arg_a, sizeof(arg_a), "%ld", res_named);
+	    snprintf(arg_b, sizeof(arg_b), "%ld", k);
+	    if (call_func_by_name(&con, "add", 2, str_args, &rets, &err) == 1) { res_named = rets[0].val.i; }
+	    sc_free(rets);
+	}
+	double t2 = bench_time();
+	if (t1 - t0 < t_native) { t_native = t1 - t0; }
+	if (t2 - t1 < t_named) { t_named = t2 - t1; }
+    }
+    printf("  add() from C     %8.1f ms %6.1f ns/call %s\n", 1e3*t_native, 1e9*t_native/BENCH_CALLS_N, (res_native == BENCH_CALLS_N*(BENCH_CALLS_N - 1)/2)? "" : "(WRONG RESULT)");
+    printf("  add() by name    %8.1f ms %6.1f ns/call %s\n", 1e3*t_named, 1e9*t_named/BENCH_CALLS_N, (res_named == BENCH_CALLS_N*(BENCH_CALLS_N - 1)/2)? "" : "(WRONG RESULT)");
+
+    //tail recursion against the equivalent loop
+    function acc_f = {0};
+    function tail_f = {0};
+    function while_f = {0};
+    char acc_def[] = "(int n, int acc) => (int) {\nif n <= 0 {\nreturn acc\n}\nreturn acc_sum(n - 1, acc + n)\n}";
+    char tail_def[] = "(int n) => (int) {\nreturn acc_sum(n, 0)\n}";
+    char while_def[] = "(int n) => (int) {\nint acc = 0\nwhile n > 0 {\nacc = acc + n\nn = n - 1\n}\nreturn acc\n}";
+    if (bench_make_global(&con, "acc_sum", &acc_f, acc_def, &err) < 0 || bench_make_global(&con, "tail_sum", &tail_f, tail_def, &err) < 0 || bench_make_global(&con, "while_sum", &while_f, while_def, &err) < 0) {
+	printf("failed to compile benchmark: %s\n", err.msg);
+	return 1;
+    }
+    double t_tail = 1e9;
+    double t_while = 1e9;
+    long res_tail = 0;
+    long res_while = 0;
+    for (size_t r = 0; r < BENCH_REPS; ++r) {
+	double t0 = bench_time();
+	res_tail = bench_vm_1(&con, &tail_f, BENCH_CALLS_N, &err);
+	double t1 = bench_time();
+	res_while = bench_vm_1(&con, &while_f, BENCH_CALLS_N, &err);
+	double t2 = bench_time();
+	if (t1 - t0 < t_tail) { t_tail = t1 - t0; }
+	if (t2 - t1 < t_while) { t_while = t2 - t1; }
+    }
+    printf("  tail recursion   %8.1f ms %6.1f ns/call %s\n", 1e3*t_tail, 1e9*t_tail/BENCH_CALLS_N, (res_tail == BENCH_CALLS_N*(BENCH_CALLS_N + 1)/2)? "" : "(WRONG RESULT)");
+    printf("  while loop       %8.1f ms %6.1f ns/iter %s\n", 1e3*t_while, 1e9*t_while/BENCH_CALLS_N, (res_while == BENCH_CALLS_N*(BENCH_CALLS_N + 1)/2)? "" : "(WRONG RESULT)");
+
+    free_function(&while_f);
+    free_function(&tail_f);
+    free_function(&acc_f);
+    free_function(&add_loop_f);
+    free_function(&add_f);
+    free_function(&fib_f);
+    free_function(&depth_f);
+    free_function(&shuffle_f);
+    free_function(&f);
+    free_context(&con);
+    return 0;
+}
@@ -0,0 +1,633 @@
+#include "cache.h"
+#include "exec.h"
+
+#ifdef SC_CACHE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ==================================== BYTECODE CACHE ====================================
+
+sc_uint bc_hash(const char* src) {
+    sc_uint ret = BC_FNV_BIAS;
+    for (size_t i = 0; src[i] != 0; ++i) {
+	ret ^= (_uint8)(src[i]);
+	ret *= BC_FNV_PRIME;
+    }
+    return ret;
+}
+
+size_t _bc_alloc(bc_writer* w, size_t n, sc_error* err) {
+    size_t off = (w->size + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+    if (off + n > w->cap) {
+	size_t new_cap = (w->cap > 0)? 2*(w->cap) : BC_DEF_SIZE;
+	while (new_cap < off + n) { new_cap *= 2; }
+	char* tmp = (char*)sc_realloc(w->data, new_cap, err);
+	if (tmp == NULL) { return 0; }
+	w->data = tmp;
+	w->cap = new_cap;
+    }
+    //padding is zeroed too so that images of the same function are identical
+    memset(w->data + w->size, 0, off + n - w->size);
+    w->size = off + n;
+    return off;
+}
+
+void _bc_write_value(bc_writer* w, size_t dst, value v, sc_error* err) {
+    size_t rec = 0;
+    if (v.type == VT_STRING) {
+	String* str = v.val.str;
+	rec = _bc_alloc(w, sizeof(size_t) + str->size + 1, err);
+	if (err->type != E_SUCCESS) { return; }
+	*(size_t*)(w->data + rec) = str->size;
+	memcpy(w->data + rec + sizeof(size_t), str->buf, str->size);
+    } else if (v.type == VT_ARRAY) {
+	Array* arr = (Array*)(v.val.ptr);
+	rec = _bc_alloc(w, 2*sizeof(size_t) + sizeof(value)*(arr->size), err);
+	if (err->type != E_SUCCESS) { return; }
+	((size_t*)(w->data + rec))[0] = (size_t)(arr->element_type);
+	((size_t*)(w->data + rec))[1] = arr->size;
+	//elements are written after the array so nested records always follow their parent
+	for (size_t i = 0; i < arr->size; ++i) {
+	    _bc_write_value(w, rec + 2*sizeof(size_t) + i*sizeof(value), _get_a(arr, i), err);
+	    if (err->type != E_SUCCESS) { return; }
+	}
+    } else if (v.type != VT_CHAR && v.type != VT_BOOL && v.type != VT_INT && v.type != VT_FLOAT) {
+	sc_set_error(err, E_BADTYPE, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "constants of type %d can't be cached", v.type);
+	return;
+    }
+    value* d = (value*)(w->data + dst);
+    d->type = v.type;
+    d->val = v.val;
+    if (rec) { d->val.i = (sc_int)rec; }
+}
+
+void _bc_read_value(char* img, size_t size, value* v, sc_error* err) {
+    if (v->type == VT_CHAR || v->type == VT_BOOL || v->type == VT_INT || v->type == VT_FLOAT) { return; }
+    //_bc_write_value() never writes pointers such as functions or references, so any other type means the image was corrupted
+    if (v->type != VT_STRING && v->type != VT_ARRAY) {
+	sc_set_error(err, E_BADVAL, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "constant of type %d in bytecode image", v->type);
+	return;
+    }
+    size_t rec = (size_t)(v->val.i);
+    size_t n_hdr = (v->type == VT_STRING)? 1 : 2;
+    if (rec < sizeof(bc_header) || rec % sizeof(size_t) != 0 || rec > size - n_hdr*sizeof(size_t)) {
+	sc_set_error(err, E_BADVAL, "corrupted value in bytecode image");
+	return;
+    }
+    size_t* hdr = (size_t*)(img + rec);
+    if (v->type == VT_STRING) {
+	size_t n = hdr[0];
+	if (n >= size - rec - sizeof(size_t)) {
+	    sc_set_error(err, E_BADVAL, "corrupted string in bytecode image");
+	    return;
+	}
+	value tmp = v_make_string_n(n + 1, err);
+	if (err->type != E_SUCCESS) { return; }
+	memcpy(tmp.val.str->buf, img + rec + sizeof(size_t), n + 1);
+	tmp.val.str->size = n;
+	*v = tmp;
+	return;
+    }
+
+    Valtype_e t = (Valtype_e)(hdr[0]);
+    size_t n = hdr[1];
+    if (n > (size - rec - 2*sizeof(size_t))/sizeof(value)) {
+	sc_set_error(err, E_BADVAL, "corrupted array in bytecode image");
+	return;
+    }
+    value ret;
+    ret.type = VT_ARRAY;
+    ret.val.ptr = (t == VT_UNDEF)? _make_Array(sizeof(value), (n > 0)? n : 1, err) : (Array*)_make_PrimArray(t, (n > 0)? n : 1, err);
+    if (ret.val.ptr == NULL) { return; }
+    Array* arr = (Array*)(ret.val.ptr);
+    value* els = (value*)(hdr + 2);
+    for (size_t i = 0; i < n; ++i) {
+	value el = els[i];
+	//records always follow their parent which rules out cycles
+	if ((el.type == VT_STRING || el.type == VT_ARRAY) && (size_t)(el.val.i) <= rec) {
+	    sc_set_error(err, E_BADVAL, "corrupted array in bytecode image");
+	    break;
+	}
+	_bc_read_value(img, size, &el, err);
+	if (err->type != E_SUCCESS) { break; }
+	_set_a(arr, i, el, err);
+	arr->size = i + 1;
+	if (err->type != E_SUCCESS) { break; }
+    }
+    if (err->type != E_SUCCESS) {
+	free_value(&ret);
+	return;
+    }
+    *v = ret;
+}
+
+int _bc_global_params(size_t op) {
+    switch (_ins_base(op)) {
+    case INS_OP_EVAL:
+    case INS_FN_EVAL:
+    case INS_TAIL_CALL:
+    case INS_JUMP_CND:
+    case INS_PUSH:
+    case INS_POP:
+    case INS_GET_SIZE:
+    case INS_MAKE_PTR:
+    case INS_PTR_DRF: return ((op & INS_HH) == INS_HH_G)? 1 : 0;
+    case INS_MOV:
+    case INS_IND_READ:
+    case INS_IND_WRITE: return (((op & INS_HH) == INS_HH_G)? 1 : 0) | (((op & INS_HL) == INS_HL_G)? 2 : 0);
+    default: return 0;
+    }
+}
+
+size_t _bc_sym(size_t** syms, size_t* n_syms, size_t slot, sc_error* err) {
+    for (size_t k = 0; k < *n_syms; ++k) {
+	if ((*syms)[k] == slot) { return k; }
+    }
+    size_t* tmp = (size_t*)sc_realloc(*syms, sizeof(size_t)*(*n_syms + 1), err);
+    if (tmp == NULL) { return 0; }
+    *syms = tmp;
+    tmp[*n_syms] = slot;
+    return (*n_syms)++;
+}
+
+int save_function(context* c, const function* f, sc_uint src_hash, const char* fname, sc_error* err) {
+    sc_reset_error(err);
+    const instruction_buffer* buf = &(f->buf);
+    bc_writer w = {0};
+    size_t* syms = NULL;
+    size_t n_syms = 0;
+    expression** exprs = NULL;
+    size_t n_exprs = 0;
+
+    size_t types = 0;
+    size_t insts = 0;
+    _bc_alloc(&w, sizeof(bc_header), err);
+    if (err->type == E_SUCCESS) { types = _bc_alloc(&w, sizeof(size_t)*(f->n_args + f->n_rets), err); }
+    if (err->type == E_SUCCESS) { insts = _bc_alloc(&w, sizeof(union Instruction)*(buf->n_insts), err); }
+    if (err->type != E_SUCCESS) { sc_free(w.data);return -1; }
+    for (size_t k = 0; k < f->n_args; ++k) { ((size_t*)(w.data + types))[k] = (size_t)(f->argument_types[k]); }
+    for (size_t k = 0; k < f->n_rets; ++k) { ((size_t*)(w.data + types))[f->n_args + k] = (size_t)(f->return_types[k]); }
+
+    //copy the instructions, replacing slots and pointers by indices into the symbol and expression tables
+    size_t i = 0;
+    while (i < buf->n_insts && err->type == E_SUCCESS) {
+	size_t op = _ins_opcode(buf, i);
+	size_t n = _ins_size(op);
+	union Instruction* out = (union Instruction*)(w.data + insts) + i;
+	out[0].i = op;
+	for (size_t k = 1; k < n; ++k) { out[k] = buf->buf[i+k]; }
+	if (op == (INS_OP_EVAL | INS_HH_C)) {
+	    expression** tmp = (expression**)sc_realloc(exprs, sizeof(expression*)*(n_exprs + 1), err);
+	    if (tmp == NULL) { break; }
+	    exprs = tmp;
+	    exprs[n_exprs] = (expression*)(buf->buf[i+1].ptr);
+	    out[1].i = n_exprs++;
+	} else if (op == (INS_FN_EVAL | INS_HH_C) || op == (INS_TAIL_CALL | INS_HH_C)) {
+	    sc_set_error(err, E_BADVAL, "calls to functions referenced by pointer can't be cached");
+	    break;
+	}
+	int g = _bc_global_params(op);
+	for (size_t k = 0; k < 2; ++k) {
+	    if (g & (1 << k)) { out[1+k].i = _bc_sym(&syms, &n_syms, buf->buf[i+1+k].i, err); }
+	}
+	i += n;
+    }
+
+    //globals are saved by name
+    size_t syms_off = 0;
+    if (err->type == E_SUCCESS) { syms_off = _bc_alloc(&w, sizeof(size_t)*n_syms, err); }
+    for (size_t k = 0; k < n_syms && err->type == E_SUCCESS; ++k) {
+	if (syms[k] >= c->global.n_slots || c->global.slots[syms[k]] == NULL) {
+	    sc_set_error(err, E_UNDEF, "");
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "undefined global slot %lu", syms[k]);
+	    break;
+	}
+	const char* name = c->global.slots[syms[k]]->key;
+	size_t len = strlen(name);
+	size_t name_off = _bc_alloc(&w, len + 1, err);
+	if (err->type != E_SUCCESS) { break; }
+	memcpy(w.data + name_off, name, len);
+	((size_t*)(w.data + syms_off))[k] = name_off;
+    }
+
+    //expressions are saved as structs with offsets in place of their pointers
+    size_t exprs_off = 0;
+    if (err->type == E_SUCCESS) { exprs_off = _bc_alloc(&w, sizeof(expression)*n_exprs, err); }
+    for (size_t k = 0; k < n_exprs && err->type == E_SUCCESS; ++k) {
+	expression* e = exprs[k];
+	size_t prog = _bc_alloc(&w, sizeof(union Instruction)*(e->buf.n_insts), err);
+	if (err->type != E_SUCCESS) { break; }
+	union Instruction* out = (union Instruction*)(w.data + prog);
+	//operators are saved without the flags set by quickening so that the image doesn't depend on what was executed
+	for (size_t j = 0; j < e->buf.n_insts; ++j) {
+	    out[j].i = e->buf.buf[j].i & ~EXP_Q;
+	    if ((out[j].i & EXP_BASE) == EXP_PUSH_C || (out[j].i & EXP_BASE) == EXP_PUSH_S) {
+		++j;
+		out[j] = e->buf.buf[j];
+	    }
+	}
+	size_t consts = (e->n_consts > 0)? _bc_alloc(&w, sizeof(value)*(e->n_consts), err) : 0;
+	for (size_t j = 0; j < e->n_consts && err->type == E_SUCCESS; ++j) {
+	    _bc_write_value(&w, consts + j*sizeof(value), e->consts[j], err);
+	}
+	if (err->type != E_SUCCESS) { break; }
+	expression* d = (expression*)(w.data + exprs_off) + k;
+	d->buf.cap = e->buf.n_insts;
+	d->buf.n_insts = e->buf.n_insts;
+	d->buf.buf = (union Instruction*)prog;
+	d->n_consts = e->n_consts;
+	d->consts = (value*)consts;
+	d->depth = e->depth;
+    }
+
+    size_t consts_off = 0;
+    if (err->type == E_SUCCESS) { consts_off = _bc_alloc(&w, sizeof(value)*(f->n_consts), err); }
+    for (size_t k = 0; k < f->n_consts && err->type == E_SUCCESS; ++k) {
+	_bc_write_value(&w, consts_off + k*sizeof(value), f->consts[k], err);
+    }
+    sc_free(syms);
+    sc_free(exprs);
+    if (err->type != E_SUCCESS) { sc_free(w.data);return -1; }
+
+    bc_header* hdr = (bc_header*)(w.data);
+    hdr->magic = BC_MAGIC;
+    hdr->version = BC_VERSION;
+    hdr->word_size = sizeof(size_t);
+    hdr->endian = BC_ENDIAN;
+    hdr->src_hash = src_hash;
+    hdr->size = w.size;
+    hdr->n_args = f->n_args;
+    hdr->n_rets = f->n_rets;
+    hdr->types = types;
+    hdr->n_insts = buf->n_insts;
+    hdr->insts = insts;
+    hdr->n_syms = n_syms;
+    hdr->syms = syms_off;
+    hdr->n_exprs = n_exprs;
+    hdr->exprs = exprs_off;
+    hdr->n_consts = f->n_consts;
+    hdr->consts = consts_off;
+
+    //write to a temporary file first so that the image appears all at once
+    size_t path_len = strlen(fname) + sizeof(BC_TMP_EXT);
+    char* tmp_name = (char*)sc_malloc(path_len, err);
+    if (tmp_name == NULL) { sc_free(w.data);return -1; }
+    snprintf(tmp_name, path_len, "%s%s", fname, BC_TMP_EXT);
+#ifdef SC_CACHE_MMAP
+    //the temporary file gets a unique name in the same directory so that concurrent writers never share it and the rename can't cross file systems
+    int fd = mkstemp(tmp_name);
+    int made = (fd >= 0);
+    FILE* fp = (made)? fdopen(fd, "wb") : NULL;
+    if (made && fp == NULL) { close(fd); }
+#else
+    FILE* fp = fopen(tmp_name, "wb");
+    int made = (fp != NULL);
+#endif
+    int ret = -1;
+    if (fp) {
+	size_t written = fwrite(w.data, 1, w.size, fp);
+	if (fclose(fp) == 0 && written == w.size && rename(tmp_name, fname) == 0) { ret = 0; }
+    }
+    if (ret < 0) {
+	if (made) { remove(tmp_name); }
+	sc_set_error(err, E_BADVAL, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "couldn't write bytecode image %s", fname);
+    }
+    sc_free(tmp_name);
+    sc_free(w.data);
+    return ret;
+}
+
+char* _bc_map(const char* fname, size_t* size, sc_error* err) {
+    char* img = NULL;
+#ifdef SC_CACHE_MMAP
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+	sc_set_error(err, E_UNDEF, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "couldn't open bytecode image %s", fname);
+	return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)(st.st_size) >= sizeof(bc_header)) {
+	*size = (size_t)(st.st_size);
+	if (*size >= BC_MAP_MIN) {
+	    //the mapping is private so that relocations and quickening never reach the file
+	    void* tmp = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	    if (tmp != MAP_FAILED) { img = (char*)tmp; }
+	} else {
+	    img = (char*)sc_malloc(*size, err);
+	    if (img && read(fd, img, *size) != (ssize_t)(*size)) {
+		sc_free(img);
+		img = NULL;
+	    }
+	}
+    }
+    close(fd);
+#else
+    FILE* fp = fopen(fname, "rb");
+    if (fp == NULL) {
+	sc_set_error(err, E_UNDEF, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "couldn't open bytecode image %s", fname);
+	return NULL;
+    }
+    long len = (fseek(fp, 0, SEEK_END) == 0)? ftell(fp) : -1;
+    if (len >= (long)sizeof(bc_header) && fseek(fp, 0, SEEK_SET) == 0) {
+	*size = (size_t)len;
+	img = (char*)sc_malloc(*size, err);
+	if (img && fread(img, 1, *size, fp) != *size) {
+	    sc_free(img);
+	    img = NULL;
+	}
+    }
+    fclose(fp);
+#endif
+    if (img == NULL) {
+	sc_set_error(err, E_BADVAL, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "couldn't read bytecode image %s", fname);
+    }
+    return img;
+}
+
+void _bc_unmap(char* img, size_t size) {
+#ifdef SC_CACHE_MMAP
+    if (size >= BC_MAP_MIN) {
+	munmap(img, size);
+	return;
+    }
+#endif
+    sc_free(img);
+}
+
+void _bc_release_fin(void* img) {
+    _bc_unmap((char*)img, ((bc_header*)img)->size);
+}
+
+/**
+ * Helper function which returns 1 if n elements of size el starting at the offset off lie within an image of size bytes.
+ */
+static inline int _bc_in(size_t size, size_t off, size_t n, size_t el) {
+    return off >= sizeof(bc_header) && off % sizeof(size_t) == 0 && off <= size && n <= (size - off)/el;
+}
+
+/**
+ * Helper function which returns 1 if op is an instruction that may appear in an image. This matches the handlers in the dispatch table of _ex_func() except that calls through pointers in the constant bank and expressions read from any bank other than the expression table are rejected since make_function() and save_function() never write them.
+ */
+static int _bc_valid_op(size_t op) {
+    size_t base = _ins_base(op);
+    switch (base) {
+    case INS_NOP:
+    case INS_JUMP:
+    case INS_MAKE_ARR:
+    case INS_MAKE_STR:
+    case INS_MAKE_VAL:
+    case INS_RETURN: return op == base;
+    case INS_FN_EVAL:
+    case INS_TAIL_CALL: return (op & ~INS_HH) == base && (op & INS_HH) != INS_HH_C;
+    //the compiler only evaluates expressions from the expression table. The other banks would let any value be used as an expression
+    case INS_OP_EVAL: return op == (INS_OP_EVAL | INS_HH_C);
+    case INS_JUMP_CND:
+    case INS_PUSH:
+    case INS_POP:
+    case INS_GET_SIZE:
+    case INS_MAKE_PTR:
+    case INS_PTR_DRF: return (op & ~INS_HH) == base;
+    case INS_MOV:
+    case INS_IND_READ:
+    case INS_IND_WRITE: return (op & ~(INS_HH | INS_HL)) == base;
+    default: return 0;
+    }
+}
+
+/**
+ * Helper function which returns 1 if the parameter arg of the instruction op may be dereferenced. k is 0 for the first parameter (read from the INS_HH bank) and 1 for the second (read from the INS_HL bank). Global parameters are checked separately since they index the symbol table.
+ * Registers and constants are checked exactly. Stack slots are relative to the frame, which is only known at run time, so they are checked against the largest possible execution stack.
+ */
+static int _bc_valid_param(size_t op, size_t k, size_t arg, const bc_header* hdr) {
+    size_t base = _ins_base(op);
+    size_t bank = (k == 0)? (op & INS_HH) >> 2 : op & INS_HL;
+    //these parameters aren't read from a bank
+    if (base == INS_JUMP || base == INS_MAKE_VAL || (base == INS_JUMP_CND && k == 1)) { return 1; }
+    switch (bank) {
+    case INS_HL_R: return arg < N_REGISTERS;
+    case INS_HL_S: return arg < ST_MAX_SIZE;
+    case INS_HL_G: return 1;
+    default:
+	//expressions are indexed by the expression table, discards count values and array indices are stored directly in the instruction
+	if (base == INS_OP_EVAL) { return arg < hdr->n_exprs; }
+	if (base == INS_POP || base == INS_MAKE_PTR || ((base == INS_IND_READ || base == INS_IND_WRITE) && k == 1)) { return 1; }
+	return arg < hdr->n_consts;
+    }
+}
+
+/**
+ * Helper function which returns 1 if the relocated expression e may be passed to eval_expression(). Every operator must be known, every constant must be in the constant table of e and the evaluation stack must never underflow or grow deeper than e->depth. Stack slots are checked in the same way as by _bc_valid_param().
+ */
+static int _bc_valid_expression(const expression* e) {
+    size_t h = 0;
+    size_t max_h = 0;
+    size_t j = 0;
+    while (j < e->buf.n_insts) {
+	//operators are saved without quickening flags
+	size_t op = e->buf.buf[j].i;
+	if (op == EXP_PUSH_C || op == EXP_PUSH_S) {
+	    if (j + 1 >= e->buf.n_insts) { return 0; }
+	    size_t arg = e->buf.buf[j+1].i;
+	    if ((op == EXP_PUSH_C && arg >= e->n_consts) || (op == EXP_PUSH_S && arg >= ST_MAX_SIZE)) { return 0; }
+	    if (++h > max_h) { max_h = h; }
+	    j += 2;
+	} else if (op <= EXP_NOT) {
+	    if (h < 2) { return 0; }
+	    --h;
+	    ++j;
+	} else {
+	    return 0;
+	}
+    }
+    return h == 1 && max_h <= e->depth;
+}
+
+function load_function(context* c, const char* fname, sc_uint src_hash, sc_error* err) {
+    sc_reset_error(err);
+    function ret = {0};
+    size_t size = 0;
+    char* img = _bc_map(fname, &size, err);
+    if (img == NULL) { return ret; }
+
+    //check that the image was written for this source on a compatible platform and that every section lies inside of it
+    bc_header* hdr = (bc_header*)img;
+    if (hdr->magic != BC_MAGIC || hdr->version != BC_VERSION || hdr->word_size != sizeof(size_t) || hdr->endian != BC_ENDIAN || hdr->size != size) {
+	sc_set_error(err, E_BADVAL, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "%s is not a compatible bytecode image", fname);
+    } else if (hdr->src_hash != src_hash) {
+	sc_set_error(err, E_BADVAL, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "%s was compiled from a different source", fname);
+    } else if (!_bc_in(size, hdr->types, hdr->n_args + hdr->n_rets, sizeof(size_t)) || !_bc_in(size, hdr->insts, hdr->n_insts, sizeof(union Instruction)) || !_bc_in(size, hdr->syms, hdr->n_syms, sizeof(size_t)) || !_bc_in(size, hdr->exprs, hdr->n_exprs, sizeof(expression)) || !_bc_in(size, hdr->consts, hdr->n_consts, sizeof(value))) {
+	sc_set_error(err, E_BADVAL, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "%s is corrupted", fname);
+    }
+    if (err->type != E_SUCCESS) {
+	_bc_unmap(img, size);
+	return ret;
+    }
+    //the image is released along with the arena of the function. This is registered first so that it runs after the finalizers of values in the image
+    arena_defer(&(ret.buf.mem), _bc_release_fin, img, err);
+    if (err->type != E_SUCCESS) {
+	_bc_unmap(img, size);
+	return ret;
+    }
+
+    //replace the name of each global by its slot
+    size_t* syms = (size_t*)(img + hdr->syms);
+    for (size_t k = 0; k < hdr->n_syms && err->type == E_SUCCESS; ++k) {
+	if (syms[k] < sizeof(bc_header) || syms[k] >= size || memchr(img + syms[k], 0, size - syms[k]) == NULL) {
+	    sc_set_error(err, E_BADVAL, "");
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "%s is corrupted", fname);
+	    break;
+	}
+	HashedItem* item = lookup(&(c->global), img + syms[k]);
+	if (item == NULL) {
+	    sc_set_error(err, E_UNDEF, "");
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "cached function references undefined global %s", img + syms[k]);
+	    break;
+	}
+	syms[k] = h_intern_slot(&(c->global), item, err);
+    }
+
+    //expressions are executed directly from the image
+    expression* exprs = (expression*)(img + hdr->exprs);
+    for (size_t k = 0; k < hdr->n_exprs && err->type == E_SUCCESS; ++k) {
+	expression* e = exprs + k;
+	size_t prog = (size_t)(e->buf.buf);
+	size_t consts = (size_t)(e->consts);
+	if (!_bc_in(size, prog, e->buf.n_insts, sizeof(union Instruction)) || (e->n_consts > 0 && !_bc_in(size, consts, e->n_consts, sizeof(value)))) {
+	    sc_set_error(err, E_BADVAL, "");
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "%s is corrupted", fname);
+	    break;
+	}
+	e->buf.buf = (union Instruction*)(img + prog);
+	e->buf.cap = e->buf.n_insts;
+	e->buf.opcodes = NULL;
+	memset(&(e->buf.mem), 0, sizeof(arena));
+	e->buf.n_consts = 0;
+	e->buf.consts_cap = 0;
+	e->buf.consts = NULL;
+	e->consts = (e->n_consts > 0)? (value*)(img + consts) : NULL;
+	if (!_bc_valid_expression(e)) {
+	    sc_set_error(err, E_BADVAL, "");
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "%s is corrupted at expression %lu", fname, k);
+	    break;
+	}
+	for (size_t j = 0; j < e->n_consts && err->type == E_SUCCESS; ++j) {
+	    _bc_read_value(img, size, e->consts + j, err);
+	    if (err->type == E_SUCCESS) { _arena_own_value(&(ret.buf.mem), e->consts + j, err); }
+	}
+    }
+
+    //instructions are copied since the buffer is owned by the function and may be extended by _ex_thread()
+    size_t n_insts = hdr->n_insts;
+    if (err->type == E_SUCCESS) {
+	ret.buf.buf = (union Instruction*)sc_malloc(sizeof(union Instruction)*((n_insts > 0)? n_insts : 1), err);
+    }
+    if (err->type == E_SUCCESS) {
+	union Instruction* ins = ret.buf.buf;
+	memcpy(ins, img + hdr->insts, sizeof(union Instruction)*n_insts);
+	ret.buf.cap = (n_insts > 0)? n_insts : 1;
+	ret.buf.n_insts = n_insts;
+	//jumps must land on the start of an instruction (or the end of the buffer, see _ex_thread()) so the instructions are walked once to find where each one starts
+	char* starts = (char*)sc_malloc(n_insts + 1, err);
+	if (err->type == E_SUCCESS) { memset(starts, 0, n_insts + 1); }
+	size_t i = 0;
+	while (i < n_insts && err->type == E_SUCCESS) {
+	    starts[i] = 1;
+	    i += (_bc_valid_op(ins[i].i))? _ins_size(ins[i].i) : 1;
+	}
+	if (err->type == E_SUCCESS) { starts[n_insts] = 1; }
+	i = 0;
+	while (i < n_insts && err->type == E_SUCCESS) {
+	    size_t op = ins[i].i;
+	    int bad = !_bc_valid_op(op);
+	    size_t n = (bad)? 1 : _ins_size(op);
+	    int g = (bad)? 0 : _bc_global_params(op);
+	    if (!bad) { bad = (i + n > n_insts); }
+	    for (size_t k = 0; k + 1 < n && !bad; ++k) {
+		if (g & (1 << k)) {
+		    bad = (ins[i+1+k].i >= hdr->n_syms);
+		    if (!bad) { ins[i+1+k].i = syms[ins[i+1+k].i]; }
+		} else {
+		    bad = !_bc_valid_param(op, k, ins[i+1+k].i, hdr);
+		}
+	    }
+	    if (!bad && op == (INS_OP_EVAL | INS_HH_C)) { ins[i+1].ptr = exprs + ins[i+1].i; }
+	    if (!bad && _ins_base(op) == INS_JUMP) { bad = (ins[i+1].i > n_insts || !starts[ins[i+1].i]); }
+	    if (!bad && _ins_base(op) == INS_JUMP_CND) { bad = (ins[i+2].i > n_insts || !starts[ins[i+2].i]); }
+	    if (bad) {
+		sc_set_error(err, E_BADVAL, "");
+		snprintf(err->msg, DTG_MAX_MSG_SIZE, "%s is corrupted at instruction %lu", fname, i);
+		break;
+	    }
+	    i += n;
+	}
+	sc_free(starts);
+    }
+
+    //the signature and constant pool are owned by the function
+    size_t* types = (size_t*)(img + hdr->types);
+    if (err->type == E_SUCCESS) { ret.argument_types = (Valtype_e*)sc_malloc(sizeof(Valtype_e)*(hdr->n_args), err); }
+    if (err->type == E_SUCCESS) { ret.return_types = (Valtype_e*)sc_malloc(sizeof(Valtype_e)*(hdr->n_rets), err); }
+    if (err->type == E_SUCCESS) { ret.consts = (value*)sc_malloc(sizeof(value)*((hdr->n_consts > 0)? hdr->n_consts : 1), err); }
+    if (err->type == E_SUCCESS) {
+	ret.n_args = hdr->n_args;
+	ret.n_rets = hdr->n_rets;
+	for (size_t k = 0; k < ret.n_args; ++k) { ret.argument_types[k] = (Valtype_e)(types[k]); }
+	for (size_t k = 0; k < ret.n_rets; ++k) { ret.return_types[k] = (Valtype_e)(types[ret.n_args + k]); }
+	value* consts = (value*)(img + hdr->consts);
+	for (size_t k = 0; k < hdr->n_consts; ++k) {
+	    value v = consts[k];
+	    _bc_read_value(img, size, &v, err);
+	    if (err->type != E_SUCCESS) { break; }
+	    ret.consts[k] = v;
+	    ret.n_consts = k + 1;
+	}
+    }
+
+    if (err->type != E_SUCCESS) {
+	free_function(&ret);
+	memset(&ret, 0, sizeof(function));
+    }
+    return ret;
+}
+
+function make_function_cached(context* c, char* str, const char* cache_dir, sc_error* err) {
+    function ret = {0};
+    sc_uint h = bc_hash(str);
+    //images are named by the hash of their source
+    size_t path_len = strlen(cache_dir) + 2*sizeof(sc_uint) + sizeof(BC_EXT) + 1;
+    char* fname = (char*)sc_malloc(path_len, err);
+    if (fname == NULL) { return ret; }
+    snprintf(fname, path_len, "%s/%016llx%s", cache_dir, (unsigned long long)h, BC_EXT);
+
+    ret = load_function(c, fname, h, err);
+    if (err->type != E_SUCCESS) {
+	sc_reset_error(err);
+	ret = make_function(c, str, err);
+	if (err->type == E_SUCCESS) {
+	    sc_error tmp_err;
+	    save_function(c, &ret, h, fname, &tmp_err);
+	}
+    }
+    sc_free(fname);
+    return ret;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,148 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "operations.h"
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(SC_NO_MMAP)
+#define SC_CACHE_MMAP
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BC_MAGIC	0x43426373u//"scBC" when read as little endian bytes
+#define BC_VERSION	1//increment whenever the layout of images or the meaning of any instruction changes
+#define BC_ENDIAN	0x01020304u//written in native byte order so that images from machines with a different byte order are rejected
+#define BC_EXT		".scbc"
+#define BC_TMP_EXT	".XXXXXX"//images are written to a file with this suffix appended to the name and then renamed. On POSIX systems the suffix is replaced by mkstemp() so that every writer has its own file
+#define BC_DEF_SIZE	4096//the initial capacity of a bc_writer in bytes
+#ifndef BC_MAP_MIN
+#define BC_MAP_MIN	(1ul << 16)//smaller images are read onto the heap since setting up and tearing down a mapping costs more than copying them
+#endif
+//64 bit FNV-1a parameters used by bc_hash()
+#define BC_FNV_BIAS	0xcbf29ce484222325ull
+#define BC_FNV_PRIME	0x100000001b3ull
+
+// ==================================== BYTECODE CACHE ====================================
+
+/**
+ * Compiled functions may be saved as images which are loaded without parsing the source again. An image is a single block which starts with this header and is followed by the sections it describes. Every offset is measured in bytes from the start of the header and every section is aligned to sizeof(size_t).
+ * Images hold native structs, so they are only valid on the same platform that wrote them (word_size and endian are checked). Pointers inside of images are stored as offsets (or indices) and are relocated when the image is loaded:
+ *  - global parameters of instructions hold an index into the symbol table, which is a list of offsets to the names of the globals. The loader replaces each offset by the slot of the global in the loading context.
+ *  - INS_OP_EVAL parameters in the constant bank hold an index into the expression table, which is a list of expression structs whose buf.buf and consts fields are offsets.
+ *  - string and array values (in the constant pool of the function or of an expression) hold the offset of a record in val.i. Strings are stored as their length followed by their characters and a null terminator. Arrays are stored as their element type and size followed by their elements as values.
+ * magic: BC_MAGIC
+ * version: the BC_VERSION used to write the image
+ * word_size: sizeof(size_t)
+ * endian: BC_ENDIAN
+ * src_hash: the bc_hash() of the source the function was compiled from. Images are only loaded if this matches
+ * size: the total size of the image in bytes
+ * types: n_args argument types followed by n_rets return types, each stored in a size_t
+ * insts: n_insts instructions, opcodes are never threaded
+ * syms: n_syms offsets of null terminated names
+ * exprs: n_exprs expression structs
+ * consts: n_consts values forming the constant pool of the function
+ */
+typedef struct s_bc_header {
+    _uint32 magic;
+    _uint32 version;
+    _uint32 word_size;
+    _uint32 endian;
+    sc_uint src_hash;
+    size_t size;
+    size_t n_args;
+    size_t n_rets;
+    size_t types;
+    size_t n_insts;
+    size_t insts;
+    size_t n_syms;
+    size_t syms;
+    size_t n_exprs;
+    size_t exprs;
+    size_t n_consts;
+    size_t consts;
+} bc_header;
+
+/**
+ * A growable buffer used to lay out an image before it is written.
+ * data: the image
+ * size: the number of bytes which have been used
+ * cap: the number of bytes which may be used before data is reallocated
+ */
+typedef struct s_bc_writer {
+    char* data;
+    size_t size;
+    size_t cap;
+} bc_writer;
+
+/**
+ * Returns the 64 bit FNV-1a hash of the source string src. Cached images are keyed on this hash.
+ */
+sc_uint bc_hash(const char* src);
+
+/**
+ * Helper function which appends n zero initialized bytes to w. The new bytes are aligned to sizeof(size_t).
+ * Returns: the offset of the new bytes, which remains valid if w is reallocated, or 0 on error
+ */
+size_t _bc_alloc(bc_writer* w, size_t n, sc_error* err);
+
+/**
+ * Helper function which stores the value v at the offset dst of w. Strings and arrays are appended to w as records and dst stores their offsets.
+ */
+void _bc_write_value(bc_writer* w, size_t dst, value v, sc_error* err);
+
+/**
+ * Helper function which replaces the value v read from the image img with size bytes by a live value. Strings and arrays are copied out of the image onto the heap. Only the types written by _bc_write_value() are accepted, anything else sets E_BADVAL.
+ */
+void _bc_read_value(char* img, size_t size, value* v, sc_error* err);
+
+/**
+ * Helper function which returns the parameters of the instruction with opcode op that hold global slots. Bit 0 is set if the first parameter is a slot and bit 1 is set if the second parameter is a slot.
+ */
+int _bc_global_params(size_t op);
+
+/**
+ * Helper function which returns the index of slot in the list of n_syms slots syms. The slot is appended if it isn't found.
+ */
+size_t _bc_sym(size_t** syms, size_t* n_syms, size_t slot, sc_error* err);
+
+/**
+ * Helper function which maps the file fname into memory and saves its size to size. If mapping isn't supported or the file is smaller than BC_MAP_MIN bytes then it is read into a buffer on the heap instead.
+ * Returns: the image or NULL on error
+ */
+char* _bc_map(const char* fname, size_t* size, sc_error* err);
+
+/**
+ * Helper function which releases an image of size bytes returned by _bc_map().
+ */
+void _bc_unmap(char* img, size_t size);
+
+/**
+ * Helper function with the signature expected by arena_defer() which releases the image img. The size is read from the header.
+ */
+void _bc_release_fin(void* img);
+
+/**
+ * Write the compiled function f to the file fname as an image which is keyed on src_hash (see bc_hash()). Globals referenced by f are saved by name so that f may be loaded into a different context. The image is written to a uniquely named temporary file and then renamed so that concurrent readers never see a partial image and concurrent writers never interleave.
+ * Returns: 0 on success or -1 on error
+ */
+int save_function(context* c, const function* f, sc_uint src_hash, const char* fname, sc_error* err);
+
+/**
+ * Load a function saved with save_function() from the file fname. The image is mapped into memory where possible and relocated in place, expressions are used directly from the mapping which is released along with the function by free_function(). Every global referenced by the function must already be defined in c.
+ * If the file is missing, was written by a different version or platform or doesn't match src_hash then an error is set and the returned function should not be used. The same is true if the image is corrupted: every opcode must be known, every jump must land on an instruction and every register, constant, expression and global referenced by the function or its expressions must exist. Stack slots can only be checked against ST_MAX_SIZE since frames are laid out at run time.
+ */
+function load_function(context* c, const char* fname, sc_uint src_hash, sc_error* err);
+
+/**
+ * Identical to make_function() except that the compiled function is cached in the directory cache_dir under the hash of str. If an image for str is found then it is loaded instead of compiling str, otherwise str is compiled and the image is written for the next call. Failing to write the image is not an error.
+ * NOTE: str is modified in place, just as with make_function()
+ */
+function make_function_cached(context* c, char* str, const char* cache_dir, sc_error* err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -7,12 +7,13 @@ extern "C" {
 /**
   * Creates a new error of the type p_err with an error message p_msg and stores the result in p_errloc.
   * NOTE: At most DTG_MAX_MSG_SIZE bytes will be copied from p_msg. The string is guaranteed to be null terminated.
-  * NOTE: p_msg is copied upon creation.
+  * NOTE: p_msg is copied upon creation. If p_type is E_SUCCESS then p_msg is ignored and nothing is copied.
   */
 void sc_set_error(sc_error* p_errloc, err_type_e p_type, const char* p_msg) {
     //only proceed if a valid error location was supplied
     if (p_errloc != NULL) {
 	p_errloc->type = p_type;
+	if (p_type == E_SUCCESS) { return; }
 
 	//copy the error message and always set the last char to the null terminator
 	for (_uint i = 0; i < DTG_MAX_MSG_SIZE-1; ++i) {
@@ -23,16 +24,6 @@ void sc_set_error(sc_error* p_errloc, err_type_e p_type, const char* p_msg) {
     }
 }
 
-/**
-  * Resets the error to an empty message and type=E_SUCCESS
-  */
-void sc_reset_error(sc_error* p_errloc) {
-    if (p_errloc) {
-	p_errloc->type = E_SUCCESS;
-	p_errloc->msg[0] = 0;
-    }
-}
-
 
 /**
  * Tries copying at most n bytes of the string src into the destination dest. A null termination character is always written if dest has at least one character and a E_RANGE error may be thrown if n was not large enough to store src
@@ -55,6 +46,10 @@ inline size_t sc_strncpy(char* dest, const char* src, size_t n, sc_error* err) {
     return i;
 }
 
+#ifdef SC_COUNT_ALLOCS
+size_t sc_n_allocs = 0;
+#endif
+
 /**
  * Frees the memory pointed to by loc. NOTE: it is safe to call sc_free(NULL).
  */
@@ -67,11 +62,14 @@ inline void sc_free(void* loc) {
  */
 inline void* sc_malloc(size_t buf_size, sc_error* err) {
     void* ret = malloc(buf_size);
+#ifdef SC_COUNT_ALLOCS
+    ++sc_n_allocs;
+#endif
 
     if (err) {
 	if (!ret) {
 	    err->type = E_NOMEM;
-	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "couldn't allocate %d bytes", buf_size);
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "couldn't allocate %zu bytes", buf_size);
 	} else {
 	    err->type = E_SUCCESS;
 	}
@@ -84,11 +82,14 @@ inline void* sc_malloc(size_t buf_size, sc_error* err) {
  */
 void* sc_realloc(void* ptr, size_t buf_size, sc_error* err) {
     void* ret = realloc(ptr, buf_size);
+#ifdef SC_COUNT_ALLOCS
+    ++sc_n_allocs;
+#endif
 
     if (err) {
 	if (!ret) {
 	    err->type = E_NOMEM;
-	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "couldn't allocate %d bytes", buf_size);
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "couldn't allocate %zu bytes", buf_size);
 	} else {
 	    err->type = E_SUCCESS;
 	}
@@ -99,8 +100,9 @@ void* sc_realloc(void* ptr, size_t buf_size, sc_error* err) {
 /**
  * Tries reading the string str as an integer or sets err on failure
  */
-inline int sc_atoi(const char* str, sc_error* err) {
-    long tmp = strtol(str , NULL, 0 );
+inline sc_int sc_atoi(const char* str, sc_error* err) {
+    errno = 0;
+    sc_int tmp = strtoll(str , NULL, 0 );
     if (err) {
 	if (errno == EINVAL) {
 	    err->type = E_SYNTAX;
@@ -135,34 +137,34 @@ inline double sc_atof(const char* str, sc_error* err) {
 }
 
 /**
- * Returns the number of digits needed to represent the integer a in base b
- * NOTE: this is not guaranteed to be an exact figure, but it is guaranteed to be greater than or equal to the number of bytes written by DTG_itof.
+ * Returns the number of characters needed to represent the integer a in base b, including the minus sign for negative numbers. This is exactly the number of bytes written by sc_itoa().
  */
-inline size_t get_int_digits(int a, int b) {
+inline size_t get_int_digits(sc_int a, int b) {
     if (b <= 0) { b = 10; }
-    int tmp_i = a;
-    if (tmp_i >= 0) {
-	return (size_t)floor( log((double)tmp_i)/log(b) ) + 1;
+    //count in unsigned arithmetic so that the most negative value is handled correctly
+    sc_uint tmp = (a < 0)? (sc_uint)0 - (sc_uint)a : (sc_uint)a;
+    size_t ret = (a < 0)? 2 : 1;
+    while (tmp >= (sc_uint)b) {
+	tmp /= b;
+	++ret;
     }
-    return (size_t)floor( log((double)tmp_i)/log(b) ) + 2;
+    return ret;
 }
 
 /**
  * Returns the number of digits needed to represent the floating point number a using n digits of precision. (Only base 10 is supported at present).
- * NOTE: this is not guaranteed to be an exact figure, but it is guaranteed to be greater than or equal to the number of bytes written by DTG_itof.
+ * NOTE: this is not guaranteed to be an exact figure, but it is guaranteed to be greater than or equal to the number of bytes written by sc_ftoa().
  */
 inline size_t get_float_digits(double a, int n) {
-    size_t ret = 0;
-
-    if (a >= 0) {
-	ret = (size_t)floor( log10((double)a) ) + n + 1;
-    } else {
-	ret = (size_t)floor( log10((double)a) ) + n + 2;
-    }
-    if (a > HI_SCIENTIFIC_THRESHOLD) {
-	ret = DEF_FLOAT_PRECISION;
+    double tmp = fabs(a);
+    //the sign, the first digit and the decimal point
+    size_t ret = (a < 0)? 3 : 2;
+    if (!isfinite(tmp) || tmp >= HI_SCIENTIFIC_THRESHOLD || (tmp <= LO_SCIENTIFIC_THRESHOLD && tmp != 0)) {
+	ret += EXP_N_CHARS;
+    } else if (tmp >= 10) {
+	ret += (size_t)floor(log10(tmp));
     }
-    return ret;
+    return ret + (size_t)((n > 0)? n : 0);
 }
 
 /**
@@ -173,113 +175,107 @@ inline size_t get_float_digits(double a, int n) {
  * returns: number of characters actually written
  * WARNING: this function does not null terminate!
  */
-inline size_t sc_itoa(int a, char* str, size_t n, int b, sc_error* err) {
-    //figure out the number of digits
-    int n_digits = get_int_digits(a, b);
+inline size_t sc_itoa(sc_int a, char* str, size_t n, int b, sc_error* err) {
     if (b <= 0) { b = 10; }
     if (b > 36) {
 	sc_set_error(err, E_BADVAL, "can't use base larger than 36");
 	return 0;
     }
-    size_t i = n_digits - 1;
-    _uint tmp = a;
+    //figure out the number of digits
+    size_t n_digits = get_int_digits(a, b);
+    if (n_digits > n) {
+	sc_set_error(err, E_BADVAL, "not enough space to write string");
+	return 0;
+    }
     //handle negative numbers
-    if (a <= 0) {
-	tmp = -a;
+    sc_uint tmp = (sc_uint)a;
+    if (a < 0) {
+	tmp = (sc_uint)0 - tmp;
 	str[0] = '-';
-	str += 1;//ignore the minus sign for the rest of this function
-	--n_digits;
     }
-    //iterate over the string to write
-    while (tmp > 0 && i >= 0) {
+    //write digits from least to most significant
+    size_t i = n_digits;
+    do {
 	int digit = tmp % b;
 	if (digit < 10) {
-	    str[i] = '0' + digit;
+	    str[--i] = '0' + digit;
 	} else {
-	    str[i] = 'A' + digit - 10;
-	}
-
-	//check that we don't write before the point we are allowed to
-	if (i == 0 && tmp > b) {
-	    sc_set_error(err, E_BADVAL, "not enough space to write string");
-	    return 0;
+	    str[--i] = 'A' + digit - 10;
 	}
-	--i;
 	tmp /= b;
-    }
+    } while (tmp > 0);
     return n_digits;
 }
 
 /**
- * Tries writing the representation of the floating point number a to the string str filling at most n bytes.
+ * Tries writing the representation of the floating point number a to the string str filling at most n bytes. The number is rounded to precision significant digits and trailing zeros are dropped. Numbers of at least HI_SCIENTIFIC_THRESHOLD or at most LO_SCIENTIFIC_THRESHOLD in magnitude are written in scientific notation (e.g. 1.5E+12).
  * param str: string to write to
- * param n: maximum number of bytes to write
- * int b: the base of the formatted string. If b <= 0 then the default value, 10 is used.
+ * param n: maximum number of bytes to write, this must be at least get_float_digits(a, precision)
  * returns: number of characters actually written
  * WARNING: this function does not null terminate!
  */
 inline size_t sc_ftoa(double a, char* str, size_t n, int precision, sc_error* err) {
-    if (n < 2) {
+    if (n < get_float_digits(a, precision)) {
 	sc_set_error(err, E_BADVAL, "not enough space to write string");
 	return 0;
     }
-    //figure out the number of digits
-    int n_digits = get_float_digits(a, n);
-    size_t i = n_digits - 1;
+    size_t off = 0;
     double tmp = a;
+    if (isnan(a)) {
+	str[0] = 'n';str[1] = 'a';str[2] = 'n';
+	return 3;
+    }
     //handle negative numbers
-    if (a <= 0) {
+    if (a < 0) {
 	tmp = -a;
-	str[0] = '-';
-	str += 1;//ignore the minus sign for the rest of this function
-	--n_digits;
+	str[off++] = '-';
+    }
+    if (isinf(tmp)) {
+	str[off] = 'i';str[off+1] = 'n';str[off+2] = 'f';
+	return off + 3;
     }
 
-    //write exponents to a temporary string +1 for null terminator
-    char exp[EXP_N_CHARS+1];
+    //very large and small numbers are scaled to have exactly one digit before the decimal point
     int write_exp = 0;
-    exp[0] = 'E';
-    if (tmp >= HI_SCIENTIFIC_THRESHOLD) {
-	exp[1] = '+';
-	double log_tmp = floor(log10(tmp));
-	size_t written = sc_itoa((int)log_tmp + 1, exp + 2, EXP_N_CHARS-2, 10, err);
-	exp[written] = 0;
-	tmp /= pow(10, log_tmp);//fix tmp to have only one point before the decimal
-	write_exp = 1;
-    } else if (tmp <= LO_SCIENTIFIC_THRESHOLD) {
-	exp[1] = '-';
-	double log_tmp = floor(-log10(tmp));
-	size_t written = sc_itoa((int)log_tmp + 1, exp + 2, EXP_N_CHARS-2, 10, err);
-	exp[written] = 0;
-	tmp /= pow(10, log_tmp);
+    int exp10 = 0;
+    if (tmp >= HI_SCIENTIFIC_THRESHOLD || (tmp <= LO_SCIENTIFIC_THRESHOLD && tmp != 0)) {
+	exp10 = (int)floor(log10(tmp));
+	tmp /= pow(10, exp10);
+	//log10 may be off by one close to powers of ten
+	if (tmp >= 10) { tmp /= 10;++exp10; }
+	if (tmp < 1) { tmp *= 10;--exp10; }
 	write_exp = 1;
     }
-    double tmp_flr = floor(tmp);
-    size_t off = sc_itoa((int)tmp_flr, str, n, 10, err);
-    if (off < n && tmp_flr != tmp) {
-	str[off] = '.';
-	double remain = tmp - tmp_flr;
-	//this should be impossible but...	
-	if (remain >= 1 || remain < 0) {
-	    sc_set_error(err, E_BADVAL, "Invalid floating point number");
-	    return off + 1;
-	}
 
-	while (off < n && remain != 0) {
-	    remain *= 10;
-	    str[off] = (char)floor(remain) + '0';
-	    remain -= floor(remain);
-	    ++off;
+    //the digits after the decimal point are rounded into an integer so that they can be written exactly
+    double ip = floor(tmp);
+    int n_int = (ip >= 1)? (int)floor(log10(ip)) + 1 : 0;
+    int n_frac = (precision > n_int)? precision - n_int : 0;
+    if (n_frac > FLOAT_MAX_FRAC_DIGITS) { n_frac = FLOAT_MAX_FRAC_DIGITS; }
+    sc_uint scale = 1;
+    for (int k = 0; k < n_frac; ++k) { scale *= 10; }
+    sc_uint frac = (sc_uint)llround((tmp - ip)*(double)scale);
+    if (frac >= scale) {
+	//rounding carried into the integer part
+	ip += 1;
+	frac -= scale;
+	if (write_exp && ip >= 10) { ip /= 10;++exp10; }
+    }
+    off += sc_itoa((sc_int)ip, str + off, n - off, 10, err);
+    if (frac != 0) {
+	while (frac % 10 == 0) { frac /= 10;--n_frac; }
+	str[off++] = '.';
+	for (int k = n_frac - 1; k >= 0; --k) {
+	    str[off + k] = '0' + (char)(frac % 10);
+	    frac /= 10;
 	}
+	off += n_frac;
     }
     if (write_exp) {
-	if (off >= n - EXP_N_CHARS) { off = n - EXP_N_CHARS - 1; }
-	for (size_t i = 0; i < EXP_N_CHARS && exp[i] != 0; ++i) {
-	    str[off+i] = exp[i];
-	    ++off;
-	}
+	str[off++] = 'E';
+	str[off++] = (exp10 < 0)? '-' : '+';
+	off += sc_itoa((exp10 < 0)? -exp10 : exp10, str + off, n - off, 10, err);
     }
-
     return off;
 }
 
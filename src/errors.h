@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <errno.h>
 #include <stdio.h>
 #include <math.h>
@@ -15,6 +16,8 @@ extern "C" {
 
 #define DEF_FLOAT_PRECISION	16
 #define EXP_N_CHARS		5
+//the most digits sc_ftoa() writes after the decimal point, 10^FLOAT_MAX_FRAC_DIGITS must fit in an sc_uint
+#define FLOAT_MAX_FRAC_DIGITS	17
 //all floats above this constant in absolute value are represented in scientific notion (E+n)
 #define HI_SCIENTIFIC_THRESHOLD	1000000000.0
 //all floats below this constant in absolute value are represented in scientific notion (E+n)
@@ -22,6 +25,11 @@ extern "C" {
 
 typedef unsigned int _uint;
 typedef unsigned int _uint32;
+//integer values are always 64 bits wide so that counters and byte offsets don't overflow
+typedef int64_t sc_int;
+typedef uint64_t sc_uint;
+#define SC_INT_MIN	INT64_MIN
+#define SC_INT_MAX	INT64_MAX
 
 typedef enum {
   E_SUCCESS = 0,
@@ -36,6 +44,11 @@ typedef enum {
   E_UNEXPECT_CHAR,
   N_ERRORS} err_type_e;
 
+/**
+ * Describes the result of an operation.
+ * type: E_SUCCESS or the kind of error that occurred
+ * msg: a description of the error. This is only written when an error occurs, so it is meaningless while type == E_SUCCESS.
+ */
 typedef struct ssc_error {
     err_type_e type;
     char msg[DTG_MAX_MSG_SIZE];
@@ -49,9 +62,11 @@ typedef struct ssc_error {
 void sc_set_error(sc_error* p_errloc, err_type_e p_type, const char* p_msg);
 
 /**
-  * Resets the error to an empty message and type=E_SUCCESS
+  * Resets the error to type=E_SUCCESS. This is called at the start of nearly every function so it only writes the status, the message is left untouched since it is only read after a failure.
   */
-void sc_reset_error(sc_error* p_errloc);
+static inline void sc_reset_error(sc_error* p_errloc) {
+    if (p_errloc) { p_errloc->type = E_SUCCESS; }
+}
 
 /**
  * Tries copying at most n bytes of the string src into the destination dest. A null termination character is always written if dest has at least one character and a RANGE error may be thrown if n was not large enough to store src
@@ -61,6 +76,11 @@ size_t sc_strncpy(char* dest, const char* src, size_t n, sc_error* err);
 
 void sc_free(void* loc);
 
+#ifdef SC_COUNT_ALLOCS
+//the number of calls to sc_malloc() and sc_realloc(). This is only tracked when profiling.
+extern size_t sc_n_allocs;
+#endif
+
 /**
  * Helper function which tries to allocate a block of memory of size buf_size or sets err in the event of a failure
  */
@@ -74,7 +94,7 @@ void* sc_realloc(void* ptr, size_t buf_size, sc_error* err);
 /**
  * Tries reading the string str as an integer or sets err on failure
  */
-int sc_atoi(const char* str, sc_error* err);
+sc_int sc_atoi(const char* str, sc_error* err);
 
 /**
  * Tries reading the string str as an integer or sets err on failure
@@ -82,14 +102,13 @@ int sc_atoi(const char* str, sc_error* err);
 double sc_atof(const char* str, sc_error* err);
 
 /**
- * Returns the number of digits needed to represent the integer a in base b
- * NOTE: this is not guaranteed to be an exact figure, but it is guaranteed to be greater than or equal to the number of bytes written by DTG_itof.
+ * Returns the number of characters needed to represent the integer a in base b, including the minus sign for negative numbers. This is exactly the number of bytes written by sc_itoa().
  */
-size_t get_int_digits(int a, int b);
+size_t get_int_digits(sc_int a, int b);
 
 /**
  * Returns the number of digits needed to represent the floating point number a using n digits of precision. (Only base 10 is supported at present).
- * NOTE: this is not guaranteed to be an exact figure, but it is guaranteed to be greater than or equal to the number of bytes written by DTG_itof.
+ * NOTE: this is not guaranteed to be an exact figure, but it is guaranteed to be greater than or equal to the number of bytes written by sc_ftoa().
  */
 size_t get_float_digits(double a, int n);
 
@@ -101,13 +120,12 @@ size_t get_float_digits(double a, int n);
  * returns: number of characters actually written
  * WARNING: this function does not null terminate!
  */
-size_t sc_itoa(int a, char* str, size_t n, int b, sc_error* err);
+size_t sc_itoa(sc_int a, char* str, size_t n, int b, sc_error* err);
 
 /**
- * Tries writing the representation of the floating point number a to the string str filling at most n bytes.
+ * Tries writing the representation of the floating point number a to the string str filling at most n bytes. The number is rounded to precision significant digits and trailing zeros are dropped. Numbers of at least HI_SCIENTIFIC_THRESHOLD or at most LO_SCIENTIFIC_THRESHOLD in magnitude are written in scientific notation (e.g. 1.5E+12).
  * param str: string to write to
- * param n: maximum number of bytes to write
- * int b: the base of the formatted string. If b <= 0 then the default value, 10 is used.
+ * param n: maximum number of bytes to write, this must be at least get_float_digits(a, precision)
  * returns: number of characters actually written
  * WARNING: this function does not null terminate!
  */
@@ -1,441 +1,562 @@
 #include "exec.h"
 
-#ifdef __cplusplus 
+#ifdef __cplusplus
 extern "C" {
 #endif
 
 // ==================================== FUNCTION EXECUTION ====================================
 
 /**
- * Helper function to read the value stored at the stack index ind.
+ * Helper function which returns a pointer to the value referenced by the parameter arg in the bank specified by bank (one of the INS_HL flags). Global parameters are slot indices into the global table and constant parameters are indices into the constant pool of the executing function f. In the event of an error, NULL is returned.
  */
-Value _st_fetch(LiveContext* c, size_t ind) {
-    return c->callstack.top[ind];
+value* _ex_ref(LiveContext* c, value* regs, const function* f, size_t bank, union Instruction arg, sc_error* err) {
+    switch (bank) {
+    case INS_HL_R: return regs + arg.i;
+    case INS_HL_S: return _ex_slot(c, arg.i);
+    case INS_HL_G:
+	//slots of globals which have been removed are NULL
+	if (arg.i >= c->global->n_slots || c->global->slots[arg.i] == NULL) {
+	    sc_set_error(err, E_UNDEF, "");
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "undefined global slot %lu", arg.i);
+	    return NULL;
+	}
+	return &(c->global->slots[arg.i]->val);
+    default:
+	if (arg.i >= f->n_consts) {
+	    sc_set_error(err, E_UNDEF, "");
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "undefined constant %lu", arg.i);
+	    return NULL;
+	}
+	return f->consts + arg.i;
+    }
+}
+
+/**
+ * Helper function which reads an array index from the parameter arg in the bank specified by bank (one of the INS_HL flags). Unlike _ex_ref(), constant indices are stored directly in the instruction.
+ */
+long _ex_index(LiveContext* c, value* regs, const function* f, size_t bank, union Instruction arg, sc_error* err) {
+    if (bank == INS_HL_C) { return (long)(arg.i); }
+    value* v = _ex_ref(c, regs, f, bank, arg, err);
+    if (v == NULL) { return -1; }
+    if (v->type != VT_INT && v->type != VT_CHAR) {
+	sc_set_error(err, E_BADTYPE, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "Tried to index with non integer type %d", v->type);
+	return -1;
+    }
+    return (long)(v->val.i);
+}
+
+/**
+ * Helper function which returns the array (an Array or PrimArray) stored in v if ind is a valid index for it. If v is not an array or ind is out of bounds, NULL is returned and err is set.
+ */
+Array* _ex_array(value* v, long ind, sc_error* err) {
+    if (v == NULL) { return NULL; }
+    if (v->type != VT_ARRAY) {
+	sc_set_error(err, E_BADTYPE, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "Expected array type for indexing, got %d", v->type);
+	return NULL;
+    }
+    Array* arr = (Array*)(v->val.ptr);
+    if (ind < 0 || (size_t)ind >= arr->size) {
+	sc_set_error(err, E_RANGE, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "index %ld out of bounds for array of size %lu", ind, arr->size);
+	return NULL;
+    }
+    return arr;
+}
+
+/**
+ * Helper function which moves the values returned by f from the top of the stack to the start of its stack frame and discards everything else in the frame. The frame starts base values above the bottom of the stack.
+ */
+int _ex_return(function* f, LiveContext* c, size_t base, sc_error* err) {
+    if (get_size(c->callstack) < base + f->n_rets) {
+	sc_set_error(err, E_STACK_UNDERFLOW, "function returned without enough values on the stack");
+	return -1;
+    }
+    //the stack grows downwards so the last returned value is stored at the lowest address
+    value* dst = c->callstack.bottom - base - f->n_rets;
+    memmove(dst, c->callstack.top, sizeof(value)*(f->n_rets));
+    c->callstack.top = dst;
+    return 0;
+}
+
+/**
+ * Helper function which doubles the capacity of the frame stack of c. Calls nested deeper than MAX_CALL_DEPTH fail with E_STACK_OVERFLOW.
+ * Returns: 0 on success or -1 on error
+ */
+int _ex_grow_frames(LiveContext* c, sc_error* err) {
+    if (c->frames_cap >= MAX_CALL_DEPTH) {
+	sc_set_error(err, E_STACK_OVERFLOW, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "calls nested deeper than %d", MAX_CALL_DEPTH);
+	return -1;
+    }
+    size_t new_cap = (c->frames_cap > 0)? 2*(c->frames_cap) : DEF_N_FRAMES;
+    if (new_cap > MAX_CALL_DEPTH) { new_cap = MAX_CALL_DEPTH; }
+    Frame* tmp = (Frame*)sc_realloc(c->frames, sizeof(Frame)*new_cap, err);
+    if (tmp == NULL) { return -1; }
+    c->frames = tmp;
+    c->frames_cap = new_cap;
+    return 0;
 }
 
+#ifdef SC_COMPUTED_GOTO
+/**
+ * Rewrites the instruction buffer buf in place so that every opcode is replaced by the address of its handler in the table dispatch (indexed by opcode). The original opcodes are saved in buf->opcodes. A return instruction is appended if needed so that execution can never run past the end of the buffer.
+ * Returns: 0 on success or -1 on error
+ */
+int _ex_thread(instruction_buffer* buf, void* const* dispatch, sc_error* err) {
+    //jumps may target the end of the buffer, so a return is always stored just past the last instruction. It isn't counted in n_insts so the buffer still describes the compiled function
+    union Instruction ret;
+    ret.i = INS_RETURN;
+    append_Instruction(buf, ret, err);
+    if (err->type != E_SUCCESS) { return -1; }
+    buf->n_insts -= 1;
+
+    buf->opcodes = (size_t*)sc_malloc(sizeof(size_t)*(buf->n_insts + 1), err);
+    if (err->type != E_SUCCESS) { return -1; }
+    size_t i = 0;
+    while (i < buf->n_insts) {
+	size_t op = buf->buf[i].i;
+	buf->opcodes[i] = op;
+	buf->buf[i].ptr = dispatch[op & 0xFFu];
+	i += _ins_size(op);
+    }
+    buf->opcodes[buf->n_insts] = INS_RETURN;
+    buf->buf[buf->n_insts].ptr = dispatch[INS_RETURN];
+    return 0;
+}
+
+//each handler is a label and the address of the next handler is read directly from the instruction stream
+#define EX_LABEL(name)	ex_##name:
+#define EX_CASE(op)
+#define EX_CASE_DEFAULT
+#define EX_DEFAULT
+#define EX_END_DEFAULT
+#define EX_NEXT		if (err->type != E_SUCCESS) { return -1; } goto *(ins[i].ptr)
+#define EX_THREAD(fn)	if ((fn)->buf.opcodes == NULL && _ex_thread(&((fn)->buf), dispatch, err) < 0) { return -1; }
+#else
+//portable fallback which dispatches on the opcode with a switch statement
+#define EX_LABEL(name)
+#define EX_CASE(op)	case op:
+#define EX_CASE_DEFAULT	default:
+#define EX_DEFAULT	default: switch (_ins_base(ins[i].i)) {
+#define EX_END_DEFAULT	}
+#define EX_NEXT		break
+#define EX_THREAD(fn)
+#endif
+
+//enters the function fn which was called by the instruction at i. Execution continues after the call instruction once fn returns
+#define EX_CALL(fn)	if (_ex_enter(c, (fn), f, i + 2, err) < 0) { return -1; } EX_THREAD(fn) f = (fn); ins = f->buf.buf; i = 0; EX_NEXT
+
+//replaces the executing function by fn, which returns directly to the caller of the executing function
+#define EX_TAIL(fn)	_ex_tail(c, (fn)); EX_THREAD(fn) f = (fn); ins = f->buf.buf; i = 0; EX_NEXT
+
+//helpers for building the dispatch table, instructions reading from one or two banks share a handler
+#define EX_BANKS1(op, lbl)	[op|INS_HH_R] = &&ex_##lbl, [op|INS_HH_S] = &&ex_##lbl, [op|INS_HH_G] = &&ex_##lbl, [op|INS_HH_C] = &&ex_##lbl
+#define EX_BANKS2(op, lbl)	EX_BANKS1(op|INS_HL_R, lbl), EX_BANKS1(op|INS_HL_S, lbl), EX_BANKS1(op|INS_HL_G, lbl), EX_BANKS1(op|INS_HL_C, lbl)
+
 /**
- * Execute the already created function f within the runtime Context c.
+ * Execute the already created function f within the runtime context c. Calls made by f are executed in the same loop using the frame stack of c.
  */
-int _ex_func(Function f, LiveContext* c, DTG_Error* err) {
-    InstructionBuffer b = f.buf;
-    Value regs[N_REGISTERS];
+int _ex_func(function* f, LiveContext* c, sc_error* err) {
+    //registers only hold temporaries between consecutive instructions, so they are shared by every frame
+    value regs[N_REGISTERS] = {0};
+    sc_reset_error(err);
+
+#ifdef SC_COMPUTED_GOTO
+    //every entry defaults to ex_bad and is then overridden by its handler, which -Wextra would otherwise report once per opcode
+#pragma GCC diagnostic push
+#ifdef __clang__
+#pragma GCC diagnostic ignored "-Winitializer-overrides"
+#else
+#pragma GCC diagnostic ignored "-Woverride-init"
+#endif
+    static void* const dispatch[256] = {
+	[0 ... 255] = &&ex_bad,
+	[INS_NOP] = &&ex_nop,
+	[INS_OP_EVAL|INS_HH_R] = &&ex_op_eval, [INS_OP_EVAL|INS_HH_S] = &&ex_op_eval, [INS_OP_EVAL|INS_HH_G] = &&ex_op_eval,
+	[INS_OP_EVAL|INS_HH_C] = &&ex_op_eval_c,
+	[INS_FN_EVAL|INS_HH_R] = &&ex_fn_eval, [INS_FN_EVAL|INS_HH_S] = &&ex_fn_eval,
+	[INS_FN_EVAL|INS_HH_G] = &&ex_fn_eval_g, [INS_FN_EVAL|INS_HH_C] = &&ex_fn_eval_c,
+	EX_BANKS1(INS_TAIL_CALL, tail_call),
+	[INS_JUMP] = &&ex_jump,
+	EX_BANKS1(INS_JUMP_CND, jump_cnd),
+	[INS_PUSH|INS_HH_R] = &&ex_push_r, [INS_PUSH|INS_HH_S] = &&ex_push_s, [INS_PUSH|INS_HH_G] = &&ex_push_g, [INS_PUSH|INS_HH_C] = &&ex_push_c,
+	[INS_POP|INS_HH_R] = &&ex_pop_r, [INS_POP|INS_HH_S] = &&ex_pop_s, [INS_POP|INS_HH_G] = &&ex_pop_g, [INS_POP|INS_HH_C] = &&ex_pop_c,
+	[INS_MAKE_ARR] = &&ex_make_arr,
+	[INS_MAKE_STR] = &&ex_make_str,
+	[INS_MAKE_VAL] = &&ex_make_val,
+	[INS_RETURN] = &&ex_return,
+	EX_BANKS2(INS_MOV, mov),
+	EX_BANKS2(INS_IND_READ, ind_read),
+	EX_BANKS2(INS_IND_WRITE, ind_write),
+	EX_BANKS1(INS_GET_SIZE, get_size),
+	EX_BANKS1(INS_MAKE_PTR, make_ptr),
+	EX_BANKS1(INS_PTR_DRF, ptr_drf)
+    };
+#pragma GCC diagnostic pop
+    //the first execution threads the instruction stream
+    EX_THREAD(f)
+#endif
+    union Instruction* ins = f->buf.buf;
+
+    //the stack frame for this function starts at the first argument. We store its offset from the bottom since the stack may be reallocated
+    if (get_size(c->callstack) < f->n_args) {
+	sc_set_error(err, E_STACK_UNDERFLOW, "not enough arguments supplied to function");
+	return -1;
+    }
+    c->base = get_size(c->callstack) - f->n_args;
+    //frames beneath this point belong to callers outside of this loop
+    size_t entry = c->n_frames;
+    Frame* fr = NULL;
 
     //we declare these pointers before the switch statement in which they are used to save on typing
-    struct Operation* op = NULL;
-    Value* val = NULL;
-    Function* fn = NULL;
-    HashedItem* hash = NULL;
-    //Value* src_val = NULL;
-    size_t len = 0;
+    function* fn = NULL;
+    value* src = NULL;
+    value* dst = NULL;
+    Array* arr = NULL;
+    value tmp;
     size_t ind = 0;
-    size_t src_ind = 0;
-    size_t dst_ind = 0;
-
-    for (size_t i = 0; i < b.n_insts; ++i) {
-	//branch based on the low nibble, note that certain low nibbles may indicate multiple different instructions based on the high nibble, these are listed in comments.
-	switch (b.buf[i].i) {
-	  //Operation evaluations
-	    case INS_OP_EVAL | INS_HH_R:
-	  op = (struct Operation*)(regs[b.buf[i+1].i].val.ptr);
-	  regs[0] = eval(op, err);
-	  i += 2;
-	  break;
-	    case INS_OP_EVAL | INS_HH_S:
-	  op = (struct Operation*)(_st_fetch(c, b.buf[i+1].i).val.ptr);
-	  regs[0] = eval(op, err);
-	  i += 2;
-	  break;
-	    case INS_OP_EVAL | INS_HH_G:
-	  hash = lookup( &(c->global), (char*)(b.buf[i+1].ptr) );
-	  op = (struct Operation*)(hash->val.val.ptr);
-	  regs[0] = eval(op, err);
-	  i += 2;
-	  break;
-	    case INS_OP_EVAL | INS_HH_C:
-	  op = (struct Operation*)(b.buf[i+1].ptr);
-	  regs[0] = eval(op, err);
-	  i += 2;
-	  break;
-
-	  //Function Evaluations
-	    case INS_FN_EVAL | INS_HH_R:
-	  fn = (Function*)(regs[b.buf[i+1].i].val.ptr);
-	  regs[0].val.i = _ex_func(*fn, c, err);
-	  i += 2;
-	  break;
-	    case INS_FN_EVAL | INS_HH_S:
-	  fn = (Function*)(_st_fetch(c, b.buf[i+1].i).val.ptr);
-	  regs[0].val.i = _ex_func(*fn, c, err);
-	  i += 2;
-	  break;
-	    case INS_FN_EVAL | INS_HH_G:
-	  hash = lookup( &(c->global), (char*)(b.buf[i+1].ptr) );
-	  fn = (Function*)(hash->val.val.ptr);
-	  regs[0].val.i = _ex_func(*fn, c, err);
-	  i += 2;
-	  break;
-	    case INS_FN_EVAL | INS_HH_C:
-	  fn = (Function*)(b.buf[i+1].ptr);
-	  regs[0].val.i = _ex_func(*fn, c, err);
-	  i += 2;
-	  break;
-	  
-	  //Value initialization functions
-	  //TODO: make sure that pointers remain valid
-	    /*case INS_MAKE_PTR | INS_HH_S:
-	  regs[0].val. = &(c->callstack.buf[c->callstack.stack_ptr - b.buf[i+1].i]);
-	  i += 2;
-	  break;
-	    case INS_MAKE_PTR | INS_HH_G:
-	  hash = lookup( &(c->global), (char*)(b.buf[i+1].ptr) );
-	  regs[0] = &(hash->val);
-	  i += 2;
-	  break;
-	    case INS_MAKE_ARR:
-	  len = b.buf[i+1].i;
-	  Value tmplt = {0};
-	  regs[0] = v_make_array_n(len, tmplt, err);
-	  i += 2;
-	  break;
-	    case INS_MAKE_STR:
-	  len = b.buf[i+1].i;
-	  regs[0] = v_make_array_n(len, VT_ERROR, err);
-	  i += 2;
-	  break;*/
-
-	  //jumps (conditional and unctionditional
-	    case INS_JUMP:
-	  i = b.buf[i+1].i;
-	  break;
-	    case INS_JUMP_CND | INS_HH_R:
-	  op = (struct Operation*)(regs[b.buf[i+1].i].val.ptr);
-	  regs[0] = eval(op, err);
-	  if (regs[0].val.i) {
-	      i = b.buf[i+2].i;
-	  } else {
-	      i += 3;
-	  }
-	  break;
-	    case INS_JUMP_CND | INS_HH_S:
-	  op = (struct Operation*)(_st_fetch(c, b.buf[i+1].i).val.ptr);
-	  regs[0] = eval(op, err);
-	  if (regs[0].val.i) {
-	      i = b.buf[i+2].i;
-	  } else {
-	      i += 3;
-	  }
-	  break;
-	    case INS_JUMP_CND | INS_HH_G:
-	  hash = lookup( &(c->global), (char*)(b.buf[i+1].ptr) );
-	  op = (struct Operation*)(hash->val.val.ptr);
-	  regs[0] = eval(op, err);
-	  if (regs[0].val.i) {
-	      i = b.buf[i+2].i;
-	  } else {
-	      i += 3;
-	  }
-	  break;
-	    case INS_JUMP_CND | INS_HH_C:
-	  op = (struct Operation*)(b.buf[i+1].ptr);
-	  regs[0] = eval(op, err);
-	  if (regs[0].val.i) {
-	      i = b.buf[i+2].i;
-	  } else {
-	      i += 3;
-	  }
-	  break;
-
-	  //Push instructions
-	    case INS_PUSH | INS_HH_R:
-	  ind = b.buf[i+1].i;
-	  push(&(c->callstack), regs[ind], err);
-	  i += 2;
-	  break;
-	    case INS_PUSH | INS_HH_S:
-	  push(&(c->callstack), _st_fetch(c, b.buf[i+1].i), err);
-	  i += 2;
-	  break;
-	    case INS_PUSH | INS_HH_G:
-	  hash = lookup( &(c->global), (char*)(b.buf[i+1].ptr) );
-	  push(&(c->callstack), hash->val, err);
-	  i += 2;
-	  break;
-	    case INS_PUSH | INS_HH_C:
-	  push(&(c->callstack), *( (Value*)(b.buf[i+1].ptr) ), err);
-	  i += 2;
-	  break;
-
-	  //Pop instructions
-	  case INS_POP | INS_HH_R:
-	  ind = b.buf[i+1].i;
-	  regs[ind] = pop(&(c->callstack), err);
-	  i+= 2;
-	  break;
-	  case INS_POP | INS_HH_S:
-	  ind = b.buf[i+1].i;
-	  Value tmp = pop(&(c->callstack), err);
-	  c->callstack.top[ind] = tmp;
-	  i += 2;
-	  break;
-	  case INS_POP | INS_HH_G:
-	  tmp = pop(&(c->callstack), err);
-	  break;
-	  case INS_POP | INS_HH_C:
-	  tmp = pop(&(c->callstack), err);
-	  break;
-
-	  //Move instructions
-	  case INS_MOV | INS_HH_R | INS_HL_R:
-	  dst_ind = b.buf[i+1].i;
-	  src_ind = b.buf[i+2].i;
-	  regs[dst_ind] = regs[src_ind];
-	  break;
-	  case INS_MOV | INS_HH_S | INS_HL_R:
-	  dst_ind = b.buf[i+1].i;
-	  src_ind = b.buf[i+2].i;
-	  c->callstack.top[dst_ind] = regs[src_ind];
-	  break;
-	  case INS_MOV | INS_HH_G | INS_HL_R:
-	  hash = lookup( &(c->global), (char*)(b.buf[i+1].ptr) );
-	  src_ind = b.buf[i+2].i;
-	  hash->val = regs[src_ind];
-	  break;
-	  case INS_MOV | INS_HH_R | INS_HL_S:
-	  dst_ind = b.buf[i+1].i;
-	  src_ind = b.buf[i+2].i;
-	  regs[dst_ind] = c->callstack.top[src_ind];
-	  break;
-	  case INS_MOV | INS_HH_S | INS_HL_S:
-	  dst_ind = b.buf[i+1].i;
-	  src_ind = b.buf[i+2].i;
-	  c->callstack.top[dst_ind] = c->callstack.top[src_ind];
-	  break;
-	  case INS_MOV | INS_HH_G | INS_HL_S:
-	  hash = lookup( &(c->global), (char*)(b.buf[i+1].ptr) );
-	  src_ind = b.buf[i+2].i;
-	  hash->val = c->callstack.top[src_ind];
-	  break;
-	  case INS_MOV | INS_HH_R | INS_HL_G:
-	  dst_ind = b.buf[i+1].i;
-	  hash = lookup( &(c->global), (char*)(b.buf[i+2].ptr) );
-	  regs[dst_ind] = hash->val;
-	  break;
-	  case INS_MOV | INS_HH_S | INS_HL_G:
-	  dst_ind = b.buf[i+1].i;
-	  hash = lookup( &(c->global), (char*)(b.buf[i+2].ptr) );
-	  c->callstack.top[dst_ind] = hash->val;
-	  break;
-	  case INS_MOV | INS_HH_G | INS_HL_G:
-	  hash = lookup( &(c->global), (char*)(b.buf[i+1].ptr) );
-	  HashedItem* src_hash = lookup( &(c->global), (char*)(b.buf[i+2].ptr) );
-	  hash->val = src_hash->val;
-	  break;
-	  case INS_MOV | INS_HH_R | INS_HL_C:
-	  dst_ind = b.buf[i+1].i;
-	  Value* src_val = (Value*)(b.buf[i+2].ptr);
-	  regs[dst_ind] = *src_val;
-	  break;
-	  case INS_MOV | INS_HH_S | INS_HL_C:
-	  dst_ind = b.buf[i+1].i;
-	  src_val = (Value*)(b.buf[i+2].ptr);
-	  c->callstack.top[dst_ind] = *src_val;
-	  break;
-	  case INS_MOV | INS_HH_G | INS_HL_C:
-	  hash = lookup( &(c->global), (char*)(b.buf[i+1].ptr) );
-	  src_val = (Value*)(b.buf[i+2].ptr);
-	  hash->val = *src_val;
-	  break;
-
-	  //pointer dereference
-	  case INS_PTR_DRF | INS_HH_R:
-	  ind = b.buf[i+1].i;
-	  if (regs[ind].type & LO_NIB == VT_REF) {
-	      //if the top bit is set then this is a pointer to a global value
-	      if (regs[ind].type & TOP_BIT) {
-		  hash = lookup( &(c->global), (char*)(regs[ind].val.ptr) );
-		  regs[0] = hash->val;
-	      } else {
-		  ind = regs[ind].val.i;
-		  regs[0] = c->callstack.top[ind];
-	      }
-	  } else {
-	      DTG_SetError(err, BADTYPE, "");
-	      snprintf(err->msg, DTG_MAX_MSG_SIZE, "Tried to dereference non pointer type %d", regs[ind].type);
-	  }
-	  break;
-	  case INS_PTR_DRF | INS_HH_S:
-	  ind = b.buf[i+1].i;
-	  if (c->callstack.top[ind].type & LO_NIB == VT_REF) {
-	      //if the top bit is set then this is a pointer to a global value
-	      if (regs[ind].type & TOP_BIT) {
-		  hash = lookup( &(c->global), (char*)(c->callstack.top[ind].val.ptr) );
-		  regs[0] = hash->val;
-	      } else {
-		  ind = regs[ind].val.i;
-		  regs[0] = c->callstack.top[ind];
-	      }
-	  } else {
-	      DTG_SetError(err, BADTYPE, "");
-	      snprintf(err->msg, DTG_MAX_MSG_SIZE, "Tried to dereference non pointer type %d", regs[ind].type);
-	  }
-	  break;
-	  case INS_PTR_DRF | INS_HH_G:
-	  ind = b.buf[i+1].i;
-	  if (c->callstack.top[ind].type & LO_NIB == VT_REF) {
-	      //if the top bit is set then this is a pointer to a global value
-	      if (regs[ind].type & TOP_BIT) {
-		  hash = lookup( &(c->global), (char*)(c->callstack.top[ind].val.ptr) );
-		  regs[0] = hash->val;
-	      } else {
-		  ind = regs[ind].val.i;
-		  regs[0] = c->callstack.top[ind];
-	      }
-	  } else {
-	      DTG_SetError(err, BADTYPE, "");
-	      snprintf(err->msg, DTG_MAX_MSG_SIZE, "Tried to dereference non pointer type %d", regs[ind].type);
-	  }
-	  break;
-
-	  //Get size instructions
-	  case INS_GET_SIZE | INS_HH_R:
-	  ind = b.buf[i+1].i;
-	  regs[0].val.i = ( (Array*)(regs[ind].val.ptr) )->size;
-	  break;
-	  case INS_GET_SIZE | INS_HH_S:
-	  ind = b.buf[i+1].i;
-	  regs[0].val.i = ( (Array*)(c->callstack.top[ind].val.ptr) )->size;
-	  break;
-	  case INS_GET_SIZE | INS_HH_G:
-	  hash = lookup( &(c->global), (char*)(b.buf[i+1].ptr) );
-	  regs[0].val.i = ( (Array*)(hash->val.val.ptr) )->size;
-	  break;
-
-	  //Read index from array instructions
-	  case INS_IND_READ | INS_HH_R:
-	  ind = b.buf[i+1].i;
-	  //ensure this is an array
-	  if (regs[ind].type == VT_ARRAY) {
-	      size_t arr_ind = b.buf[i+2].i;
-	      regs[0] = ( (Array*)(regs[ind].val.ptr) )->buf[arr_ind];
-	  } else {
-	      DTG_SetError(err, BADTYPE, "Expected array type for writing");
-	      return -1;
-	  }
-	  break;
-	  case INS_IND_READ | INS_HH_S:
-	  ind = b.buf[i+1].i;
-	  //ensure this is an array
-	  if (regs[ind].type == VT_ARRAY) {
-	      size_t arr_ind = b.buf[i+2].i;
-	      regs[0] = ( (Array*)(c->callstack.top[ind].val.ptr) )->buf[arr_ind];
-	  } else {
-	      DTG_SetError(err, BADTYPE, "Expected array type for writing");
-	      return -1;
-	  }
-	  break;
-	  case INS_IND_READ | INS_HH_G:
-	  hash = lookup( &(c->global), (char*)(b.buf[i+1].ptr) );
-	  //ensure this is an array
-	  if (regs[ind].type == VT_ARRAY) {
-	      size_t arr_ind = b.buf[i+2].i;
-	      regs[0] = ( (Array*)(hash->val.val.ptr) )->buf[arr_ind];
-	  } else {
-	      DTG_SetError(err, BADTYPE, "Expected array type for writing");
-	      return -1;
-	  }
-	  break;
-
-	  //Write to array index instructions
-	  case INS_IND_WRITE | INS_HH_R:
-	  ind = b.buf[i+1].i;
-	  //ensure this is an array
-	  if (regs[ind].type == VT_ARRAY) {
-	      size_t arr_ind = b.buf[i+2].i;
-	      ( (Array*)(regs[ind].val.ptr) )->buf[arr_ind] = regs[0];
-	  } else {
-	      DTG_SetError(err, BADTYPE, "Expected array type for writing");
-	      return -1;
-	  }
-	  break;
-	  case INS_IND_WRITE | INS_HH_S:
-	  ind = b.buf[i+1].i;
-	  //ensure this is an array
-	  if (regs[ind].type == VT_ARRAY) {
-	      size_t arr_ind = b.buf[i+2].i;
-	      ( (Array*)(c->callstack.top[ind].val.ptr) )->buf[arr_ind] = regs[0];
-	  } else {
-	      DTG_SetError(err, BADTYPE, "Expected array type for writing");
-	      return -1;
-	  }
-	  break;
-	  case INS_IND_WRITE | INS_HH_G:
-	  hash = lookup( &(c->global), (char*)(b.buf[i+1].ptr) );
-	  //ensure this is an array
-	  if (regs[ind].type == VT_ARRAY) {
-	      size_t arr_ind = b.buf[i+2].i;
-	      ( (Array*)(hash->val.val.ptr) )->buf[arr_ind] = regs[0];
-	  } else {
-	      DTG_SetError(err, BADTYPE, "Expected array type for writing");
-	      return -1;
-	  }
-	  break;
-
-	  //TODO:
-	  case INS_FL_OPEN:
-	  case INS_FL_CLOSE:
-	  case INS_FL_READ:
-	  case INS_FL_WRITE:
-
-	  //make pointer
-	  case INS_MAKE_PTR | INS_HH_S:
-	  ind = b.buf[i+1].i;
-	  regs[0].type = VT_REF;
-	  //store the offset from the BOTTOM of the stack to ensure that pushing and popping won't result in alterations
-	  //TODO: make sure this is safe
-	  regs[0].val.i = c->callstack.bottom - (c->callstack.top+ind);
-	  break;
-	  case INS_MAKE_PTR | INS_HH_G:
-	  regs[0].type = VT_REF | TOP_BIT;
-	  //store the offset from the BOTTOM of the stack to ensure that pushing and popping won't result in alterations
-	  //TODO: make sure this is safe
-	  regs[0].val.ptr = b.buf[i+1].ptr;
-	  break;
-
-	  //make strings and arrays
-	  case INS_MAKE_ARR:
-	  len = (size_t)(regs[0].val.i);
-	  regs[0].type = VT_ARRAY;
-	  regs[0].val.ptr = _make_Array(sizeof(Value), len, err);
-	  if (err->type != E_SUCCESS) {
-	      return -1;
-	  }
-	  break;
-	  case INS_MAKE_STR:
-	  len = (size_t)(regs[0].val.i);
-	  regs[0].type = VT_STRING;
-	  //allocate memory for the string
-	  regs[0].val.str = (String*)DTG_malloc(sizeof(String), err);
-	  *(regs[0].val.str) = make_String_n(len, err);
-	  if (err->type != E_SUCCESS) {
-	      return -1;
-	  }
-	  break;
-
-	  case INS_MAKE_VAL:
-	  regs[0].type = b.buf[i+1].i;
-	  regs[0].val.i = 0;
-	  break;
-
-	  case INS_EXT://TODO
-	  case INS_RETURN:
-	  return 0;
-	  default: break;
+    size_t n = 0;
+
+    size_t i = 0;
+#ifdef SC_COMPUTED_GOTO
+    goto *(ins[0].ptr);
+#else
+    while (1) {
+	//branch based on the opcode, the high bits of each opcode specify the bank that parameters are read from. Reaching the end of the instruction buffer is equivalent to a return
+	switch ((i < f->buf.n_insts)? ins[i].i : INS_RETURN) {
+#endif
+	EX_LABEL(nop) EX_CASE(INS_NOP)
+	    i += 1;
+	    EX_NEXT;
+
+	//Expression evaluations
+	EX_LABEL(op_eval) EX_CASE(INS_OP_EVAL | INS_HH_R) EX_CASE(INS_OP_EVAL | INS_HH_S) EX_CASE(INS_OP_EVAL | INS_HH_G)
+	    src = _ex_ref(c, regs, f, (_ins_opcode(&(f->buf), i) & INS_HH) >> 2, ins[i+1], err);
+	    if (src == NULL) { return -1; }
+	    regs[0] = eval_expression((expression*)(src->val.ptr), &(c->callstack), err);
+	    i += 2;
+	    EX_NEXT;
+	EX_LABEL(op_eval_c) EX_CASE(INS_OP_EVAL | INS_HH_C)
+	    regs[0] = eval_expression((expression*)(ins[i+1].ptr), &(c->callstack), err);
+	    i += 2;
+	    EX_NEXT;
+
+	//Function Evaluations
+	EX_LABEL(fn_eval) EX_CASE(INS_FN_EVAL | INS_HH_R) EX_CASE(INS_FN_EVAL | INS_HH_S)
+	    src = _ex_ref(c, regs, f, (_ins_opcode(&(f->buf), i) & INS_HH) >> 2, ins[i+1], err);
+	    if (src == NULL) { return -1; }
+	    if (src->type != VT_FUNC) {
+		sc_set_error(err, E_BADTYPE, "");
+		snprintf(err->msg, DTG_MAX_MSG_SIZE, "Tried to call non function type %d", src->type);
+		return -1;
+	    }
+	    fn = (function*)(src->val.ptr);
+	    EX_CALL(fn);
+	EX_LABEL(fn_eval_g) EX_CASE(INS_FN_EVAL | INS_HH_G)
+	    //calls to global functions are what the compiler emits, so the slot is read directly
+	    src = _ex_ref(c, regs, f, INS_HL_G, ins[i+1], err);
+	    if (src == NULL) { return -1; }
+	    if (src->type != VT_FUNC) {
+		sc_set_error(err, E_BADTYPE, "");
+		snprintf(err->msg, DTG_MAX_MSG_SIZE, "Tried to call non function type %d", src->type);
+		return -1;
+	    }
+	    fn = (function*)(src->val.ptr);
+	    EX_CALL(fn);
+	EX_LABEL(fn_eval_c) EX_CASE(INS_FN_EVAL | INS_HH_C)
+	    fn = (function*)(ins[i+1].ptr);
+	    EX_CALL(fn);
+
+	EX_LABEL(tail_call) EX_CASE(INS_TAIL_CALL | INS_HH_R) EX_CASE(INS_TAIL_CALL | INS_HH_S) EX_CASE(INS_TAIL_CALL | INS_HH_G) EX_CASE(INS_TAIL_CALL | INS_HH_C)
+	    if ((_ins_opcode(&(f->buf), i) & INS_HH) == INS_HH_C) {
+		fn = (function*)(ins[i+1].ptr);
+	    } else {
+		src = _ex_ref(c, regs, f, (_ins_opcode(&(f->buf), i) & INS_HH) >> 2, ins[i+1], err);
+		if (src == NULL) { return -1; }
+		if (src->type != VT_FUNC) {
+		    sc_set_error(err, E_BADTYPE, "");
+		    snprintf(err->msg, DTG_MAX_MSG_SIZE, "Tried to call non function type %d", src->type);
+		    return -1;
+		}
+		fn = (function*)(src->val.ptr);
+	    }
+	    if (get_size(c->callstack) < c->base + fn->n_args) {
+		sc_set_error(err, E_STACK_UNDERFLOW, "not enough arguments supplied to function");
+		return -1;
+	    }
+	    //the global may have been replaced since compilation, if the number of returned values differs then this is an ordinary call followed by a return
+	    if (fn->n_rets != f->n_rets) { EX_CALL(fn); }
+	    EX_TAIL(fn);
+
+	//jumps (conditional and unconditional)
+	EX_LABEL(jump) EX_CASE(INS_JUMP)
+	    i = ins[i+1].i;
+	    EX_NEXT;
+	EX_LABEL(jump_cnd) EX_CASE(INS_JUMP_CND | INS_HH_R) EX_CASE(INS_JUMP_CND | INS_HH_S) EX_CASE(INS_JUMP_CND | INS_HH_G) EX_CASE(INS_JUMP_CND | INS_HH_C)
+	    src = _ex_ref(c, regs, f, (_ins_opcode(&(f->buf), i) & INS_HH) >> 2, ins[i+1], err);
+	    if (src == NULL) { return -1; }
+	    //the jump is taken if the condition is false
+	    if ((src->type == VT_FLOAT && src->val.f == 0.0) || (src->type != VT_FLOAT && src->val.i == 0)) {
+		i = ins[i+2].i;
+	    } else {
+		i += 3;
+	    }
+	    EX_NEXT;
+
+	//Push instructions
+	EX_LABEL(push_r) EX_CASE(INS_PUSH | INS_HH_R)
+	    _ex_push(c, regs[ins[i+1].i], err);
+	    i += 2;
+	    EX_NEXT;
+	EX_LABEL(push_s) EX_CASE(INS_PUSH | INS_HH_S)
+	    _ex_push(c, *_ex_slot(c, ins[i+1].i), err);
+	    i += 2;
+	    EX_NEXT;
+	EX_LABEL(push_g) EX_CASE(INS_PUSH | INS_HH_G)
+	    src = _ex_ref(c, regs, f, INS_HL_G, ins[i+1], err);
+	    if (src == NULL) { return -1; }
+	    _ex_push(c, *src, err);
+	    i += 2;
+	    EX_NEXT;
+	EX_LABEL(push_c) EX_CASE(INS_PUSH | INS_HH_C)
+	    _ex_push(c, f->consts[ins[i+1].i], err);
+	    i += 2;
+	    EX_NEXT;
+
+	//Pop instructions
+	EX_LABEL(pop_r) EX_CASE(INS_POP | INS_HH_R)
+	    regs[ins[i+1].i] = _ex_pop(c, err);
+	    i += 2;
+	    EX_NEXT;
+	EX_LABEL(pop_s) EX_CASE(INS_POP | INS_HH_S)
+	    tmp = _ex_pop(c, err);
+	    *_ex_slot(c, ins[i+1].i) = tmp;
+	    i += 2;
+	    EX_NEXT;
+	EX_LABEL(pop_g) EX_CASE(INS_POP | INS_HH_G)
+	    tmp = _ex_pop(c, err);
+	    dst = _ex_ref(c, regs, f, INS_HL_G, ins[i+1], err);
+	    if (dst == NULL) { return -1; }
+	    *dst = tmp;
+	    i += 2;
+	    EX_NEXT;
+	EX_LABEL(pop_c) EX_CASE(INS_POP | INS_HH_C)
+	    //discard values, this is used to remove variables at the end of a block
+	    n = ins[i+1].i;
+	    if (get_size(c->callstack) < n) {
+		sc_set_error(err, E_STACK_UNDERFLOW, "tried to pop from empty stack");
+		return -1;
+	    }
+	    c->callstack.top += n;
+	    i += 2;
+	    EX_NEXT;
+
+	//make strings and arrays
+	EX_LABEL(make_arr) EX_CASE(INS_MAKE_ARR)
+	    n = (size_t)(regs[0].val.i);
+	    regs[0].type = VT_ARRAY;
+	    regs[0].val.ptr = _make_Array(sizeof(value), n, err);
+	    i += 1;
+	    EX_NEXT;
+	EX_LABEL(make_str) EX_CASE(INS_MAKE_STR)
+	    n = (size_t)(regs[0].val.i);
+	    regs[0].type = VT_STRING;
+	    //allocate memory for the string
+	    regs[0].val.str = _alloc_String(n, err);
+	    if (err->type != E_SUCCESS) { return -1; }
+	    i += 1;
+	    EX_NEXT;
+	EX_LABEL(make_val) EX_CASE(INS_MAKE_VAL)
+	    if (ins[i+1].i == VT_STRING) {
+		regs[0] = v_make_string("", err);
+	    } else if (ins[i+1].i == VT_ARRAY) {
+		regs[0].type = VT_ARRAY;
+		regs[0].val.ptr = _make_Array(sizeof(value), DEF_ARR_N, err);
+	    } else if (ins[i+1].i == VT_FLOAT) {
+		regs[0].type = VT_FLOAT;
+		regs[0].val.f = 0.0;
+	    } else {
+		regs[0].type = ins[i+1].i;
+		regs[0].val.i = 0;
+	    }
+	    i += 2;
+	    EX_NEXT;
+
+	EX_LABEL(return) EX_CASE(INS_RETURN)
+	    if (_ex_return(f, c, c->base, err) < 0) { return -1; }
+	    if (c->n_frames == entry) { return 0; }
+	    //resume the caller
+	    c->n_frames -= 1;
+	    fr = c->frames + c->n_frames;
+	    f = fr->f;
+	    ins = f->buf.buf;
+	    i = fr->ret;
+	    c->base = fr->base;
+	    EX_NEXT;
+
+	//these instructions read from two banks so the switch matches on the instruction alone
+	EX_DEFAULT
+	EX_LABEL(mov) EX_CASE(INS_MOV)
+	    dst = _ex_ref(c, regs, f, (_ins_opcode(&(f->buf), i) & INS_HH) >> 2, ins[i+1], err);
+	    if (dst == NULL) { return -1; }
+	    src = _ex_ref(c, regs, f, _ins_opcode(&(f->buf), i) & INS_HL, ins[i+2], err);
+	    if (src == NULL) { return -1; }
+	    *dst = *src;
+	    i += 3;
+	    EX_NEXT;
+	EX_LABEL(ind_read) EX_CASE(INS_IND_READ)
+	    src = _ex_ref(c, regs, f, (_ins_opcode(&(f->buf), i) & INS_HH) >> 2, ins[i+1], err);
+	    ind = _ex_index(c, regs, f, _ins_opcode(&(f->buf), i) & INS_HL, ins[i+2], err);
+	    arr = _ex_array(src, (long)ind, err);
+	    if (arr == NULL) { return -1; }
+	    regs[0] = _get_a(arr, ind);
+	    i += 3;
+	    EX_NEXT;
+	EX_LABEL(ind_write) EX_CASE(INS_IND_WRITE)
+	    dst = _ex_ref(c, regs, f, (_ins_opcode(&(f->buf), i) & INS_HH) >> 2, ins[i+1], err);
+	    ind = _ex_index(c, regs, f, _ins_opcode(&(f->buf), i) & INS_HL, ins[i+2], err);
+	    arr = _ex_array(dst, (long)ind, err);
+	    if (arr == NULL) { return -1; }
+	    _set_a(arr, ind, regs[0], err);
+	    if (err->type != E_SUCCESS) { return -1; }
+	    i += 3;
+	    EX_NEXT;
+	EX_LABEL(get_size) EX_CASE(INS_GET_SIZE)
+	    src = _ex_ref(c, regs, f, (_ins_opcode(&(f->buf), i) & INS_HH) >> 2, ins[i+1], err);
+	    if (src == NULL) { return -1; }
+	    if (src->type != VT_ARRAY && src->type != VT_STRING) {
+		sc_set_error(err, E_BADTYPE, "");
+		snprintf(err->msg, DTG_MAX_MSG_SIZE, "Tried to take the size of non array type %d", src->type);
+		return -1;
+	    }
+	    regs[0] = v_make_int(len(*src), err);
+	    i += 2;
+	    EX_NEXT;
+	EX_LABEL(make_ptr) EX_CASE(INS_MAKE_PTR)
+	    if ((_ins_opcode(&(f->buf), i) & INS_HH) == INS_HH_G) {
+		//pointers to globals store the slot index with the top bit of the type set
+		regs[0].type = VT_REF | TOP_BIT;
+		regs[0].val.i = ins[i+1].i;
+	    } else if ((_ins_opcode(&(f->buf), i) & INS_HH) == INS_HH_S) {
+		//store the offset from the BOTTOM of the stack to ensure that pushing and popping won't result in alterations
+		ind = ins[i+1].i;
+		regs[0].type = VT_REF;
+		regs[0].val.i = c->callstack.bottom - _ex_slot(c, ind);
+	    } else {
+		sc_set_error(err, E_BADTYPE, "pointers may only reference stack or global values");
+		return -1;
+	    }
+	    i += 2;
+	    EX_NEXT;
+	EX_LABEL(ptr_drf) EX_CASE(INS_PTR_DRF)
+	    src = _ex_ref(c, regs, f, (_ins_opcode(&(f->buf), i) & INS_HH) >> 2, ins[i+1], err);
+	    if (src == NULL) { return -1; }
+	    if ((src->type & LO_NIB) != VT_REF) {
+		sc_set_error(err, E_BADTYPE, "");
+		snprintf(err->msg, DTG_MAX_MSG_SIZE, "Tried to dereference non pointer type %d", src->type);
+		return -1;
+	    }
+	    //if the top bit is set then this is a pointer to a global value
+	    if (src->type & TOP_BIT) {
+		if ((size_t)(src->val.i) >= c->global->n_slots || c->global->slots[src->val.i] == NULL) {
+		    sc_set_error(err, E_UNDEF, "dereferenced pointer to undefined global");
+		    return -1;
+		}
+		regs[0] = c->global->slots[src->val.i]->val;
+	    } else {
+		regs[0] = *(c->callstack.bottom - src->val.i);
+	    }
+	    i += 2;
+	    EX_NEXT;
+	EX_LABEL(bad) EX_CASE_DEFAULT
+	    sc_set_error(err, E_UNDEF, "");
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "unsupported instruction 0x%lx at %lu", _ins_opcode(&(f->buf), i), i);
+	    return -1;
+	EX_END_DEFAULT
+#ifndef SC_COMPUTED_GOTO
 	}
+	if (err->type != E_SUCCESS) { return -1; }
     }
+#endif
+}
 
-    return 0;
+/**
+ * Executes the function f using the context c to infer the stack and global variables. The context is altered by this proceedure as f pops arguments off of the stack (including the caller) and pushes returned values onto the stack.
+ */
+void _ex_begin(context* c, LiveContext* lc, sc_error* err) {
+    //the named stack is only used during compilation, values are moved onto an unnamed stack for execution. This stack is kept in the context between calls and is the only one allowed to grow to ST_MAX_SIZE
+    if (c->exec_stack.bottom == NULL) {
+	c->exec_stack = make_Stack_n(DEF_STACK_SIZE, ST_MAX_SIZE, err);
+	if (err->type != E_SUCCESS) { return; }
+    }
+    lc->global = &(c->global);
+    lc->callstack = c->exec_stack;
+    lc->base = 0;
+    lc->frames = NULL;
+    lc->n_frames = 0;
+    lc->frames_cap = 0;
+}
+
+void _ex_end(context* c, LiveContext* lc) {
+    //values on the execution stack are shallow copies, so we only discard the entries
+    lc->callstack.top = lc->callstack.bottom;
+    c->exec_stack = lc->callstack;
+    free(lc->frames);
+}
+
+void execute_function(context* c, function* f, sc_error* err) {
+    sc_reset_error(err);
+    if (get_size_n(c->callstack) < f->n_args) {
+	sc_set_error(err, E_STACK_UNDERFLOW, "not enough arguments supplied to function");
+	return;
+    }
+
+    LiveContext lc;
+    _ex_begin(c, &lc, err);
+    if (err->type != E_SUCCESS) { return; }
+    //the first argument is the deepest on the stack
+    for (size_t i = f->n_args; i > 0; --i) {
+	push(&(lc.callstack), c->callstack.top[i-1].val, err);
+	if (err->type != E_SUCCESS) { break; }
+    }
+    if (err->type == E_SUCCESS) {
+	//keys are owned by the caller so we only remove the entries
+	c->callstack.top += f->n_args;
+	_ex_func(f, &lc, err);
+    }
+    if (err->type == E_SUCCESS) {
+	for (size_t i = f->n_rets; i > 0; --i) {
+	    push_n(&(c->callstack), NULL, lc.callstack.top[i-1], err);
+	    if (err->type != E_SUCCESS) { break; }
+	}
+    }
+    _ex_end(c, &lc);
+}
+
+int call_function(context* c, function* f, const value* args, value* results, sc_error* err) {
+    sc_reset_error(err);
+    LiveContext lc;
+    _ex_begin(c, &lc, err);
+    if (err->type != E_SUCCESS) { return -1; }
+    for (size_t i = 0; i < f->n_args; ++i) {
+	_ex_push(&lc, args[i], err);
+	if (err->type != E_SUCCESS) { break; }
+    }
+    if (err->type == E_SUCCESS) {
+	_ex_func(f, &lc, err);
+    }
+    if (err->type == E_SUCCESS) {
+	//the first return value is the deepest on the stack
+	for (size_t i = 0; i < f->n_rets; ++i) {
+	    results[i] = lc.callstack.top[f->n_rets-1-i];
+	}
+    }
+    _ex_end(c, &lc);
+    return (err->type == E_SUCCESS)? (int)f->n_rets : -1;
 }
 
-#ifdef __cplusplus 
+#ifdef __cplusplus
 }
 #endif
@@ -3,33 +3,135 @@
 
 #include "operations.h"
 
-#ifdef __cplusplus 
+#ifdef __cplusplus
 extern "C" {
 #endif
 
 #define N_REGISTERS	4
+#define DEF_N_FRAMES	16
+#define MAX_CALL_DEPTH	(1 << 20)//calls nested deeper than this fail with E_STACK_OVERFLOW
+
+//GCC and clang support taking the address of labels which allows _ex_func to jump directly between instruction handlers. Define SC_NO_COMPUTED_GOTO to use the portable switch dispatch instead.
+#if defined(__GNUC__) && !defined(SC_NO_COMPUTED_GOTO)
+#define SC_COMPUTED_GOTO
+#endif
+
+/**
+ * A Frame records the state of a function which called another function so that it can be resumed once the call returns.
+ * f: the calling function
+ * ret: the index of the instruction in f to resume from
+ * base: the base of the frame of f, see LiveContext
+ */
+typedef struct s_Frame {
+    function* f;
+    size_t ret;
+    size_t base;
+} Frame;
 
 /**
- * The LiveContext struct describes the state of the program at a given point in time. Its primary purpose is to hold the program stack and translate "heap" variable names into usable Value structs. This differs from the Context struct in that the callstack is not named and only referenced by index.
+ * The LiveContext struct describes the state of the program at a given point in time. Its primary purpose is to hold the program stack and translate "heap" variable names into usable value structs. This differs from the context struct in that the callstack is not named and only referenced by index. The global table is shared with the context the function was compiled in.
+ * base: the number of values on the callstack beneath the first argument of the executing function. Stack slots are measured upwards from this point, so slot 0 is the first argument.
+ * frames: the frame stack which holds one Frame for every call that hasn't yet returned. Calls don't recurse on the native stack.
  */
 typedef struct s_LiveContext {
     Stack callstack;
-    HashTable global;
+    HashTable* global;
+    size_t base;
+    Frame* frames;
+    size_t n_frames;
+    size_t frames_cap;
 } LiveContext;
 
 // ==================================== FUNCTION EXECUTION ====================================
 
 /**
- * Helper function to read the value stored at the stack index ind.
+ * Helper function which returns a pointer to the value in the specified slot of the frame of the executing function.
+ */
+static inline value* _ex_slot(LiveContext* c, size_t slot) {
+    return c->callstack.bottom - 1 - c->base - slot;
+}
+
+/**
+ * Helper function which pushes v onto the stack of c. Growing the stack is left to push().
  */
-Value _fetch_from_stack(LiveContext* c, size_t ind);
+static inline void _ex_push(LiveContext* c, value v, sc_error* err) {
+    if (c->callstack.top > c->callstack.block) {
+	c->callstack.top -= 1;
+	*(c->callstack.top) = v;
+    } else {
+	push(&(c->callstack), v, err);
+    }
+}
+
+/**
+ * Helper function which pops the top value off of the stack of c. Errors are left to pop().
+ */
+static inline value _ex_pop(LiveContext* c, sc_error* err) {
+    if (c->callstack.top < c->callstack.bottom) { return *(c->callstack.top++); }
+    return pop(&(c->callstack), err);
+}
+
+/**
+ * Helper function which doubles the capacity of the frame stack of c. Calls nested deeper than MAX_CALL_DEPTH fail with E_STACK_OVERFLOW.
+ * Returns: 0 on success or -1 on error
+ */
+int _ex_grow_frames(LiveContext* c, sc_error* err);
+
+/**
+ * Helper function which prepares lc to execute on the value stack saved in c. The stack is created on first use.
+ */
+void _ex_begin(context* c, LiveContext* lc, sc_error* err);
+
+/**
+ * Helper function which hands the value stack used by lc back to c and releases the frames of lc.
+ */
+void _ex_end(context* c, LiveContext* lc);
+
+/**
+ * Helper function which pushes a Frame for the function f onto the frame stack of c and starts a new frame for the function fn whose arguments are on top of the stack. Execution of f resumes from the instruction ret once fn returns. The arguments stay where they are and become the first slots of the new frame.
+ * Returns: 0 on success or -1 on error
+ */
+static inline int _ex_enter(LiveContext* c, function* fn, function* f, size_t ret, sc_error* err) {
+    size_t size = get_size(c->callstack);
+    if (size < c->base + fn->n_args) {
+	sc_set_error(err, E_STACK_UNDERFLOW, "not enough arguments supplied to function");
+	return -1;
+    }
+    if (c->n_frames == c->frames_cap && _ex_grow_frames(c, err) < 0) { return -1; }
+    Frame* fr = c->frames + c->n_frames;
+    fr->f = f;
+    fr->ret = ret;
+    fr->base = c->base;
+    c->n_frames += 1;
+    c->base = size - fn->n_args;
+    return 0;
+}
+
+/**
+ * Helper function which replaces the frame of the executing function by a frame for the function fn whose arguments are on top of the stack. No Frame is pushed, so fn returns directly to the caller of the executing function. The caller must check that there are at least n_args values in the current frame.
+ */
+static inline void _ex_tail(LiveContext* c, function* fn) {
+    //the stack grows downwards so the arguments move up to the start of the frame
+    value* dst = c->callstack.bottom - c->base - fn->n_args;
+    memmove(dst, c->callstack.top, sizeof(value)*(fn->n_args));
+    c->callstack.top = dst;
+}
+
+#ifdef SC_COMPUTED_GOTO
+/**
+ * Rewrites the instruction buffer buf in place so that every opcode is replaced by the address of its handler in the table dispatch (indexed by opcode). The original opcodes are saved in buf->opcodes. A return instruction is always stored just past the last instruction (without counting it in n_insts) so that neither falling off the end nor a jump to n_insts can run past the end of the buffer.
+ * Returns: 0 on success or -1 on error
+ */
+int _ex_thread(instruction_buffer* buf, void* const* dispatch, sc_error* err);
+#endif
 
 /**
- * Execute the already created function f within the runtime Context c.
+ * Execute the already created function f within the runtime context c. The arguments to f should be the top values on the stack. On return they are replaced by the values returned from f. When computed gotos are available the instruction buffer of f is threaded the first time it is executed.
+ * Returns: 0 on success or -1 on error
  */
-int _ex_func(Function f, LiveContext* c, DTG_Error* err);
+int _ex_func(function* f, LiveContext* c, sc_error* err);
 
-#ifdef __cplusplus 
+#ifdef __cplusplus
 }
 #endif
 
@@ -12,8 +12,8 @@ int main() {
     sc_error err;
     char result[100];
     printf("true: %d, false: %d\n", v_fetch_bool(test_bool_true, &err), v_fetch_bool(test_bool_false, &err));
-    printf("test_int: int: %d, float: %f\n", v_fetch_int(test_int, &err), v_fetch_float(test_int, &err));
-    printf("test_float: int: %d, float: %f\n", v_fetch_int(test_float, &err), v_fetch_float(test_float, &err));
+    printf("test_int: int: %lld, float: %f\n", (long long)v_fetch_int(test_int, &err), v_fetch_float(test_int, &err));
+    printf("test_float: int: %lld, float: %f\n", (long long)v_fetch_int(test_float, &err), v_fetch_float(test_float, &err));
     v_fetch_string(test_bool_true, result, 100, &err);
     printf("%s\n", result);
     v_fetch_string(test_bool_false, result, 100, &err);
@@ -1,5 +1,9 @@
 #include "operations.h"
 
+#ifdef SC_SIMD_X86
+#include <immintrin.h>
+#endif
+
 #ifdef __cplusplus 
 extern "C" {
 #endif
@@ -11,8 +15,8 @@ extern "C" {
  *  Behaviours:
  *  string a, (any type b): Converts b into a string representation and appends the result to the end of a.
  *  float a, float b or int a, float b or float a, int b: If either a or b is a floating point value, the result is guaranteed to be a floating point type with value a+b.
- *  int a, int b: Returns a+b
- *  array a, (any type b): This is an invalid operation unless the type of b matches the type stored in a, in which case a deep copy of b is made and appended to the end of a.
+ *  int a, int b: Returns a+b, wrapping around on overflow
+ *  array a, (array or scalar b) or scalar a, array b: Adds element-wise and returns a new array which must be freed. Two arrays must have the same length, while a scalar is broadcast by adding it to every element. Each element of the result is identical to op_add() applied to the corresponding elements, see _op_array().
  *  bool a, bool b: invalid
  */
 value op_add(value a, value b, sc_error* err) {sc_reset_error(err);
@@ -24,11 +28,7 @@ value op_add(value a, value b, sc_error* err) {sc_reset_error(err);
 	ret.type = VT_ERROR;
 	return ret;
     }
-    if (a.type == VT_ARRAY || (b.type == VT_ARRAY && a.type != VT_STRING)) {
-	sc_set_error(err, E_BADTYPE, "can't perform addition on array values");
-	ret.type = VT_ERROR;
-	return ret;
-    }
+    if (a.type == VT_ARRAY || (b.type == VT_ARRAY && a.type != VT_STRING)) { return _op_array(OP_ADD, a, b, err); }
     if (a.type == VT_BOOL || (b.type == VT_BOOL && a.type != VT_STRING)) {
 	sc_set_error(err, E_BADTYPE, "can't perform addition on boolean values");
 	ret.type = VT_ERROR;
@@ -37,90 +37,77 @@ value op_add(value a, value b, sc_error* err) {sc_reset_error(err);
 
     //handling strings is rather complicated...
     if (a.type == VT_STRING) {
-	ret.type = VT_STRING;
-	ret.val.str = (String*)sc_malloc(sizeof(String), err);
-	if (err->type != E_SUCCESS) {
-	    ret.type = VT_ERROR;
-	    return ret;
-	}
-	String* str = ret.val.str;
-
+	//b is formatted first and then appended to a. Repeatedly appending to the same string shares a builder so each concatenation takes amortized constant time, see _concat_s()
+	const char* b_str = "";
+	size_t b_size = 0;
+	char num_buf[4*STRING_SMALL_SIZE];
+	String* tmp_str = NULL;
 	if (b.type == VT_STRING) {
-	    //figure out the length of the output array and allocate memory
-	    str->buf_size = a.val.str->size + b.val.str->size + 1;
-	    str->size = str->buf_size - 1;
-	    str->buf = (char*)sc_malloc(sizeof(char)*(str->buf_size), err);
-	    //copy memory from the old a string
-	    strncpy(str->buf, a.val.str->buf, a.val.str->size);
-	    //copy memory from the old b string to the end of the last string
-	    strncpy(str->buf + a.val.str->size, b.val.str->buf, b.val.str->size);
-	    str->buf[str->size] = 0;
+	    b_str = b.val.str->buf;
+	    b_size = b.val.str->size;
 	} else if (b.type == VT_ARRAY) {
 	    Array* b_arr = (Array*)(b.val.ptr);
-	    //let n be the size of the array and m be the number of bytes for the contents of each value we allocate 3 bytes for the '[', ']', and NULL characters. According to the fencepost rule there are n-1 separators (each given two characters) so the total allocated should be m*n + 2*(n-1) + 3 = n*(m+2) + 1.
-	    //This is only a heuristic, we must call _grow_s during execution
-	    ret.val.str->buf_size = (b_arr->size)*(DEF_ELEMENT_CHARS) + 1;
-	    ret.val.str->size = 0;
-	    //allocate memory
-	    ret.val.str->buf = (char*)sc_malloc(sizeof(char)*(ret.val.str->buf_size), err);
-	    //copy memory from the old a string
-	    strncpy(ret.val.str->buf, a.val.str->buf, a.val.str->size);
-	    
-	    size_t off = a.val.str->size;
-	    ret.val.str->buf[off] = '[';
-	    ++off;
+	    //let n be the size of the array and m be the number of bytes for the contents of each value we allocate 3 bytes for the '[', ']', and NULL characters. According to the fencepost rule there are n-1 separators (each given two characters) so the total allocated should be m*n + 2*(n-1) + 3 = n*(m+2) + 1. This is only a heuristic and we must call _grow_s while writing.
+	    tmp_str = _alloc_String(b_arr->size*(DEF_ELEMENT_CHARS + 2) + 3, err);
+	    if (tmp_str == NULL) {
+		ret.type = VT_ERROR;
+		return ret;
+	    }
+	    tmp_str->buf[tmp_str->size++] = '[';
 	    for (size_t i = 0; i < b_arr->size; ++i) {
-		size_t cur_ele_size = get_format_string_size(((value*)b_arr->buf)[i], DEF_FLOAT_PRECISION);
+		value cur_ele = _get_a(b_arr, i);
+		size_t cur_ele_size = get_format_string_size(cur_ele, DEF_FLOAT_PRECISION);
 		// +2 for the separators between strings
-		_grow_s(ret.val.str, cur_ele_size + 2, err);
-		off += v_fetch_string(((value*)b_arr->buf)[i], ret.val.str->buf + off, cur_ele_size, err);
+		_grow_s(tmp_str, cur_ele_size + 2, err);
+		if (err->type == E_SUCCESS) {
+		    tmp_str->size += v_fetch_string(cur_ele, tmp_str->buf + tmp_str->size, cur_ele_size, err);
+		}
 		if (err->type != E_SUCCESS) {
+		    free_String(tmp_str);
+		    sc_free(tmp_str);
 		    ret.type = VT_ERROR;
 		    return ret;
 		}
 		//only write a ',' if we aren't at the end of the list
 		if (i < b_arr->size - 1) {
-		    ret.val.str->buf[off] = ',';ret.val.str->buf[off+1] = ' ';off += 2;
+		    tmp_str->buf[tmp_str->size] = ',';tmp_str->buf[tmp_str->size+1] = ' ';tmp_str->size += 2;
 		}
 	    }
-	    //write the end of the array and update the size of the string
-	    ret.val.str->buf[off] = ']';ret.val.str->buf[off+1] = 0;
-	    ret.val.str->size = off+1;//include the ']'
-	    str = ret.val.str;
+	    //write the end of the array
+	    tmp_str->buf[tmp_str->size] = ']';tmp_str->buf[tmp_str->size+1] = 0;
+	    tmp_str->size += 1;
+	    b_str = tmp_str->buf;
+	    b_size = tmp_str->size;
 	} else if (b.type == VT_INT || b.type == VT_FLOAT) {
-	    //figure out the length of the output array and allocate memory
-	    int n_num_bytes = get_format_string_size(b, DEF_FLOAT_PRECISION) + 1;
-	    str->buf_size = len(a) + n_num_bytes;
-	    str->size = str->buf_size - 1;
-	    str->buf = (char*)sc_malloc(sizeof(char)*(str->buf_size), err);
-	    //copy memory from the old a string
-	    strncpy(str->buf, a.val.str->buf, a.val.str->size);
-	    str->buf[str->size] = 0;
-
-	    //copy the integer value into the end of the string
-	    v_fetch_string(b, str->buf + a.val.str->size, n_num_bytes, err);
-	    //check for errors and free memory if necessary
+	    size_t n_num_bytes = get_format_string_size(b, DEF_FLOAT_PRECISION) + 1;
+	    char* buf = num_buf;
+	    //very large floats may not fit in the local buffer
+	    if (n_num_bytes > sizeof(num_buf)) {
+		tmp_str = _alloc_String(n_num_bytes, err);
+		if (tmp_str == NULL) {
+		    ret.type = VT_ERROR;
+		    return ret;
+		}
+		buf = tmp_str->buf;
+	    }
+	    //the size is only an upper bound, so the number of bytes actually written is appended
+	    int n_written = v_fetch_string(b, buf, n_num_bytes, err);
 	    if (err->type != E_SUCCESS) {
-		sc_free(str->buf);
+		if (tmp_str) { free_String(tmp_str);sc_free(tmp_str); }
 		ret.type = VT_ERROR;
 		return ret;
 	    }
+	    b_str = buf;
+	    b_size = (size_t)n_written;
 	} else if (b.type == VT_BOOL) {
-	    //alocate memory for the string buffer
-	    str->buf_size = len(a) + BOOL_STRING_GROW;
-	    str->size = str->buf_size;
-	    str->buf = (char*)sc_malloc(sizeof(char)*(str->buf_size), err);
-	    //copy memory from the old a string
-	    strncpy(str->buf, a.val.str->buf, a.val.str->size);
-	    //depending on the value store strings "true" or "false" and set size accordingly
-	    if (b.val.i == 0) {
-		strncpy(str->buf + a.val.str->size, "false", BOOL_STRING_GROW);
-	    } else {
-		strncpy(str->buf + a.val.str->size, "true", BOOL_STRING_GROW-1);
-		str->size -= 1;//"false" is one character longer than "true"
-	    }
-	    str->buf[str->buf_size - 1] = 0;
+	    //depending on the value store strings "true" or "false"
+	    b_str = (b.val.i == 0)? "false" : "true";
+	    b_size = strlen(b_str);
 	}
+	ret.type = VT_STRING;
+	ret.val.str = _concat_s(a.val.str, b_str, b_size, err);
+	if (tmp_str) { free_String(tmp_str);sc_free(tmp_str); }
+	if (ret.val.str == NULL) { ret.type = VT_ERROR; }
 	return ret;
     }
     if (a.type == VT_FLOAT || b.type == VT_FLOAT) {
@@ -134,13 +121,13 @@ value op_add(value a, value b, sc_error* err) {sc_reset_error(err);
 	return ret;
     }
     //chars and ints are actually the same type at a lower level (both are stored as ints).
-    int a_val = v_fetch_int(a, err);
+    sc_int a_val = v_fetch_int(a, err);
     if (err->type != E_SUCCESS) { return ret; }
-    int b_val = v_fetch_int(b, err);
+    sc_int b_val = v_fetch_int(b, err);
     if (err->type != E_SUCCESS) { return ret; }
 
-    //set the type and value
-    ret.val.i = a_val + b_val;
+    //set the type and value. The arithmetic is unsigned so that overflow wraps around instead of being undefined
+    ret.val.i = (sc_int)((sc_uint)a_val + (sc_uint)b_val);
     //default to char if either value is a char
     if (a.type == VT_CHAR || b.type == VT_CHAR) {
 	ret.type = VT_CHAR;
@@ -154,8 +141,8 @@ value op_add(value a, value b, sc_error* err) {sc_reset_error(err);
  *  Creates a new value object which holds the result of the subtraction operation applied to a and b. The behaviour depends upon the types of a and b.
  *  Behaviours:
  *  float a, float b or int a, float b or float a, int b: If either a or b is a floating point value, the result is guaranteed to be a floating point type with value a-b.
- *  int a, int b: Returns a-b
- *  array a, (any type b): invalid
+ *  int a, int b: Returns a-b, wrapping around on overflow
+ *  array a, (array or scalar b) or scalar a, array b: Subtracts element-wise and returns a new array which must be freed. Two arrays must have the same length, while a scalar is broadcast to every element (so 1 - [1, 2] is [0, -1]). Each element of the result is identical to op_sub() applied to the corresponding elements, see _op_array().
  *  string a, (any type b): invalid
  *  bool a, bool b: invalid
  */
@@ -168,11 +155,7 @@ value op_sub(value a, value b, sc_error* err) {sc_reset_error(err);
 	ret.type = VT_ERROR;
 	return ret;
     }
-    if (a.type == VT_ARRAY || b.type == VT_ARRAY) {
-	sc_set_error(err, E_BADTYPE, "can't perform addition on array values");
-	ret.type = VT_ERROR;
-	return ret;
-    }
+    if (a.type == VT_ARRAY || b.type == VT_ARRAY) { return _op_array(OP_SUB, a, b, err); }
     if (a.type == VT_BOOL || b.type == VT_BOOL) {
 	sc_set_error(err, E_BADTYPE, "can't perform addition on boolean values");
 	ret.type = VT_ERROR;
@@ -194,13 +177,13 @@ value op_sub(value a, value b, sc_error* err) {sc_reset_error(err);
 	return ret;
     }
     //chars and ints are actually the same type at a lower level (both are stored as ints).
-    int a_val = v_fetch_int(a, err);
+    sc_int a_val = v_fetch_int(a, err);
     if (err->type != E_SUCCESS) { return ret; }
-    int b_val = v_fetch_int(b, err);
+    sc_int b_val = v_fetch_int(b, err);
     if (err->type != E_SUCCESS) { return ret; }
 
-    //set the type and value
-    ret.val.i = a_val - b_val;
+    //set the type and value. The arithmetic is unsigned so that overflow wraps around instead of being undefined
+    ret.val.i = (sc_int)((sc_uint)a_val - (sc_uint)b_val);
     //default to char if either value is a char
     if (a.type == VT_CHAR || b.type == VT_CHAR) {
 	ret.type = VT_CHAR;
@@ -214,8 +197,8 @@ value op_sub(value a, value b, sc_error* err) {sc_reset_error(err);
  *  Creates a new value object which holds the result of the multiply operation applied to a and b. The behaviour depends upon the types of a and b.
  *  Behaviours:
  *  float a, float b or int a, float b or float a, int b: If either a or b is a floating point value, the result is guaranteed to be a floating point type with value a*b.
- *  int a, int b: Returns a*b
- *  array a, (float or int b): Performs a scalar multiply to each element of a so that for each element e of a the new array has the same value as a call to mult(e, a) would. Note that a deep copy of the data is performed, so changes to a may be made safely and the result must be freed.
+ *  int a, int b: Returns a*b, wrapping around on overflow
+ *  array a, (array or scalar b) or scalar a, array b: Multiplies element-wise and returns a new array which must be freed. Two arrays must have the same length, while a scalar is broadcast to every element. Each element of the result is identical to op_mult() applied to the corresponding elements, see _op_array().
  *  string a, (any type b): invalid
  *  bool a, bool b: invalid
  */
@@ -228,11 +211,7 @@ value op_mult(value a, value b, sc_error* err) {sc_reset_error(err);
 	ret.type = VT_ERROR;
 	return ret;
     }
-    if (a.type == VT_ARRAY || b.type == VT_ARRAY) {
-	sc_set_error(err, E_BADTYPE, "can't perform multiplication on array values");
-	ret.type = VT_ERROR;
-	return ret;
-    }
+    if (a.type == VT_ARRAY || b.type == VT_ARRAY) { return _op_array(OP_MULT, a, b, err); }
     if (a.type == VT_BOOL || b.type == VT_BOOL) {
 	sc_set_error(err, E_BADTYPE, "can't perform multiplication on boolean values");
 	ret.type = VT_ERROR;
@@ -261,12 +240,13 @@ value op_mult(value a, value b, sc_error* err) {sc_reset_error(err);
 	return ret;
     }
     //chars and ints are actually the same type at a lower level (both are stored as ints).
-    int a_val = v_fetch_int(a, err);
+    sc_int a_val = v_fetch_int(a, err);
     if (err->type != E_SUCCESS) { return ret; }
-    int b_val = v_fetch_int(b, err);
+    sc_int b_val = v_fetch_int(b, err);
     if (err->type != E_SUCCESS) { return ret; }
     ret.type = VT_INT;
-    ret.val.i = a_val * b_val;
+    //the arithmetic is unsigned so that overflow wraps around instead of being undefined
+    ret.val.i = (sc_int)((sc_uint)a_val * (sc_uint)b_val);
 
     return ret;
 }
@@ -275,8 +255,8 @@ value op_mult(value a, value b, sc_error* err) {sc_reset_error(err);
  *  Creates a new value object which holds the result of the divide operation applied to a and b. The behaviour depends upon the types of a and b.
  *  Behaviours:
  *  float a, float b or int a, float b or float a, int b: If either a or b is a floating point value, the result is guaranteed to be a floating point type with value a/b.
- *  int a, int b: Returns the greatest integer less than a/b (i.e. floor(a/b)).
- *  array a, (float or int b): Performs a scalar multiply to each element of a so that for each element e of a the new array has the same value as a call to mult(e, a) would.
+ *  int a, int b: Returns a/b rounded toward zero. SC_INT_MIN/-1 wraps around to SC_INT_MIN.
+ *  array a, (array or scalar b) or scalar a, array b: Divides element-wise and returns a new array which must be freed. Two arrays must have the same length, while a scalar is broadcast to every element. Each element of the result is identical to op_div() applied to the corresponding elements, so a zero divisor in any element is an error just as for scalars, see _op_array().
  *  string a, (any type b): invalid
  *  bool a, bool b: invalid
  */
@@ -289,11 +269,7 @@ value op_div(value a, value b, sc_error* err) {sc_reset_error(err);
 	ret.type = VT_ERROR;
 	return ret;
     }
-    if (a.type == VT_ARRAY || b.type == VT_ARRAY) {
-	sc_set_error(err, E_BADTYPE, "can't perform division on array values");
-	ret.type = VT_ERROR;
-	return ret;
-    }
+    if (a.type == VT_ARRAY || b.type == VT_ARRAY) { return _op_array(OP_DIV, a, b, err); }
     if (a.type == VT_BOOL || b.type == VT_BOOL) {
 	sc_set_error(err, E_BADTYPE, "can't perform division on boolean values");
 	ret.type = VT_ERROR;
@@ -328,9 +304,9 @@ value op_div(value a, value b, sc_error* err) {sc_reset_error(err);
 	return ret;
     }
     //chars and ints are actually the same type at a lower level (both are stored as ints).
-    int a_val = v_fetch_int(a, err);
+    sc_int a_val = v_fetch_int(a, err);
     if (err->type != E_SUCCESS) { return ret; }
-    int b_val = v_fetch_int(b, err);
+    sc_int b_val = v_fetch_int(b, err);
     if (err->type != E_SUCCESS) { return ret; }
     //check for division by zero
     if (b_val == 0) {
@@ -338,9 +314,9 @@ value op_div(value a, value b, sc_error* err) {sc_reset_error(err);
 	ret.type = VT_ERROR;
 	return ret;  
     }
-    //set the type and value
+    //set the type and value. Dividing SC_INT_MIN by -1 wraps around like the other integer operations instead of trapping
     ret.type = VT_INT;
-    ret.val.i = a_val / b_val;
+    ret.val.i = (b_val == -1)? (sc_int)(0 - (sc_uint)a_val) : a_val / b_val;
 
     return ret;
 }
@@ -393,10 +369,7 @@ value op_eq(value a, value b, sc_error* err) {sc_reset_error(err);
 	ret.val.i = 0;
 	//if they are of unequal length then we know they aren't equal
 	if (a.val.str->size != b.val.str->size) { return ret; }
-	for (size_t i = 0; i < a.val.str->size; ++i) {
-	    if (a.val.str->buf[i] != b.val.str->buf[i]) { return ret; }
-	}
-	ret.val.i = 1;
+	ret.val.i = (memcmp(a.val.str->buf, b.val.str->buf, a.val.str->size) == 0);
     } else {
 	sc_set_error(err, E_BADTYPE, "can't compare types");
 	ret.type = VT_ERROR;
@@ -410,8 +383,13 @@ value op_eq(value a, value b, sc_error* err) {sc_reset_error(err);
 	Array* arr_b = (Array*)b.val.ptr;
 	//if they are of unequal length then we know they aren't equal
 	if (arr_a->size != arr_b->size) { return ret; }
+	//unboxed integers are equal exactly when their bytes are, floats need an element-wise comparison for -0.0 and NaN
+	if (arr_a->element_type == arr_b->element_type && arr_a->element_type != VT_UNDEF && arr_a->element_type != VT_FLOAT) {
+	    ret.val.i = (arr_a->size == 0 || memcmp(arr_a->buf, arr_b->buf, (arr_a->el_size)*(arr_a->size)) == 0);
+	    return ret;
+	}
 	for (size_t i = 0; i < arr_a->size; ++i) {
-	    value tmp_ret = op_eq(arr_a->buf[i], arr_b->buf[i], err);
+	    value tmp_ret = op_eq(_get_a(arr_a, i), _get_a(arr_b, i), err);
 	    //an invalid comparison should result in a false evaluation rather than throwing an error
 	    if (err->type != E_SUCCESS) {
 		sc_reset_error(err);
@@ -433,18 +411,14 @@ value op_eq(value a, value b, sc_error* err) {sc_reset_error(err);
  *  Creates a new boolean value object which is set to true if a is greater than b.
  *  Behaviours:
  *  numeric a, numeric b: returns if the values are equal, note that integers are cast to floats for comparison
- *  arrays invalid
+ *  array a, (array or scalar b) or scalar a, array b: compares element-wise and returns an array of bools, see _op_array().
  *  strings a, b: returns true if a comes before b alphabetically
  *  bool a, bool b: invalid
  */
 value op_grt(value a, value b, sc_error* err) {sc_reset_error(err);
     value ret = {0};
     ret.type = VT_BOOL;
-    if (a.type == VT_ARRAY || b.type == VT_ARRAY) {
-	ret.type = VT_ERROR;
-	sc_set_error(err, E_BADTYPE, "Can't use '>' to compare arrays");
-	return ret;
-    }
+    if (a.type == VT_ARRAY || b.type == VT_ARRAY) { return _op_array(OP_GRT, a, b, err); }
     if (a.type == VT_BOOL || b.type == VT_BOOL) {
 	ret.type = VT_ERROR;
 	sc_set_error(err, E_BADTYPE, "Can't use '>' to compare boolean values");
@@ -475,7 +449,7 @@ value op_grt(value a, value b, sc_error* err) {sc_reset_error(err);
 	ret.val.i = 0;
 	//if they are of unequal length then we know they aren't equal
 	if (a.val.str->size < b.val.str->size) { return ret; }
-	int tmp = strcmp(a.val.str->buf, b.val.str->buf);
+	int tmp = _compare_s(a.val.str, b.val.str);
 	if (tmp > 0) { ret.val.i = 1; }
     } else {
 	sc_set_error(err, E_BADTYPE, "can't compare types");
@@ -490,7 +464,7 @@ value op_grt(value a, value b, sc_error* err) {sc_reset_error(err);
  *  Creates a new boolean value object which is set to true if a is greater than or equal to b.
  *  Behaviours:
  *  numeric a, numeric b: returns if the values are equal, note that integers are cast to floats for comparison
- *  arrays invalid
+ *  array a, (array or scalar b) or scalar a, array b: compares element-wise and returns an array of bools, see _op_array().
  *  strings a, b: returns true if a comes before b alphabetically
  *  bool a, bool b: invalid
  *  NOTE: there is no low level implementation of < or <=, these are evaluated by reversing parameters.
@@ -498,11 +472,7 @@ value op_grt(value a, value b, sc_error* err) {sc_reset_error(err);
 value op_geq(value a, value b, sc_error* err) {sc_reset_error(err);
     value ret = {0};
     ret.type = VT_BOOL;
-    if (a.type == VT_ARRAY || b.type == VT_ARRAY) {
-	ret.type = VT_ERROR;
-	sc_set_error(err, E_BADTYPE, "Can't use '>=' to compare arrays");
-	return ret;
-    }
+    if (a.type == VT_ARRAY || b.type == VT_ARRAY) { return _op_array(OP_GEQ, a, b, err); }
     if (a.type == VT_BOOL || b.type == VT_BOOL) {
 	ret.type = VT_ERROR;
 	sc_set_error(err, E_BADTYPE, "Can't use '>=' to compare boolean values");
@@ -533,7 +503,7 @@ value op_geq(value a, value b, sc_error* err) {sc_reset_error(err);
 	ret.val.i = 0;
 	//if they are of unequal length then we know they aren't equal
 	if (a.val.str->size <= b.val.str->size) { return ret; }
-	int tmp = strcmp(a.val.str->buf, b.val.str->buf);
+	int tmp = _compare_s(a.val.str, b.val.str);
 	if (tmp >= 0) { ret.val.i = 1; }
     } else {
 	sc_set_error(err, E_BADTYPE, "can't compare types");
@@ -544,8 +514,284 @@ value op_geq(value a, value b, sc_error* err) {sc_reset_error(err);
     return ret;
 }
 
+// ============================ ELEMENT-WISE ARRAY OPERATIONS ============================
+
+/**
+ * Helper function which applies op to elements i through n-1 of the float operands a and b. Operands are read with the strides sa and sb so that a stride of 0 broadcasts a scalar. Arithmetic results are written to out as doubles and comparisons as chars.
+ */
+void _vec_ff(Optype_e op, const double* a, size_t sa, const double* b, size_t sb, void* out, size_t i, size_t n) {
+    double* of = (double*)out;
+    char* ob = (char*)out;
+    switch (op) {
+	case OP_ADD: for (; i < n; ++i) { of[i] = a[i*sa] + b[i*sb]; } break;
+	case OP_SUB: for (; i < n; ++i) { of[i] = a[i*sa] - b[i*sb]; } break;
+	case OP_MULT: for (; i < n; ++i) { of[i] = a[i*sa] * b[i*sb]; } break;
+	case OP_DIV: for (; i < n; ++i) { of[i] = a[i*sa] / b[i*sb]; } break;
+	case OP_GRT: for (; i < n; ++i) { ob[i] = (a[i*sa] > b[i*sb]); } break;
+	case OP_GEQ: for (; i < n; ++i) { ob[i] = (a[i*sa] >= b[i*sb]); } break;
+	default: break;
+    }
+}
+
+/**
+ * Helper function which applies op to elements i through n-1 of the integer operands a and b. This behaves identically to _vec_ff(). Addition, subtraction, multiplication and SC_INT_MIN/-1 wrap on overflow.
+ */
+void _vec_ii(Optype_e op, const sc_int* a, size_t sa, const sc_int* b, size_t sb, void* out, size_t i, size_t n) {
+    sc_int* oi = (sc_int*)out;
+    char* ob = (char*)out;
+    switch (op) {
+	case OP_ADD: for (; i < n; ++i) { oi[i] = (sc_int)((sc_uint)a[i*sa] + (sc_uint)b[i*sb]); } break;
+	case OP_SUB: for (; i < n; ++i) { oi[i] = (sc_int)((sc_uint)a[i*sa] - (sc_uint)b[i*sb]); } break;
+	case OP_MULT: for (; i < n; ++i) { oi[i] = (sc_int)((sc_uint)a[i*sa] * (sc_uint)b[i*sb]); } break;
+	case OP_DIV: for (; i < n; ++i) { oi[i] = (b[i*sb] == -1)? (sc_int)(0 - (sc_uint)a[i*sa]) : a[i*sa] / b[i*sb]; } break;
+	case OP_GRT: for (; i < n; ++i) { ob[i] = (a[i*sa] > b[i*sb]); } break;
+	case OP_GEQ: for (; i < n; ++i) { ob[i] = (a[i*sa] >= b[i*sb]); } break;
+	default: break;
+    }
+}
+
+#ifdef SC_SIMD_X86
+//stamps out a loop over blocks of W elements which loads the operands into va and vb (unless they are broadcast scalars) and then evaluates BODY
+#define VEC_LOOP(W, LOAD, BODY) for (; i + (W) <= n; i += (W)) {\
+	if (sa) { va = LOAD(a + i); }\
+	if (sb) { vb = LOAD(b + i); }\
+	BODY;\
+    }
+//write the lowest W bits of the mask m to W consecutive bools starting at index i
+#define VEC_BOOLS2(m) ob[i] = (m) & 1;ob[i+1] = ((m) >> 1) & 1
+#define VEC_BOOLS4(m) VEC_BOOLS2(m);ob[i+2] = ((m) >> 2) & 1;ob[i+3] = ((m) >> 3) & 1
+
+/**
+ * SSE2 version of _vec_ff(). The remaining elements which don't fill a vector must be handled by _vec_ff().
+ * Returns: the number of elements which were processed
+ */
+size_t _vec_ff_sse2(Optype_e op, const double* a, size_t sa, const double* b, size_t sb, void* out, size_t n) {
+    double* of = (double*)out;
+    char* ob = (char*)out;
+    __m128d va = _mm_set1_pd(a[0]);
+    __m128d vb = _mm_set1_pd(b[0]);
+    size_t i = 0;
+    int m;
+    switch (op) {
+	case OP_ADD: VEC_LOOP(2, _mm_loadu_pd, _mm_storeu_pd(of + i, _mm_add_pd(va, vb))) break;
+	case OP_SUB: VEC_LOOP(2, _mm_loadu_pd, _mm_storeu_pd(of + i, _mm_sub_pd(va, vb))) break;
+	case OP_MULT: VEC_LOOP(2, _mm_loadu_pd, _mm_storeu_pd(of + i, _mm_mul_pd(va, vb))) break;
+	case OP_DIV: VEC_LOOP(2, _mm_loadu_pd, _mm_storeu_pd(of + i, _mm_div_pd(va, vb))) break;
+	case OP_GRT: VEC_LOOP(2, _mm_loadu_pd, m = _mm_movemask_pd(_mm_cmpgt_pd(va, vb));VEC_BOOLS2(m)) break;
+	case OP_GEQ: VEC_LOOP(2, _mm_loadu_pd, m = _mm_movemask_pd(_mm_cmpge_pd(va, vb));VEC_BOOLS2(m)) break;
+	default: break;
+    }
+    return i;
+}
+
+/**
+ * Helper function which loads two integers into a vector. This wraps _mm_loadu_si128() so that it may be used by VEC_LOOP.
+ */
+static inline __m128i _vec_load_i2(const sc_int* p) { return _mm_loadu_si128((const __m128i*)p); }
+
+/**
+ * SSE2 version of _vec_ii(). SSE2 has no 64 bit multiplication or comparison, so only addition and subtraction are vectorized.
+ * Returns: the number of elements which were processed
+ */
+size_t _vec_ii_sse2(Optype_e op, const sc_int* a, size_t sa, const sc_int* b, size_t sb, void* out, size_t n) {
+    __m128i* oi = (__m128i*)out;
+    __m128i va = _mm_set1_epi64x(a[0]);
+    __m128i vb = _mm_set1_epi64x(b[0]);
+    size_t i = 0;
+    switch (op) {
+	case OP_ADD: VEC_LOOP(2, _vec_load_i2, _mm_storeu_si128(oi + i/2, _mm_add_epi64(va, vb))) break;
+	case OP_SUB: VEC_LOOP(2, _vec_load_i2, _mm_storeu_si128(oi + i/2, _mm_sub_epi64(va, vb))) break;
+	default: break;
+    }
+    return i;
+}
+
+/**
+ * AVX2 version of _vec_ff(). This is compiled for AVX2 regardless of the flags used for the rest of the file and must only be called if simd_supported() returns SIMD_AVX2.
+ * Returns: the number of elements which were processed
+ */
+__attribute__((target("avx2"))) size_t _vec_ff_avx2(Optype_e op, const double* a, size_t sa, const double* b, size_t sb, void* out, size_t n) {
+    double* of = (double*)out;
+    char* ob = (char*)out;
+    __m256d va = _mm256_set1_pd(a[0]);
+    __m256d vb = _mm256_set1_pd(b[0]);
+    size_t i = 0;
+    int m;
+    switch (op) {
+	case OP_ADD: VEC_LOOP(4, _mm256_loadu_pd, _mm256_storeu_pd(of + i, _mm256_add_pd(va, vb))) break;
+	case OP_SUB: VEC_LOOP(4, _mm256_loadu_pd, _mm256_storeu_pd(of + i, _mm256_sub_pd(va, vb))) break;
+	case OP_MULT: VEC_LOOP(4, _mm256_loadu_pd, _mm256_storeu_pd(of + i, _mm256_mul_pd(va, vb))) break;
+	case OP_DIV: VEC_LOOP(4, _mm256_loadu_pd, _mm256_storeu_pd(of + i, _mm256_div_pd(va, vb))) break;
+	case OP_GRT: VEC_LOOP(4, _mm256_loadu_pd, m = _mm256_movemask_pd(_mm256_cmp_pd(va, vb, _CMP_GT_OQ));VEC_BOOLS4(m)) break;
+	case OP_GEQ: VEC_LOOP(4, _mm256_loadu_pd, m = _mm256_movemask_pd(_mm256_cmp_pd(va, vb, _CMP_GE_OQ));VEC_BOOLS4(m)) break;
+	default: break;
+    }
+    return i;
+}
+
+/**
+ * Helper function which loads four integers into a vector. This wraps _mm256_loadu_si256() so that it may be used by VEC_LOOP.
+ */
+__attribute__((target("avx2"))) static inline __m256i _vec_load_i4(const sc_int* p) { return _mm256_loadu_si256((const __m256i*)p); }
+
+/**
+ * AVX2 version of _vec_ii(). AVX2 has no 64 bit multiplication, so only addition, subtraction and comparisons are vectorized.
+ * Returns: the number of elements which were processed
+ */
+__attribute__((target("avx2"))) size_t _vec_ii_avx2(Optype_e op, const sc_int* a, size_t sa, const sc_int* b, size_t sb, void* out, size_t n) {
+    __m256i* oi = (__m256i*)out;
+    char* ob = (char*)out;
+    __m256i va = _mm256_set1_epi64x(a[0]);
+    __m256i vb = _mm256_set1_epi64x(b[0]);
+    size_t i = 0;
+    int m;
+    switch (op) {
+	case OP_ADD: VEC_LOOP(4, _vec_load_i4, _mm256_storeu_si256(oi + i/4, _mm256_add_epi64(va, vb))) break;
+	case OP_SUB: VEC_LOOP(4, _vec_load_i4, _mm256_storeu_si256(oi + i/4, _mm256_sub_epi64(va, vb))) break;
+	case OP_GRT: VEC_LOOP(4, _vec_load_i4, m = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(va, vb)));VEC_BOOLS4(m)) break;
+	//a >= b is equivalent to !(b > a)
+	case OP_GEQ: VEC_LOOP(4, _vec_load_i4, m = ~_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(vb, va)));VEC_BOOLS4(m)) break;
+	default: break;
+    }
+    return i;
+}
+#endif
+
+/**
+ * Helper function which applies the scalar operation corresponding to op to a and b.
+ */
+value _op_scalar(Optype_e op, value a, value b, sc_error* err) {
+    switch (op) {
+	case OP_ADD: return op_add(a, b, err);
+	case OP_SUB: return op_sub(a, b, err);
+	case OP_MULT: return op_mult(a, b, err);
+	case OP_DIV: return op_div(a, b, err);
+	case OP_GRT: return op_grt(a, b, err);
+	case OP_GEQ: return op_geq(a, b, err);
+	default: {
+	    value ret = {0};
+	    sc_set_error(err, E_BADVAL, "");
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "operator %d can't be applied element-wise", op);
+	    return ret;
+	}
+    }
+}
+
+/**
+ * Helper function for _op_array() which handles n > 0 elements when both operands are unboxed and of type t (VT_INT or VT_FLOAT). Scalar operands have a stride of 0.
+ */
+value _op_array_prim(Optype_e op, Valtype_e t, const void* a, size_t sa, const void* b, size_t sb, size_t n, sc_error* err) {
+    value ret = {0};
+    //division by zero is an error for scalars so it must be an error for arrays too
+    if (op == OP_DIV) {
+	size_t n_b = (sb)? n : 1;
+	for (size_t i = 0; i < n_b; ++i) {
+	    if ((t == VT_FLOAT && ((const double*)b)[i] == 0) || (t == VT_INT && ((const sc_int*)b)[i] == 0)) {
+		sc_set_error(err, E_BADTYPE, "divide by zero");
+		ret.type = VT_ERROR;
+		return ret;
+	    }
+	}
+    }
+    PrimArray* out = _make_PrimArray((op == OP_GRT || op == OP_GEQ)? VT_BOOL : t, n, err);
+    if (err->type != E_SUCCESS) { ret.type = VT_ERROR;return ret; }
+    out->size = n;
+    ret.type = VT_ARRAY;
+    ret.val.ptr = out;
+
+#ifdef SC_SIMD_X86
+    int simd_level = get_simd_level();
+#endif
+    size_t i = 0;
+    if (t == VT_FLOAT) {
+#ifdef SC_SIMD_X86
+	if (simd_level >= SIMD_AVX2) {
+	    i = _vec_ff_avx2(op, (const double*)a, sa, (const double*)b, sb, out->buf, n);
+	} else if (simd_level >= SIMD_SSE2) {
+	    i = _vec_ff_sse2(op, (const double*)a, sa, (const double*)b, sb, out->buf, n);
+	}
+#endif
+	_vec_ff(op, (const double*)a, sa, (const double*)b, sb, out->buf, i, n);
+    } else {
+#ifdef SC_SIMD_X86
+	if (simd_level >= SIMD_AVX2) {
+	    i = _vec_ii_avx2(op, (const sc_int*)a, sa, (const sc_int*)b, sb, out->buf, n);
+	} else if (simd_level >= SIMD_SSE2) {
+	    i = _vec_ii_sse2(op, (const sc_int*)a, sa, (const sc_int*)b, sb, out->buf, n);
+	}
+#endif
+	_vec_ii(op, (const sc_int*)a, sa, (const sc_int*)b, sb, out->buf, i, n);
+    }
+    return ret;
+}
+
+/**
+ * Applies the operator op (one of OP_ADD, OP_SUB, OP_MULT, OP_DIV, OP_GRT or OP_GEQ) element-wise to a and b. At least one of a and b must be an array. Arrays must have the same length and scalars are broadcast to every element. Each element of the result is identical to the result of the scalar op_* function applied to the corresponding elements. If any of those would fail then no array is returned and err is set.
+ * Returns: a new array which must be freed. Results with a single primitive type are stored unboxed.
+ */
+value _op_array(Optype_e op, value a, value b, sc_error* err) {sc_reset_error(err);
+    value ret = {0};
+    Array* arr_a = (a.type == VT_ARRAY)? (Array*)(a.val.ptr) : NULL;
+    Array* arr_b = (b.type == VT_ARRAY)? (Array*)(b.val.ptr) : NULL;
+    if (arr_a && arr_b && arr_a->size != arr_b->size) {
+	sc_set_error(err, E_RANGE, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "can't apply operator to arrays of sizes %lu and %lu", arr_a->size, arr_b->size);
+	ret.type = VT_ERROR;
+	return ret;
+    }
+    size_t n = (arr_a)? arr_a->size : arr_b->size;
+
+    //unboxed int and float operands of the same type can be handled by the vectorized kernels
+    Valtype_e t_a = (arr_a)? arr_a->element_type : a.type;
+    Valtype_e t_b = (arr_b)? arr_b->element_type : b.type;
+    if (n > 0 && t_a == t_b && (t_a == VT_INT || t_a == VT_FLOAT)) {
+	const void* pa = (arr_a)? (const void*)(arr_a->buf) : (const void*)&(a.val);
+	const void* pb = (arr_b)? (const void*)(arr_b->buf) : (const void*)&(b.val);
+	return _op_array_prim(op, t_a, pa, (arr_a)? 1 : 0, pb, (arr_b)? 1 : 0, n, err);
+    }
+
+    //everything else is evaluated one element at a time
+    Array* out = _make_Array(sizeof(value), (n > 0)? n : 1, err);
+    if (err->type != E_SUCCESS) { ret.type = VT_ERROR;return ret; }
+    ret.type = VT_ARRAY;
+    ret.val.ptr = out;
+    for (size_t i = 0; i < n; ++i) {
+	value tmp = _op_scalar(op, (arr_a)? _get_a(arr_a, i) : a, (arr_b)? _get_a(arr_b, i) : b, err);
+	if (err->type != E_SUCCESS) {
+	    free_value(&ret);
+	    ret.type = VT_ERROR;
+	    ret.val.ptr = NULL;
+	    return ret;
+	}
+	out->buf[i] = tmp;
+	out->size = i + 1;
+    }
+    _unbox_a(out, err);
+    return ret;
+}
+
 // ================================== MATH EXPRESSION PARSING ==================================
 
+/**
+ * Helper function which applies the logical operator op (one of OP_AND, OP_OR or OP_NOT) to lf and rf. The not operator only reads rf.
+ */
+value _op_logic(Optype_e op, value lf, value rf, sc_error* err) {
+    value ret = {0};
+    ret.type = VT_BOOL;
+    //throw an error if the type isn't boolean or convertable to boolean
+    if ((op != OP_NOT && lf.type != VT_BOOL && lf.type != VT_INT) || (rf.type != VT_BOOL && rf.type != VT_INT)) {
+	sc_set_error(err, E_BADTYPE, "Can't apply not to non boolean type");
+	return ret;
+    }
+    switch (op) {
+    case OP_AND: ret.val.i = (rf.val.i != 0 && lf.val.i != 0);break;
+    case OP_OR: ret.val.i = (rf.val.i != 0 || lf.val.i != 0);break;
+    //set to 1 if the value was false, 0 otherwise
+    default: ret.val.i = (rf.val.i == 0);break;
+    }
+    return ret;
+}
+
 /**
   * Recursively evaluates the operation tree with the root specified by o. All values are treated as floats during calculation. For integer arithmetic use evali().
   * Returns: the value of the operation tree. Note that boolean operations consider 0.0 false and all other values true.
@@ -554,7 +800,7 @@ value eval(struct Operation* o, Stack* st, sc_error* err) {
     value ret = {0};
     ret.type = VT_ERROR;
 
-    sc_set_error(err, E_SUCCESS, "");
+    sc_reset_error(err);
 
     //if this is a leaf then we return the value
     if (o->child_l == NULL || o->child_r == NULL) {
@@ -586,45 +832,15 @@ value eval(struct Operation* o, Stack* st, sc_error* err) {
     case OP_LEQ: return op_geq(rf, lf, err);
     case OP_GEQ: return op_geq(lf, rf, err);
     case OP_AND:
-    ret.type = VT_BOOL;
-    //throw an error if the type isn't boolean or convertable to boolean
-    if ( (lf.type != VT_BOOL && lf.type != VT_INT)
-      || (rf.type != VT_BOOL && rf.type != VT_INT) ) {
-	sc_set_error(err, E_BADTYPE, "Can't apply not to non boolean type");
-	return ret;
-    }
-    //set to 1 if the value was false, 0 otherwise
-    if (rf.val.i == 0 || lf.val.i == 0) { ret.val.i = 0; } else { ret.val.i = 1; }
-    return ret;
-
     case OP_OR:
-    ret.type = VT_BOOL;
-    //throw an error if the type isn't boolean or convertable to boolean
-    if ((lf.type != VT_BOOL && lf.type != VT_INT) || (rf.type != VT_BOOL && rf.type != VT_INT)) {
-	sc_set_error(err, E_BADTYPE, "Can't apply not to non boolean type");
-	return ret;
-    }
-    //set to 1 if the value was false, 0 otherwise
-    if (rf.val.i == 0 && lf.val.i == 0) { ret.val.i = 0; } else { ret.val.i = 1; }
-    return ret;
-
-    case OP_NOT:
-    ret.type = VT_BOOL;
-    //throw an error if the type isn't boolean or convertable to boolean
-    if (rf.type != VT_BOOL && rf.type != VT_INT) {
-	sc_set_error(err, E_BADTYPE, "Can't apply not to non boolean type");
-	return ret;
-    }
-    //set to 1 if the value was false, 0 otherwise
-    if (rf.val.i == 0) { ret.val.i = 1; } else { ret.val.i = 0; }
-    return ret;
-
+    case OP_NOT: return _op_logic(o->op, lf, rf, err);
     default: sc_set_error(err, E_SYNTAX, "unrecognized operator");return o->val;
     }
 }
 
 /**
   * Helper function which parses a string expression into a tree of operations. The optree can then be evaluated using a call to eval() or evali()
+  * NOTE: this rescans the string at every level of the tree and modifies str. parse_optree() produces the same trees in linear time.
   */
 struct Operation* gen_optree(char* str, NamedStack* st, sc_error* err) {
     struct Operation* ret = sc_malloc(sizeof(struct Operation), err);
@@ -780,7 +996,7 @@ struct Operation* gen_optree(char* str, NamedStack* st, sc_error* err) {
 	str[i] = 0;//null terminate the string
 	ret->child_l = gen_optree(str, st, err);
 	if (err->type != E_SUCCESS) { return NULL; }
-	ret->child_r = gen_optree(str + i + 2, st, err);
+	ret->child_r = gen_optree(str + i + n_skip, st, err);
 	if (err->type != E_SUCCESS) { return NULL; }
 	return ret;
     }
@@ -830,9 +1046,12 @@ struct Operation* gen_optree(char* str, NamedStack* st, sc_error* err) {
 		    int i = 0;
 		    //trim whitespace
 		    str = _trim_whitespace(str);
+		    //names on the stack are interned so they may be compared by pointer. If str was never interned then there can't be a match.
+		    const char* ikey = find_interned(str);
 		    //iterate through every item in the stack looking for a match
-		    for (HashedItem* h = st->top; h != st->bottom; ++h) {
-			if (strcmp(h->key, str) == 0) {
+		    for (HashedItem* h = st->top; ikey && h != st->bottom; ++h) {
+			//temporary values pushed during compilation don't have names
+			if (h->key == ikey) {
 			    //we have to reset the error if we actually found a match
 			    sc_reset_error(err);
 			    //if we found a match then we set the type to indicate that the value should be read from the stack
@@ -860,432 +1079,1569 @@ struct Operation* gen_optree(char* str, NamedStack* st, sc_error* err) {
 }
 
 /**
- * Frees the operation pointed to by op and all of its children
+ * Helper function which returns 1 if c may not appear in an atom outside of quotes or brackets.
  */
-void free_Operation(struct Operation* op) {
-    if (op != NULL) {
-	free_Operation(op->child_l);
-	free_Operation(op->child_r);
-	sc_free(op);
+int _is_op_char(char c) {
+    switch (c) {
+    case '+': case '-': case '*': case '/': case '<': case '>': case '=': case '!': case '~': case '&': case '|': case '(': case ')':
+    case ' ': case '\t': case '\n': case 0: return 1;
+    default: return 0;
     }
 }
 
-// ============================ Instruction Buffer ============================
-
-/**
- * make a new empty instruction_buffer struct
- */
-instruction_buffer make_instruction_buffer(sc_error* err) {
-    instruction_buffer ret = {0};
-    ret.cap = DEF_NUM_INS;
-    ret.n_insts = 0;
-    ret.buf = (union Instruction*)sc_malloc(sizeof(union Instruction)*ret.cap, err);
-    return ret;
-}
-
 /**
- * Append the instruction inst to the end of buf and store potential errors in err
+ * Helper function which reads the next token from lx. If operand is 1 then an operand is expected so that '+' and '-' are read as the sign of the following atom.
  */
-void append_Instruction(instruction_buffer* buf, union Instruction inst, sc_error* err) {
-    if (buf) {
-	//ensure there is enough space to store the instructions
-	if (buf->n_insts >= buf->cap) {
-	    buf->cap = 2*(buf->cap);
-	    if (buf->n_insts >= buf->cap) { buf->cap += buf->n_insts; }
-	    buf->buf = (union Instruction*)sc_realloc(buf->buf, sizeof(union Instruction)*(buf->cap), err);
+void _lex_next(op_lexer* lx, int operand, sc_error* err) {
+    const char* str = lx->str;
+    size_t i = lx->pos;
+    while (str[i] == ' ' || str[i] == '\t' || str[i] == '\n') { ++i; }
+    lx->start = i;
+    lx->type = TOK_OPER;
+    size_t n = 1;
+    switch (str[i]) {
+    case 0: lx->type = TOK_END;n = 0;break;
+    case '(': lx->type = TOK_OPEN;break;
+    case ')': lx->type = TOK_CLOSE;break;
+    case '*': lx->op = OP_MULT;break;
+    case '/': lx->op = OP_DIV;break;
+    case '!': //no break is intentional
+    case '~': lx->op = OP_NOT;break;
+    case '>': lx->op = (str[i+1] == '=')? OP_GEQ : OP_GRT;n = (str[i+1] == '=')? 2 : 1;break;
+    case '<': lx->op = (str[i+1] == '=')? OP_LEQ : OP_LST;n = (str[i+1] == '=')? 2 : 1;break;
+    case '=': lx->op = (str[i+1] == '=')? OP_EQ : OP_ASSN;n = (str[i+1] == '=')? 2 : 1;break;
+    case '&':
+    case '|':
+	if (str[i+1] != str[i]) {
+	    sc_set_error(err, E_SYNTAX, "bitwise operations are not supported");
+	    return;
 	}
-	//if there is an E_NOMEM, buf->buf may be NULL, check
-	if (buf->buf) {
-	    buf->buf[buf->n_insts] = inst;
-	    buf->n_insts += 1;
+	lx->op = (str[i] == '&')? OP_AND : OP_OR;
+	n = 2;
+	break;
+    case '+':
+    case '-':
+	//signs are part of the following atom unless they precede a parenthetical group
+	if (!operand) {
+	    lx->op = (str[i] == '+')? OP_ADD : OP_SUB;
+	    break;
 	} else {
-	    free(buf->buf);
-	    buf->n_insts = -1;
+	    size_t j = i + 1;
+	    while (str[j] == ' ' || str[j] == '\t') { ++j; }
+	    if (str[j] == '(') {
+		lx->op = (str[i] == '+')? OP_ADD : OP_SUB;
+		break;
+	    }
 	}
+	//no break is intentional
+    default:
+	lx->type = TOK_ATOM;
+	n = 0;
+	if (str[i] == '+' || str[i] == '-') {
+	    ++n;
+	    while (str[i+n] == ' ' || str[i+n] == '\t') { ++n; }
+	}
+	//decimal numbers may have a signed exponent
+	int is_dec = (str[i+n] >= '0' && str[i+n] <= '9' && !(str[i+n] == '0' && (str[i+n+1] == 'x' || str[i+n+1] == 'X')));
+	while (!_is_op_char(str[i+n]) || (is_dec && (str[i+n] == '+' || str[i+n] == '-') && (str[i+n-1] == 'e' || str[i+n-1] == 'E'))) {
+	    //quoted strings and array literals may contain any character
+	    if (str[i+n] == '\"' || str[i+n] == '[') {
+		char close = (str[i+n] == '[')? ']' : '\"';
+		int depth = 1;
+		int verbatim = (close == '\"');
+		++n;
+		while (depth > 0) {
+		    if (str[i+n] == 0) {
+			sc_set_error(err, E_SYNTAX, "unterminated literal in expression");
+			return;
+		    }
+		    if (str[i+n] == '\"' && close == ']') {
+			verbatim = 1 - verbatim;
+		    } else if (!verbatim && str[i+n] == '[') {
+			++depth;
+		    } else if (str[i+n] == close && (close == '\"' || !verbatim)) {
+			--depth;
+		    }
+		    ++n;
+		}
+	    } else {
+		++n;
+	    }
+	}
+	break;
     }
+    lx->len = n;
+    lx->pos = i + n;
 }
 
 /**
- * Append n_in instructions from the array inst to the end of buf and store potential errors in err
+ * Helper function which returns the binding power of the binary operator op. Higher values bind more tightly. Logical operators and assignments have the lowest precedence and are right associative while every other operator is left associative.
  */
-void append_Instructions(instruction_buffer* buf, size_t n_in, union Instruction* inst, sc_error* err) {
-    if (buf) {
-	//ensure there is enough space to store the instructions
-	if (buf->n_insts + n_in >= buf->cap) {
-	    buf->cap = 2*(buf->cap) + n_in;
-	    buf->buf = (union Instruction*)sc_realloc(buf->buf, sizeof(union Instruction)*(buf->cap), err);
-	}
-	//if there is an E_NOMEM, buf->buf may be NULL, check
-	if (buf->buf) {
-	    for (size_t i = 0; i < n_in; ++i) {
-		buf->buf[buf->n_insts + i] = inst[i];
-	    }
-	    buf->n_insts += n_in;
-	} else {
-	    free(buf->buf);
-	    buf->n_insts = -1;
-	}
+int _op_prec(Optype_e op) {
+    switch (op) {
+    case OP_ASSN:
+    case OP_AND:
+    case OP_OR:
+    case OP_NOT: return 1;
+    case OP_EQ:
+    case OP_GRT:
+    case OP_LST:
+    case OP_GEQ:
+    case OP_LEQ: return 2;
+    case OP_ADD:
+    case OP_SUB: return 3;
+    case OP_MULT:
+    case OP_DIV: return 4;
+    default: return 0;
     }
 }
 
 /**
- * Deallocate memory used by the instruction_buffer buf
+ * Helper function which frees the optree op unless its nodes are owned by the arena a.
  */
-void free_instruction_buffer(instruction_buffer* buf) {
-    if (buf) {
-	if(buf->buf) {
-	    size_t i = 0;
-	    while (i < buf->n_insts) {
-		size_t tmp = buf->buf[i].i;
-		size_t skip = 1;
-		//if this instruction is a constant type we should free the next value
-		if (tmp & HI_NIB == INS_HH_C && i < buf->n_insts - 1) {
-		    free_value(buf->buf[i+1].ptr);
-		    sc_free(buf->buf[i+1].ptr);
-		    skip += 1;
-		}
-		//if this is a move instruction, then potentially there is a move from a constant allocated value that we will need to free.
-		if ((tmp & LO_NIB == INS_MOV) && (tmp & 0x30 == INS_HL_C) && (i < buf->n_insts - 2)) {
-		    free_value(buf->buf[i+2].ptr);
-		    sc_free(buf->buf[i+2].ptr);
-		    skip += 1;
-		}
-		i += skip;
-	    }
-	}
-	free(buf->buf);
-    }
+void _drop_Operation(struct Operation* op, arena* a) {
+    if (a == NULL) { free_Operation(op); }
 }
 
-// ============================ FUNCTIONS ============================
+/**
+ * Helper function with the signature expected by arena_defer() which frees the value pointed to by v.
+ */
+void _free_value_fin(void* v) {
+    free_value((value*)v);
+}
 
 /**
- * Helper function to lookup the stack index associated with a given stack variable. If the given name is not found -1 is returned.
+ * Helper function which makes the arena a responsible for freeing the value v if it owns heap memory.
  */
-int get_stack_ind(size_t stack_size, char** name_stack, char* name) {
-    for (size_t i = 0; i < stack_size; ++i) {
-	if (strcmp(name_stack[i], name) == 0) { return i; }
-    }
-    return -1;
+void _arena_own_value(arena* a, value* v, sc_error* err) {
+    if (v->type == VT_STRING || v->type == VT_ARRAY) { arena_defer(a, _free_value_fin, v, err); }
 }
 
 /**
- * This is a helper function which reads the specified token and pushes it onto the named stack st.
+ * Helper function which allocates a new optree node with the operator op and the specified children. If a is not NULL the node is allocated from a.
  */
-HashedItem _push_valtup(NamedStack* st, char* token, sc_error* err) {
-    //read the value and check for errors
-    HashedItem ret = _read_valtup(token, err);
-    if (err->type == E_SUCCESS) {
-	//push said value onto the stack and check for errors
-	push_n(st, ret.key, ret.val, err);
-	if (err->type != E_SUCCESS) { free_NamedStack(st); }
-    }
+struct Operation* _make_Operation(Optype_e op, struct Operation* l, struct Operation* r, arena* a, sc_error* err) {
+    struct Operation* ret = (a)? (struct Operation*)arena_alloc(a, sizeof(struct Operation), err) : (struct Operation*)sc_malloc(sizeof(struct Operation), err);
+    if (ret == NULL) {
+	_drop_Operation(l, a);
+	_drop_Operation(r, a);
+	return NULL;
+    }
+    ret->op = op;
+    ret->val.type = VT_UNDEF;
+    ret->val.val.f = 0.0;
+    ret->child_l = l;
+    ret->child_r = r;
     return ret;
 }
 
 /**
- * Helper function which parses an rval string into a sequence of instructions. This is done by recursively looking up values from the provided context and replacing with optrees or functions to evaluate where appropriate. The resulting set of instructions is appended to i_list and i_size is modified appropriately. The string str is modified "in place".
- * param c: the context of the calling function
- * param str: the string to parse into a list of instructions
- * param force_1ret: if this is 1, then all functions which are parsed must return one value, or an error will be thrown. This is applied to expressions in optrees and arguments in functions.
- * param i_list: this is the current list of instructions. This list will be modified by appending results to the end. As such this function is not parallelizable without making some careful considerations.
- * param i_size: the current size of the list of instructions. This is modified during the execution of the function.
- * param err: check for errors
- * returns: on success, the number of values pushed onto the stack during execution is returned. on failure, a negative value is returned
+ * Helper function which creates a leaf from the len characters of str. Literals are read with read_value_string() and names are substituted with references into the named stack st in the same manner as gen_optree().
+ */
+struct Operation* _make_leaf(const char* str, size_t len, NamedStack* st, arena* a, sc_error* err) {
+    //short atoms are copied onto the stack since read_value_string may modify its argument
+    char loc_buf[TOK_BUF_SIZE];
+    char* buf = loc_buf;
+    if (len >= TOK_BUF_SIZE) {
+	buf = (char*)sc_malloc(sizeof(char)*(len+1), err);
+	if (err->type != E_SUCCESS) { return NULL; }
+    }
+    memcpy(buf, str, len);
+    buf[len] = 0;
+
+    struct Operation* ret = _make_Operation(NOP, NULL, NULL, a, err);
+    if (ret) {
+	ret->val = read_value_string(buf, 0, err);
+	if (err->type == E_SUCCESS && a) {
+	    _arena_own_value(a, &(ret->val), err);
+	} else if (err->type != E_SUCCESS) {
+	    int found = 0;
+	    if (st) {
+		//names are looked up from the top of the stack so that the most recent declaration is used. Names are interned so they may be compared by pointer.
+		const char* ikey = find_interned(buf);
+		size_t i = 0;
+		for (HashedItem* h = st->top; ikey && h != st->bottom; ++h) {
+		    if (h->key == ikey) {
+			sc_reset_error(err);
+			ret->val.type = VT_OPREF;
+			ret->val.val.i = i;
+			found = 1;
+			break;
+		    }
+		    ++i;
+		}
+	    }
+	    if (!found) {
+		if (a == NULL) { sc_free(ret); }
+		ret = NULL;
+	    }
+	}
+    }
+    if (buf != loc_buf) { sc_free(buf); }
+    return ret;
+}
+
+struct Operation* _parse_optree_r(op_lexer* lx, int min_prec, NamedStack* st, arena* a, sc_error* err);
+
+/**
+ * Helper function for parse_optree() which reads a single operand from lx. On success the lexer is advanced to the token after the operand.
+ */
+struct Operation* _parse_operand(op_lexer* lx, NamedStack* st, arena* a, sc_error* err) {
+    struct Operation* ret = NULL;
+    if (lx->type == TOK_ATOM) {
+	ret = _make_leaf(lx->str + lx->start, lx->len, st, a, err);
+	if (ret == NULL) { return NULL; }
+	_lex_next(lx, 0, err);
+    } else if (lx->type == TOK_OPEN) {
+	_lex_next(lx, 1, err);
+	if (err->type != E_SUCCESS) { return NULL; }
+	ret = _parse_optree_r(lx, 0, st, a, err);
+	if (ret == NULL) { return NULL; }
+	if (lx->type != TOK_CLOSE) {
+	    _drop_Operation(ret, a);
+	    sc_set_error(err, E_SYNTAX, "expected ')'");
+	    return NULL;
+	}
+	_lex_next(lx, 0, err);
+    } else if (lx->type == TOK_OPER && (lx->op == OP_ADD || lx->op == OP_SUB)) {
+	//a sign before a parenthetical group is applied by subtracting from zero
+	Optype_e op = lx->op;
+	_lex_next(lx, 1, err);
+	if (err->type != E_SUCCESS) { return NULL; }
+	ret = _parse_operand(lx, st, a, err);
+	if (ret == NULL || op == OP_ADD) { return ret; }
+	struct Operation* zero = _make_Operation(NOP, NULL, NULL, a, err);
+	if (zero == NULL) {
+	    _drop_Operation(ret, a);
+	    return NULL;
+	}
+	zero->val = v_make_int(0, err);
+	return _make_Operation(OP_SUB, zero, ret, a, err);
+    } else if (lx->type == TOK_OPER && lx->op == OP_NOT) {
+	//gen_optree() treats not as a binary operator with an empty left operand
+	return _make_leaf("", 0, st, a, err);
+    } else {
+	sc_set_error(err, (lx->type == TOK_CLOSE)? E_SYNTAX : E_BADVAL, (lx->type == TOK_CLOSE)? "encountered close brace without matching open" : "expected operand");
+	return NULL;
+    }
+    if (err->type != E_SUCCESS) {
+	_drop_Operation(ret, a);
+	return NULL;
+    }
+    return ret;
+}
+
+/**
+ * Helper function for parse_optree() which reads operators with a precedence of at least min_prec and their operands from lx using precedence climbing.
+ */
+struct Operation* _parse_optree_r(op_lexer* lx, int min_prec, NamedStack* st, arena* a, sc_error* err) {
+    struct Operation* lhs = _parse_operand(lx, st, a, err);
+    if (lhs == NULL) { return NULL; }
+    while (lx->type == TOK_OPER && _op_prec(lx->op) >= min_prec) {
+	Optype_e op = lx->op;
+	int prec = _op_prec(op);
+	_lex_next(lx, 1, err);
+	if (err->type != E_SUCCESS) {
+	    _drop_Operation(lhs, a);
+	    return NULL;
+	}
+	//the lowest precedence operators are right associative
+	struct Operation* rhs = _parse_optree_r(lx, (prec == 1)? prec : prec + 1, st, a, err);
+	if (rhs == NULL) {
+	    _drop_Operation(lhs, a);
+	    return NULL;
+	}
+	lhs = _make_Operation(op, lhs, rhs, a, err);
+	if (lhs == NULL) { return NULL; }
+    }
+    return lhs;
+}
+
+/**
+  * Parses the expression str into a tree of operations in a single pass without modifying str. This produces the same trees as gen_optree() in time linear in the length of str. If a is not NULL then the nodes and their values are owned by a and the tree must not be freed with free_Operation().
+  */
+struct Operation* parse_optree(const char* str, NamedStack* st, arena* a, sc_error* err) {
+    sc_reset_error(err);
+    op_lexer lx = {0};
+    lx.str = str;
+    _lex_next(&lx, 1, err);
+    if (err->type != E_SUCCESS) { return NULL; }
+    struct Operation* ret = _parse_optree_r(&lx, 0, st, a, err);
+    if (ret == NULL) { return NULL; }
+    if (lx.type != TOK_END) {
+	_drop_Operation(ret, a);
+	sc_set_error(err, E_SYNTAX, (lx.type == TOK_CLOSE)? "encountered close brace without matching open" : "unexpected token in expression");
+	return NULL;
+    }
+    return ret;
+}
+
+/**
+ * Frees the operation pointed to by op and all of its children
+ */
+void free_Operation(struct Operation* op) {
+    if (op != NULL) {
+	free_Operation(op->child_l);
+	free_Operation(op->child_r);
+	sc_free(op);
+    }
+}
+
+/**
+ * Helper function which returns 1 if the optree op is a constant leaf of a primitive numeric or boolean type. Only these are folded since they don't own any memory.
+ */
+int _is_const_leaf(const struct Operation* op) {
+    if (op->child_l != NULL && op->child_r != NULL) { return 0; }
+    return op->val.type == VT_BOOL || op->val.type == VT_INT || op->val.type == VT_FLOAT;
+}
+
+/**
+ * Helper function which counts the nodes in the optree op.
+ */
+size_t _n_Operation_nodes(const struct Operation* op) {
+    if (op == NULL) { return 0; }
+    return 1 + _n_Operation_nodes(op->child_l) + _n_Operation_nodes(op->child_r);
+}
+
+/**
+ * Helper function which replaces the node pointed to by op with its child keep and frees every other node in the subtree unless they are owned by the arena a.
+ * Returns: the number of nodes which were removed
+ */
+size_t _replace_Operation(struct Operation** op, struct Operation* keep, arena* a) {
+    struct Operation* old = *op;
+    struct Operation* other = (old->child_l == keep)? old->child_r : old->child_l;
+    size_t ret = 1 + _n_Operation_nodes(other);
+    if (a == NULL) {
+	free_Operation(other);
+	sc_free(old);
+    }
+    *op = keep;
+    return ret;
+}
+
+/**
+ * Helper function for fold_Operation() which simplifies the subtree pointed to by op and stores the type that it is known to evaluate to in type (VT_UNDEF if this can't be determined at compile time).
+ * Returns: the number of nodes which were eliminated
+ */
+size_t _fold_Operation(struct Operation** op, arena* a, Valtype_e* type) {
+    struct Operation* o = *op;
+    if (o->child_l == NULL || o->child_r == NULL) {
+	//declared types aren't enforced at runtime, so a stack reference may hold a value of any type
+	*type = (o->val.type == VT_OPREF)? VT_UNDEF : o->val.type;
+	return 0;
+    }
+    Valtype_e t_l, t_r;
+    size_t ret = _fold_Operation(&(o->child_l), a, &t_l);
+    ret += _fold_Operation(&(o->child_r), a, &t_r);
+    struct Operation* l = o->child_l;
+    struct Operation* r = o->child_r;
+    int num_l = (t_l == VT_INT || t_l == VT_FLOAT);
+    int num_r = (t_r == VT_INT || t_r == VT_FLOAT);
+    if (o->op == OP_ADD || o->op == OP_SUB || o->op == OP_MULT || o->op == OP_DIV) {
+	*type = (num_l && num_r)? ((t_l == VT_INT && t_r == VT_INT)? VT_INT : VT_FLOAT) : VT_UNDEF;
+    } else if (o->op == OP_EQ || o->op == OP_AND || o->op == OP_OR || o->op == OP_NOT) {
+	*type = VT_BOOL;
+    } else if (o->op == OP_GRT || o->op == OP_LST || o->op == OP_GEQ || o->op == OP_LEQ) {
+	//ordering comparisons are element-wise if either operand is an array
+	int known = (t_l != VT_UNDEF && t_l != VT_ARRAY && t_r != VT_UNDEF && t_r != VT_ARRAY);
+	*type = known? VT_BOOL : VT_UNDEF;
+    } else {
+	*type = VT_UNDEF;
+    }
+
+    //evaluate operations with only constant operands now. If this fails (e.g. a division by zero) the error is left to be raised at runtime
+    if (_is_const_leaf(l) && _is_const_leaf(r) && o->op != OP_ASSN && o->op != NOP) {
+	sc_error tmp_err;
+	value res = eval(o, NULL, &tmp_err);
+	if (tmp_err.type == E_SUCCESS) {
+	    if (a == NULL) {
+		sc_free(l);
+		sc_free(r);
+	    }
+	    o->op = NOP;
+	    o->val = res;
+	    o->child_l = NULL;
+	    o->child_r = NULL;
+	    *type = res.type;
+	    return ret + 2;
+	}
+	return ret;
+    }
+
+    //logical operations with one constant operand either have a known result or reduce to the other operand if it is already a boolean
+    if (o->op == OP_AND || o->op == OP_OR) {
+	struct Operation* c_op = (_is_const_leaf(l) && l->val.type != VT_FLOAT)? l : NULL;
+	if (c_op == NULL && _is_const_leaf(r) && r->val.type != VT_FLOAT) { c_op = r; }
+	if (c_op) {
+	    struct Operation* other = (c_op == l)? r : l;
+	    Valtype_e t_other = (c_op == l)? t_r : t_l;
+	    int c_true = (c_op->val.val.i != 0);
+	    if ((o->op == OP_AND && !c_true) || (o->op == OP_OR && c_true)) {
+		//the result is the constant converted to a boolean
+		c_op->val.type = VT_BOOL;
+		c_op->val.val.i = c_true;
+		return ret + _replace_Operation(op, c_op, a);
+	    } else if (t_other == VT_BOOL) {
+		return ret + _replace_Operation(op, other, a);
+	    }
+	}
+    }
+    return ret;
+}
+
+/**
+ * Simplifies the optree pointed to by op in place by folding constant subtrees and short circuiting logical operations with constant operands. Identities such as x*1 or x+0 are kept since declared types aren't enforced at runtime and x may be a string or an array. If the tree was allocated from the arena a (see parse_optree()) then removed nodes are left for a to release.
+ * Returns: the number of nodes which were eliminated
+ */
+size_t fold_Operation(struct Operation** op, arena* a) {
+    if (op == NULL || *op == NULL) { return 0; }
+    Valtype_e type;
+    return _fold_Operation(op, a, &type);
+}
+
+/**
+ * Helper function which counts the nodes and constant leaves in the optree op so that make_expression() can allocate everything up front.
+ */
+void _count_Operation(const struct Operation* op, size_t* n_nodes, size_t* n_consts) {
+    *n_nodes += 1;
+    if (op->child_l == NULL || op->child_r == NULL) {
+	if (op->val.type != VT_OPREF) { *n_consts += 1; }
+	return;
+    }
+    _count_Operation(op->child_l, n_nodes, n_consts);
+    _count_Operation(op->child_r, n_nodes, n_consts);
+}
+
+/**
+ * Helper function which appends the postfix program for op to e.
+ * Returns: the depth of the evaluation stack needed by op or 0 on error
+ */
+size_t _lower_Operation(const struct Operation* op, expression* e, sc_error* err) {
+    union Instruction tmp[2];
+    //leaves push a single value, stack references are read directly from the program stack at evaluation time
+    if (op->child_l == NULL || op->child_r == NULL) {
+	if (op->val.type == VT_OPREF) {
+	    tmp[0].i = EXP_PUSH_S;
+	    tmp[1].i = op->val.val.i;
+	} else {
+	    tmp[0].i = EXP_PUSH_C;
+	    tmp[1].i = e->n_consts;
+	    e->consts[e->n_consts] = v_deep_copy(op->val, err);
+	    if (err->type != E_SUCCESS) { return 0; }
+	    e->n_consts += 1;
+	}
+	append_Instructions(&(e->buf), 2, tmp, err);
+	return (err->type == E_SUCCESS)? 1 : 0;
+    }
+
+    switch (op->op) {
+    case OP_ADD: tmp[0].i = EXP_ADD;break;
+    case OP_SUB: tmp[0].i = EXP_SUB;break;
+    case OP_MULT: tmp[0].i = EXP_MULT;break;
+    case OP_DIV: tmp[0].i = EXP_DIV;break;
+    case OP_EQ: tmp[0].i = EXP_EQ;break;
+    case OP_GRT: tmp[0].i = EXP_GRT;break;
+    case OP_LST: tmp[0].i = EXP_LST;break;
+    case OP_GEQ: tmp[0].i = EXP_GEQ;break;
+    case OP_LEQ: tmp[0].i = EXP_LEQ;break;
+    case OP_AND: tmp[0].i = EXP_AND;break;
+    case OP_OR: tmp[0].i = EXP_OR;break;
+    case OP_NOT: tmp[0].i = EXP_NOT;break;
+    default: sc_set_error(err, E_SYNTAX, "unrecognized operator");return 0;
+    }
+    size_t depth_l = _lower_Operation(op->child_l, e, err);
+    if (depth_l == 0) { return 0; }
+    //the left operand stays on the stack while the right is evaluated
+    size_t depth_r = _lower_Operation(op->child_r, e, err);
+    if (depth_r == 0) { return 0; }
+    append_Instruction(&(e->buf), tmp[0], err);
+    if (err->type != E_SUCCESS) { return 0; }
+    return (depth_l > depth_r + 1)? depth_l : depth_r + 1;
+}
+
+/**
+ * Lowers the operation tree op into a flat expression which may be evaluated with eval_expression(). Constant values in op are copied so op may be freed afterwards. If a is not NULL then the expression is allocated from a and must not be freed with free_expression().
+ */
+expression make_expression(const struct Operation* op, arena* a, sc_error* err) {
+    expression ret = {0};
+    size_t n_nodes = 0;
+    size_t n_consts = 0;
+    _count_Operation(op, &n_nodes, &n_consts);
+
+    //leaves take two instructions and operators take one so the program never needs to be reallocated
+    ret.buf.cap = 2*n_nodes + 1;
+    size_t buf_size = sizeof(union Instruction)*(ret.buf.cap);
+    ret.buf.buf = (union Instruction*)((a)? arena_alloc(a, buf_size, err) : sc_malloc(buf_size, err));
+    if (ret.buf.buf == NULL) { return ret; }
+    if (n_consts > 0) {
+	ret.consts = (value*)((a)? arena_alloc(a, sizeof(value)*n_consts, err) : sc_malloc(sizeof(value)*n_consts, err));
+	if (ret.consts == NULL) {
+	    if (a == NULL) { free_expression(&ret); }
+	    return ret;
+	}
+    }
+    ret.depth = _lower_Operation(op, &ret, err);
+    if (a) {
+	//constants which were copied before an error still need to be released with the arena
+	sc_error tmp_err;
+	sc_reset_error(&tmp_err);
+	for (size_t i = 0; i < ret.n_consts; ++i) { _arena_own_value(a, ret.consts + i, &tmp_err); }
+	if (err->type == E_SUCCESS && tmp_err.type != E_SUCCESS) { *err = tmp_err; }
+    }
+    if (ret.depth == 0 && err->type == E_SUCCESS) { sc_set_error(err, E_SYNTAX, "invalid expression"); }
+    if (err->type != E_SUCCESS && a == NULL) { free_expression(&ret); }
+    return ret;
+}
+
+/**
+ * Frees memory used by the expression e.
+ */
+void free_expression(expression* e) {
+    if (e) {
+	for (size_t i = 0; i < e->n_consts; ++i) {
+	    free_value(e->consts + i);
+	}
+	sc_free(e->consts);
+	//the program doesn't contain normal instructions so we can't use free_instruction_buffer
+	sc_free(e->buf.buf);
+	e->consts = NULL;
+	e->n_consts = 0;
+	e->buf.buf = NULL;
+	e->buf.n_insts = 0;
+	e->buf.cap = 0;
+	e->depth = 0;
+    }
+}
+
+/**
+ * Helper function for eval_expression() which applies the generic implementation of the operator op (with quickening flags removed) to lf and rf.
+ */
+value _exp_apply(size_t op, value lf, value rf, sc_error* err) {
+    switch (op) {
+    case EXP_ADD: return op_add(lf, rf, err);
+    case EXP_SUB: return op_sub(lf, rf, err);
+    case EXP_MULT: return op_mult(lf, rf, err);
+    case EXP_DIV: return op_div(lf, rf, err);
+    case EXP_EQ: return op_eq(lf, rf, err);
+    case EXP_GRT: return op_grt(lf, rf, err);
+    case EXP_LST: return op_grt(rf, lf, err);
+    case EXP_GEQ: return op_geq(lf, rf, err);
+    case EXP_LEQ: return op_geq(rf, lf, err);
+    case EXP_AND: return _op_logic(OP_AND, lf, rf, err);
+    case EXP_OR: return _op_logic(OP_OR, lf, rf, err);
+    case EXP_NOT: return _op_logic(OP_NOT, lf, rf, err);
+    default: break;
+    }
+    value ret = {0};
+    sc_set_error(err, E_SYNTAX, "unrecognized operator");
+    return ret;
+}
+
+/**
+ * Helper function which returns the quickening flag to use for the operator op after it was applied to operands of the types t_l and t_r.
+ */
+size_t _exp_quicken(size_t op, Valtype_e t_l, Valtype_e t_r) {
+    if (op < EXP_ADD || op > EXP_LEQ) { return EXP_Q_GENERIC; }
+    if (t_l == VT_INT && t_r == VT_INT) { return EXP_Q_II; }
+    if (t_l == VT_FLOAT && t_r == VT_FLOAT) { return EXP_Q_FF; }
+    return EXP_Q_GENERIC;
+}
+
+//guards used by quickened operators to check the operands on top of the evaluation stack
+#define EXP_GUARD_II(sp)	((sp)[-2].type == VT_INT && (sp)[-1].type == VT_INT)
+#define EXP_GUARD_FF(sp)	((sp)[-2].type == VT_FLOAT && (sp)[-1].type == VT_FLOAT)
+
+/**
+ * Helper function for eval_expression() which frees the values on the evaluation stack vs that were computed by operators after the operator at index fail in the program of e failed. Values pushed from the constant table or the program stack are borrowed and are left alone. The operands of the failed operator must be on the stack.
+ */
+void _exp_release(const expression* e, size_t fail, value* vs) {
+    //whether each entry is owned only depends on the program, so it is recomputed rather than tracked during evaluation
+    char local[EXP_STACK_SIZE];
+    char* owned = local;
+    if (e->depth > EXP_STACK_SIZE) {
+	owned = (char*)sc_malloc(e->depth, NULL);
+	if (owned == NULL) { return; }
+    }
+    size_t h = 0;
+    size_t j = 0;
+    while (j < fail) {
+	if ((e->buf.buf[j].i & EXP_BASE) == EXP_PUSH_C || (e->buf.buf[j].i & EXP_BASE) == EXP_PUSH_S) {
+	    owned[h++] = 0;
+	    j += 2;
+	} else {
+	    owned[--h - 1] = 1;
+	    ++j;
+	}
+    }
+    for (size_t k = 0; k < h; ++k) {
+	if (owned[k]) { free_value(vs + k); }
+    }
+    if (owned != local) { sc_free(owned); }
+}
+
+/**
+ * Evaluates the expression e using values from the program stack st. This has the same semantics as eval() on the optree e was generated from. Operators in e are quickened in place based on the types of the operands that they see (see EXP_Q).
+ * Returns: the value of the expression
+ */
+value eval_expression(expression* e, Stack* st, sc_error* err) {
+    value ret = {0};
+    ret.type = VT_ERROR;
+    sc_reset_error(err);
+
+    //most expressions are shallow enough to use an evaluation stack in automatic storage
+    value local[EXP_STACK_SIZE];
+    value* vs = local;
+    if (e->depth > EXP_STACK_SIZE) {
+	vs = (value*)sc_malloc(sizeof(value)*(e->depth), err);
+	if (err->type != E_SUCCESS) { return ret; }
+    }
+
+    //sp always points one past the top of the evaluation stack. The generic operators save their operands in l and r since the result replaces them
+    value* sp = vs;
+    value l = {0};
+    value r = {0};
+    union Instruction* ins = e->buf.buf;
+    const union Instruction* end = ins + e->buf.n_insts;
+    while (ins < end) {
+	switch (ins->i) {
+	case EXP_PUSH_C: *(sp++) = e->consts[ins[1].i];ins += 2;continue;
+	case EXP_PUSH_S: *(sp++) = st->top[ins[1].i];ins += 2;continue;
+
+	//quickened operators only need to check the types of their operands. Integer overflow wraps around just as in op_add() and friends
+	case EXP_ADD | EXP_Q_II: if (!EXP_GUARD_II(sp)) { goto exp_miss; }
+	    sp[-2].val.i = (sc_int)((sc_uint)sp[-2].val.i + (sc_uint)sp[-1].val.i);break;
+	case EXP_SUB | EXP_Q_II: if (!EXP_GUARD_II(sp)) { goto exp_miss; }
+	    sp[-2].val.i = (sc_int)((sc_uint)sp[-2].val.i - (sc_uint)sp[-1].val.i);break;
+	case EXP_MULT | EXP_Q_II: if (!EXP_GUARD_II(sp)) { goto exp_miss; }
+	    sp[-2].val.i = (sc_int)((sc_uint)sp[-2].val.i * (sc_uint)sp[-1].val.i);break;
+	case EXP_DIV | EXP_Q_II: if (!EXP_GUARD_II(sp) || sp[-1].val.i == 0 || (sp[-1].val.i == -1 && sp[-2].val.i == SC_INT_MIN)) { goto exp_miss; }
+	    sp[-2].val.i /= sp[-1].val.i;break;
+	case EXP_EQ | EXP_Q_II: if (!EXP_GUARD_II(sp)) { goto exp_miss; }
+	    sp[-2].type = VT_BOOL;sp[-2].val.i = (sp[-2].val.i == sp[-1].val.i);break;
+	case EXP_GRT | EXP_Q_II: if (!EXP_GUARD_II(sp)) { goto exp_miss; }
+	    sp[-2].type = VT_BOOL;sp[-2].val.i = (sp[-2].val.i > sp[-1].val.i);break;
+	case EXP_LST | EXP_Q_II: if (!EXP_GUARD_II(sp)) { goto exp_miss; }
+	    sp[-2].type = VT_BOOL;sp[-2].val.i = (sp[-2].val.i < sp[-1].val.i);break;
+	case EXP_GEQ | EXP_Q_II: if (!EXP_GUARD_II(sp)) { goto exp_miss; }
+	    sp[-2].type = VT_BOOL;sp[-2].val.i = (sp[-2].val.i >= sp[-1].val.i);break;
+	case EXP_LEQ | EXP_Q_II: if (!EXP_GUARD_II(sp)) { goto exp_miss; }
+	    sp[-2].type = VT_BOOL;sp[-2].val.i = (sp[-2].val.i <= sp[-1].val.i);break;
+	case EXP_ADD | EXP_Q_FF: if (!EXP_GUARD_FF(sp)) { goto exp_miss; }
+	    sp[-2].val.f += sp[-1].val.f;break;
+	case EXP_SUB | EXP_Q_FF: if (!EXP_GUARD_FF(sp)) { goto exp_miss; }
+	    sp[-2].val.f -= sp[-1].val.f;break;
+	case EXP_MULT | EXP_Q_FF: if (!EXP_GUARD_FF(sp)) { goto exp_miss; }
+	    sp[-2].val.f *= sp[-1].val.f;break;
+	case EXP_DIV | EXP_Q_FF: if (!EXP_GUARD_FF(sp) || sp[-1].val.f == 0.0) { goto exp_miss; }
+	    sp[-2].val.f /= sp[-1].val.f;break;
+	case EXP_EQ | EXP_Q_FF: if (!EXP_GUARD_FF(sp)) { goto exp_miss; }
+	    sp[-2].type = VT_BOOL;sp[-2].val.i = (sp[-2].val.f == sp[-1].val.f);break;
+	case EXP_GRT | EXP_Q_FF: if (!EXP_GUARD_FF(sp)) { goto exp_miss; }
+	    sp[-2].type = VT_BOOL;sp[-2].val.i = (sp[-2].val.f > sp[-1].val.f);break;
+	case EXP_LST | EXP_Q_FF: if (!EXP_GUARD_FF(sp)) { goto exp_miss; }
+	    sp[-2].type = VT_BOOL;sp[-2].val.i = (sp[-2].val.f < sp[-1].val.f);break;
+	case EXP_GEQ | EXP_Q_FF: if (!EXP_GUARD_FF(sp)) { goto exp_miss; }
+	    sp[-2].type = VT_BOOL;sp[-2].val.i = (sp[-2].val.f >= sp[-1].val.f);break;
+	case EXP_LEQ | EXP_Q_FF: if (!EXP_GUARD_FF(sp)) { goto exp_miss; }
+	    sp[-2].type = VT_BOOL;sp[-2].val.i = (sp[-2].val.f <= sp[-1].val.f);break;
+
+	exp_miss:
+	    //the guard failed (or a division needs to be handled by op_div()) so this operator stops being specialized
+	    ins->i = (ins->i & EXP_BASE) | EXP_Q_GENERIC;
+	    l = sp[-2];
+	    r = sp[-1];
+	    sp[-2] = _exp_apply(ins->i & EXP_BASE, l, r, err);
+	    break;
+	default:
+	    l = sp[-2];
+	    r = sp[-1];
+	    if ((ins->i & EXP_Q) == 0) {
+		//generic operators are quickened the first time they are evaluated successfully
+		sp[-2] = _exp_apply(ins->i, l, r, err);
+		if (err->type == E_SUCCESS) { ins->i |= _exp_quicken(ins->i, l.type, r.type); }
+	    } else {
+		sp[-2] = _exp_apply(ins->i & EXP_BASE, l, r, err);
+	    }
+	    break;
+	}
+	//every operator replaces its two operands with the result
+	--sp;
+	++ins;
+	if (err->type != E_SUCCESS) { break; }
+    }
+    if (err->type == E_SUCCESS) {
+	ret = vs[0];
+    } else {
+	//put the operands of the failed operator back so that temporaries computed by earlier operators can be released
+	sp[-1] = l;
+	sp[0] = r;
+	_exp_release(e, (size_t)(ins - 1 - e->buf.buf), vs);
+    }
+    if (vs != local) { sc_free(vs); }
+    return ret;
+}
+
+// ============================ Instruction Buffer ============================
+
+/**
+ * make a new empty instruction_buffer struct
+ */
+instruction_buffer make_instruction_buffer(sc_error* err) {
+    instruction_buffer ret = {0};
+    ret.cap = DEF_NUM_INS;
+    ret.n_insts = 0;
+    ret.buf = (union Instruction*)sc_malloc(sizeof(union Instruction)*ret.cap, err);
+    return ret;
+}
+
+/**
+ * Append the instruction inst to the end of buf and store potential errors in err
+ */
+void append_Instruction(instruction_buffer* buf, union Instruction inst, sc_error* err) {
+    if (buf) {
+	//ensure there is enough space to store the instructions
+	if (buf->n_insts >= buf->cap) {
+	    buf->cap = 2*(buf->cap);
+	    if (buf->n_insts >= buf->cap) { buf->cap += buf->n_insts; }
+	    buf->buf = (union Instruction*)sc_realloc(buf->buf, sizeof(union Instruction)*(buf->cap), err);
+	}
+	//if there is an E_NOMEM, buf->buf may be NULL, check
+	if (buf->buf) {
+	    buf->buf[buf->n_insts] = inst;
+	    buf->n_insts += 1;
+	} else {
+	    free(buf->buf);
+	    buf->n_insts = -1;
+	}
+    }
+}
+
+/**
+ * Append n_in instructions from the array inst to the end of buf and store potential errors in err
+ */
+void append_Instructions(instruction_buffer* buf, size_t n_in, union Instruction* inst, sc_error* err) {
+    if (buf) {
+	//ensure there is enough space to store the instructions
+	if (buf->n_insts + n_in >= buf->cap) {
+	    buf->cap = 2*(buf->cap) + n_in;
+	    buf->buf = (union Instruction*)sc_realloc(buf->buf, sizeof(union Instruction)*(buf->cap), err);
+	}
+	//if there is an E_NOMEM, buf->buf may be NULL, check
+	if (buf->buf) {
+	    for (size_t i = 0; i < n_in; ++i) {
+		buf->buf[buf->n_insts + i] = inst[i];
+	    }
+	    buf->n_insts += n_in;
+	} else {
+	    free(buf->buf);
+	    buf->n_insts = -1;
+	}
+    }
+}
+
+/**
+ * Deallocate memory used by the instruction_buffer buf. Constant parameters are owned by buf->mem and the constant pool so they are all released at once without walking the instructions.
+ */
+void free_instruction_buffer(instruction_buffer* buf) {
+    if (buf) {
+	free(buf->buf);
+	sc_free(buf->opcodes);
+	free_arena(&(buf->mem));
+	for (size_t i = 0; i < buf->n_consts; ++i) { free_value(buf->consts + i); }
+	sc_free(buf->consts);
+    }
+}
+
+/**
+ * Helper function which returns 1 if the constants a and b are interchangeable. Arrays are never shared since they may be modified through references.
+ */
+int _const_equal(const value* a, const value* b) {
+    if (a->type != b->type) { return 0; }
+    switch (a->type) {
+    case VT_FLOAT: return memcmp(&(a->val.f), &(b->val.f), sizeof(double)) == 0;
+    case VT_STRING: return a->val.str->size == b->val.str->size && strncmp(a->val.str->buf, b->val.str->buf, a->val.str->size) == 0;
+    case VT_ARRAY: return 0;
+    default: return a->val.i == b->val.i;
+    }
+}
+
+/**
+ * Adds the value v to the constant pool of buf unless an equal value is already present, in which case v is freed. Ownership of v is taken in either case.
+ * Returns: the index of the constant in the pool
+ */
+size_t intern_const(instruction_buffer* buf, value v, sc_error* err) {
+    sc_reset_error(err);
+    for (size_t i = 0; i < buf->n_consts; ++i) {
+	if (_const_equal(buf->consts + i, &v)) {
+	    free_value(&v);
+	    return i;
+	}
+    }
+    if (buf->n_consts == buf->consts_cap) {
+	size_t new_cap = (buf->consts_cap)? 2*(buf->consts_cap) : DEFAULT_STACK_SIZE;
+	value* tmp = (value*)sc_realloc(buf->consts, sizeof(value)*new_cap, err);
+	if (tmp == NULL) {
+	    free_value(&v);
+	    return 0;
+	}
+	buf->consts = tmp;
+	buf->consts_cap = new_cap;
+    }
+    buf->consts[buf->n_consts] = v;
+    return (buf->n_consts)++;
+}
+
+/**
+ * Returns the opcode of the instruction starting at index ind of buf. This should be used instead of reading buf->buf directly whenever the buffer may have been threaded.
+ */
+size_t _ins_opcode(const instruction_buffer* buf, size_t ind) {
+    if (buf->opcodes) { return buf->opcodes[ind]; }
+    return buf->buf[ind].i;
+}
+
+/**
+ * Returns the instruction specified by the opcode ins with bank flags removed
+ */
+size_t _ins_base(size_t ins) {
+    size_t lo = ins & LO_NIB;
+    //only these instructions use the INS_HL bits, every other instruction is identified by the low six bits
+    if (lo == INS_MOV || lo == INS_IND_READ || lo == INS_IND_WRITE) { return lo; }
+    return ins & INS_LO;
+}
+
+/**
+ * Returns the number of union Instructions used by the instruction with opcode ins, including the opcode itself.
+ */
+size_t _ins_size(size_t ins) {
+    switch (_ins_base(ins)) {
+    case INS_OP_EVAL:
+    case INS_FN_EVAL:
+    case INS_TAIL_CALL:
+    case INS_JUMP:
+    case INS_PUSH:
+    case INS_POP:
+    case INS_PTR_DRF:
+    case INS_GET_SIZE:
+    case INS_MAKE_PTR:
+    case INS_MAKE_VAL: return 2;
+    case INS_JUMP_CND:
+    case INS_MOV:
+    case INS_IND_READ:
+    case INS_IND_WRITE: return 3;
+    default: return 1;
+    }
+}
+
+// ============================ FUNCTIONS ============================
+
+/**
+ * Helper function to lookup the stack index associated with a given stack variable. If the given name is not found -1 is returned.
+ */
+int get_stack_ind(size_t stack_size, char** name_stack, char* name) {
+    for (size_t i = 0; i < stack_size; ++i) {
+	if (strcmp(name_stack[i], name) == 0) { return i; }
+    }
+    return -1;
+}
+
+/**
+ * This is a helper function which reads the specified token and pushes it onto the named stack st.
+ */
+HashedItem _push_valtup(NamedStack* st, char* token, sc_error* err) {
+    //read the value and check for errors
+    HashedItem ret = _read_valtup(token, err);
+    if (err->type == E_SUCCESS) {
+	//push said value onto the stack and check for errors. The key is already interned by _read_valtup().
+	push_n(st, ret.key, ret.val, err);
+	if (err->type != E_SUCCESS) { free_NamedStack(st); }
+    }
+    return ret;
+}
+
+/**
+ * Helper function which removes the top n entries from the named stack of c and their bindings in the scope table. The named stack mirrors the stack at execution time so this must be called whenever an instruction pops values. Names are interned so they aren't freed here.
+ */
+void _pop_names(context* c, size_t n) {
+    sc_error tmp_err;
+    for (size_t i = 0; i < n; ++i) {
+	unbind_top(c);
+	pop_n(&(c->callstack), &tmp_err);
+    }
+}
+
+/**
+ * Helper function which converts the index f_ind returned by search_val() (measured from the top of the named stack) into the slot of the same value in the frame of the function being compiled. Unlike indices measured from the top, slots don't change as values are pushed and popped.
+ */
+size_t _frame_slot(context* c, int f_ind) {
+    return get_size_n(c->callstack) - 1 - (size_t)f_ind - c->frame;
+}
+
+/**
+ * Helper function which appends an instruction to discard every value above depth on the stack and removes the matching entries from the named stack of c.
+ */
+void _discard_names(context* c, size_t depth, instruction_buffer* buf, sc_error* err) {
+    size_t n_added = get_size_n(c->callstack);
+    if (n_added <= depth) { return; }
+    n_added -= depth;
+
+    union Instruction tmp[2];
+    tmp[0].i = INS_POP | INS_HH_C;
+    tmp[1].i = n_added;
+    append_Instructions(buf, 2, tmp, err);
+    _pop_names(c, n_added);
+}
+
+/**
+ * Helper function which checks whether the string str contains an operator outside of any parenthesis, brackets or quotes. Signs at the start of a literal (e.g. "-1") are not considered operators.
+ */
+int _has_root_op(const char* str) {
+    int nest_level = 0;
+    int verbatim = 0;
+    int seen_operand = 0;
+    for (size_t i = 0; str[i] != 0; ++i) {
+	if (str[i] == '\"') {
+	    verbatim = 1 - verbatim;
+	    seen_operand = 1;
+	} else if (verbatim) {
+	    continue;
+	} else if (str[i] == '(' || str[i] == '[') {
+	    ++nest_level;
+	} else if (str[i] == ')' || str[i] == ']') {
+	    --nest_level;
+	    seen_operand = 1;
+	} else if (nest_level == 0 && str[i] != ' ' && str[i] != '\t' && str[i] != '\n') {
+	    if (strchr("+-*/<>=!&|~", str[i])) {
+		//signs are only operators if they follow an operand and aren't part of an exponent (e.g. "1e-3")
+		if (str[i] == '+' || str[i] == '-') {
+		    if (!seen_operand) { continue; }
+		    if (i > 1 && (str[i-1] == 'e' || str[i-1] == 'E') && str[i-2] >= '0' && str[i-2] <= '9') { continue; }
+		}
+		return 1;
+	    }
+	    seen_operand = 1;
+	}
+    }
+    return 0;
+}
+
+/**
+ * Helper function which finds an assignment '=' at the root nest level of str. Comparisons such as "==" or "<=" are ignored. If an assignment is found then str is null terminated at the '=' and a pointer to the rval is returned, otherwise NULL is returned.
  */
-int _parse_rval(context* c, char* str, int force_1ret, instruction_buffer* buf, sc_error* err) {sc_reset_error(err);
-    //we create a temporary dyamic array to hold instructions
-    //TODO: figure out a better way to do this
-    /*size_t n_insts = *i_size;
-    size_t tmp_cap = 2*n_insts;
-    union Instruction* tmp_insts = (union Instruction*)sc_malloc(sizeof(union Instruction)*tmp_cap, err);
-    if (err->type != E_SUCCESS) { return -1; }*/
+char* _split_assignment(char* str) {
+    int nest_level = 0;
+    int verbatim = 0;
+    for (size_t i = 0; str[i] != 0; ++i) {
+	if (str[i] == '\"') {
+	    verbatim = 1 - verbatim;
+	} else if (verbatim) {
+	    continue;
+	} else if (str[i] == '(' || str[i] == '[') {
+	    ++nest_level;
+	} else if (str[i] == ')' || str[i] == ']') {
+	    --nest_level;
+	} else if (nest_level == 0 && str[i] == '=') {
+	    if (str[i+1] == '=') { ++i;continue; }
+	    if (i > 0 && (str[i-1] == '<' || str[i-1] == '>' || str[i-1] == '!')) { continue; }
+	    str[i] = 0;
+	    return str + i + 1;
+	}
+    }
+    return NULL;
+}
+
+/**
+ * Helper function which checks whether the string str starts with the keyword kw. Keywords must be followed by whitespace, a parenthesis, a curly brace or the end of the string.
+ * returns: the length of kw if there was a match or 0 otherwise
+ */
+size_t _read_keyword(const char* str, const char* kw) {
+    size_t i = 0;
+    for (; kw[i] != 0; ++i) {
+	if (str[i] != kw[i]) { return 0; }
+    }
+    if (str[i] == 0 || str[i] == ' ' || str[i] == '\t' || str[i] == '\n' || str[i] == '(' || str[i] == '{') { return i; }
+    return 0;
+}
+
+/**
+ * Helper function which returns 1 if the string str is a non negative base 10 integer literal or 0 otherwise.
+ */
+int _is_index_literal(const char* str) {
+    if (str[0] == 0) { return 0; }
+    for (size_t i = 0; str[i] != 0; ++i) {
+	if (str[i] < '0' || str[i] > '9') { return 0; }
+    }
+    return 1;
+}
 
-    int is_var = 1;
-    int st_off = -1;
+/**
+ * Helper function which compiles the array index ind_str so that it may be used by INS_IND_READ and INS_IND_WRITE. Literal indices are stored directly in the instruction while computed indices are placed in register 1.
+ * param bank: the INS_HL flag that the index should be read from is saved here
+ * returns: the parameter to use for the index
+ */
+size_t _parse_index(context* c, char* ind_str, size_t* bank, instruction_buffer* buf, sc_error* err) {
+    char* t_ind = _trim_whitespace(ind_str);
+    if (strchr(t_ind, ':')) {
+	sc_set_error(err, E_SYNTAX, "array slices are not supported in functions");
+	return 0;
+    }
+    if (_is_index_literal(t_ind)) {
+	*bank = INS_HL_C;
+	return (size_t)atol(t_ind);
+    }
+    if (_parse_rval(c, t_ind, 1, buf, err) < 0) { return 0; }
+    union Instruction tmp[2];
+    tmp[0].i = INS_POP | INS_HH_R;
+    tmp[1].i = 1;
+    append_Instructions(buf, 2, tmp, err);
+    _pop_names(c, 1);
+    *bank = INS_HL_R;
+    return 1;
+}
 
+/**
+ * Helper function for _parse_rval which compiles a call to the global function named name with the comma separated arguments in arg_str.
+ * returns: the number of values pushed onto the stack or a negative value on failure
+ */
+int _parse_call(context* c, char* name, char* arg_str, int force_1ret, instruction_buffer* buf, sc_error* err) {
     HashedItem* tmp_hash = NULL;
+    int f_ind = search_val(c, name, &tmp_hash);
 
-    //iterate through str to see if this is a function
-    for (size_t i = 0; str[i] != 0; ++i) {
-	if (str[i] == '('/*)*/) {
-	    char* arg_ilist = _get_enclosed(str + i, "(", ")");
-	    str[i] = 0;
-	    char* func_name = _trim_whitespace(str);
-	    int f_ind = search_val(c, func_name, &tmp_hash);
+    //throw an error if we couldn't find the function
+    if (f_ind < -1) {
+	sc_set_error(err, E_BADVAL, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "Couldn't find function \"%s\"", name);
+	return -1;
+    }
+    //the signature of the function must be known during compilation, so only global functions may be called
+    if (f_ind >= 0 || tmp_hash->val.type != VT_FUNC) {
+	sc_set_error(err, E_BADVAL, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "\"%s\" is not a global function", name);
+	return -1;
+    }
+    function* f = (function*)(tmp_hash->val.val.ptr);
+    //globals are referenced by their slot in the global table so that they may be accessed without hashing
+    size_t slot = h_intern_slot(&(c->global), tmp_hash, err);
+    if (err->type != E_SUCCESS) { return -1; }
 
-	    //throw an error if we couldn't find the function
-	    if (f_ind < -1) {
-		sc_set_error(err, E_BADVAL, "");
-		snprintf(err->msg, DTG_MAX_MSG_SIZE, "Couldn't find function \"%s\"", str);
-		return -1;
-	    }
-	    //throw an error if the value isn't a function
-	    if (tmp_hash->val.type != VT_FUNC) {
-		sc_set_error(err, E_BADVAL, "");
-		snprintf(err->msg, DTG_MAX_MSG_SIZE, "\"%s\" is of non function type %d", str, tmp_hash->val.type);
-		return -1;
-	    }
+    //throw an error if the function doesn't have the correct number of return values
+    if (force_1ret && f->n_rets != 1) {
+	sc_set_error(err, E_BADVAL, "functions in operations or function arguments may only return one value");
+	return -1;
+    }
 
-	    //cast the pointer to a function struct
-	    function* f = (function*)(tmp_hash->val.val.ptr);
+    //break up the inside of the parenthesis by commas to find arguments
+    size_t n_args_i = 0;
+    char** args_i = csv_to_list(arg_str, ',', &n_args_i, err);
+    if (err->type != E_SUCCESS) { return -1; }
+    if (n_args_i == 1 && args_i[0][0] == 0) { n_args_i = 0; }
+    if (n_args_i != f->n_args) {
+	sc_set_error(err, E_SYNTAX, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "function %s expects %lu arguments, got %lu", name, f->n_args, n_args_i);
+	free(args_i);
+	return -1;
+    }
 
-	    //throw an error if the function doesn't have the correct number of return values
-	    if (force_1ret && f->n_rets != 1) {
-		sc_set_error(err, E_BADVAL, "functions in operations or function arguments may only return one value");
-		return -1;
-	    }
+    //iterate over each argument and parse it into a list of instructions
+    for (size_t j = 0; j < n_args_i; ++j) {
+	if (_parse_rval(c, args_i[j], 1, buf, err) < 0) {
+	    free(args_i);
+	    return -1;
+	}
+    }
+    free(args_i);
 
-	    //break up the inside of the parenthesis by commas to find arguments
-	    size_t n_args_i = 0;
-	    char** args_i = csv_to_list(arg_ilist, ',', &n_args_i, err);
-	    if (err->type != E_SUCCESS) { return -1; }
+    //append the function call instruction to the buffer
+    union Instruction tmp[2];
+    tmp[0].i = INS_FN_EVAL | INS_HH_G;
+    tmp[1].i = slot;
+    append_Instructions(buf, 2, tmp, err);
+    if (err->type != E_SUCCESS) { return -1; }
+
+    //the arguments are replaced by the returned values
+    _pop_names(c, f->n_args);
+    value tmp_val = {0};
+    for (size_t j = 0; j < f->n_rets; ++j) {
+	tmp_val.type = f->return_types[j];
+	push_n(&(c->callstack), NULL, tmp_val, err);
+    }
+    return f->n_rets;
+}
+
+/**
+ * Helper function which returns 1 if c may be part of a value name or 0 otherwise.
+ */
+int _is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
 
-	    //iterate over each argument and parse it into a list of instructions
-	    for (size_t j = 0; j < n_args_i; ++j) {
-		char* arg = _trim_whitespace(args_i[j]);
-		int tmp_err = _parse_rval(c, arg, 1, buf, err);
-		if (tmp_err < 0) {
-		    free(args_i);
-		    return tmp_err;
+/**
+ * Helper function for _parse_rval which prepares the expression str for gen_optree. Optrees may only reference literals and values on the stack, so function calls, array indices and global values are evaluated first and pushed onto the stack as temporaries. Calls and indices are replaced in str by the name of their temporary while globals keep their own names.
+ * returns: the number of temporaries pushed onto the stack or a negative value on failure
+ */
+int _hoist_operands(context* c, char* str, instruction_buffer* buf, sc_error* err) {
+    int n_tmps = 0;
+    int verbatim = 0;
+    HashedItem* tmp_hash = NULL;
+    union Instruction tmp[2];
+    char name[N_WORD_BYTES];
+    for (size_t i = 0; str[i] != 0; ++i) {
+	if (str[i] == '\"') { verbatim = 1 - verbatim;continue; }
+	//only look at the start of names, this excludes exponents in literals such as 1e5
+	if (verbatim || !_is_name_char(str[i]) || (str[i] >= '0' && str[i] <= '9')) { continue; }
+	if (i > 0 && (_is_name_char(str[i-1]) || str[i-1] == '.' || str[i-1] == '$')) { continue; }
+	size_t j = i;
+	while (_is_name_char(str[j])) { ++j; }
+	size_t k = j;
+	while (str[k] == ' ' || str[k] == '\t') { ++k; }
+
+	if (str[k] == '(' || str[k] == '[') {
+	    //find the matching close
+	    int nest_level = 0;
+	    size_t e = k;
+	    for (; str[e] != 0; ++e) {
+		if (str[e] == '(' || str[e] == '[') {
+		    ++nest_level;
+		} else if (str[e] == ')' || str[e] == ']') {
+		    --nest_level;
+		    if (nest_level == 0) { break; }
 		}
 	    }
-	    is_var = 0;
-
-	    //append the function call instruction to the buffer
-	    union Instruction tmp[2];
-	    tmp[0].i = INS_FN_EVAL;
-	    if (f_ind < 0) {
-		tmp[0].i = tmp[0].i | INS_HH_G;
-		tmp[1].ptr = tmp_hash->key;
-	    } else {
-		tmp[0].i = tmp[0].i | INS_HH_S;
-		tmp[1].i = f_ind;
-	    }
-	   
-	    append_Instructions(buf, 2, tmp, err);
-	    if (err->type != E_SUCCESS) { return -2; }
-	    return f->n_rets;
-	} else if (str[i] == '['/*]*/) {
-	    char* arg = _get_enclosed(str + i, "[", "]");
-	    str[i] = 0;
-	    char* arr_name = _trim_whitespace(str);
-	    int f_ind = search_val(c, arr_name, &tmp_hash);
-
-	    //throw an error if we couldn't find the array
-	    if (f_ind < -1) {
-		sc_set_error(err, E_BADVAL, "");
-		snprintf(err->msg, DTG_MAX_MSG_SIZE, "Couldn't find Array \"%s\"", str);
+	    if (str[e] == 0) {
+		sc_set_error(err, E_SYNTAX, "");
+		snprintf(err->msg, DTG_MAX_MSG_SIZE, "unmatched open in %s", str);
 		return -1;
 	    }
-	    //throw an error if the value isn't an array
-	    if (tmp_hash->val.type != VT_ARRAY) {
-		sc_set_error(err, E_BADVAL, "");
-		snprintf(err->msg, DTG_MAX_MSG_SIZE, "\"%s\" is of non Array type %d", str, tmp_hash->val.type);
+	    //compile a copy of the call or index since _parse_rval modifies its argument. Short copies are kept on the stack.
+	    size_t span = e + 1 - i;
+	    char loc_sub[TOK_BUF_SIZE];
+	    char* sub = loc_sub;
+	    if (span >= TOK_BUF_SIZE) {
+		sub = (char*)sc_malloc(sizeof(char)*(span + 1), err);
+		if (err->type != E_SUCCESS) { return -1; }
+	    }
+	    memcpy(sub, str + i, span);
+	    sub[span] = 0;
+	    int n_vals = _parse_rval(c, sub, 1, buf, err);
+	    if (sub != loc_sub) { sc_free(sub); }
+	    if (n_vals < 0) { return -1; }
+
+	    //name the temporary and substitute the name into the expression
+	    int n_written = snprintf(name, N_WORD_BYTES, "$%d", n_tmps);
+	    if (n_written < 0 || (size_t)n_written > span) {
+		sc_set_error(err, E_SYNTAX, "too many function calls in expression");
 		return -1;
 	    }
-
-	    //cast the pointer to a function struct
-	    Array* a = (Array*)(tmp_hash->val.val.ptr);
-
-	    //parse slices
-	    size_t n_args_i;
-	    char** args_i = csv_to_list(arg, ':', &n_args_i, err);
+	    c->callstack.top->key = intern_str(name, err);
+	    memcpy(str + i, name, n_written);
+	    memset(str + i + n_written, ' ', span - n_written);
+	    ++n_tmps;
+	    i = e;
+	} else {
+	    //globals are copied onto the stack under their own name
+	    char term = str[j];
+	    str[j] = 0;
+	    if (search_val(c, str + i, &tmp_hash) == -1) {
+		tmp[0].i = INS_PUSH | INS_HH_G;
+		tmp[1].i = h_intern_slot(&(c->global), tmp_hash, err);
+		if (err->type == E_SUCCESS) { append_Instructions(buf, 2, tmp, err); }
+		value tmp_val = {0};
+		tmp_val.type = tmp_hash->val.type;
+		push_n(&(c->callstack), str + i, tmp_val, err);
+		++n_tmps;
+	    }
+	    str[j] = term;
 	    if (err->type != E_SUCCESS) { return -1; }
-	    //depending on the number of colons we interpret the index differently
-	    if (n_args_i == 1) {
-		int ind = sc_atoi(args_i[0], err);
-		if (err->type == E_SUCCESS) {
-		    //make sure that the index is in bounds
-		    if (a->size <= ind || ind < 0) {
-			sc_set_error(err, E_BADVAL, "");
-			snprintf(err->msg, DTG_MAX_MSG_SIZE, "index %d out of bounds for array %s of size %d", ind, str, a->size);
-			return -1;
-		    }
-		    union Instruction tmp[5];
-		    //read the appropriate array index into the register A
-		    if (f_ind < 0) {
-			tmp[0].i = INS_IND_READ | INS_HH_G;
-			tmp[1].ptr = tmp_hash->key;
-
-		    } else {
-			tmp[0].i = INS_IND_READ | INS_HH_S;
-			tmp[1].i = f_ind;
-		    }
-		    //push register A onto the stack
-		    tmp[2].i = ind;
-		    tmp[3].i = INS_PUSH | INS_HH_R;
-		    tmp[4].i = 0;
-		    append_Instructions(buf, 5, tmp, err);
-		    return 1;
-		} else {
-		    return -1;
-		}
-	    //if there are at least two entries we interpret the first two as the start and end respectively
-	    } else if (n_args_i >= 2) {
-		//figure out the start and end values
-		/*TODO: uncomment
-		int start = sc_atoi(args_i[0], err);
-		if (err->type != E_SUCCESS) { return -1; }
-		int end = sc_atoi(args_i[1], err);
-		if (err->type != E_SUCCESS) { return -1; }
-		
-		//interpret the last number as a span so we only include every n entries
-		int span = 1;
-		if (n_args_i > 2) {
-		    span = sc_atoi(args_i[2], err);
-		    if (err->type != E_SUCCESS) { return -1; }
-		}
-
-		//parse negative values as offsets from the end
-		if (start < 0) { start = a->size + start; }
-		if (end < 0) { end = a->size + end; }
-		//make sure both indices are in bounds
-		if (start < 0 || end < 0 || start > end ||
-		      start >= a->size || end >= a->size) {
-		    sc_set_error(err, E_BADVAL, "");
-		    snprintf(err->msg, DTG_MAX_MSG_SIZE, "indices %d:%d out of bounds for array %s of size %d", start, end, str, a->size);
-		    return -1;
-		}
+	    i = j - 1;
+	}
+    }
+    return n_tmps;
+}
 
-		//throw an error if the slice doesn't have the correct number of return values
-		if (force_1ret && end-start > 1) {
-		    sc_set_error(err, E_BADVAL, "functions in operations or function arguments may only return one value");
-		    return -1;
-		}
+/**
+ * Helper function which parses an rval string into a sequence of instructions. This is done by recursively looking up values from the provided context and replacing with optrees or functions to evaluate where appropriate. The resulting set of instructions is appended to buf. The string str is modified "in place".
+ * The named stack of c mirrors the stack at execution time, so an unnamed entry is pushed onto it for every value the instructions push.
+ * param c: the context of the calling function
+ * param str: the string to parse into a list of instructions
+ * param force_1ret: if this is 1, then all functions which are parsed must return one value, or an error will be thrown. This is applied to expressions in optrees and arguments in functions.
+ * param buf: the instruction buffer to append to.
+ * param err: check for errors
+ * returns: on success, the number of values pushed onto the stack during execution is returned. on failure, a negative value is returned
+ */
+int _parse_rval(context* c, char* str, int force_1ret, instruction_buffer* buf, sc_error* err) {
+    sc_reset_error(err);
+    HashedItem* tmp_hash = NULL;
+    union Instruction tmp[5];
+    value tmp_val = {0};
 
-		//place a pointer to the array in register A.
-		union Instruction tmp[3];
-		if (f_ind < 0) {
-		    tmp[0].i = INS_MOV & INS_HH_R & INS_HL_G;
-		    tmp[1].i = 0;
-		    tmp[2].ptr = tmp_hash->key;
-		} else {
-		    tmp[0].i = INS_MOV & INS_HH_R & INS_HL_S;
-		    tmp[1].i = 0;
-		    tmp[2].i = f_ind;
-		}
+    char* t_str = _trim_whitespace(str);
+    size_t n_chars = strlen(t_str);
+    if (n_chars == 0 || t_str[0] == ' ' || t_str[0] == '\t' || t_str[0] == '\n') {
+	sc_set_error(err, E_SYNTAX, "expected rvalue");
+	return -1;
+    }
 
-		//set instructions to push values onto stack
-
-		for (size_t j = start; j < end; j += span) {
-		    if (f_ind < 0) {
-			tmp[0].i = INS_PUSH_A;
-			tmp[1].ptr = tmp_hash->key;
-			tmp[2].i = j;
-		    } else {
-			tmp[0].i = INS_PUSH_A_ST;
-			tmp[1].i = f_ind;
-			tmp[2].i = j;
-		    }
-		    append_Instructions(buf, 2, tmp, err);
-		}
-		return end - start;*/
+    //expressions are compiled into optrees
+    if (_has_root_op(t_str)) {
+	int n_tmps = _hoist_operands(c, t_str, buf, err);
+	if (n_tmps < 0) { return -1; }
+	//the optree is only needed to generate the flat expression which is actually executed, so its nodes are placed in the scratch arena which is reset once the expression is generated
+	struct Operation* op = parse_optree(t_str, &(c->callstack), &(c->scratch), err);
+	if (op == NULL || err->type != E_SUCCESS) {
+	    reset_arena(&(c->scratch));
+	    if (err->type == E_SUCCESS) { sc_set_error(err, E_SYNTAX, "invalid expression"); }
+	    return -1;
+	}
+	c->n_folded += fold_Operation(&op, &(c->scratch));
+	expression* e = (expression*)arena_alloc(&(buf->mem), sizeof(expression), err);
+	if (e) { *e = make_expression(op, &(buf->mem), err); }
+	reset_arena(&(c->scratch));
+	if (err->type != E_SUCCESS) { return -1; }
+	tmp[0].i = INS_OP_EVAL | INS_HH_C;
+	tmp[1].ptr = e;
+	append_Instructions(buf, 2, tmp, err);
+	//temporaries are discarded once the expression is evaluated
+	if (n_tmps > 0) { _discard_names(c, get_size_n(c->callstack) - n_tmps, buf, err); }
+	tmp[0].i = INS_PUSH | INS_HH_R;
+	tmp[1].i = 0;
+	append_Instructions(buf, 2, tmp, err);
+	if (err->type != E_SUCCESS) { return -1; }
+	push_n(&(c->callstack), NULL, tmp_val, err);
+	return 1;
+    }
+
+    //remove parenthesis enclosing the whole expression
+    if (t_str[0] == '(' && t_str[n_chars-1] == ')') {
+	char* endptr = NULL;
+	char* inner = _get_enclosed_r(t_str, &endptr, "(", ")");
+	if (endptr == NULL || *endptr != 0) {
+	    sc_set_error(err, E_SYNTAX, "invalid expression");
+	    return -1;
+	}
+	return _parse_rval(c, inner, force_1ret, buf, err);
+    }
+
+    //function calls and array indices are names followed by a parenthetical or bracketed block
+    if ((t_str[n_chars-1] == ')' || t_str[n_chars-1] == ']') && t_str[0] != '[' && t_str[0] != '\"') {
+	//find the matching open character
+	int nest_level = 0;
+	size_t j = n_chars;
+	for (; j > 0; --j) {
+	    if (t_str[j-1] == ')' || t_str[j-1] == ']') {
+		++nest_level;
+	    } else if (t_str[j-1] == '(' || t_str[j-1] == '[') {
+		--nest_level;
+		if (nest_level == 0) { break; }
 	    }
 	}
+	if (j < 2) {
+	    sc_set_error(err, E_SYNTAX, "");
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "unmatched close in %s", t_str);
+	    return -1;
+	}
+	char open = t_str[j-1];
+	t_str[j-1] = 0;
+	t_str[n_chars-1] = 0;
+	char* name = _trim_whitespace(t_str);
+	if (open == '(') {
+	    return _parse_call(c, name, t_str + j, force_1ret, buf, err);
+	}
+
+	size_t ind_bank = INS_HL_C;
+	size_t ind = _parse_index(c, t_str + j, &ind_bank, buf, err);
+	if (err->type != E_SUCCESS) { return -1; }
+	int f_ind = search_val(c, name, &tmp_hash);
+	//throw an error if we couldn't find the array
+	if (f_ind < -1) {
+	    sc_set_error(err, E_BADVAL, "");
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "Couldn't find Array \"%s\"", name);
+	    return -1;
+	}
+	//throw an error if the value isn't an array, types of temporary values aren't known until execution
+	if (tmp_hash->val.type != VT_ARRAY && tmp_hash->val.type != VT_UNDEF) {
+	    sc_set_error(err, E_BADVAL, "");
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "\"%s\" is of non Array type %d", name, tmp_hash->val.type);
+	    return -1;
+	}
+	//read the appropriate array index into register 0 and push it onto the stack
+	if (f_ind < 0) {
+	    tmp[0].i = INS_IND_READ | INS_HH_G | ind_bank;
+	    tmp[1].i = h_intern_slot(&(c->global), tmp_hash, err);
+	    if (err->type != E_SUCCESS) { return -1; }
+	} else {
+	    tmp[0].i = INS_IND_READ | INS_HH_S | ind_bank;
+	    tmp[1].i = _frame_slot(c, f_ind);
+	}
+	tmp[2].i = ind;
+	tmp[3].i = INS_PUSH | INS_HH_R;
+	tmp[4].i = 0;
+	append_Instructions(buf, 5, tmp, err);
+	if (err->type != E_SUCCESS) { return -1; }
+	push_n(&(c->callstack), NULL, tmp_val, err);
+	return 1;
     }
-    //if we reach the end of the loop we treat the name as a variable
-    char* t_str = _trim_whitespace(str);
+
+    //otherwise treat the string as a variable name or a literal
     int f_ind = search_val(c, t_str, &tmp_hash);
-    //create an array for the instruction
-    union Instruction tmp[2];
     if (f_ind < -1) {
 	//in the event that we didn't find a variable with a matching name, try parsing the value as a constant. For example 'int i = 1234' should create a new value with the name i and an integer type value, val, with val.i = 1234.
-	//TODO: allow the caller to supply hints for value type
-	//allocate memory for a constant value
-	value* tmp_val = (value*)sc_malloc(sizeof(value), err);
-	*tmp_val = read_value_string(t_str, VT_UNDEF, err);
-	//if there was an error, try parsing as an operation
-	/*if (err->type != E_SUCCESS) {
-	    sc_reset_error(err);
-	    tmp[0].i = INS_OP_EVAL;
-	    tmp[1].ptr = gen_optree(str, &(c->callstack), err);
-	    if (err->type != E_SUCCESS) {
-		return -1;
-	    }
-	}*/
+	value con_val = read_value_string(t_str, VT_UNDEF, err);
+	if (err->type != E_SUCCESS) {
+	    sc_set_error(err, E_BADVAL, "");
+	    snprintf(err->msg, DTG_MAX_MSG_SIZE, "unrecognized rvalue %s", t_str);
+	    return -1;
+	}
+	tmp_val.type = con_val.type;
 	tmp[0].i = INS_PUSH | INS_HH_C;
-	tmp[1].ptr = tmp_val;
+	tmp[1].i = intern_const(buf, con_val, err);
+	if (err->type != E_SUCCESS) { return -1; }
     } else if (f_ind == -1) {
 	//otherwise push from global or stack memory accordingly
+	tmp_val.type = tmp_hash->val.type;
 	tmp[0].i = INS_PUSH | INS_HH_G;
-	tmp[1].ptr = tmp_hash->key;
+	tmp[1].i = h_intern_slot(&(c->global), tmp_hash, err);
+	if (err->type != E_SUCCESS) { return -1; }
     } else {
+	tmp_val.type = tmp_hash->val.type;
 	tmp[0].i = INS_PUSH | INS_HH_S;
-	tmp[1].i = f_ind;
+	tmp[1].i = _frame_slot(c, f_ind);
     }
 
     append_Instructions(buf, 2, tmp, err);
+    if (err->type != E_SUCCESS) { return -1; }
+    push_n(&(c->callstack), NULL, tmp_val, err);
     return 1;
 }
 
 /**
- *  A helper function to parse the string str (of the form <type> <name>) into a type and value string.
+ *  A helper function to parse the string str (of the form <type> <name> or <type> <name> = <rval>) into instructions which push the declared value onto the stack.
  *  param str: string to parse, including the type
  *  param type: the type to cast the resulting value to
  *  param off: the offset specifying the end of the type specifier string in str
- *  param n_st: named stack to push the new value to
+ *  param c: context with the named stack to push the new value to
  *  param i_buf: instruction buffer to write to
  *  param err: track errors
- *  returns: the number of characters from the name which were read, see the specifications for read_dtg_word
+ *  returns: the number of characters from str which were read
  */
 size_t __read_declaration(char* str, Valtype_e type, size_t off, context* c, instruction_buffer* i_buf, sc_error* err) {
-    char next_word[N_WORD_BYTES];
-
-    //we can safely write to the location that has the variable type since a code for the type will be stored in the instruction buffer
-    size_t ret = read_dtg_word(str, off, str, N_WORD_BYTES);
+    size_t ret = strlen(str);
+    char* rval = _split_assignment(str + off);
+    char* name = _trim_whitespace(str + off);
+    if (name[0] == 0 || name[0] == ' ' || name[0] == '\t' || name[0] == '\n') {
+	sc_set_error(err, E_SYNTAX, "missing variable name");
+	return ret;
+    }
 
-    //set the value to a sane default
-    value tmp;
-    tmp.type = type;
-    tmp.val.i = 0;
+    if (rval) {
+	if (_parse_rval(c, rval, 1, i_buf, err) < 0) { return ret; }
+    } else {
+	//set the value to a sane default
+	union Instruction tmp_ins[4];
+	tmp_ins[0].i = INS_MAKE_VAL;
+	tmp_ins[1].i = type;
+	tmp_ins[2].i = INS_PUSH | INS_HH_R;
+	tmp_ins[3].i = 0;
+	append_Instructions(i_buf, 4, tmp_ins, err);
+	if (err->type != E_SUCCESS) { return ret; }
+	value tmp = {0};
+	push_n(&(c->callstack), NULL, tmp, err);
+	if (err->type != E_SUCCESS) { return ret; }
+    }
 
-    //push onto the list of named items
-    char* dec_namestr = strdup(str);
-    push_n(&(c->callstack), dec_namestr, tmp, err);
-    if (err->type != E_SUCCESS) { return ret; }
+    //the value on the top of the stack is now the declared variable
+    c->callstack.top->key = intern_str(name, err);
+    c->callstack.top->val.type = type;
+    if (err->type == E_SUCCESS) { bind_top(c, err); }
+    return ret;
+}
 
-    union Instruction tmp_ins[2];
-    //read the next word to check if there is an assignment
-    size_t new_off = read_dtg_word(str, ret, next_word, N_WORD_BYTES);
-    if (next_word[0] == '=' && next_word[1] == 0) {
-	//read the term after the '=' sign
-	new_off += read_dtg_word(str, new_off, next_word, N_WORD_BYTES);
+/**
+ * Helper function for make_function which compiles the assignment of rval to the comma separated list of names in lval.
+ */
+void _parse_assignment(context* c, char* lval, char* rval, instruction_buffer* buf, sc_error* err) {
+    size_t n_l = 0;
+    char** lvals = csv_to_list(lval, ',', &n_l, err);
+    if (err->type != E_SUCCESS) { return; }
+    int n_rvals = _parse_rval(c, rval, n_l == 1, buf, err);
+    if (n_rvals < 0) { free(lvals);return; }
+    if ((size_t)n_rvals != n_l) {
+	sc_set_error(err, E_SYNTAX, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "expected %lu values for assignment, got %d", n_l, n_rvals);
+	free(lvals);
+	return;
+    }
 
-	//first try interpreting the rval as a literal assignment
-	/*tmp = read_value_string(next_word, type, err);
-	//if that didn't work, then search the current context
-	if (err->type != E_SUCCESS) {
-	    //look for the matching rval and perform a deep copy into tmp
-	    HashedItem* hash;
-	    int ind = search_val(c, next_word, &hash);
-	    if (ind >= 0) {
-		tmp_ins[0].i = INS_PUSH | INS_HH_S;
-		tmp_ins[1].i = (size_t)ind;
-	    } else if (ind == -1) {
-		tmp_ins[0].i = INS_PUSH | INS_HH_G;
-		tmp_ins[1].ptr = hash->key;
+    union Instruction tmp[5];
+    HashedItem* tmp_hash = NULL;
+    //the last value is on the top of the stack so we assign in reverse order
+    for (size_t j = n_l; j > 0 && err->type == E_SUCCESS; --j) {
+	char* name = lvals[j-1];
+	char* ind_str = strchr(name, '[');
+	if (ind_str) {
+	    //writes to an array index. The index is computed after the value so the value is moved to register 0 after the index is read
+	    char* close = strrchr(name, ']');
+	    if (close == NULL || close < ind_str) {
+		sc_set_error(err, E_SYNTAX, "expected ']'");
+		break;
+	    }
+	    *ind_str = 0;
+	    *close = 0;
+	    size_t ind_bank = INS_HL_C;
+	    size_t ind = _parse_index(c, ind_str + 1, &ind_bank, buf, err);
+	    if (err->type != E_SUCCESS) { break; }
+	    tmp[0].i = INS_POP | INS_HH_R;
+	    tmp[1].i = 0;
+	    _pop_names(c, 1);
+	    int f_ind = search_val(c, name, &tmp_hash);
+	    if (f_ind < -1) {
+		sc_set_error(err, E_BADVAL, "");
+		snprintf(err->msg, DTG_MAX_MSG_SIZE, "Couldn't find Array \"%s\"", name);
+		break;
+	    } else if (f_ind == -1) {
+		tmp[2].i = INS_IND_WRITE | INS_HH_G | ind_bank;
+		tmp[3].i = h_intern_slot(&(c->global), tmp_hash, err);
+		if (err->type != E_SUCCESS) { break; }
 	    } else {
+		tmp[2].i = INS_IND_WRITE | INS_HH_S | ind_bank;
+		tmp[3].i = _frame_slot(c, f_ind);
+	    }
+	    tmp[4].i = ind;
+	    append_Instructions(buf, 5, tmp, err);
+	    continue;
+	}
+
+	//If we didn't find the value in the stack or global memory then we create a new one by naming the value on top of the stack
+	int f_ind = search_val(c, name, &tmp_hash);
+	if (f_ind < -1) {
+	    //TODO: implement global keyword
+	    if (n_l > 1) {
 		sc_set_error(err, E_BADVAL, "");
-		snprintf(err->msg, DTG_MAX_MSG_SIZE, "bad rval %s", next_word);
-		return ret;
+		snprintf(err->msg, DTG_MAX_MSG_SIZE, "undeclared value %s in multiple assignment", name);
+		break;
 	    }
+	    c->callstack.top->key = intern_str(name, err);
+	    if (err->type == E_SUCCESS) { bind_top(c, err); }
+	    continue;
+	}
+	//the value is stored once it has been popped
+	_pop_names(c, 1);
+	f_ind = search_val(c, name, &tmp_hash);
+	if (f_ind == -1) {
+	    tmp[0].i = INS_POP | INS_HH_G;
+	    tmp[1].i = h_intern_slot(&(c->global), tmp_hash, err);
+	    if (err->type != E_SUCCESS) { break; }
 	} else {
-	    tmp_ins[0].i = INS_PUSH | INS_HH_C;
-	    value* tmp_val = sc_malloc(sizeof(value), err);
-	    tmp_val->type = tmp.type;
-	    tmp_val->val = tmp.val;
-	    tmp_ins[0].ptr = tmp_val;
+	    tmp[0].i = INS_POP | INS_HH_S;
+	    tmp[1].i = _frame_slot(c, f_ind);
 	}
-	//update the return value
-	ret = new_off;*/
-	_parse_rval(c, next_word, 1, i_buf, err);
+	append_Instructions(buf, 2, tmp, err);
     }
+    free(lvals);
+}
+
+/**
+ * Helper function for make_function which compiles a return statement with the comma separated list of values in str for the function f.
+ */
+void _parse_return(context* c, function* f, char* str, sc_error* err) {
+    size_t n_r = 0;
+    char* t_str = _trim_whitespace(str);
+    if (t_str[0] != 0 && t_str[0] != ' ' && t_str[0] != '\t' && t_str[0] != '\n') {
+	char** rvals = csv_to_list(t_str, ',', &n_r, err);
+	if (err->type != E_SUCCESS) { return; }
+	for (size_t j = 0; j < n_r; ++j) {
+	    if (_parse_rval(c, rvals[j], 1, &(f->buf), err) < 0) { free(rvals);return; }
+	}
+	free(rvals);
+    }
+    if (n_r != f->n_rets) {
+	sc_set_error(err, E_SYNTAX, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "function returns %lu values, got %lu", f->n_rets, n_r);
+	return;
+    }
+    union Instruction tmp;
+    tmp.i = INS_RETURN;
+    append_Instruction(&(f->buf), tmp, err);
+    _pop_names(c, n_r);
+}
 
-    /*append_Instructions(i_buf, 2, tmp_ins, err);
-    if (err->type != E_SUCCESS) { return ret; }*/
+/**
+ * Helper function for make_function which compiles the condition of a while or if block. A conditional jump is appended which is taken if the condition is false.
+ * returns: the index of the jump target so that it may be filled in once the end of the block is found or INONE on failure
+ */
+size_t _parse_condition(context* c, char* str, instruction_buffer* buf, sc_error* err) {
+    if (_parse_rval(c, str, 1, buf, err) < 0) { return INONE; }
+    union Instruction tmp[5];
+    tmp[0].i = INS_POP | INS_HH_R;
+    tmp[1].i = 0;
+    tmp[2].i = INS_JUMP_CND | INS_HH_R;
+    tmp[3].i = 0;
+    tmp[4].i = INONE;
+    append_Instructions(buf, 5, tmp, err);
+    _pop_names(c, 1);
+    if (err->type != E_SUCCESS) { return INONE; }
+    return buf->n_insts - 1;
+}
 
-    return ret;
+/**
+ * Helper function for make_function which compiles a single statement (a declaration, assignment, return or expression) into the instruction buffer of f.
+ */
+void _parse_statement(context* c, function* f, char* stmt, sc_error* err) {
+    //check for declarations
+    size_t kw = 0;
+    Valtype_e type = VT_UNDEF;
+    if ((kw = _read_keyword(stmt, "bool"))) {
+	type = VT_BOOL;
+    } else if ((kw = _read_keyword(stmt, "char"))) {
+	type = VT_CHAR;
+    } else if ((kw = _read_keyword(stmt, "int"))) {
+	type = VT_INT;
+    } else if ((kw = _read_keyword(stmt, "float"))) {
+	type = VT_FLOAT;
+    } else if ((kw = _read_keyword(stmt, "string"))) {
+	type = VT_STRING;
+    } else if ((kw = _read_keyword(stmt, "array"))) {
+	type = VT_ARRAY;
+    } else if ((kw = _read_keyword(stmt, "func"))) {
+	type = VT_FUNC;
+    }
+    if (type != VT_UNDEF) {
+	__read_declaration(stmt, type, kw, c, &(f->buf), err);
+	return;
+    }
+
+    if ((kw = _read_keyword(stmt, "return"))) {
+	_parse_return(c, f, stmt + kw, err);
+	return;
+    }
+
+    char* rval = _split_assignment(stmt);
+    if (rval) {
+	_parse_assignment(c, stmt, rval, &(f->buf), err);
+	return;
+    }
+
+    //handle all other types of instruction (mostly function executions) by discarding the results
+    size_t depth = get_size_n(c->callstack);
+    if (_parse_rval(c, stmt, 0, &(f->buf), err) < 0) { return; }
+    _discard_names(c, depth, &(f->buf), err);
+}
+
+/**
+ * Helper function for make_function which replaces calls in tail position by tail calls. A call is in tail position if it is immediately followed by a return and the called function returns as many values as f. The return is left in place since it may be the target of a jump.
+ * Tail calls reuse the frame of f, so they are not used if f takes the address of any of its stack values.
+ */
+void _mark_tail_calls(context* c, function* f) {
+    union Instruction* ins = f->buf.buf;
+    size_t n = f->buf.n_insts;
+    for (size_t i = 0; i < n; i += _ins_size(ins[i].i)) {
+	if (ins[i].i == (INS_MAKE_PTR | INS_HH_S)) { return; }
+    }
+    for (size_t i = 0; i < n; i += _ins_size(ins[i].i)) {
+	if (ins[i].i != (INS_FN_EVAL | INS_HH_G) || i + 2 >= n || ins[i+2].i != INS_RETURN) { continue; }
+	size_t slot = ins[i+1].i;
+	if (slot >= c->global.n_slots || c->global.slots[slot] == NULL || c->global.slots[slot]->val.type != VT_FUNC) { continue; }
+	function* fn = (function*)(c->global.slots[slot]->val.val.ptr);
+	if (fn->n_rets == f->n_rets) { ins[i].i = INS_TAIL_CALL | INS_HH_G; }
+    }
 }
 
 /**
@@ -1293,8 +2649,10 @@ size_t __read_declaration(char* str, Valtype_e type, size_t off, context* c, ins
  */
 function make_function(context* con, char* str, sc_error* err) {
     function ret = {0};
-    //we need to store the current stack index so that we can erase everything we added after completion
+    //we need to store the current stack index so that we can erase everything we added after completion. The frame of the function starts here as well
     size_t stack_start = get_size_n(con->callstack);
+    size_t old_frame = con->frame;
+    con->frame = stack_start;
 
     //find the arguments and return lists and the main program list
     char* endptr;
@@ -1313,9 +2671,9 @@ function make_function(context* con, char* str, sc_error* err) {
 		return ret;
 	    }
 	    //see if this is a 2 character expression of the form =>
-	    if (endptr[1] = '>') {
+	    if (endptr[1] == '>') {
 		endptr[0] = 0;
-		*endptr = *endptr + 2;
+		endptr += 2;
 	    } else {
 		//if it isn't then we try once more under the assumption that this is a function assignment of the form "f = arg => out {}"
 		endptr = strchr(str, '=');
@@ -1323,9 +2681,9 @@ function make_function(context* con, char* str, sc_error* err) {
 		    sc_set_error(err, E_SYNTAX, "Couldn't identify argument list in function string.");
 		    return ret;
 		}
-		if (endptr[1] = '>') {
+		if (endptr[1] == '>') {
 		    endptr[0] = 0;
-		    *endptr = *endptr + 2;
+		    endptr += 2;
 		}
 	    }
 	}
@@ -1378,11 +2736,20 @@ function make_function(context* con, char* str, sc_error* err) {
 	//read the value and check for errors
 	_push_valtup(&(con->callstack), token, err);
 	if (err->type != E_SUCCESS) { return ret; }
+	bind_top(con, err);
+	if (err->type != E_SUCCESS) { return ret; }
 
 	ret.n_args += 1;
 	token = strtok_r(NULL, ",", &saveptr); 
     }
 
+    //the argument types are read from the named stack, where the first argument is the deepest
+    ret.argument_types = sc_malloc(sizeof(Valtype_e)*(ret.n_args), err);
+    if (err->type != E_SUCCESS) { return ret; }
+    for (size_t k = 0; k < ret.n_args; ++k) {
+	ret.argument_types[k] = con->callstack.top[ret.n_args - 1 - k].val.type;
+    }
+
     /*REMOVE?
      * //create two lists, one to hold the types and one to hold names. Names are only used for this function. The final returned value will only contain references to stack indices.
     ret.argument_types = sc_malloc(sizeof(Valtype_e)*(ret.n_args), err);
@@ -1432,6 +2799,7 @@ function make_function(context* con, char* str, sc_error* err) {
 	    //free_NamedStack(&name_stack);
 	}
 	++i;
+	rets->size = i;
 	token = strtok_r(NULL, ",", &saveptr); 
     }
     ret.n_rets = i;
@@ -1450,252 +2818,224 @@ function make_function(context* con, char* str, sc_error* err) {
     }
     //free_Array(args);
     free_Array(rets);
+    sc_free(rets);
 
     //actually start parsing the main body
-    //char** f_lines = csv_to_list(main_block, ';', &(ret.n_instructions), err);
-
     ret.buf = make_instruction_buffer(err);
     if (err->type != E_SUCCESS) {
-	//free_NamedStack(&name_stack);
-	sc_free(ret.return_types);
-	ret.return_types = NULL;
-	return ret;
-    }
-
-    int commented = 0;
-    //store instruction "tokens". These include statements like "if", "while", "for", type indicators (e.g. bool, int), value names and literals
-    char* ins_toks[N_INS_TOKS];
-    int n_toks = 0;
-    int paren_nest = 0;
-    int block_nest = 0;
-    //we have to keep track of the location of block size indices so that we can properly set our GOTOs
-    Stack block_inds = make_Stack(err);
-    if (err->type != E_SUCCESS) {
-	//free_NamedStack(&name_stack);
 	sc_free(ret.return_types);
 	ret.return_types = NULL;
-	free_instruction_buffer(&(ret.buf));
 	return ret;
     }
+    //we have to keep track of the location of block jump indices so that we can properly set our GOTOs once the end of the block is found
+    block_info blk_stk[MAX_BLK_RECURSE];
+    size_t n_blks = 0;
+    union Instruction tmp[2];
 
-    //iterate over the main block string
+    //iterate over the main block one statement at a time. Statements are terminated by newlines, semicolons or the start or end of a block.
     i = 0;
-    char next_word[N_WORD_BYTES];
-    char scnd_word[N_WORD_BYTES];
-    size_t n_read = 0;
-    while (main_block[i] != 0) {
-	if (!commented) {
-	    if (main_block[i] == '\n' && paren_nest == 0) {
-		//check if we have a complete statement
-		//grow the number of instructions and check for errors if necessary
-		/*if (ret.n_instructions >= ins_cap) {
-		    ins_cap *= 2;
-		    ret.i_list = (union Instruction*)sc_realloc(ret.i_list, sizeof(union Instruction)*ins_cap, err);
-		    if (err->type != E_SUCCESS) {
-			free_NamedStack(&name_stack);
-			sc_free(ret.return_types);
-			sc_free(ret.i_list);
-			ret.i_list = NULL;
-			return ret;
-		    }
-		}*/
-
-		//read the next word
-		n_read = read_dtg_word(main_block, i, next_word, N_WORD_BYTES);
-
-		//check if the next word is "while" or "if" (the start of a block)
-		char blk_type = INS_NOP;
-		if (strcmp(next_word, "while") == 0) {
-		    blk_type = BLOCK_WHILE;
-		} else if (strcmp(next_word, "if") == 0) {
-		    blk_type = BLOCK_BRANCH;
-		} else if (strcmp(next_word, "else") == 0) {
-		    n_read += read_dtg_word(main_block, i+n_read, next_word, N_WORD_BYTES);
-		    //check if this is an "else if or just a regular if
-		    if (strcmp(next_word, "if") == 0) {
-			blk_type = BLOCK_SUB_BRANCH;
-		    } else {
-			blk_type = BLOCK_ELSE;
-		    }
-		} else if (strcmp(next_word, "return") == 0) {
-		    blk_type = INS_RETURN;
-		}
+    while (main_block[i] != 0 && err->type == E_SUCCESS) {
+	if (main_block[i] == ' ' || main_block[i] == '\t' || main_block[i] == '\n' || main_block[i] == '\r' || main_block[i] == ';') {
+	    ++i;
+	    continue;
+	}
 
-		//check for declarations
-		if (strcmp(next_word, "bool") == 0) {
-		    n_read += __read_declaration(main_block+i, VT_BOOL, n_read, con, &(ret.buf), err);
-		} else if (strcmp(next_word, "char") == 0) {
-		    n_read += __read_declaration(main_block+i, VT_CHAR, n_read, con, &(ret.buf), err);
-		} else if (strcmp(next_word, "int") == 0) {
-		    n_read += __read_declaration(main_block+i, VT_INT, n_read, con, &(ret.buf), err);
-		} else if (strcmp(next_word, "float") == 0) {
-		    n_read += __read_declaration(main_block+i, VT_FLOAT, n_read, con, &(ret.buf), err);
-		} else if (strcmp(next_word, "string") == 0) {
-		    n_read += __read_declaration(main_block+i, VT_STRING, n_read, con, &(ret.buf), err);
-		} else if (strcmp(next_word, "array") == 0) {
-		    n_read += __read_declaration(main_block+i, VT_FLOAT, n_read, con, &(ret.buf), err);
-		} else if (strcmp(next_word, "func") == 0) {
-		    //TODO: this will require some special implementation
-		    n_read += __read_declaration(main_block+i, VT_FUNC, n_read, con, &(ret.buf), err);
+	//check if we hit the end of a block
+	if (main_block[i] == '}') {
+	    ++i;
+	    if (n_blks == 0) {
+		sc_set_error(err, E_SYNTAX, /*{*/"unexpected '}'");
+		break;
+	    }
+	    block_info* blk = blk_stk + n_blks - 1;
+	    //values declared inside the block go out of scope
+	    _discard_names(con, blk->depth, &(ret.buf), err);
+
+	    //check whether the block is followed by an else statement
+	    size_t j = i;
+	    while (main_block[j] == ' ' || main_block[j] == '\t' || main_block[j] == '\n' || main_block[j] == '\r') { ++j; }
+	    int has_else = (blk->type == BLOCK_BRANCH && _read_keyword(main_block + j, "else"));
+
+	    if (blk->type == BLOCK_WHILE) {
+		//jump back to the condition
+		tmp[0].i = INS_JUMP;
+		tmp[1].i = blk->start_ind;
+		append_Instructions(&(ret.buf), 2, tmp, err);
+		ret.buf.buf[blk->cnd_ind].i = ret.buf.n_insts;
+		--n_blks;
+	    } else if (has_else) {
+		//jump past the remaining branches. Until the end of the chain is known, the jump target stores the index of the previous jump in the chain
+		tmp[0].i = INS_JUMP;
+		tmp[1].i = blk->end_ind;
+		append_Instructions(&(ret.buf), 2, tmp, err);
+		blk->end_ind = ret.buf.n_insts - 1;
+		ret.buf.buf[blk->cnd_ind].i = ret.buf.n_insts;
+		blk->cnd_ind = INONE;
+		blk->type = BLOCK_SUB_BRANCH;
+	    } else {
+		if (blk->cnd_ind != INONE) { ret.buf.buf[blk->cnd_ind].i = ret.buf.n_insts; }
+		//fill in every jump in the chain
+		size_t k = blk->end_ind;
+		while (k != INONE) {
+		    size_t next = ret.buf.buf[k].i;
+		    ret.buf.buf[k].i = ret.buf.n_insts;
+		    k = next;
 		}
+		--n_blks;
+	    }
+	    continue;
+	}
 
-		//handle all other types of instruction (mostly assignments and function executions)
-		if (blk_type == INS_NOP) {
-		    n_read += read_dtg_word(main_block, i+n_read, scnd_word, N_WORD_BYTES);
-		    if (scnd_word[0] == '=') {
-			//read the lval
-			size_t n_l = 0;
-			char** args_i = csv_to_list(next_word, ',', &n_l, err);
-			if (err->type != E_SUCCESS) {
-			    //free_NamedStack(&name_stack);
-			    sc_free(ret.return_types);
-			    ret.return_types = NULL;
-			    free_instruction_buffer(&(ret.buf));
-			    return ret;
-			}
-
-			//read the string after the equal sign
-			n_read += read_dtg_word(main_block, i+n_read, scnd_word, N_WORD_BYTES);
-			int n_rvals = _parse_rval(con, scnd_word, 0, &(ret.buf), err);
-			if (err->type != E_SUCCESS) {
-			    //free_NamedStack(&name_stack);
-			    sc_free(ret.return_types);
-			    ret.return_types = NULL;
-			    free_instruction_buffer(&(ret.buf));
-			    return ret;
-			}
-			//TODO: allow more flexibility
-			if (n_l == n_rvals) {
-			    //lookup each term in the lval
-			    for (size_t j = 0; j < n_l; ++j) {
-				//try finding the value by name or create it
-				HashedItem* tmp_hash = NULL;
-				int f_ind = search_val(con, args_i[j], &tmp_hash);
-				
-				//append the assignment operation to the instruction buffer
-				union Instruction tmp[2];
-				if (f_ind < -1) {
-				    //If we didn't find the value in the stack or global memory then we need to create a new one
-				    //TODO: implement global keyword
-				    _push_valtup(&(con->callstack), args_i[j], err);
-				    //NOTE: we don't need to do any further stack manipulation, as _parse_rval has already pushed the appropriate value onto the stack
-				} else if (f_ind == -1) {
-				    tmp[0].i = INS_POP & INS_HH_G;
-				    tmp[1].ptr = tmp_hash->key;
-				    append_Instructions(&(ret.buf), 2, tmp, err);
-				} else {
-				    tmp[0].i = INS_POP & INS_HH_S;
-				    tmp[1].i = f_ind;
-				    append_Instructions(&(ret.buf), 2, tmp, err);
-				}
-
-				if (err->type != E_SUCCESS) {
-				    //free_NamedStack(&name_stack);
-				    sc_free(ret.return_types);
-				    ret.return_types = NULL;
-				    free_instruction_buffer(&(ret.buf));
-				    return ret;
-				}
-			    }
-			}
-		    } else if (scnd_word[0] == ';') {
-			size_t n_l = 0;
-			char** args_i = csv_to_list(next_word, ',', &n_l, err);
-			for (size_t j = 0; j < n_l; ++j) {
-			    //try finding the value by name
-			    HashedItem* tmp_hash = NULL;
-			    int f_ind = search_val(con, args_i[j], &tmp_hash);
-			    if (f_ind < -1) {
-				//If we didn't find the value in the stack or global memory then we need to create a new one
-				//TODO: implement global keyword
-				_push_valtup(&(con->callstack), args_i[j], err);
-				if (err->type != E_SUCCESS) {
-				    //free_NamedStack(&name_stack);
-				    sc_free(ret.return_types);
-				    ret.return_types = NULL;
-				    free_instruction_buffer(&(ret.buf));
-				    return ret;
-				}
-				//append the assignment operation to the instruction buffer
-				union Instruction tmp[2];
-				tmp[0].i = INS_MAKE_VAL;
-				tmp[1].i = (con->callstack).top->val.type;
-				append_Instructions(&(ret.buf), 2, tmp, err);
-			    } else {
-				//if we already created this value then we need to throw an error
-				sc_set_error(err, E_BADVAL, "");
-				snprintf(err->msg, DTG_MAX_MSG_SIZE, "Redeclaration of value name %s", args_i[j]);
-				//free_NamedStack(&name_stack);
-				sc_free(ret.return_types);
-				ret.return_types = NULL;
-				free_instruction_buffer(&(ret.buf));
-				return ret;
-			    }
-			}
-		    }
+	//find the end of the statement
+	size_t j = i;
+	int nest_level = 0;
+	int verbatim = 0;
+	for (; main_block[j] != 0; ++j) {
+	    if (main_block[j] == '\"') {
+		verbatim = 1 - verbatim;
+	    } else if (verbatim) {
+		continue;
+	    } else if (main_block[j] == '(' || main_block[j] == '[') {
+		++nest_level;
+	    } else if (main_block[j] == ')' || main_block[j] == ']') {
+		--nest_level;
+	    } else if (nest_level <= 0 && (main_block[j] == ';' || main_block[j] == '\n' || main_block[j] == '{' || main_block[j] == '}')) {
+		break;
+	    }
+	}
+	char term = main_block[j];
+	main_block[j] = 0;
+	char* stmt = _trim_whitespace(main_block + i);
+
+	size_t kw = 0;
+	if (term == '{') {
+	    //check if the statement is the start of a block
+	    if (n_blks == MAX_BLK_RECURSE) {
+		sc_set_error(err, E_SYNTAX, "too many nested blocks");
+		break;
+	    }
+	    block_info* blk = blk_stk + n_blks;
+	    if ((kw = _read_keyword(stmt, "while"))) {
+		blk->type = BLOCK_WHILE;
+		blk->depth = get_size_n(con->callstack);
+		blk->start_ind = ret.buf.n_insts;
+		blk->end_ind = INONE;
+		blk->cnd_ind = _parse_condition(con, stmt + kw, &(ret.buf), err);
+		++n_blks;
+	    } else if ((kw = _read_keyword(stmt, "if"))) {
+		blk->type = BLOCK_BRANCH;
+		blk->depth = get_size_n(con->callstack);
+		blk->start_ind = ret.buf.n_insts;
+		blk->end_ind = INONE;
+		blk->cnd_ind = _parse_condition(con, stmt + kw, &(ret.buf), err);
+		++n_blks;
+	    } else if ((kw = _read_keyword(stmt, "else"))) {
+		//else statements continue the chain started by the most recent if statement
+		if (n_blks == 0 || blk_stk[n_blks-1].type != BLOCK_SUB_BRANCH) {
+		    sc_set_error(err, E_SYNTAX, "else without matching if");
+		    break;
 		}
-
-		//read the instruction
-		/*if (blk_loc > 0) {
-		    //make sure we have enough parameters to form an instruction
-		    if (n_toks < 3) {
-			sc_set_error(err, E_SYNTAX, "while loop requires condition and execution block");
-		    }
-		    //add the instruction and push the block index onto the stack. This way, we can pop the last block off the stack when we encounter a close curly brace.
-		    ret.i_list[ret.n_instructions].i = INS_JNCOND;
-		    ret.i_list[ret.n_instructions+1].ptr = gen_optree(ins_toks[1], err);
-		    value tmp_val = v_make_int(ret.n_instructions+2, err);
-		    //store the type of instruction (while statements require an additional unconditional jump at the end of the block
-		    tmp_val.type = blk_type;
-
-		    push(&block_inds, tmp_val, err);
-		    //check for errors
-		    if (err->type != E_SUCCESS) {
-			sc_free(name_stack);
-			sc_free(ret.argument_types);
-			sc_free(ret.return_types);
-			sc_free(ret.i_list);
-			ret.argument_types = NULL;
-			ret.return_types = NULL;
-			ret.i_list = NULL;
-			return ret;
-		    }
-		} else if (n_toks == 1) {
-		    //check if we hit the end of a block
+		blk = blk_stk + n_blks - 1;
+		char* rest = _trim_whitespace(stmt + kw);
+		size_t kw_if = _read_keyword(rest, "if");
+		if (kw_if) {
+		    blk->type = BLOCK_BRANCH;
+		    blk->cnd_ind = _parse_condition(con, rest + kw_if, &(ret.buf), err);
+		} else if (rest[0] == 0) {
+		    blk->type = BLOCK_ELSE;
+		} else {
+		    sc_set_error(err, E_SYNTAX, "");
+		    snprintf(err->msg, DTG_MAX_MSG_SIZE, "unexpected %s after else", rest);
 		}
-		ret.i_list[ret.n_instructions] = */
+	    } else {
+		sc_set_error(err, E_SYNTAX, "");
+		snprintf(err->msg, DTG_MAX_MSG_SIZE, "expected while, if or else before '{' in %s", stmt);
 	    }
+	} else {
+	    _parse_statement(con, &ret, stmt, err);
+	}
+
+	//statements which are terminated by the end of a block leave the '}' to be read on the next iteration
+	if (term == '}') {
+	    main_block[j] = '}';
+	    i = j;
+	} else if (term == 0) {
+	    i = j;
+	} else {
+	    i = j + 1;
 	}
-	i += n_read;
     }
+    if (err->type == E_SUCCESS && n_blks > 0) {
+	sc_set_error(err, E_SYNTAX, /*{*/"expected '}'");
+    }
+    if (err->type == E_SUCCESS) { _mark_tail_calls(con, &ret); }
 
     //cleanup the stack
-    size_t n_added = get_size_n(con->callstack) - stack_start;
-    for (size_t i = 0; i < n_added; ++i) {
-	HashedItem tmp = pop_n(&(con->callstack), err);
-	free_HashedItem(&tmp);
-    }
+    _pop_names(con, get_size_n(con->callstack) - stack_start);
+    con->frame = old_frame;
+
+    //the constant pool is owned by the function and only needs as much space as it uses
+    ret.n_consts = ret.buf.n_consts;
+    ret.consts = ret.buf.consts;
+    if (ret.n_consts > 0 && ret.n_consts < ret.buf.consts_cap) {
+	sc_error tmp_err;
+	value* tmp_consts = (value*)sc_realloc(ret.consts, sizeof(value)*(ret.n_consts), &tmp_err);
+	if (tmp_consts) { ret.consts = tmp_consts; }
+    }
+    ret.buf.n_consts = 0;
+    ret.buf.consts_cap = 0;
+    ret.buf.consts = NULL;
     return ret;
 }
 
 /**
- * Free memory used by the function pointed to by f.
+ * Free memory used by the function pointed to by f. Everything allocated while compiling f is owned by the arena of its instruction buffer and released at once.
  */
 void free_function(function* f) {
     if (f) {
-	//sc_free(f->argument_types);
+	if (f->argument_types) { sc_free(f->argument_types); }
 	if (f->return_types) { sc_free(f->return_types); }
-	//for (size_t i = 0; i < f->n_consts; ++i) { free_value(f->consts[i]); }
-	//sc_free(f->consts);
+	for (size_t i = 0; i < f->n_consts; ++i) { free_value(f->consts + i); }
+	sc_free(f->consts);
 	free_instruction_buffer(&(f->buf));
     }
 }
 
 /**
- * Executes the function f using the context c to infer the stack and global variables. The context is altered by this proceedure as f pops arguments off of the stack (including the caller) and pushes returned values onto the stack.
+ * Helper for call_func_by_name which reads the argument string str into a value of type hint. Strings of the form g(...) are evaluated by calling g, in which case the first return value is used.
  */
-void execute_function(context* c, function* f, sc_error* err) {
+value _read_call_arg(context* c, char* str, Valtype_e hint, sc_error* err) {
+    value ret = {0};
+    size_t j = 0;
+    while (str[j] == '_' || (str[j] >= 'a' && str[j] <= 'z') || (str[j] >= 'A' && str[j] <= 'Z') || (j > 0 && str[j] >= '0' && str[j] <= '9')) { ++j; }
+    if (j == 0 || str[j] != '('/*)*/) { return read_value_string(str, hint, err); }
+
+    //break up the inside of the parenthesis by commas
+    char* arg_ilist = _get_enclosed_r(str+j, NULL, "(", ")");
+    if (arg_ilist == NULL) {
+	sc_set_error(err, E_SYNTAX, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "unmatched parenthesis in %s", str);
+	return ret;
+    }
+    str[j] = 0;
+    size_t n_args_i = 0;
+    char** args_i = csv_to_list(arg_ilist, ',', &n_args_i, err);
+    if (err->type != E_SUCCESS) { return ret; }
+    if (n_args_i == 1 && args_i[0][0] == 0) { n_args_i = 0; }
 
+    value* rets = NULL;
+    int n_rets = call_func_by_name(c, str, n_args_i, args_i, &rets, err);
+    free(args_i);
+    if (n_rets < 0) { return ret; }
+    if (n_rets == 0) {
+	sc_set_error(err, E_BADVAL, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "function %s used as an argument returns no values", str);
+	return ret;
+    }
+    ret = rets[0];
+    for (int k = 1; k < n_rets; ++k) { free_value(rets + k); }
+    sc_free(rets);
+    return ret;
 }
 
 /**
@@ -1703,12 +3043,14 @@ void execute_function(context* c, function* f, sc_error* err) {
  * param c: current context with stack and global variables
  * param func_name: name of the function in global scope to call
  * param n_args: number of arguments accessible in the args array
- * param args: a list of arguments to be supplied to the function for calling
+ * param args: a list of arguments to be supplied to the function for calling. These strings are modified in place.
  * param res: a pointer to which the list of return values will be stored
  * param err: save error messages
  * returns the number of return values on success or -1 on error
  */
 int call_func_by_name(context* c, const char* func_name, size_t n_args, char** args, value** results, sc_error* err) {
+    sc_reset_error(err);
+    *results = NULL;
     //lookup the name in the hashtable
     HashedItem* v_f = lookup(&(c->global), func_name);
 
@@ -1718,56 +3060,44 @@ int call_func_by_name(context* c, const char* func_name, size_t n_args, char** a
 	snprintf(err->msg, DTG_MAX_MSG_SIZE, "Couldn't find function %s", func_name);
 	return -1;
     }
-
-    //base case, simply return the associated value
     if (v_f->val.type != VT_FUNC) {
-	push_n(&(c->callstack), "", v_f->val, err);
-	/*sc_set_error(err, E_BADVAL, "");
+	sc_set_error(err, E_BADTYPE, "");
 	snprintf(err->msg, DTG_MAX_MSG_SIZE, "%s is not a function", func_name);
-	return -1;*/
+	return -1;
     }
 
     //make sure the function has the proper number of arguments or throw an error
     function* f = (function*)(v_f->val.val.ptr);
     if (f->n_args != n_args) {
 	sc_set_error(err, E_SYNTAX, "");
-	snprintf(err->msg, DTG_MAX_MSG_SIZE, "Invalid number of arguments %d=/=%d", n_args, f->n_args);
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "Invalid number of arguments %lu=/=%lu", n_args, f->n_args);
 	return -1;
     }
 
-    sc_reset_error(err);
-    for (size_t i = 0; i < n_args; ++i) {
-	int found_func = 1;
-	for (size_t j = 0; args[i][j] != 0; ++j) {
-	    if (args[i][j] == '('/*)*/) {
-		char* arg_ilist = _get_enclosed(args[i]+j, "(", ")");
-		args[i][j] = 0;
-
-		//break up the inside of the parenthesis by commas
-		size_t n_args_i = 0;
-		char** args_i = csv_to_list(arg_ilist, ',', &n_args_i, err);
-		if (err->type != E_SUCCESS) { return -1; }
-
-		//call the function and check for errors
-		value* rets;
-		int n_rets = call_func_by_name(c, args[i], n_args_i, args_i, &rets, err);
-		if (err->type != E_SUCCESS) {
-		    free(args_i);
-		    return n_rets;
-		}
-		found_func = 1;
-		
-		//push the results onto the callstack
-		for (size_t j = 0; j < n_rets; ++j) {
-		    push_n(&(c->callstack), "", rets[j], err);
-		    if (err->type != E_SUCCESS) { return -2; }
-		}
-		return n_rets;
-
-		break;
-	    }
+    //arguments are followed by space for the results so that a single allocation is needed
+    value* vals = (value*)sc_malloc(sizeof(value)*(n_args + f->n_rets + 1), err);
+    if (err->type != E_SUCCESS) { return -1; }
+    size_t n_read = 0;
+    for (; n_read < n_args; ++n_read) {
+	vals[n_read] = _read_call_arg(c, args[n_read], f->argument_types[n_read], err);
+	if (err->type != E_SUCCESS) { break; }
+    }
+    int n_rets = -1;
+    if (err->type == E_SUCCESS) {
+	n_rets = call_function(c, f, vals, vals + n_args, err);
+    }
+    //results may share heap data with the arguments which we are about to release
+    if (n_rets > 0) {
+	*results = (value*)sc_malloc(sizeof(value)*n_rets, err);
+	if (err->type != E_SUCCESS) {
+	    n_rets = -1;
+	} else {
+	    for (int k = 0; k < n_rets; ++k) { (*results)[k] = v_deep_copy(vals[n_args+k], err); }
 	}
     }
+    for (size_t k = 0; k < n_read; ++k) { free_value(vals + k); }
+    sc_free(vals);
+    return n_rets;
 }
 
 #ifdef __cplusplus 
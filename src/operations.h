@@ -20,30 +20,41 @@ extern "C" {
 #define FLAG_COMP	2
 #define FLAG_AND	3
 
-#define INS_NOP		0x00u
-#define INS_OP_EVAL	0x01u
-#define INS_FN_EVAL	0x02u
-#define INS_JUMP	0x03u
-#define INS_JUMP_CND	0x04u
-#define INS_PUSH	0x05u
-#define INS_POP		0x06u
-#define INS_MOV		0x07u
-#define INS_PTR_DRF	0x08u
-#define INS_GET_SIZE	0x09u
-#define INS_IND_READ	0x0Au
-#define INS_IND_WRITE	0x0Bu
+//token types read by the expression lexer used by parse_optree()
+#define TOK_END		0
+#define TOK_ATOM	1
+#define TOK_OPEN	2
+#define TOK_CLOSE	3
+#define TOK_OPER	4
+//the size of the buffer used to read atoms without allocating memory
+#define TOK_BUF_SIZE	64
+
+//Each instruction occupies one union Instruction holding the opcode (bitwise or'd with the bank flags described below) followed by its parameters. Stack parameters are slots in the frame of the executing function, where slot 0 is its first argument, so they don't depend on how many values are currently pushed.
+#define INS_NOP		0x00u//params 0
+#define INS_OP_EVAL	0x01u//params 1: evaluates the expression (see make_expression()) read from the specified bank and stores the result in register 0
+#define INS_FN_EVAL	0x02u//params 1: calls the function read from the specified bank. Arguments are taken from the top of the stack and are replaced by the returned values
+#define INS_JUMP	0x03u//params 1: jumps unconditionally to the instruction index given by the parameter
+#define INS_JUMP_CND	0x04u//params 2: reads a value from the specified bank and jumps to the instruction index given by the second parameter if that value is false
+#define INS_PUSH	0x05u//params 1: pushes the value read from the specified bank onto the stack
+#define INS_POP		0x06u//params 1: pops the top value off the stack and stores it in the specified bank. For the constant bank the parameter is instead the number of values to discard
+#define INS_MOV		0x07u//params 2: copies the value from the bank specified by INS_HL to the bank specified by INS_HH
+#define INS_PTR_DRF	0x08u//params 1: dereferences the pointer read from the specified bank into register 0
+#define INS_GET_SIZE	0x09u//params 1: stores the length of the array read from the specified bank in register 0
+#define INS_IND_READ	0x0Au//params 2: reads the array from the INS_HH bank at the index read from the INS_HL bank into register 0
+#define INS_IND_WRITE	0x0Bu//params 2: writes register 0 into the array from the INS_HH bank at the index read from the INS_HL bank
 #define INS_FL_OPEN	0x0Cu
 #define INS_FL_CLOSE	0x0Du
 #define INS_FL_READ	0x0Eu
 #define INS_FL_WRITE	0x0Fu
-#define INS_MAKE_PTR	0x10u
-#define INS_MAKE_ARR	0x11u
-#define INS_MAKE_STR	0x12u
-#define INS_MAKE_VAL	0x13u
+#define INS_MAKE_PTR	0x10u//params 1: stores a pointer to the value in the specified bank in register 0
+#define INS_MAKE_ARR	0x11u//params 0: stores a new array with capacity given by register 0 in register 0
+#define INS_MAKE_STR	0x12u//params 0: stores a new string with capacity given by register 0 in register 0
+#define INS_MAKE_VAL	0x13u//params 1: stores a default initialized value with the type given by the parameter in register 0
 #define INS_EXT		0x14u
-#define INS_RETURN	0x15u
+#define INS_RETURN	0x15u//params 0: returns from the function. The top n_rets values on the stack are the returned values
+#define INS_TAIL_CALL	0x16u//params 1: calls the function read from the specified bank in place of the executing function. Its arguments on top of the stack replace the current frame and it returns directly to the caller. Emitted for calls immediately followed by INS_RETURN
 
-//these are special temporary instructions which
+//these are the types of blocks which may be opened in a function body
 #define BLOCK_WHILE		0
 #define BLOCK_BRANCH		1
 #define BLOCK_SUB_BRANCH	2
@@ -56,11 +67,13 @@ extern "C" {
 #define INS_HL_R	0x00u //register
 #define INS_HL_S	0x10u //stack
 #define INS_HL_G	0x20u //global
-#define INS_HL_C	0x30u //constant (instruction buffer)
+#define INS_HL_C	0x30u //constant (index into the constant pool of the function)
 #define INS_HH_R	0x00u
 #define INS_HH_S	0x40u
 #define INS_HH_G	0x80u
 #define INS_HH_C	0xC0u
+//mask used to read the instruction from an opcode with the destination bank removed. Only INS_MOV, INS_IND_READ and INS_IND_WRITE use the INS_HL bits
+#define INS_LO		0x3Fu
 
 /*#define INS_NOP		0//params 0
 #define INS_EVAL	1//params 1: interprets the next instruction as a pointer to an Operation struct to evaluate, the result is pushed onto the stack
@@ -101,6 +114,24 @@ struct Operation {
     struct Operation* child_r;
 };
 
+/**
+ * Helper struct used by parse_optree() to read an expression one token at a time.
+ * str: the expression being read
+ * pos: the index of the first character after the current token
+ * type: the type of the current token, one of the TOK_* flags
+ * op: the operator read if type is TOK_OPER
+ * start: the index of the first character of the current token
+ * len: the number of characters in the current token
+ */
+typedef struct s_op_lexer {
+    const char* str;
+    size_t pos;
+    int type;
+    Optype_e op;
+    size_t start;
+    size_t len;
+} op_lexer;
+
 /**
  * This is a helper struct used by function to describe individual instructions (pseudo bytecodes interpreted by the interpreter).
  */
@@ -109,17 +140,76 @@ union Instruction {
     void* ptr;
 };
 
+//Expressions are lowered from optrees into a postfix program which is run by eval_expression(). Operators pop their right and then left operands off of the evaluation stack and push the result.
+#define EXP_PUSH_C	0x00u//params 1: pushes the constant with the specified index in the constant table of the expression
+#define EXP_PUSH_S	0x01u//params 1: pushes the value at the specified index of the program stack (measured from the top)
+#define EXP_ADD		0x02u//params 0
+#define EXP_SUB		0x03u//params 0
+#define EXP_MULT	0x04u//params 0
+#define EXP_DIV		0x05u//params 0
+#define EXP_EQ		0x06u//params 0
+#define EXP_GRT		0x07u//params 0
+#define EXP_LST		0x08u//params 0
+#define EXP_GEQ		0x09u//params 0
+#define EXP_LEQ		0x0Au//params 0
+#define EXP_AND		0x0Bu//params 0
+#define EXP_OR		0x0Cu//params 0
+#define EXP_NOT		0x0Du//params 0: the left operand is ignored
+//Arithmetic and comparison operators are quickened the first time they are evaluated by or'ing in one of these flags. Quickened operators check the types of their operands and fall back to the generic implementation if they don't match, after which the operator is marked as generic.
+#define EXP_BASE	0x0Fu//mask which reads the operator with the quickening flags removed
+#define EXP_Q		0x30u//mask which reads the quickening flags
+#define EXP_Q_II	0x10u//both operands are ints
+#define EXP_Q_FF	0x20u//both operands are floats
+#define EXP_Q_GENERIC	0x30u//the operands have varying or mixed types, always use the generic implementation
+
+//expressions which need a deeper evaluation stack than this allocate it on the heap
+#define EXP_STACK_SIZE	16
+
+/**
+ * A growable list of instructions.
+ * cap: the number of instructions that may be stored before buf is reallocated
+ * n_insts: the number of instructions that have been written
+ * buf: the instructions
+ * opcodes: if the buffer has been threaded for execution (see _ex_thread()) then opcodes in buf are replaced by the addresses of their handlers and the original opcodes are saved here at the same indices. Otherwise this is NULL.
+ * mem: owns the expressions referenced by instructions and the names which were bound while compiling them
+ * n_consts: the number of values in the constant pool
+ * consts_cap: the number of values that may be stored in consts before it is reallocated
+ * consts: the constant pool. Constant value parameters are indices into this pool (see intern_const()). make_function() moves the pool into the compiled function.
+ */
 typedef struct s_instruction_buffer {
     size_t cap;
     size_t n_insts;
     union Instruction* buf;
+    size_t* opcodes;
+    arena mem;
+    size_t n_consts;
+    size_t consts_cap;
+    value* consts;
 } instruction_buffer;
 
+/**
+ * An expression compiled from an optree into a flat postfix program so that it may be evaluated in a single loop without recursion.
+ * buf: the program, see the EXP_* opcodes. Note that this must not be freed with free_instruction_buffer().
+ * n_consts: the number of constant values
+ * consts: the constant values read by EXP_PUSH_C, these are owned by the expression or the arena it was allocated from
+ * depth: the largest number of values held on the evaluation stack at any point
+ */
+typedef struct s_expression {
+    instruction_buffer buf;
+    size_t n_consts;
+    value* consts;
+    size_t depth;
+} expression;
+
 /**
  * The function struct holds functional types
- * el_size: the size of each element
- * buf_size: the size of the allocated buffer in the number of elements. The total number of bytes allocated for the buffer is el_size*buf_size
- * size: the size of the array that has been written to with valid contents
+ * n_args: the number of arguments which are read from the top of the stack
+ * n_rets: the number of values returned
+ * n_consts: the number of values in the constant pool
+ * argument_types: the declared type of each argument, the first argument is the deepest on the stack
+ * return_types: the declared type of each return value
+ * consts: the constant pool of the function. Instructions which read constant values (from the INS_HH_C or INS_HL_C banks) store an index into this pool. Identical literals share a single entry.
+ * buf: the instructions of the function
  */
 typedef struct s_function {
     size_t n_args;
@@ -131,6 +221,22 @@ typedef struct s_function {
     instruction_buffer buf;
 } function;
 
+/**
+ * Helper struct used by make_function to keep track of while and if blocks which have been opened but not yet closed.
+ * type: one of BLOCK_WHILE, BLOCK_BRANCH (an if or else if body), BLOCK_SUB_BRANCH (a branch was closed and an else is expected) or BLOCK_ELSE
+ * depth: the size of the named callstack when the block was opened. Values declared in the block are discarded when it is closed.
+ * start_ind: the index of the first instruction of the condition. Only used by while loops.
+ * cnd_ind: the index of the jump target for the block condition or INONE if there is none.
+ * end_ind: the index of the most recent jump to the end of an if else chain or INONE. Each of these jump targets holds the index of the previous one until the chain is closed.
+ */
+typedef struct s_block_info {
+    char type;
+    size_t depth;
+    size_t start_ind;
+    size_t cnd_ind;
+    size_t end_ind;
+} block_info;
+
 // ============================ MATHEMATICAL OPERATIONS ============================
 
 /**
@@ -138,8 +244,8 @@ typedef struct s_function {
  *  Behaviours:
  *  string a, (any type b): Converts b into a string representation and appends the result to the end of a.
  *  float a, float b or int a, float b or float a, int b: If either a or b is a floating point value, the result is guaranteed to be a floating point type with value a+b.
- *  int a, int b: Returns a+b
- *  array a, (any type b): This is an invalid operation unless the type of b matches the type stored in a, in which case a deep copy of b is made and appended to the end of a.
+ *  int a, int b: Returns a+b, wrapping around on overflow
+ *  array a, (array or scalar b) or scalar a, array b: Adds element-wise and returns a new array which must be freed. Two arrays must have the same length, while a scalar is broadcast by adding it to every element. Each element of the result is identical to op_add() applied to the corresponding elements, see _op_array().
  *  bool a, bool b: invalid
  */
 value op_add(value a, value b, sc_error* err);
@@ -148,8 +254,8 @@ value op_add(value a, value b, sc_error* err);
  *  Creates a new value object which holds the result of the subtraction operation applied to a and b. The behaviour depends upon the types of a and b.
  *  Behaviours:
  *  float a, float b or int a, float b or float a, int b: If either a or b is a floating point value, the result is guaranteed to be a floating point type with value a-b.
- *  int a, int b: Returns a-b
- *  array a, (any type b): invalid
+ *  int a, int b: Returns a-b, wrapping around on overflow
+ *  array a, (array or scalar b) or scalar a, array b: Subtracts element-wise and returns a new array which must be freed. Two arrays must have the same length, while a scalar is broadcast to every element (so 1 - [1, 2] is [0, -1]). Each element of the result is identical to op_sub() applied to the corresponding elements, see _op_array().
  *  string a, (any type b): invalid
  *  bool a, bool b: invalid
  */
@@ -159,8 +265,8 @@ value op_sub(value a, value b, sc_error* err);
  *  Creates a new value object which holds the result of the multiply operation applied to a and b. The behaviour depends upon the types of a and b.
  *  Behaviours:
  *  float a, float b or int a, float b or float a, int b: If either a or b is a floating point value, the result is guaranteed to be a floating point type with value a*b.
- *  int a, int b: Returns a*b
- *  array a, (float or int b): Performs a scalar multiply to each element of a so that for each element e of a the new array has the same value as a call to mult(e, a) would. Note that a deep copy of the data is performed, so changes to a may be made safely and the result must be freed.
+ *  int a, int b: Returns a*b, wrapping around on overflow
+ *  array a, (array or scalar b) or scalar a, array b: Multiplies element-wise and returns a new array which must be freed. Two arrays must have the same length, while a scalar is broadcast to every element. Each element of the result is identical to op_mult() applied to the corresponding elements, see _op_array().
  *  string a, (any type b): invalid
  *  bool a, bool b: invalid
  */
@@ -170,8 +276,8 @@ value op_mult(value a, value b, sc_error* err);
  *  Creates a new value object which holds the result of the divide operation applied to a and b. The behaviour depends upon the types of a and b.
  *  Behaviours:
  *  float a, float b or int a, float b or float a, int b: If either a or b is a floating point value, the result is guaranteed to be a floating point type with value a/b.
- *  int a, int b: Returns the greatest integer less than a/b (i.e. floor(a/b)).
- *  array a, (float or int b): Performs a scalar multiply to each element of a so that for each element e of a the new array has the same value as a call to mult(e, a) would.
+ *  int a, int b: Returns a/b rounded toward zero. SC_INT_MIN/-1 wraps around to SC_INT_MIN.
+ *  array a, (array or scalar b) or scalar a, array b: Divides element-wise and returns a new array which must be freed. Two arrays must have the same length, while a scalar is broadcast to every element. Each element of the result is identical to op_div() applied to the corresponding elements, so a zero divisor in any element is an error just as for scalars, see _op_array().
  *  string a, (any type b): invalid
  *  bool a, bool b: invalid
  */
@@ -191,7 +297,7 @@ value op_eq(value a, value b, sc_error* err);
  *  Creates a new boolean value object which is set to true if a is greater than b.
  *  Behaviours:
  *  numeric a, numeric b: returns if the values are equal, note that integers are cast to floats for comparison
- *  arrays invalid
+ *  array a, (array or scalar b) or scalar a, array b: compares element-wise and returns an array of bools, see _op_array().
  *  strings a, b: returns true if a comes before b alphabetically
  *  bool a, bool b: invalid
  */
@@ -201,13 +307,23 @@ value op_grt(value a, value b, sc_error* err);
  *  Creates a new boolean value object which is set to true if a is greater than or equal to b.
  *  Behaviours:
  *  numeric a, numeric b: returns if the values are equal, note that integers are cast to floats for comparison
- *  arrays invalid
+ *  array a, (array or scalar b) or scalar a, array b: compares element-wise and returns an array of bools, see _op_array().
  *  strings a, b: returns true if a comes before b alphabetically
  *  bool a, bool b: invalid
  *  NOTE: there is no low level implementation of < or <=, these are evaluated by reversing parameters.
  */
 value op_geq(value a, value b, sc_error* err);
 
+// ============================ ELEMENT-WISE ARRAY OPERATIONS ============================
+
+//Element-wise operations on unboxed int and float arrays use the vectorized kernels selected by set_simd_level(), see utils.h.
+
+/**
+ * Applies the operator op (one of OP_ADD, OP_SUB, OP_MULT, OP_DIV, OP_GRT or OP_GEQ) element-wise to a and b. At least one of a and b must be an array. Arrays must have the same length and scalars are broadcast to every element. Each element of the result is identical to the result of the scalar op_* function applied to the corresponding elements. If any of those would fail then no array is returned and err is set.
+ * Returns: a new array which must be freed. Results with a single primitive type are stored unboxed.
+ */
+value _op_array(Optype_e op, value a, value b, sc_error* err);
+
 // ============================ OPERATION TREES ============================
 
 /**
@@ -218,14 +334,47 @@ value eval(struct Operation* o, Stack* st, sc_error* err);
 
 /**
   * Helper function which parses a string expression into a tree of operations. The optree can then be evaluated using a call to eval() or evali()
+  * NOTE: this rescans the string at every level of the tree and modifies str. parse_optree() produces the same trees in linear time.
   */
 struct Operation* gen_optree(char* str, NamedStack* st, sc_error* err);
 
+/**
+  * Parses the expression str into a tree of operations in a single pass without modifying str. This produces the same trees as gen_optree() in time linear in the length of str. If a is not NULL then the nodes and their values are owned by a and the tree must not be freed with free_Operation().
+  */
+struct Operation* parse_optree(const char* str, NamedStack* st, arena* a, sc_error* err);
+
 /**
  * Frees the operation pointed to by op and all of its children
  */
 void free_Operation(struct Operation* op);
 
+/**
+ * Simplifies the optree pointed to by op in place by folding constant subtrees and short circuiting logical operations with constant operands. Identities such as x*1 or x+0 are kept since declared types aren't enforced at runtime and x may be a string or an array. If the tree was allocated from the arena a (see parse_optree()) then removed nodes are left for a to release.
+ * Returns: the number of nodes which were eliminated
+ */
+size_t fold_Operation(struct Operation** op, arena* a);
+
+/**
+ * Helper function which makes the arena a responsible for freeing the value v if it owns heap memory.
+ */
+void _arena_own_value(arena* a, value* v, sc_error* err);
+
+/**
+ * Lowers the operation tree op into a flat expression which may be evaluated with eval_expression(). Constant values in op are copied so op may be freed afterwards. If a is not NULL then the expression is allocated from a and must not be freed with free_expression().
+ */
+expression make_expression(const struct Operation* op, arena* a, sc_error* err);
+
+/**
+ * Frees memory used by the expression e.
+ */
+void free_expression(expression* e);
+
+/**
+ * Evaluates the expression e using values from the program stack st. This has the same semantics as eval() on the optree e was generated from. Operators in e are quickened in place based on the types of the operands that they see (see EXP_Q).
+ * Returns: the value of the expression
+ */
+value eval_expression(expression* e, Stack* st, sc_error* err);
+
 // ============================ Instruction Buffer ============================
 
 /**
@@ -248,6 +397,27 @@ void append_Instructions(instruction_buffer* buf, size_t n_in, union Instruction
  */
 void free_instruction_buffer(instruction_buffer* buf);
 
+/**
+ * Adds the value v to the constant pool of buf unless an equal value is already present, in which case v is freed. Ownership of v is taken in either case.
+ * Returns: the index of the constant in the pool
+ */
+size_t intern_const(instruction_buffer* buf, value v, sc_error* err);
+
+/**
+ * Returns the opcode of the instruction starting at index ind of buf. This should be used instead of reading buf->buf directly whenever the buffer may have been threaded.
+ */
+size_t _ins_opcode(const instruction_buffer* buf, size_t ind);
+
+/**
+ * Returns the instruction specified by the opcode ins with bank flags removed
+ */
+size_t _ins_base(size_t ins);
+
+/**
+ * Returns the number of union Instructions used by the instruction with opcode ins, including the opcode itself.
+ */
+size_t _ins_size(size_t ins);
+
 // ============================ FUNCTIONS ============================
 
 /**
@@ -298,7 +468,15 @@ int _parse_rval(context* c, char* str, int force_single, instruction_buffer* buf
 void execute_function(context* c, function* f, sc_error* err);
 
 /**
- * Lookup the function named func_name and an array of arguments args and n_args
+ * Call the function f from C without going through the named stack. The n_args values in args are placed directly on the execution stack (args[0] is the first argument) and the n_rets values returned by f are written to results in the same order. The values are shallow copies, ownership of heap data is not transferred.
+ * returns: the number of values written to results or -1 on error
+ */
+int call_function(context* c, function* f, const value* args, value* results, sc_error* err);
+
+/**
+ * Lookup the function named func_name and call it with the n_args argument strings in args. Arguments are read as the declared type of the function's parameters. An argument of the form g(...) is evaluated by calling g and taking its first return value.
+ * The results are stored in an array allocated with sc_malloc which is saved to results and which the caller must release with sc_free. Each result owns its heap data.
+ * returns: the number of return values or -1 on error
  */
 int call_func_by_name(context* c, const char* func_name, size_t n_args, char** args, value** results, sc_error* err);
 
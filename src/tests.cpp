@@ -2,11 +2,14 @@
 //#include "../extern/catch.hpp"
 #include <doctest.h>
 #include <stdlib.h>
+#include <limits.h>
 
 extern "C" {
 #include "utils.h"
 #include "values.h"
 #include "operations.h"
+#include "exec.h"
+#include "cache.h"
 }
 
 #define TEST_ARR_SIZE 3
@@ -26,6 +29,30 @@ extern "C" {
 #define TEST_ARR_1_VAL	1.0
 #define TEST_ARR_2_VAL	"test"
 
+/**
+ * Helper function which checks whether the optrees a and b have the same structure and values.
+ */
+int optrees_equal(const struct Operation* a, const struct Operation* b) {
+    if (a == NULL || b == NULL) { return a == b; }
+    if ((a->child_l == NULL || a->child_r == NULL) && (b->child_l == NULL || b->child_r == NULL)) {
+	if (a->val.type != b->val.type) { return 0; }
+	if (a->val.type == VT_FLOAT) { return APPROX(a->val.val.f, b->val.val.f); }
+	if (a->val.type == VT_STRING) { return strcmp(a->val.val.str->buf, b->val.val.str->buf) == 0; }
+	if (a->val.type == VT_ARRAY) { return ((Array*)(a->val.val.ptr))->size == ((Array*)(b->val.val.ptr))->size; }
+	return a->val.val.i == b->val.val.i;
+    }
+    return a->op == b->op && optrees_equal(a->child_l, b->child_l) && optrees_equal(a->child_r, b->child_r);
+}
+
+/**
+ * Helper finalizer for arena tests which records the order in which it was called by writing an increasing count to the int pointed to by p.
+ */
+int n_finalized = 0;
+void record_finalizer(void* p) {
+    n_finalized += 1;
+    *(int*)p = n_finalized;
+}
+
 /*class valueOperationsTestFixture {
 private:
     value test_bool;
@@ -98,6 +125,143 @@ TEST_CASE( "Test Hash Table [values]") {
 	    free_value(test_arr + i);
 	}
     }
+
+    SUBCASE("Test interned keys") {
+	sc_error err;
+	//equal strings in different buffers should produce the same canonical pointer
+	char buf_a[TEST_STR_SIZE];
+	char buf_b[TEST_STR_SIZE];
+	strncpy(buf_a, "interned_name", TEST_STR_SIZE);
+	strncpy(buf_b, "interned_name", TEST_STR_SIZE);
+	const char* ia = intern_str(buf_a, &err);
+	CHECK(err.type == E_SUCCESS);
+	const char* ib = intern_str(buf_b, &err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(ia == ib);
+	CHECK(ia != buf_a);
+	CHECK(strcmp(ia, "interned_name") == 0);
+	CHECK(interned_len(ia) == strlen("interned_name"));
+	CHECK(intern_str_n("interned_name_suffix", strlen("interned_name"), &err) == ia);
+	CHECK(intern_str("interned_nam", &err) != ia);
+	CHECK(find_interned(buf_b) == ia);
+	CHECK(find_interned("never_interned_name") == NULL);
+	CHECK(interned_hash(ia) != interned_hash(intern_str("interned_nam", &err)));
+
+	//keys in the table are the interned copies, so pointer lookups and string lookups agree even after the table grows
+	HashTable hasher = make_HashTable(&err);
+	char key[TEST_STR_SIZE];
+	size_t n_wrong = 0;
+	for (int i = 0; i < 100; ++i) {
+	    snprintf(key, TEST_STR_SIZE, "key_%d", i);
+	    insert(&hasher, key, v_make_int(i, &err), &err);
+	    if (err.type != E_SUCCESS) { ++n_wrong; }
+	}
+	size_t n_pool = n_interned_strs();
+	for (int i = 0; i < 100; ++i) {
+	    snprintf(key, TEST_STR_SIZE, "key_%d", i);
+	    HashedItem* tmp = lookup(&hasher, key);
+	    if (tmp == NULL || tmp->val.val.i != i || tmp->key != find_interned(key)) { ++n_wrong; continue; }
+	    if (lookup_interned(&hasher, tmp->key) != tmp) { ++n_wrong; }
+	}
+	CHECK(n_wrong == 0);
+	CHECK(lookup(&hasher, "interned_name") == NULL);
+	CHECK(lookup(&hasher, "never_interned_name") == NULL);
+	//lookups should never add to the pool
+	CHECK(n_interned_strs() == n_pool);
+	free_HashTable(&hasher);
+
+	//compiling another function with the same names shouldn't allocate any new names
+	context con = make_context(&err);
+	char func_def[2*TEST_STR_SIZE];
+	strncpy(func_def, "(int alpha, int beta) => (int) {\nint gamma = alpha+beta\nreturn gamma;\n}", 2*TEST_STR_SIZE);
+	function f1 = make_function(&con, func_def, &err);
+	CHECK(err.type == E_SUCCESS);
+	n_pool = n_interned_strs();
+	strncpy(func_def, "(int alpha, int beta) => (int) {\nint gamma = alpha*beta\nreturn gamma;\n}", 2*TEST_STR_SIZE);
+	function f2 = make_function(&con, func_def, &err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(n_interned_strs() == n_pool);
+	free_function(&f1);
+	free_function(&f2);
+	free_context(&con);
+    }
+
+    SUBCASE("Test removal and long keys") {
+	sc_error err;
+	//keys with a long common prefix must still hash differently
+	const char* fmt = "a_very_long_common_prefix_shared_by_every_key_%d";
+	char key[2*TEST_STR_SIZE];
+	char key2[2*TEST_STR_SIZE];
+	snprintf(key, 2*TEST_STR_SIZE, fmt, 1);
+	snprintf(key2, 2*TEST_STR_SIZE, fmt, 2);
+	CHECK(hash(key) != hash(key2));
+
+	HashTable h = make_HashTable(&err);
+	CHECK(err.type == E_SUCCESS);
+	size_t n_keys = 2000;
+	size_t n_wrong = 0;
+	for (size_t i = 0; i < n_keys; ++i) {
+	    snprintf(key, 2*TEST_STR_SIZE, fmt, (int)i);
+	    insert(&h, key, v_make_int(i, &err), &err);
+	    if (err.type != E_SUCCESS) { ++n_wrong; }
+	}
+	CHECK(n_wrong == 0);
+	CHECK(h.n_els == n_keys);
+	CHECK(h.n_els <= h.max_load*h.table_size);
+	//the table size stays a power of two
+	CHECK((h.table_size & (h.table_size - 1)) == 0);
+
+	//intern a slot so that we can make sure removals and displacements keep it valid
+	snprintf(key, 2*TEST_STR_SIZE, fmt, 7);
+	HashedItem* item = lookup(&h, key);
+	CHECK(item != NULL);
+	size_t slot = h_intern_slot(&h, item, &err);
+	snprintf(key, 2*TEST_STR_SIZE, fmt, 8);
+	size_t slot_rm = h_intern_slot(&h, lookup(&h, key), &err);
+
+	//remove every other key
+	for (size_t i = 0; i < n_keys; i += 2) {
+	    snprintf(key, 2*TEST_STR_SIZE, fmt, (int)i);
+	    if (h_remove(&h, key) != 1) { ++n_wrong; }
+	    if (h_remove(&h, key) != 0) { ++n_wrong; }
+	}
+	CHECK(n_wrong == 0);
+	CHECK(h.n_els == n_keys/2);
+	CHECK(h.slots[slot_rm] == NULL);
+	CHECK(h.slots[slot]->val.val.i == 7);
+	for (size_t i = 0; i < n_keys; ++i) {
+	    snprintf(key, 2*TEST_STR_SIZE, fmt, (int)i);
+	    HashedItem* tmp = lookup(&h, key);
+	    if (i % 2 == 0 && tmp != NULL) { ++n_wrong; }
+	    if (i % 2 == 1 && (tmp == NULL || tmp->val.val.i != (sc_int)i)) { ++n_wrong; }
+	}
+	CHECK(n_wrong == 0);
+	CHECK(h_remove(&h, "never_inserted_key") == 0);
+
+	//removed keys may be inserted again and a lower load factor grows the table
+	size_t old_size = h.table_size;
+	h_set_max_load(&h, 1.5, &err);
+	CHECK(err.type == E_BADVAL);
+	CHECK(h.max_load == GROW_THRESH);
+	h_set_max_load(&h, 0.2, &err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(h.table_size > old_size);
+	for (size_t i = 0; i < n_keys; i += 2) {
+	    snprintf(key, 2*TEST_STR_SIZE, fmt, (int)i);
+	    insert(&h, key, v_make_int(-(sc_int)i, &err), &err);
+	}
+	CHECK(h.n_els == n_keys);
+	CHECK(h.n_els <= 0.2*h.table_size);
+	for (size_t i = 0; i < n_keys; ++i) {
+	    snprintf(key, 2*TEST_STR_SIZE, fmt, (int)i);
+	    HashedItem* tmp = lookup(&h, key);
+	    sc_int expect = (i % 2 == 0)? -(sc_int)i : (sc_int)i;
+	    if (tmp == NULL || tmp->val.val.i != expect) { ++n_wrong; }
+	}
+	CHECK(n_wrong == 0);
+	CHECK(h.slots[slot]->val.val.i == 7);
+	free_HashTable(&h);
+    }
 }
 
 TEST_CASE( "Test parsing utilities [Parse]" ) {
@@ -172,6 +336,16 @@ TEST_CASE( "Test parsing utilities [Parse]" ) {
 	CHECK(v_int.type == VT_INT);
 	CHECK(v_int.val.i == -34);
 	free_value(&v_int);
+	//test integers which don't fit in 32 bits
+	strncpy(test_str, "-9876543210123", TEST_STR_SIZE);
+	v_int = read_value_string(test_str, 0, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(v_int.type == VT_INT);
+	CHECK(v_int.val.i == -9876543210123ll);
+	strncpy(test_str, "0x100000000", TEST_STR_SIZE);
+	v_int = read_value_string(test_str, VT_INT, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(v_int.val.i == 0x100000000ll);
 	//test hex interpretation
 	strncpy(test_str, "0xFF", TEST_STR_SIZE);
 	v_int = read_value_string(test_str, 0, &tmp_err);
@@ -232,6 +406,17 @@ TEST_CASE( "Test parsing utilities [Parse]" ) {
 	CHECK(v_flt.type == VT_FLOAT);
 	CHECK(v_flt.val.f == -0.000125);
 	free_value(&v_int);
+	//exponents without a decimal point and with a sign that differs from the mantissa
+	const char* exp_strs[] = {"1e3", "1e-3", "2.5e-2", "-1.25e4", "-2e-1", "1e0"};
+	double exp_vals[] = {1000.0, 0.001, 0.025, -12500.0, -0.2, 1.0};
+	for (size_t i = 0; i < sizeof(exp_strs)/sizeof(char*); ++i) {
+	    INFO("literal: ", exp_strs[i]);
+	    strncpy(test_str, exp_strs[i], TEST_STR_SIZE);
+	    v_flt = read_value_string(test_str, 0, &tmp_err);
+	    CHECK(tmp_err.type == E_SUCCESS);
+	    CHECK(v_flt.type == VT_FLOAT);
+	    CHECK(v_flt.val.f == exp_vals[i]);
+	}
 	
 	//test string interpretation
 	strncpy(test_str, "\"test strings\"", TEST_STR_SIZE);
@@ -354,6 +539,69 @@ TEST_CASE( "Test Array objects [Arrays]" ) {
 	    free_value(proto_arr + i);
 	}
     }
+    SUBCASE( "Test unboxed arrays [Arrays]" ) {
+	sc_error tmp_err;
+	value proto_arr[TEST_ARR_SIZE];
+	for (size_t i = 0; i < TEST_ARR_SIZE; ++i) { proto_arr[i] = v_make_int(10*i, &tmp_err); }
+	//arrays of a single primitive type are stored unboxed
+	value v_arr = v_make_array(proto_arr, TEST_ARR_SIZE, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	Array* arr = (Array*)v_arr.val.ptr;
+	CHECK(arr->element_type == VT_INT);
+	CHECK(arr->el_size == sizeof(sc_int));
+	CHECK(_get_a(arr, 2).type == VT_INT);
+	CHECK(_get_a(arr, 2).val.i == 20);
+	//appending values of the same type keeps the array unboxed
+	_extend_a(arr, proto_arr, TEST_ARR_SIZE, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(arr->element_type == VT_INT);
+	CHECK(arr->size == 2*TEST_ARR_SIZE);
+	CHECK(_get_a(arr, TEST_ARR_SIZE + 1).val.i == 10);
+	//slices and comparisons work with either representation
+	Array slice = _slice_a(*arr, 1, 3, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(slice.element_type == VT_INT);
+	CHECK(slice.size == 2);
+	CHECK(_get_a(&slice, 0).val.i == 10);
+	CHECK(_get_a(&slice, 1).val.i == 20);
+	free_Array(&slice);
+	value v_boxed = v_make_array(proto_arr, TEST_ARR_SIZE, &tmp_err);
+	_box_a((Array*)v_boxed.val.ptr, &tmp_err);
+	CHECK(((Array*)v_boxed.val.ptr)->element_type == VT_UNDEF);
+	slice = _slice_a(*(Array*)v_boxed.val.ptr, -2, TEST_ARR_SIZE, &tmp_err);
+	CHECK(slice.size == 2);
+	CHECK(_get_a(&slice, 0).val.i == 10);
+	free(slice.buf);
+	//unboxed elements own no memory so the array may be truncated directly
+	arr->size = TEST_ARR_SIZE;
+	CHECK(op_eq(v_arr, v_boxed, &tmp_err).val.i == 1);
+	//storing a value of a different type falls back to boxed storage
+	_set_a(arr, 1, v_make_float(0.5, &tmp_err), &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(arr->element_type == VT_UNDEF);
+	CHECK(arr->buf[0].val.i == 0);
+	CHECK(arr->buf[1].val.f == 0.5);
+	CHECK(arr->buf[2].val.i == 20);
+	CHECK(op_eq(v_arr, v_boxed, &tmp_err).val.i == 0);
+	//empty arrays become unboxed when they are first extended
+	value v_empty = {0};
+	v_empty.type = VT_ARRAY;
+	v_empty.val.ptr = _make_Array(sizeof(value), DEF_ARR_N, &tmp_err);
+	value f_val = v_make_float(1.5, &tmp_err);
+	_extend_a((Array*)v_empty.val.ptr, &f_val, 1, &tmp_err);
+	CHECK(((Array*)v_empty.val.ptr)->element_type == VT_FLOAT);
+	CHECK(_get_a((Array*)v_empty.val.ptr, 0).val.f == 1.5);
+	//mixed literals stay boxed
+	char arr_str[TEST_STR_SIZE];
+	strncpy(arr_str, "[1, 2.0]", TEST_STR_SIZE);
+	value v_mixed = read_value_string(arr_str, VT_UNDEF, &tmp_err);
+	CHECK(((Array*)v_mixed.val.ptr)->element_type == VT_UNDEF);
+	//cleanup
+	free_value(&v_arr);
+	free_value(&v_boxed);
+	free_value(&v_empty);
+	free_value(&v_mixed);
+    }
 }
 
 TEST_CASE( "Test that initialization functions produce correct results [values]") {
@@ -385,7 +633,9 @@ TEST_CASE( "Test that initialization functions produce correct results [values]"
 	CHECK(tmp_err.type == E_SUCCESS);
 	CHECK(test_string_n.val.str->size == 0);
 	CHECK(len(test_string_n) == 0);
-	CHECK(test_string_n.val.str->buf_size == 5);
+	//short strings are stored inline with the capacity of the inline buffer
+	CHECK(test_string_n.val.str->buf_size == STRING_SMALL_SIZE);
+	CHECK(test_string_n.val.str->buf == test_string_n.val.str->small);
 	CHECK(strcmp(test_string.val.str->buf, "test") == 0);
 	CHECK(test_string.val.str->buf[test_string.val.str->size] == 0);
 
@@ -397,9 +647,6 @@ TEST_CASE( "Test that initialization functions produce correct results [values]"
 	free_value(&test_string);
 	free_value(&test_string_n);
     }
-}
-
-TEST_CASE ( "Test single operations [operations]") {
     SUBCASE ( "String bool addition" ) {
 	//setup
 	sc_error tmp_err;
@@ -444,6 +691,37 @@ TEST_CASE ( "Test single operations [operations]") {
 	CHECK(res.val.i == 2);
 	res = op_div(s2, s1, &tmp_err);
 	CHECK(res.val.i == 2);
+	//integers are 64 bits wide so products of 32 bit values don't overflow
+	s1.val.i = 3000000000ll;
+	res = op_mult(s1, s1, &tmp_err);
+	CHECK(res.val.i == 9000000000000000000ll);
+	res = op_grt(res, s1, &tmp_err);
+	CHECK(res.val.i == 1);
+	char int_str[TEST_STR_SIZE];
+	int_str[v_fetch_string(v_make_int(INT64_MIN, &tmp_err), int_str, TEST_STR_SIZE, &tmp_err)] = 0;
+	CHECK(strcmp(int_str, "-9223372036854775808") == 0);
+	int_str[v_fetch_string(v_make_int(0, &tmp_err), int_str, TEST_STR_SIZE, &tmp_err)] = 0;
+	CHECK(strcmp(int_str, "0") == 0);
+	//integer overflow wraps around
+	res = op_add(v_make_int(INT64_MAX, &tmp_err), v_make_int(1, &tmp_err), &tmp_err);
+	CHECK(res.val.i == INT64_MIN);
+	res = op_sub(v_make_int(INT64_MIN, &tmp_err), v_make_int(1, &tmp_err), &tmp_err);
+	CHECK(res.val.i == INT64_MAX);
+	res = op_mult(v_make_int(INT64_MAX, &tmp_err), v_make_int(2, &tmp_err), &tmp_err);
+	CHECK(res.val.i == -2);
+	//the only integer division which overflows wraps around instead of trapping
+	res = op_div(v_make_int(INT64_MIN, &tmp_err), v_make_int(-1, &tmp_err), &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(res.val.i == INT64_MIN);
+	value min_ints[2] = {v_make_int(INT64_MIN, &tmp_err), v_make_int(7, &tmp_err)};
+	value min_arr = v_make_array(min_ints, 2, &tmp_err);
+	res = op_div(min_arr, v_make_int(-1, &tmp_err), &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(_get_a((Array*)res.val.ptr, 0).val.i == INT64_MIN);
+	CHECK(_get_a((Array*)res.val.ptr, 1).val.i == -7);
+	free_value(&res);
+	free_value(&min_arr);
+	s1.val.i = 1;
 
 	for (size_t i = 0; i < N_ARITH_TESTS; ++i) {
 	    int tmp_1 = (rand() % RAND_RANGE) - RAND_RANGE/2;
@@ -598,12 +876,25 @@ TEST_CASE ( "Test single operations [operations]") {
 	CHECK(strcmp(fooint.val.str->buf, "foo1") == 0);
 	CHECK(fooint.val.str->buf[fooint.val.str->size] == 0);
 
-	//test ints
+	//test floats, the size must match the formatted number rather than the estimate used to allocate it
 	value fooflt = op_add(foo_string, test_arr[1], &tmp_err);
 	CHECK(tmp_err.type == E_SUCCESS);
-	INFO(fooint.val.str->buf);
-	CHECK(strcmp(fooint.val.str->buf, "foo1") == 0);
+	INFO(fooflt.val.str->buf);
+	CHECK(strcmp(fooflt.val.str->buf, "foo1") == 0);
+	CHECK(fooflt.val.str->size == 4);
 	CHECK(fooflt.val.str->buf[fooflt.val.str->size] == 0);
+	double flts[] = {1.5, -2.25, 0.1, 1e12, -1.5e-7};
+	const char* flt_strs[] = {"x1.5", "x-2.25", "x0.1", "x1E+12", "x-1.5E-7"};
+	value x_string = v_make_string("x", &tmp_err);
+	for (size_t i = 0; i < sizeof(flts)/sizeof(double); ++i) {
+	    value xflt = op_add(x_string, v_make_float(flts[i], &tmp_err), &tmp_err);
+	    CHECK(tmp_err.type == E_SUCCESS);
+	    INFO("expected ", flt_strs[i]);
+	    CHECK(xflt.val.str->size == strlen(flt_strs[i]));
+	    CHECK(strcmp(xflt.val.str->buf, flt_strs[i]) == 0);
+	    free_value(&xflt);
+	}
+	free_value(&x_string);
 
 	//test arrays
 	value arr = v_make_array(test_arr, TEST_ARR_SIZE, &tmp_err);
@@ -628,6 +919,89 @@ TEST_CASE ( "Test single operations [operations]") {
 	    free_value(test_arr + i);
 	}
     }
+    SUBCASE ( "Element-wise array arithmetic" ) {
+	sc_error tmp_err;
+	//use a length which isn't a multiple of the vector width so that the scalar tail is exercised
+	const size_t n = 37;
+	value ints_a[n], ints_b[n], flts_a[n], flts_b[n];
+	for (size_t i = 0; i < n; ++i) {
+	    ints_a[i] = v_make_int((sc_int)(rand() % RAND_RANGE) - RAND_RANGE/2, &tmp_err);
+	    ints_b[i] = v_make_int((sc_int)(rand() % RAND_RANGE) + 1, &tmp_err);
+	    flts_a[i] = v_make_float((double)(rand() % RAND_RANGE)/7 - RAND_RANGE/14, &tmp_err);
+	    flts_b[i] = v_make_float((double)(rand() % RAND_RANGE)/3 + 0.5, &tmp_err);
+	}
+	ints_a[0].val.i = INT64_MAX;
+	flts_a[1].val.f = -0.0;
+	flts_a[2].val.f = NAN;
+	flts_a[3].val.f = -INFINITY;
+	flts_b[4].val.f = NAN;
+	value arrs[4] = {v_make_array(ints_a, n, &tmp_err), v_make_array(ints_b, n, &tmp_err), v_make_array(flts_a, n, &tmp_err), v_make_array(flts_b, n, &tmp_err)};
+	CHECK(((Array*)arrs[0].val.ptr)->element_type == VT_INT);
+	CHECK(((Array*)arrs[3].val.ptr)->element_type == VT_FLOAT);
+	value (*ops[6])(value, value, sc_error*) = {op_add, op_sub, op_mult, op_div, op_grt, op_geq};
+	//every kernel must produce results bit identical to the scalar operations
+	size_t n_mismatch = 0;
+	for (int level = SIMD_NONE; level <= simd_supported(); ++level) {
+	    CHECK(set_simd_level(level) == level);
+	    for (size_t k = 0; k < 6; ++k) {
+		for (size_t t = 0; t < 2; ++t) {
+		    value a_arr = arrs[2*t];
+		    value b_arr = arrs[2*t + 1];
+		    value b_scl = _get_a((Array*)b_arr.val.ptr, 5);
+		    //check the forms array op array, array op scalar and scalar op array
+		    for (size_t j = 0; j < 3; ++j) {
+			value l = (j == 2)? b_scl : a_arr;
+			value r = (j == 0)? b_arr : ((j == 1)? b_scl : a_arr);
+			value res = ops[k](l, r, &tmp_err);
+			int res_failed = (tmp_err.type != E_SUCCESS);
+			//the result must fail exactly when some element fails and otherwise match every element
+			int any_failed = 0;
+			for (size_t i = 0; i < n; ++i) {
+			    value el_l = (l.type == VT_ARRAY)? _get_a((Array*)l.val.ptr, i) : l;
+			    value el_r = (r.type == VT_ARRAY)? _get_a((Array*)r.val.ptr, i) : r;
+			    value expect = ops[k](el_l, el_r, &tmp_err);
+			    if (tmp_err.type != E_SUCCESS) { any_failed = 1;continue; }
+			    if (res_failed) { continue; }
+			    value got = _get_a((Array*)res.val.ptr, i);
+			    if (expect.type != got.type || memcmp(&expect.val, &got.val, sizeof(expect.val)) != 0) { ++n_mismatch; }
+			}
+			if (res_failed != any_failed) { ++n_mismatch; }
+			free_value(&res);
+		    }
+		}
+	    }
+	}
+	CHECK(n_mismatch == 0);
+	set_simd_level(SIMD_AVX2);
+	//comparisons produce unboxed bools
+	value res = op_grt(arrs[0], arrs[1], &tmp_err);
+	CHECK(((Array*)res.val.ptr)->element_type == VT_BOOL);
+	free_value(&res);
+	//errors from any element are reported
+	res = op_div(arrs[2], v_make_float(0.0, &tmp_err), &tmp_err);
+	CHECK(tmp_err.type != E_SUCCESS);
+	CHECK(res.type == VT_ERROR);
+	res = op_add(arrs[0], arrs[2], &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(((Array*)res.val.ptr)->element_type == VT_FLOAT);
+	free_value(&res);
+	value short_arr = v_make_array(ints_a, n - 1, &tmp_err);
+	res = op_sub(arrs[0], short_arr, &tmp_err);
+	CHECK(tmp_err.type == E_RANGE);
+	//mixed arrays fall back to the scalar operations
+	value mixed[2] = {v_make_int(3, &tmp_err), v_make_float(2.5, &tmp_err)};
+	value mixed_arr = v_make_array(mixed, 2, &tmp_err);
+	res = op_mult(mixed_arr, v_make_int(2, &tmp_err), &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(_get_a((Array*)res.val.ptr, 0).type == VT_INT);
+	CHECK(_get_a((Array*)res.val.ptr, 0).val.i == 6);
+	CHECK(_get_a((Array*)res.val.ptr, 1).val.f == 5.0);
+	free_value(&res);
+	//cleanup
+	for (size_t i = 0; i < 4; ++i) { free_value(arrs + i); }
+	free_value(&short_arr);
+	free_value(&mixed_arr);
+    }
 }
 
 TEST_CASE ( "Test Math Evaluations [operations]") {
@@ -923,7 +1297,6 @@ TEST_CASE ( "Test Math Evaluations [operations]") {
 	//setup
 	sc_error err;
 
-	char tmp_str[TEST_STR_SIZE];
 	NamedStack st = make_NamedStack(&err);
 
 	CHECK(err.type == E_SUCCESS);
@@ -979,6 +1352,319 @@ TEST_CASE ( "Test Math Evaluations [operations]") {
 	free_NamedStack(&n_st);
 	free_Stack(&st);
     }
+
+    SUBCASE ( "Test single pass parsing" ) {
+	//setup
+	char test_str[2][TEST_STR_SIZE];
+	char expr_str[4*TEST_STR_SIZE];
+	sc_error tmp_err;
+	NamedStack n_st = make_NamedStack(&tmp_err);
+	Stack st = make_Stack(&tmp_err);
+	strncpy(test_str[0], "test_a", TEST_STR_SIZE);
+	strncpy(test_str[1], "test_b", TEST_STR_SIZE);
+	push_n(&n_st, test_str[0], v_make_int(TEST_INT_VAL, &tmp_err), &tmp_err);
+	push(&st, v_make_int(TEST_INT_VAL, &tmp_err), &tmp_err);
+	push_n(&n_st, test_str[1], v_make_int(3, &tmp_err), &tmp_err);
+	push(&st, v_make_int(3, &tmp_err), &tmp_err);
+
+	//parse_optree should produce the same trees as gen_optree
+	const char* exprs[] = {"1", "-4", "(7+2)-3", "17 -\t( (1.0 + 2.0) - 0.5)", "1 - 2 - 3 + 4", "8/4/2*3", "1 + 2*3 - 4/5",
+	    "(test_a + test_b)*test_b", "test_a/3 - test_b*4", "-3*test_a + -2", "(test_a- test_b <= test_a)", "1 < 2 < 3",
+	    "(7+2 <= 3) || (7-5 <= 3)", "(7+2 <= 9) && (test_a > test_b) || test_a == 1", "!(test_a < 3)", "2.5e2 + 1",
+	    "((((1+test_a)*2)-(3+(4*(5-(6+(7*(8-(9+(10*(11-(12+(13*(14-(15+(16*(17-(18+test_a))))))))))))))))))"};
+	for (size_t i = 0; i < sizeof(exprs)/sizeof(char*); ++i) {
+	    INFO("expression: ", exprs[i]);
+	    strncpy(expr_str, exprs[i], 4*TEST_STR_SIZE);
+	    struct Operation* expect = gen_optree(expr_str, &n_st, &tmp_err);
+	    CHECK(tmp_err.type == E_SUCCESS);
+	    struct Operation* op = parse_optree(exprs[i], &n_st, NULL, &tmp_err);
+	    CHECK(tmp_err.type == E_SUCCESS);
+	    CHECK(optrees_equal(op, expect));
+	    free_Operation(expect);
+	    free_Operation(op);
+	}
+
+	//literals which gen_optree can't handle
+	struct Operation* op = parse_optree("\"a+b\" + \"c\"", &n_st, NULL, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	value res = eval(op, &st, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(res.type == VT_STRING);
+	CHECK(strcmp(res.val.str->buf, "a+bc") == 0);
+	free_value(&res);
+	free_value(&(op->child_l->val));
+	free_value(&(op->child_r->val));
+	free_Operation(op);
+	op = parse_optree("1.5e-1 * 2 - -(test_b - 1)", &n_st, NULL, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	res = eval(op, &st, &tmp_err);
+	CHECK(res.type == VT_FLOAT);
+	CHECK(APPROX(res.val.f, 2.3));
+	free_Operation(op);
+	//signed exponents are kept as part of the literal
+	op = parse_optree("1e3 - 2.5e-2*4", &n_st, NULL, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	res = eval(op, &st, &tmp_err);
+	CHECK(res.type == VT_FLOAT);
+	CHECK(res.val.f == 999.9);
+	free_Operation(op);
+	//a minus sign before a group negates the whole group. gen_optree drops the sign here and evaluates to 5
+	const char* neg_exprs[] = {"-(2+3)", "-(test_a - test_b)*2", "1 - -(2*3)"};
+	sc_int neg_res[] = {-5, -2*(TEST_INT_VAL - 3), 7};
+	for (size_t i = 0; i < sizeof(neg_exprs)/sizeof(char*); ++i) {
+	    INFO("expression: ", neg_exprs[i]);
+	    op = parse_optree(neg_exprs[i], &n_st, NULL, &tmp_err);
+	    CHECK(tmp_err.type == E_SUCCESS);
+	    res = eval(op, &st, &tmp_err);
+	    CHECK(res.type == VT_INT);
+	    CHECK(res.val.i == neg_res[i]);
+	    free_Operation(op);
+	}
+
+	//invalid expressions
+	const char* bad_exprs[] = {"(1 + 2", "1 + 2)", "1 +", "test_c * 2", "1 & 2", "1 2"};
+	for (size_t i = 0; i < sizeof(bad_exprs)/sizeof(char*); ++i) {
+	    INFO("expression: ", bad_exprs[i]);
+	    op = parse_optree(bad_exprs[i], &n_st, NULL, &tmp_err);
+	    CHECK(op == NULL);
+	    CHECK(tmp_err.type != E_SUCCESS);
+	}
+
+	//cleanup
+	free_NamedStack(&n_st);
+	free_Stack(&st);
+    }
+
+    SUBCASE ( "Test lowering optrees to expressions" ) {
+	//setup
+	char test_str[2][TEST_STR_SIZE];
+	char expr_str[4*TEST_STR_SIZE];
+	sc_error tmp_err;
+	NamedStack n_st = make_NamedStack(&tmp_err);
+	Stack st = make_Stack(&tmp_err);
+	strncpy(test_str[0], "test_a", TEST_STR_SIZE);
+	strncpy(test_str[1], "test_b", TEST_STR_SIZE);
+	push_n(&n_st, test_str[0], v_make_int(TEST_INT_VAL, &tmp_err), &tmp_err);
+	push(&st, v_make_int(TEST_INT_VAL, &tmp_err), &tmp_err);
+	push_n(&n_st, test_str[1], v_make_int(3, &tmp_err), &tmp_err);
+	push(&st, v_make_int(3, &tmp_err), &tmp_err);
+
+	//every expression should produce the same result as the optree it was lowered from
+	const char* exprs[] = {"(7+2)-3", "17 -\t( (1.0 + 2.0) - 0.5)", "(test_a + test_b)*test_b", "test_a/3 - test_b*4",
+	    "(test_a- test_b <= test_a)", "(7+2 <= 3) || (7-5 <= 3)", "(7+2 <= 9) && (test_a > test_b)", "!(test_a < 3)",
+	    "((((1+test_a)*2)-(3+(4*(5-(6+(7*(8-(9+(10*(11-(12+(13*(14-(15+(16*(17-(18+test_a))))))))))))))))))"};
+	for (size_t i = 0; i < sizeof(exprs)/sizeof(char*); ++i) {
+	    INFO("expression: ", exprs[i]);
+	    strncpy(expr_str, exprs[i], 4*TEST_STR_SIZE);
+	    struct Operation* op = gen_optree(expr_str, &n_st, &tmp_err);
+	    CHECK(tmp_err.type == E_SUCCESS);
+	    expression e = make_expression(op, NULL, &tmp_err);
+	    CHECK(tmp_err.type == E_SUCCESS);
+	    CHECK(e.depth > 0);
+	    value expect = eval(op, &st, &tmp_err);
+	    CHECK(tmp_err.type == E_SUCCESS);
+	    //the optree isn't needed to evaluate the expression
+	    free_Operation(op);
+	    value res = eval_expression(&e, &st, &tmp_err);
+	    CHECK(tmp_err.type == E_SUCCESS);
+	    CHECK(res.type == expect.type);
+	    if (res.type == VT_FLOAT) {
+		CHECK(APPROX(res.val.f, expect.val.f));
+	    } else {
+		CHECK(res.val.i == expect.val.i);
+	    }
+	    free_expression(&e);
+	}
+
+	//stack references are read directly from the stack
+	strncpy(expr_str, "test_a + 1", 4*TEST_STR_SIZE);
+	struct Operation* op = gen_optree(expr_str, &n_st, &tmp_err);
+	expression e = make_expression(op, NULL, &tmp_err);
+	free_Operation(op);
+	CHECK(e.buf.n_insts == 5);
+	CHECK(e.buf.buf[0].i == EXP_PUSH_S);
+	CHECK(e.buf.buf[1].i == 1);
+	CHECK(e.buf.buf[2].i == EXP_PUSH_C);
+	CHECK(e.buf.buf[4].i == EXP_ADD);
+	CHECK(e.n_consts == 1);
+	CHECK(e.depth == 2);
+
+	//operators are specialized for the types they see the first time they are evaluated
+	value res = eval_expression(&e, &st, &tmp_err);
+	CHECK(res.val.i == TEST_INT_VAL + 1);
+	CHECK(e.buf.buf[4].i == (EXP_ADD | EXP_Q_II));
+	res = eval_expression(&e, &st, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(res.type == VT_INT);
+	CHECK(res.val.i == TEST_INT_VAL + 1);
+	//if the types change the generic implementation is used from then on
+	value saved = st.top[1];
+	st.top[1] = v_make_float(1.5, &tmp_err);
+	res = eval_expression(&e, &st, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(res.type == VT_FLOAT);
+	CHECK(APPROX(res.val.f, 2.5));
+	CHECK(e.buf.buf[4].i == (EXP_ADD | EXP_Q_GENERIC));
+	free_expression(&e);
+	strncpy(expr_str, "(test_a*2.0 - 0.5) >= 2.5", 4*TEST_STR_SIZE);
+	op = gen_optree(expr_str, &n_st, &tmp_err);
+	e = make_expression(op, NULL, &tmp_err);
+	free_Operation(op);
+	for (size_t i = 0; i < 2; ++i) {
+	    res = eval_expression(&e, &st, &tmp_err);
+	    CHECK(tmp_err.type == E_SUCCESS);
+	    CHECK(res.type == VT_BOOL);
+	    CHECK(res.val.i == 1);
+	}
+	CHECK(e.buf.buf[4].i == (EXP_MULT | EXP_Q_FF));
+	CHECK(e.buf.buf[7].i == (EXP_SUB | EXP_Q_FF));
+	CHECK(e.buf.buf[10].i == (EXP_GEQ | EXP_Q_FF));
+	st.top[1] = saved;
+	free_expression(&e);
+	//dividing the smallest integer by -1 leaves the specialized division instead of trapping
+	strncpy(expr_str, "test_a / test_b", 4*TEST_STR_SIZE);
+	op = gen_optree(expr_str, &n_st, &tmp_err);
+	e = make_expression(op, NULL, &tmp_err);
+	free_Operation(op);
+	res = eval_expression(&e, &st, &tmp_err);
+	CHECK(res.val.i == TEST_INT_VAL/3);
+	CHECK(e.buf.buf[4].i == (EXP_DIV | EXP_Q_II));
+	value saved_b = st.top[0];
+	st.top[0] = v_make_int(-1, &tmp_err);
+	st.top[1] = v_make_int(INT64_MIN, &tmp_err);
+	res = eval_expression(&e, &st, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(res.val.i == INT64_MIN);
+	st.top[0] = saved_b;
+	st.top[1] = saved;
+	free_expression(&e);
+	//specialized integer arithmetic wraps around on overflow just like op_add()
+	strncpy(expr_str, "test_a + test_b", 4*TEST_STR_SIZE);
+	op = gen_optree(expr_str, &n_st, &tmp_err);
+	e = make_expression(op, NULL, &tmp_err);
+	free_Operation(op);
+	res = eval_expression(&e, &st, &tmp_err);
+	CHECK(e.buf.buf[4].i == (EXP_ADD | EXP_Q_II));
+	st.top[1] = v_make_int(INT64_MAX, &tmp_err);
+	res = eval_expression(&e, &st, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(res.val.i == INT64_MIN + 2);
+	st.top[1] = saved;
+	free_expression(&e);
+
+	//optrees and expressions may be placed in arenas, values which own memory are released with the arena
+	arena scratch = {0};
+	arena mem = {0};
+	op = parse_optree("\"foo\" + \"bar\" + (test_a - 0)*(2 - 1)", &n_st, &scratch, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(fold_Operation(&op, &scratch) == 2);
+	e = make_expression(op, &mem, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	reset_arena(&scratch);
+	res = eval_expression(&e, &st, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(res.type == VT_STRING);
+	CHECK(strcmp(res.val.str->buf, "foobar12") == 0);
+	free_value(&res);
+	free_arena(&mem);
+	free_arena(&scratch);
+
+	//cleanup
+	free_NamedStack(&n_st);
+	free_Stack(&st);
+    }
+
+    SUBCASE ( "Test constant folding" ) {
+	//setup
+	char test_str[2][TEST_STR_SIZE];
+	char expr_str[TEST_STR_SIZE];
+	sc_error tmp_err;
+	NamedStack n_st = make_NamedStack(&tmp_err);
+	Stack st = make_Stack(&tmp_err);
+	strncpy(test_str[0], "x", TEST_STR_SIZE);
+	strncpy(test_str[1], "s", TEST_STR_SIZE);
+	push_n(&n_st, test_str[0], v_make_int(TEST_INT_VAL, &tmp_err), &tmp_err);
+	push(&st, v_make_int(TEST_INT_VAL, &tmp_err), &tmp_err);
+	push_n(&n_st, test_str[1], v_make_string("foo", &tmp_err), &tmp_err);
+	push(&st, v_make_string("foo", &tmp_err), &tmp_err);
+
+	//each expression is listed with the number of nodes that should be eliminated
+	const char* exprs[] = {"(2*3) + x", "x*1 + 0", "0 + 1*x", "x/1 - 0", "(1 < 2) || (x > 3)", "(0 > 1) || (x > 3)", "(1 < 2) && (x > 3)",
+	    "!(3 < 4)", "x + 0.0", "2/0 + x", "s + 0", "x*(2 - 1) + (3 - 3)", "(x == 3) && (1 < 2)", "s*1 - 0"};
+	//identities aren't removed since declared types aren't enforced at runtime
+	size_t n_elim[] = {2, 0, 0, 0, 6, 2, 2, 4, 0, 0, 0, 4, 4, 0};
+	for (size_t i = 0; i < sizeof(exprs)/sizeof(char*); ++i) {
+	    INFO("expression: ", exprs[i]);
+	    strncpy(expr_str, exprs[i], TEST_STR_SIZE);
+	    struct Operation* op = gen_optree(expr_str, &n_st, &tmp_err);
+	    CHECK(tmp_err.type == E_SUCCESS);
+	    value expect = eval(op, &st, &tmp_err);
+	    sc_error expect_err = tmp_err;
+	    CHECK(fold_Operation(&op, NULL) == n_elim[i]);
+	    //folding must not change the result
+	    value res = eval(op, &st, &tmp_err);
+	    CHECK(tmp_err.type == expect_err.type);
+	    if (tmp_err.type == E_SUCCESS) {
+		CHECK(res.type == expect.type);
+		if (res.type == VT_STRING) {
+		    CHECK(strcmp(res.val.str->buf, expect.val.str->buf) == 0);
+		    free_value(&res);
+		    free_value(&expect);
+		} else {
+		    CHECK(res.val.i == expect.val.i);
+		}
+	    }
+	    free_Operation(op);
+	}
+
+	//constants are folded when functions are compiled
+	context con = make_context(&tmp_err);
+	char func_def[4*TEST_STR_SIZE];
+	doctest::String fold_def_str = "(int x) => (int) {\nreturn (2*3)*x + 0\n}";
+	strncpy(func_def, fold_def_str.c_str(), 4*TEST_STR_SIZE);
+	function fold_f = make_function(&con, func_def, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	CHECK(con.n_folded == 2);
+	push_n(&(con.callstack), NULL, v_make_int(7, &tmp_err), &tmp_err);
+	execute_function(&con, &fold_f, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	HashedItem res = pop_n(&(con.callstack), &tmp_err);
+	CHECK(res.val.val.i == 42);
+
+	//a local may hold a value of any type, so folding mustn't drop operations based on its declaration
+	doctest::String ident_def_str = "(string s) => (int) {\nint x = s\nreturn x + 0\n}";
+	strncpy(func_def, ident_def_str.c_str(), 4*TEST_STR_SIZE);
+	function ident_f = make_function(&con, func_def, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	value str_arg = v_make_string("abc", &tmp_err);
+	push_n(&(con.callstack), NULL, str_arg, &tmp_err);
+	execute_function(&con, &ident_f, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	res = pop_n(&(con.callstack), &tmp_err);
+	CHECK(res.val.type == VT_STRING);
+	if (res.val.type == VT_STRING) { CHECK(strcmp(res.val.val.str->buf, "abc0") == 0); }
+	free_value(&(res.val));
+	free_value(&str_arg);
+	free_function(&ident_f);
+	//ordering comparisons of arrays are element-wise, so they aren't known to be boolean
+	doctest::String arr_def_str = "(array l) => (int) {\nreturn 1 && (l > 3)\n}";
+	strncpy(func_def, arr_def_str.c_str(), 4*TEST_STR_SIZE);
+	function arr_f = make_function(&con, func_def, &tmp_err);
+	CHECK(tmp_err.type == E_SUCCESS);
+	//arguments are borrowed by the function, so the caller still owns the array
+	value arr_arg = v_make_array_n(5, v_make_int(4, &tmp_err), &tmp_err);
+	push_n(&(con.callstack), NULL, arr_arg, &tmp_err);
+	execute_function(&con, &arr_f, &tmp_err);
+	CHECK(tmp_err.type == E_BADTYPE);
+	free_value(&arr_arg);
+	free_function(&arr_f);
+
+	//cleanup
+	free_function(&fold_f);
+	free_context(&con);
+	free_NamedStack(&n_st);
+	free_Stack(&st);
+    }
 }
 
 TEST_CASE( "Test that String structs work as expected [Strings]") {
@@ -1037,6 +1723,125 @@ TEST_CASE( "Test that String structs work as expected [Strings]") {
 	free_String(&foo_str);
 	free_String(&bar_str);
     }
+
+    SUBCASE ( "Test inline strings" ) {
+	sc_error err;
+	const char* long_text = "a string which is too long to be stored inline";
+	value short_v = v_make_string("key_", &err);
+	value long_v = v_make_string(long_text, &err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(short_v.val.str->buf == short_v.val.str->small);
+	CHECK(long_v.val.str->buf != long_v.val.str->small);
+	CHECK(strcmp(long_v.val.str->buf, long_text) == 0);
+
+	//short concatenations and copies stay inline
+	value label = v_make_string("label", &err);
+	value sum = op_add(short_v, label, &err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(sum.val.str->buf == sum.val.str->small);
+	CHECK(sum.val.str->size == 9);
+	CHECK(strcmp(sum.val.str->buf, "key_label") == 0);
+	value copy = v_deep_copy(sum, &err);
+	CHECK(copy.val.str->buf == copy.val.str->small);
+	CHECK(op_eq(copy, sum, &err).val.i == 1);
+	CHECK(op_eq(copy, short_v, &err).val.i == 0);
+
+	//growing past the inline buffer moves the contents to the heap
+	_append_string(copy.val.str, long_text, &err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(copy.val.str->buf != copy.val.str->small);
+	CHECK(copy.val.str->size == 9 + strlen(long_text));
+	CHECK(strncmp(copy.val.str->buf, "key_label", 9) == 0);
+	CHECK(strcmp(copy.val.str->buf + 9, long_text) == 0);
+
+	//mixed types are written into the inline buffer
+	value with_num = op_add(short_v, v_make_int(-42, &err), &err);
+	CHECK(strcmp(with_num.val.str->buf, "key_-42") == 0);
+	value with_bool = op_add(short_v, v_make_bool(0, &err), &err);
+	CHECK(strcmp(with_bool.val.str->buf, "key_false") == 0);
+	CHECK(with_bool.val.str->size == 9);
+
+	free_value(&with_bool);
+	free_value(&with_num);
+	free_value(&copy);
+	free_value(&sum);
+	free_value(&label);
+	free_value(&long_v);
+	free_value(&short_v);
+    }
+
+    SUBCASE ( "Test repeated concatenation" ) {
+	sc_error err;
+	const char* piece = "abc";
+	value v_piece = v_make_string(piece, &err);
+	value s = v_make_string("a string which is long enough to use a builder", &err);
+	size_t start_size = s.val.str->size;
+	//appending to the last result should reuse its builder except when the capacity doubles
+	size_t n_builders = 0;
+	size_t n_wrong = 0;
+	StringBuilder* last = NULL;
+	for (size_t i = 0; i < 1000; ++i) {
+	    value next = op_add(s, v_piece, &err);
+	    if (err.type != E_SUCCESS || next.val.str->size != s.val.str->size + 3) { ++n_wrong; }
+	    if (next.val.str->bld != last) { ++n_builders; }
+	    last = next.val.str->bld;
+	    free_value(&s);
+	    s = next;
+	}
+	CHECK(n_wrong == 0);
+	CHECK(n_builders <= 8);
+	CHECK(s.val.str->size == start_size + 3000);
+	for (size_t i = 0; i < 1000; ++i) {
+	    if (strncmp(s.val.str->buf + start_size + 3*i, piece, 3) != 0) { ++n_wrong; }
+	}
+	CHECK(n_wrong == 0);
+	CHECK(s.val.str->buf[s.val.str->size] == 0);
+
+	//branching from the same string must not change either branch or the original
+	value br_x = op_add(s, v_make_bool(1, &err), &err);
+	value br_y = op_add(s, v_make_int(7, &err), &err);
+	CHECK(br_x.val.str->bld == s.val.str->bld);
+	CHECK(br_y.val.str->bld != s.val.str->bld);
+	CHECK(br_x.val.str->size == s.val.str->size + 4);
+	CHECK(strcmp(br_x.val.str->buf + s.val.str->size, "true") == 0);
+	CHECK(strcmp(br_y.val.str->buf + s.val.str->size, "7") == 0);
+	CHECK(op_eq(br_x, br_y, &err).val.i == 0);
+	CHECK(op_grt(br_x, br_y, &err).val.i == 1);
+	//s was appended to in place, so it has to be flattened before it can be used as a C string
+	CHECK(s.val.str->size != s.val.str->bld->used);
+	char* flat = _get_char_buf(s);
+	CHECK(flat != NULL);
+	CHECK(s.val.str->bld == NULL);
+	CHECK(strlen(flat) == start_size + 3000);
+	CHECK(strncmp(flat, br_x.val.str->buf, s.val.str->size) == 0);
+
+	//conversions read a flattened copy
+	value num = v_make_string("2.5000000000000000000000000", &err);
+	value num_long = op_add(num, v_make_int(0, &err), &err);
+	value num_next = op_add(num_long, v_piece, &err);
+	CHECK(num_long.val.str->bld == num_next.val.str->bld);
+	CHECK(v_fetch_float(num_long, &err) == 2.5);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(num_next.val.str->buf[num_next.val.str->size] == 0);
+
+	//growing a shared string gives it its own buffer
+	value grown = op_add(num_next, v_piece, &err);
+	_append_string(grown.val.str, "def", &err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(grown.val.str->bld == NULL);
+	CHECK(strcmp(grown.val.str->buf, "2.50000000000000000000000000abcabcdef") == 0);
+	CHECK(num_next.val.str->size == 31);
+	CHECK(strcmp(_get_char_buf(num_next), "2.50000000000000000000000000abc") == 0);
+
+	free_value(&grown);
+	free_value(&num_next);
+	free_value(&num_long);
+	free_value(&num);
+	free_value(&br_y);
+	free_value(&br_x);
+	free_value(&s);
+	free_value(&v_piece);
+    }
 }
 
 TEST_CASE( "Test NamedStack and Stack structs [contexts]" ) {
@@ -1078,6 +1883,8 @@ TEST_CASE( "Test NamedStack and Stack structs [contexts]" ) {
 	value res_eq = op_eq(test_string, hash.val, &err);
 	CHECK(strcmp(hash.key, "test_string") == 0);
 	CHECK(res_eq.val.i != 0);
+	//popping makes a shallow copy, so the string is still owned by test_string
+	free_value(&test_string);
 	hash = pop_n(&st, &err);
 	CHECK(err.type == E_SUCCESS);
 	res_eq = op_eq(test_float, hash.val, &err);
@@ -1092,10 +1899,8 @@ TEST_CASE( "Test NamedStack and Stack structs [contexts]" ) {
 	CHECK(is_empty_n(&st) == 1);
 
 	//make sure the stack still works after expansion
-	HashedItem* old_bottom = st.bottom;
-	HashedItem* old_block = st.bottom;
 	for (size_t i = 0; i < 2*DEF_STACK_SIZE; ++i) {
-	    snprintf(test_str[i], TEST_STR_SIZE, "foo%d", i);
+	    snprintf(test_str[i], TEST_STR_SIZE, "foo%zu", i);
 	    test_int.val.i = (int)i;
 	    push_n(&st, test_str[i], test_int, &err);
 	    CHECK(err.type == E_SUCCESS);
@@ -1148,6 +1953,8 @@ TEST_CASE( "Test NamedStack and Stack structs [contexts]" ) {
 	CHECK(err.type == E_SUCCESS);
 	value res_eq = op_eq(test_string, tmp, &err);
 	CHECK(res_eq.val.i != 0);
+	//popping makes a shallow copy, so the string is still owned by test_string
+	free_value(&test_string);
 	tmp = pop(&st, &err);
 	CHECK(err.type == E_SUCCESS);
 	res_eq = op_eq(test_float, tmp, &err);
@@ -1160,8 +1967,6 @@ TEST_CASE( "Test NamedStack and Stack structs [contexts]" ) {
 	CHECK(is_empty(&st) == 1);
 
 	//make sure the stack still works after expansion
-	value* old_bottom = st.bottom;
-	value* old_block = st.block;
 	for (size_t i = 0; i < 2*DEF_STACK_SIZE; ++i) {
 	    test_int.val.i = (int)i;
 	    push(&st, test_int, &err);
@@ -1180,6 +1985,78 @@ TEST_CASE( "Test NamedStack and Stack structs [contexts]" ) {
 
 	free_Stack(&st);
     }
+
+    SUBCASE ( "Test stack growth" ) {
+	sc_error err;
+	//request a tiny stack so that it has to grow several times before reaching its limit
+	Stack st = make_Stack_n(1, 1 << 14, &err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(st.cap >= 1);
+	CHECK(st.max >= 1 << 14);
+	CHECK(st.bottom == st.block + st.cap);
+	size_t first_cap = st.cap;
+	value test_int = v_make_int(0, &err);
+	push(&st, test_int, &err);
+	value* first = st.top;
+	size_t n_wrong = 0;
+	for (size_t i = 1; i < st.max; ++i) {
+	    test_int.val.i = i;
+	    push(&st, test_int, &err);
+	    if (err.type != E_SUCCESS || st.top->val.i != (sc_int)i) { ++n_wrong; }
+	}
+	CHECK(n_wrong == 0);
+	CHECK(st.cap > first_cap);
+	CHECK(st.cap == st.max);
+	CHECK(get_size(st) == st.max);
+#ifdef SC_STACK_MMAP
+	//existing entries are never moved
+	CHECK(first == st.bottom - 1);
+#endif
+	CHECK(st.bottom[-1].val.i == 0);
+	//the stack may not grow past its maximum
+	push(&st, test_int, &err);
+	CHECK(err.type == E_STACK_OVERFLOW);
+	CHECK(get_size(st) == st.max);
+	st.top = st.bottom;
+	pop(&st, &err);
+	CHECK(err.type == E_STACK_UNDERFLOW);
+	free_Stack(&st);
+
+	NamedStack n_st = make_NamedStack_n(1, 1000, &err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(n_st.max >= 1000);
+	n_wrong = 0;
+	for (size_t i = 0; i < n_st.max; ++i) {
+	    test_int.val.i = i;
+	    push_n(&n_st, "x", test_int, &err);
+	    if (err.type != E_SUCCESS || n_st.top->val.val.i != (sc_int)i) { ++n_wrong; }
+	}
+	CHECK(n_wrong == 0);
+	push_n(&n_st, "x", test_int, &err);
+	CHECK(err.type == E_STACK_OVERFLOW);
+	CHECK(get_size_n(n_st) == n_st.max);
+	CHECK(read_key(&n_st, n_st.max) == NULL);
+	n_st.top = n_st.bottom;
+	pop_n(&n_st, &err);
+	CHECK(err.type == E_STACK_UNDERFLOW);
+	free_NamedStack(&n_st);
+
+	//stacks other than the execution stack only reserve room for ST_DEF_MAX entries unless asked for more
+	st = make_Stack(&err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(st.max >= ST_DEF_MAX);
+	CHECK(st.max < ST_MAX_SIZE);
+	free_Stack(&st);
+	st = make_Stack_n(2*ST_DEF_MAX, 0, &err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(st.max >= 2*ST_DEF_MAX);
+	free_Stack(&st);
+	n_st = make_NamedStack(&err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(n_st.max >= ST_DEF_MAX);
+	CHECK(n_st.max < ST_MAX_SIZE);
+	free_NamedStack(&n_st);
+    }
 }
 
 TEST_CASE( "Parsing utilities" ) {
@@ -1192,6 +2069,99 @@ TEST_CASE( "Parsing utilities" ) {
 	CHECK(_search_block(tst_str, "then", 3) == INONE);
 	CHECK(_search_block(tst_str, "then", 0) == 16);
     }
+    SUBCASE ( "vectorized scanning" ) {
+	sc_error err;
+	sc_reset_error(&err);
+	const char* body = "if (alpha[1, 2] > \"quoted, text\") { beta = gamma(delta, {eps}); }   then rest_of_the_line_without_any_brackets , omega";
+	const char* squashed = "if(alpha[1,2]>\"quoted, text\"){beta=gamma(delta,{eps});}thenrest_of_the_line_without_any_brackets";
+	size_t len = strlen(body);
+	size_t then_ind = strstr(body, "then") - body;
+	size_t comma_ind = strrchr(body, ',') - body;
+	scan_set set = make_scan_set("{,\"");
+	//the text is shifted so that it starts at every alignment and ends next to a page boundary, which exercises the blocks that can't be read whole
+	char* page = (char*)aligned_alloc(4096, 2*4096);
+	char* copy = (char*)malloc(len + 1);
+	char word[TEST_STR_SIZE];
+	size_t n_words[SIMD_AVX2 + 1];
+	size_t n_wrong = 0;
+	for (int level = SIMD_NONE; level <= simd_supported(); ++level) {
+	    if (set_simd_level(level) != level) { ++n_wrong; }
+	    for (size_t shift = 0; shift < 40; ++shift) {
+		char* text = page + 4096 - len - 1 - shift;
+		strcpy(text, body);
+		for (size_t i = 0; i <= len; ++i) {
+		    if (_scan_set(text, i, &set) != i + strcspn(text + i, "{,\"")) { ++n_wrong; }
+		}
+		if (_search_block(text, "then", 0) != then_ind || _search_block(text, ",", 0) != comma_ind || _search_block(text, "gamma", 0) != INONE) { ++n_wrong; }
+		strcpy(copy, text);
+		if (strcmp(_get_enclosed(copy, "{", "}"), " beta = gamma(delta, {eps}); ") != 0) { ++n_wrong; }
+		strcpy(copy, text);
+		size_t n_list = 0;
+		char** list = csv_to_list(copy, ',', &n_list, &err);
+		if (err.type != E_SUCCESS || n_list != 2 || strcmp(list[0], squashed) != 0 || strcmp(list[1], "omega") != 0) { ++n_wrong; }
+		free(list);
+		size_t n = 0;
+		for (size_t off = read_dtg_word(text, 0, word, TEST_STR_SIZE); off != 0; off = read_dtg_word(text, off, word, TEST_STR_SIZE)) { ++n; }
+		if (shift == 0) { n_words[level] = n; }
+		if (n != n_words[level] || n != n_words[SIMD_NONE]) { ++n_wrong; }
+	    }
+	}
+	set_simd_level(simd_supported());
+	free(copy);
+	free(page);
+	CHECK(n_wrong == 0);
+    }
+    SUBCASE ( "arenas" ) {
+	sc_error err;
+	arena a = {0};
+	//allocations are aligned and don't overlap
+	char* ptrs[3*ARENA_BLOCK_SIZE/ARENA_ALIGN - 1];
+	size_t n_ptrs = sizeof(ptrs)/sizeof(char*);
+	size_t n_misaligned = 0;
+	for (size_t i = 0; i < n_ptrs; ++i) {
+	    ptrs[i] = (char*)arena_alloc(&a, 1 + i%ARENA_ALIGN, &err);
+	    if (err.type != E_SUCCESS) { break; }
+	    if ((size_t)(ptrs[i]) % ARENA_ALIGN != 0) { ++n_misaligned; }
+	    memset(ptrs[i], (int)(i % 128), 1 + i%ARENA_ALIGN);
+	}
+	CHECK(err.type == E_SUCCESS);
+	CHECK(n_misaligned == 0);
+	//large allocations get their own block without wasting the current one
+	char* big = (char*)arena_alloc(&a, 2*ARENA_BLOCK_SIZE, &err);
+	CHECK(err.type == E_SUCCESS);
+	memset(big, 0, 2*ARENA_BLOCK_SIZE);
+	char* after_big = (char*)arena_alloc(&a, 1, &err);
+	CHECK(after_big == ptrs[n_ptrs-1] + ARENA_ALIGN);
+	size_t n_overwritten = 0;
+	for (size_t i = 0; i < n_ptrs; ++i) {
+	    if (ptrs[i][i%ARENA_ALIGN] != (char)(i % 128)) { ++n_overwritten; }
+	}
+	CHECK(n_overwritten == 0);
+	CHECK(a.n_allocs == n_ptrs + 2);
+	char* dup = arena_strdup(&a, "if(b[1,2] in c)", &err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(strcmp(dup, "if(b[1,2] in c)") == 0);
+
+	//finalizers run in reverse order once the arena is reset
+	int fins[3] = {0, 0, 0};
+	for (size_t i = 0; i < 3; ++i) { arena_defer(&a, record_finalizer, fins + i, &err); }
+	CHECK(fins[0] == 0);
+	reset_arena(&a);
+	CHECK(fins[0] == 3);
+	CHECK(fins[1] == 2);
+	CHECK(fins[2] == 1);
+	CHECK(a.n_allocs == 0);
+	CHECK(a.head != NULL);
+	CHECK(a.head->next == NULL);
+	//memory is reused after a reset
+	char* reused = (char*)arena_alloc(&a, 1, &err);
+	CHECK((char*)(a.head) < reused);
+	CHECK(reused < (char*)(a.head) + sizeof(arena_block) + ARENA_BLOCK_SIZE + ARENA_ALIGN);
+	arena_defer(&a, record_finalizer, fins, &err);
+	free_arena(&a);
+	CHECK(fins[0] == 4);
+	CHECK(a.head == NULL);
+    }
 }
 
 TEST_CASE( "Test that context fetching works [contexts]" ) {
@@ -1212,12 +2182,15 @@ TEST_CASE( "Test that context fetching works [contexts]" ) {
 	insert(&(con.global), test_str, global_test, &err);
 	CHECK(err.type == E_SUCCESS);
 	//try fetching from global context
-	int f_ind = _parse_rval(&con, test_str, 0, &buf, &err);
+	_parse_rval(&con, test_str, 0, &buf, &err);
 	CHECK(err.type == E_SUCCESS);
 	CHECK(buf.n_insts == 2);
 	//make sure the instruction is equivalent to INS_PUSH & INS_HH_G
 	CHECK(buf.buf[0].i == 0x85u);
-	CHECK(strcmp((char*)(buf.buf[1].ptr), glob_test_str.c_str()) == 0);
+	//globals are referenced by their slot in the global table
+	CHECK(buf.buf[1].i < con.global.n_slots);
+	CHECK(strcmp(con.global.slots[buf.buf[1].i]->key, glob_test_str.c_str()) == 0);
+	CHECK(con.global.slots[buf.buf[1].i]->val.val.i == 14);
 	
 	//add a local variable
 	doctest::String loc_test_str = "local_test";
@@ -1226,13 +2199,15 @@ TEST_CASE( "Test that context fetching works [contexts]" ) {
 	CHECK(err.type == E_SUCCESS);
 	push_n(&(con.callstack), test_str, local_test, &err);
 	CHECK(err.type == E_SUCCESS);
+	bind_top(&con, &err);
+	CHECK(err.type == E_SUCCESS);
 	//try fetching from local context
-	f_ind = _parse_rval(&con, test_str, 0, &buf, &err);
+	_parse_rval(&con, test_str, 0, &buf, &err);
 	CHECK(err.type == E_SUCCESS);
 	CHECK(buf.n_insts == 4);
-	//make sure the instruction is equivalent to INS_PUSH & INS_HH_S
+	//make sure the instruction is equivalent to INS_PUSH & INS_HH_S. Stack values are addressed by their slot in the frame, and the copy of the global pushed above occupies slot 0
 	CHECK(buf.buf[2].i == 0x45u);
-	CHECK(buf.buf[3].i == 0);
+	CHECK(buf.buf[3].i == 1);
 
 	//cleanup
 	free_instruction_buffer(&buf);
@@ -1241,6 +2216,71 @@ TEST_CASE( "Test that context fetching works [contexts]" ) {
 	free_value(&local_test);
     }
 
+    SUBCASE( "Test scoped names" ) {
+	sc_error err;
+	context con = make_context(&err);
+	CHECK(err.type == E_SUCCESS);
+	char name_x[] = "x";
+	char name_y[] = "y";
+	HashedItem* item = NULL;
+
+	//names which were never bound can't be found
+	CHECK(search_val(&con, name_x, &item) == -2);
+	CHECK(item == NULL);
+	push_n(&(con.callstack), name_x, v_make_int(1, &err), &err);
+	bind_top(&con, &err);
+	push_n(&(con.callstack), name_y, v_make_int(2, &err), &err);
+	bind_top(&con, &err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(search_val(&con, name_x, &item) == 1);
+	CHECK(item->val.val.i == 1);
+	CHECK(search_val(&con, name_y, &item) == 0);
+	//an inner declaration of x shadows the outer one
+	push_n(&(con.callstack), name_x, v_make_int(3, &err), &err);
+	bind_top(&con, &err);
+	CHECK(search_val(&con, name_x, &item) == 0);
+	CHECK(item->val.val.i == 3);
+	CHECK(search_val(&con, name_y, &item) == 1);
+	//leaving the scope restores the outer binding
+	unbind_top(&con);
+	pop_n(&(con.callstack), &err);
+	CHECK(search_val(&con, name_x, &item) == 1);
+	CHECK(item->val.val.i == 1);
+	unbind_top(&con);
+	pop_n(&(con.callstack), &err);
+	CHECK(search_val(&con, name_y, &item) == -2);
+	CHECK(search_val(&con, name_x, &item) == 0);
+	unbind_top(&con);
+	pop_n(&(con.callstack), &err);
+	CHECK(search_val(&con, name_x, &item) == -2);
+	//popping without unbinding leaves a stale binding which must not resolve to whatever replaces the value
+	push_n(&(con.callstack), name_x, v_make_int(4, &err), &err);
+	bind_top(&con, &err);
+	pop_n(&(con.callstack), &err);
+	push_n(&(con.callstack), name_y, v_make_int(5, &err), &err);
+	CHECK(search_val(&con, name_x, &item) == -2);
+	CHECK(item == NULL);
+	pop_n(&(con.callstack), &err);
+
+	//declarations inside a block only shadow outer names until the block ends
+	char func_def[4*TEST_STR_SIZE];
+	doctest::String shadow_def_str = "(int x) => (int) {\nint y = 1\nif x > 0 {\nint y = 5\nx = x + y\n}\nreturn x + y\n}";
+	strncpy(func_def, shadow_def_str.c_str(), 4*TEST_STR_SIZE);
+	function shadow_f = make_function(&con, func_def, &err);
+	INFO("make_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(search_val(&con, name_y, &item) == -2);
+	push_n(&(con.callstack), NULL, v_make_int(2, &err), &err);
+	execute_function(&con, &shadow_f, &err);
+	CHECK(err.type == E_SUCCESS);
+	HashedItem res = pop_n(&(con.callstack), &err);
+	CHECK(res.val.val.i == 8);
+
+	//cleanup
+	free_function(&shadow_f);
+	free_context(&con);
+    }
+
     SUBCASE( "Test adding functions" ) {
 	//setup
 	sc_error err;
@@ -1258,9 +2298,7 @@ TEST_CASE( "Test that context fetching works [contexts]" ) {
 	//add a function to the global scope
 	doctest::String func_test_str = "function_test";
 	strncpy(test_str, func_test_str.c_str(), TEST_STR_SIZE);
-	value func_test = {0};
 	function func_test_val = make_function(&con, func_def, &err);
-	func_test.type = VT_FUNC;
 	CHECK(err.type == E_SUCCESS);
 
 	//cleanup
@@ -1270,6 +2308,751 @@ TEST_CASE( "Test that context fetching works [contexts]" ) {
     }
 }
 
+TEST_CASE( "Test that compiled functions execute [execution]" ) {
+    SUBCASE( "Test arithmetic and loops" ) {
+	//setup
+	sc_error err;
+	context con = make_context(&err);
+	CHECK(err.type == E_SUCCESS);
+
+	//sum the integers from a to b (inclusive)
+	char func_def[4*TEST_STR_SIZE];
+	doctest::String func_def_str = "(int a, int b) => (int) {\nint s = 0\nwhile a <= b {\ns = s + a;a = a + 1\n}\nreturn s\n}";
+	strncpy(func_def, func_def_str.c_str(), 4*TEST_STR_SIZE);
+	function sum_f = make_function(&con, func_def, &err);
+	INFO("make_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(sum_f.n_args == 2);
+	CHECK(sum_f.n_rets == 1);
+	CHECK(get_size_n(con.callstack) == 0);
+
+	//execute with the arguments on the stack
+	push_n(&(con.callstack), NULL, v_make_int(1, &err), &err);
+	push_n(&(con.callstack), NULL, v_make_int(100, &err), &err);
+	execute_function(&con, &sum_f, &err);
+	INFO("execute_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(get_size_n(con.callstack) == 1);
+	HashedItem res = pop_n(&(con.callstack), &err);
+	CHECK(res.val.type == VT_INT);
+	CHECK(res.val.val.i == 5050);
+
+#ifdef SC_COMPUTED_GOTO
+	//the first execution threads the instruction stream, but opcodes must still be readable
+	CHECK(sum_f.buf.opcodes != NULL);
+	CHECK(_ins_opcode(&(sum_f.buf), 0) == sum_f.buf.opcodes[0]);
+	CHECK(_ins_opcode(&(sum_f.buf), sum_f.buf.n_insts-1) == INS_RETURN);
+#endif
+	//subsequent executions should reuse the same instructions
+	push_n(&(con.callstack), NULL, v_make_int(10, &err), &err);
+	push_n(&(con.callstack), NULL, v_make_int(20, &err), &err);
+	execute_function(&con, &sum_f, &err);
+	CHECK(err.type == E_SUCCESS);
+	res = pop_n(&(con.callstack), &err);
+	CHECK(res.val.val.i == 165);
+	//sums which overflow 32 bits stay exact
+	push_n(&(con.callstack), NULL, v_make_int(3000000000ll, &err), &err);
+	push_n(&(con.callstack), NULL, v_make_int(3000000001ll, &err), &err);
+	execute_function(&con, &sum_f, &err);
+	CHECK(err.type == E_SUCCESS);
+	res = pop_n(&(con.callstack), &err);
+	CHECK(res.val.val.i == 6000000001ll);
+
+	//cleanup
+	free_function(&sum_f);
+	free_context(&con);
+    }
+
+    SUBCASE( "Test branches and function calls" ) {
+	//setup
+	sc_error err;
+	context con = make_context(&err);
+	CHECK(err.type == E_SUCCESS);
+	char func_def[4*TEST_STR_SIZE];
+	char test_str[TEST_STR_SIZE];
+
+	//clamp x to the range [lo, hi]
+	doctest::String clamp_def_str = "(int x, int lo, int hi) => (int) {\nif x < lo {\nreturn lo\n} else if x > hi {\nreturn hi\n} else {\nreturn x\n}\n}";
+	strncpy(func_def, clamp_def_str.c_str(), 4*TEST_STR_SIZE);
+	function clamp_f = make_function(&con, func_def, &err);
+	INFO("make_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	value clamp_v = {0};
+	clamp_v.type = VT_FUNC;
+	clamp_v.val.ptr = &clamp_f;
+	strncpy(test_str, "clamp", TEST_STR_SIZE);
+	insert(&(con.global), test_str, clamp_v, &err);
+	CHECK(err.type == E_SUCCESS);
+
+	//call the function from another function
+	doctest::String caller_def_str = "(int x) => (int, int) {\nint y = clamp(x*2, 0, 10)\nreturn y, clamp(x, 0, 3) + 1\n}";
+	strncpy(func_def, caller_def_str.c_str(), 4*TEST_STR_SIZE);
+	function caller_f = make_function(&con, func_def, &err);
+	INFO("make_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(caller_f.n_rets == 2);
+
+	int inputs[] = {-4, 2, 9};
+	int expect_y[] = {0, 4, 10};
+	int expect_z[] = {1, 3, 4};
+	for (size_t i = 0; i < 3; ++i) {
+	    push_n(&(con.callstack), NULL, v_make_int(inputs[i], &err), &err);
+	    execute_function(&con, &caller_f, &err);
+	    INFO("execute_function: ", err.msg);
+	    CHECK(err.type == E_SUCCESS);
+	    CHECK(get_size_n(con.callstack) == 2);
+	    HashedItem z = pop_n(&(con.callstack), &err);
+	    HashedItem y = pop_n(&(con.callstack), &err);
+	    CHECK(y.val.val.i == expect_y[i]);
+	    CHECK(z.val.val.i == expect_z[i]);
+	}
+
+	//calling with the wrong number of arguments is a compile error
+	doctest::String bad_def_str = "(int x) => (int) {\nreturn clamp(x, 0)\n}";
+	strncpy(func_def, bad_def_str.c_str(), 4*TEST_STR_SIZE);
+	function bad_f = make_function(&con, func_def, &err);
+	CHECK(err.type == E_SYNTAX);
+	CHECK(get_size_n(con.callstack) == 0);
+
+	//a false condition jumps past the last instruction, which must return rather than run off the end of the buffer
+	doctest::String tail_def_str = "(int x) => (int) {\nif x > 0 {\nreturn x\n}\n}";
+	strncpy(func_def, tail_def_str.c_str(), 4*TEST_STR_SIZE);
+	sc_reset_error(&err);
+	function tail_f = make_function(&con, func_def, &err);
+	INFO("make_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	sc_int tail_inputs[] = {5, -5, 0, 7};
+	size_t n_wrong = 0;
+	for (size_t i = 0; i < 4; ++i) {
+	    push_n(&(con.callstack), NULL, v_make_int(tail_inputs[i], &err), &err);
+	    execute_function(&con, &tail_f, &err);
+	    //without a return statement the argument is left in place of the returned value
+	    HashedItem res = pop_n(&(con.callstack), &err);
+	    if (err.type != E_SUCCESS || res.val.val.i != tail_inputs[i] || get_size_n(con.callstack) != 0) { ++n_wrong; }
+	}
+	CHECK(n_wrong == 0);
+
+	//cleanup
+	free_function(&tail_f);
+	free_function(&bad_f);
+	free_function(&caller_f);
+	free_function(&clamp_f);
+	free_context(&con);
+    }
+
+    SUBCASE( "Test recursion" ) {
+	sc_error err;
+	context con = make_context(&err);
+	CHECK(err.type == E_SUCCESS);
+	char func_def[4*TEST_STR_SIZE];
+	char test_str[TEST_STR_SIZE];
+
+	//the signature of a global function must be known before its body is compiled, so declare it first
+	Valtype_e depth_types[1] = {VT_INT};
+	function depth_f = {0};
+	depth_f.n_args = 1;
+	depth_f.n_rets = 1;
+	depth_f.argument_types = depth_types;
+	depth_f.return_types = depth_types;
+	value depth_v = {0};
+	depth_v.type = VT_FUNC;
+	depth_v.val.ptr = &depth_f;
+	strncpy(test_str, "depth", TEST_STR_SIZE);
+	insert(&(con.global), test_str, depth_v, &err);
+	CHECK(err.type == E_SUCCESS);
+	doctest::String depth_def_str = "(int n) => (int) {\nif n <= 0 {\nreturn 0\n}\nreturn depth(n - 1) + 1\n}";
+	strncpy(func_def, depth_def_str.c_str(), 4*TEST_STR_SIZE);
+	depth_f = make_function(&con, func_def, &err);
+	INFO("make_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+
+	//each call needs its own stack frame, so deep recursion forces the execution stack to grow
+	size_t depths[] = {0, 1, 10, 1000, MAX_CALL_DEPTH};
+	size_t n_wrong = 0;
+	for (size_t i = 0; i < sizeof(depths)/sizeof(size_t); ++i) {
+	    push_n(&(con.callstack), NULL, v_make_int(depths[i], &err), &err);
+	    execute_function(&con, &depth_f, &err);
+	    HashedItem res = pop_n(&(con.callstack), &err);
+	    if (err.type != E_SUCCESS || res.val.val.i != (sc_int)depths[i] || get_size(con.exec_stack) != 0) { ++n_wrong; }
+	}
+	CHECK(n_wrong == 0);
+	CHECK(con.exec_stack.cap >= MAX_CALL_DEPTH);
+	//recursing too deeply is an error rather than a crash
+	push_n(&(con.callstack), NULL, v_make_int(MAX_CALL_DEPTH + 1, &err), &err);
+	execute_function(&con, &depth_f, &err);
+	CHECK(err.type == E_STACK_OVERFLOW);
+	CHECK(get_size_n(con.callstack) == 0);
+	CHECK(get_size(con.exec_stack) == 0);
+
+	//mutually recursive functions return to the correct caller with their locals intact
+	function even_f = {0};
+	function odd_f = {0};
+	even_f.n_args = odd_f.n_args = 1;
+	even_f.n_rets = odd_f.n_rets = 1;
+	even_f.argument_types = even_f.return_types = depth_types;
+	odd_f.argument_types = odd_f.return_types = depth_types;
+	value even_v = {0};
+	even_v.type = VT_FUNC;
+	even_v.val.ptr = &even_f;
+	value odd_v = even_v;
+	odd_v.val.ptr = &odd_f;
+	strncpy(test_str, "even", TEST_STR_SIZE);
+	insert(&(con.global), test_str, even_v, &err);
+	strncpy(test_str, "odd", TEST_STR_SIZE);
+	insert(&(con.global), test_str, odd_v, &err);
+	CHECK(err.type == E_SUCCESS);
+	doctest::String even_def_str = "(int n) => (int) {\nif n == 0 {\nreturn 1\n}\nint m = n - 1\nint r = odd(m)\nreturn r + m - m\n}";
+	strncpy(func_def, even_def_str.c_str(), 4*TEST_STR_SIZE);
+	even_f = make_function(&con, func_def, &err);
+	INFO("make_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	doctest::String odd_def_str = "(int n) => (int) {\nif n == 0 {\nreturn 0\n}\nint m = n - 1\nreturn even(m)\n}";
+	strncpy(func_def, odd_def_str.c_str(), 4*TEST_STR_SIZE);
+	odd_f = make_function(&con, func_def, &err);
+	INFO("make_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	n_wrong = 0;
+	for (sc_int k = 0; k < 64; ++k) {
+	    push_n(&(con.callstack), NULL, v_make_int(k, &err), &err);
+	    execute_function(&con, &even_f, &err);
+	    HashedItem res = pop_n(&(con.callstack), &err);
+	    if (err.type != E_SUCCESS || res.val.val.i != (k % 2 == 0)) { ++n_wrong; }
+	}
+	CHECK(n_wrong == 0);
+
+	//cleanup
+	free_function(&odd_f);
+	free_function(&even_f);
+	free_function(&depth_f);
+	free_context(&con);
+    }
+
+    SUBCASE( "Test tail calls" ) {
+	sc_error err;
+	context con = make_context(&err);
+	CHECK(err.type == E_SUCCESS);
+	char func_def[4*TEST_STR_SIZE];
+	char test_str[TEST_STR_SIZE];
+
+	//an accumulating sum whose recursive call is in tail position
+	Valtype_e int_types[2] = {VT_INT, VT_INT};
+	function sum_f = {0};
+	sum_f.n_args = 2;
+	sum_f.n_rets = 1;
+	sum_f.argument_types = int_types;
+	sum_f.return_types = int_types;
+	value sum_v = {0};
+	sum_v.type = VT_FUNC;
+	sum_v.val.ptr = &sum_f;
+	strncpy(test_str, "sum", TEST_STR_SIZE);
+	insert(&(con.global), test_str, sum_v, &err);
+	CHECK(err.type == E_SUCCESS);
+	doctest::String sum_def_str = "(int n, int acc) => (int) {\nif n <= 0 {\nreturn acc\n}\nint m = n - 1\nint a = acc + n\nreturn sum(m, a)\n}";
+	strncpy(func_def, sum_def_str.c_str(), 4*TEST_STR_SIZE);
+	sum_f = make_function(&con, func_def, &err);
+	INFO("make_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	size_t n_tail = 0;
+	for (size_t i = 0; i < sum_f.buf.n_insts; i += _ins_size(sum_f.buf.buf[i].i)) {
+	    if (_ins_base(sum_f.buf.buf[i].i) == INS_TAIL_CALL) { ++n_tail; }
+	}
+	CHECK(n_tail == 1);
+
+	//tail calls reuse the frame, so recursing past MAX_CALL_DEPTH runs in constant stack space
+	sc_int depths[] = {0, 1, 10, 2*MAX_CALL_DEPTH};
+	size_t n_wrong = 0;
+	for (size_t i = 0; i < sizeof(depths)/sizeof(sc_int); ++i) {
+	    push_n(&(con.callstack), NULL, v_make_int(depths[i], &err), &err);
+	    push_n(&(con.callstack), NULL, v_make_int(0, &err), &err);
+	    execute_function(&con, &sum_f, &err);
+	    HashedItem res = pop_n(&(con.callstack), &err);
+	    if (err.type != E_SUCCESS || res.val.val.i != depths[i]*(depths[i] + 1)/2 || get_size(con.exec_stack) != 0) { ++n_wrong; }
+	}
+	CHECK(n_wrong == 0);
+	CHECK(get_size_n(con.callstack) == 0);
+	CHECK(con.exec_stack.cap < 1024);
+
+	//calls whose result is used afterwards are not in tail position
+	function twice_f = {0};
+	twice_f.n_args = 1;
+	twice_f.n_rets = 1;
+	twice_f.argument_types = twice_f.return_types = int_types;
+	value twice_v = sum_v;
+	twice_v.val.ptr = &twice_f;
+	strncpy(test_str, "twice", TEST_STR_SIZE);
+	insert(&(con.global), test_str, twice_v, &err);
+	doctest::String twice_def_str = "(int n) => (int) {\nif n <= 0 {\nreturn 0\n}\nreturn twice(n - 1) + 2\n}";
+	strncpy(func_def, twice_def_str.c_str(), 4*TEST_STR_SIZE);
+	twice_f = make_function(&con, func_def, &err);
+	CHECK(err.type == E_SUCCESS);
+	n_tail = 0;
+	for (size_t i = 0; i < twice_f.buf.n_insts; i += _ins_size(twice_f.buf.buf[i].i)) {
+	    if (_ins_base(twice_f.buf.buf[i].i) == INS_TAIL_CALL) { ++n_tail; }
+	}
+	CHECK(n_tail == 0);
+	push_n(&(con.callstack), NULL, v_make_int(100, &err), &err);
+	execute_function(&con, &twice_f, &err);
+	CHECK(err.type == E_SUCCESS);
+	HashedItem res = pop_n(&(con.callstack), &err);
+	CHECK(res.val.val.i == 200);
+
+	//a tail call out of a non tail call returns to the right frame
+	doctest::String outer_def_str = "(int n) => (int) {\nint r = sum(n, 0)\nreturn r + 1\n}";
+	strncpy(func_def, outer_def_str.c_str(), 4*TEST_STR_SIZE);
+	function outer_f = make_function(&con, func_def, &err);
+	CHECK(err.type == E_SUCCESS);
+	push_n(&(con.callstack), NULL, v_make_int(100, &err), &err);
+	execute_function(&con, &outer_f, &err);
+	CHECK(err.type == E_SUCCESS);
+	res = pop_n(&(con.callstack), &err);
+	CHECK(res.val.val.i == 5051);
+	CHECK(get_size(con.exec_stack) == 0);
+
+	//cleanup
+	free_function(&outer_f);
+	free_function(&twice_f);
+	free_function(&sum_f);
+	free_context(&con);
+    }
+
+    SUBCASE( "Test calls from C" ) {
+	sc_error err;
+	context con = make_context(&err);
+	CHECK(err.type == E_SUCCESS);
+	char func_def[4*TEST_STR_SIZE];
+	char test_str[TEST_STR_SIZE];
+
+	//arguments go straight onto the execution stack and results come back in order
+	doctest::String sub_def_str = "(int a, int b) => (int) {\nreturn a - b\n}";
+	strncpy(func_def, sub_def_str.c_str(), 4*TEST_STR_SIZE);
+	function sub_f = make_function(&con, func_def, &err);
+	INFO("make_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	value args[2] = {v_make_int(10, &err), v_make_int(3, &err)};
+	value rets[1];
+	size_t n_wrong = 0;
+	for (sc_int k = 0; k < 1000; ++k) {
+	    args[1].val.i = k;
+	    if (call_function(&con, &sub_f, args, rets, &err) != 1 || rets[0].type != VT_INT || rets[0].val.i != 10 - k) { ++n_wrong; }
+	}
+	CHECK(n_wrong == 0);
+	CHECK(get_size_n(con.callstack) == 0);
+	CHECK(get_size(con.exec_stack) == 0);
+
+	//lookup by name with arguments read from strings, including nested calls
+	value sub_v = {0};
+	sub_v.type = VT_FUNC;
+	sub_v.val.ptr = &sub_f;
+	strncpy(test_str, "sub", TEST_STR_SIZE);
+	insert(&(con.global), test_str, sub_v, &err);
+	CHECK(err.type == E_SUCCESS);
+	char arg_a[TEST_STR_SIZE];
+	char arg_b[TEST_STR_SIZE];
+	char* str_args[2] = {arg_a, arg_b};
+	value* res = NULL;
+	strncpy(arg_a, "10", TEST_STR_SIZE);
+	strncpy(arg_b, "4", TEST_STR_SIZE);
+	CHECK(call_func_by_name(&con, "sub", 2, str_args, &res, &err) == 1);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(res[0].val.i == 6);
+	sc_free(res);
+	strncpy(arg_a, "sub(20, sub(5,2))", TEST_STR_SIZE);
+	strncpy(arg_b, "7", TEST_STR_SIZE);
+	CHECK(call_func_by_name(&con, "sub", 2, str_args, &res, &err) == 1);
+	INFO("call_func_by_name: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(res[0].val.i == 10);
+	sc_free(res);
+
+	//errors are reported without touching the stacks
+	CHECK(call_func_by_name(&con, "sub", 1, str_args, &res, &err) == -1);
+	CHECK(err.type == E_SYNTAX);
+	CHECK(call_func_by_name(&con, "missing", 2, str_args, &res, &err) == -1);
+	CHECK(err.type == E_BADVAL);
+	strncpy(arg_a, "sub(1)", TEST_STR_SIZE);
+	CHECK(call_func_by_name(&con, "sub", 2, str_args, &res, &err) == -1);
+	CHECK(err.type == E_SYNTAX);
+	CHECK(res == NULL);
+	CHECK(get_size_n(con.callstack) == 0);
+	CHECK(get_size(con.exec_stack) == 0);
+
+	//cleanup
+	free_function(&sub_f);
+	free_context(&con);
+    }
+
+    SUBCASE( "Test global variables" ) {
+	sc_error err;
+	context con = make_context(&err);
+	CHECK(err.type == E_SUCCESS);
+	char func_def[4*TEST_STR_SIZE];
+	char test_str[TEST_STR_SIZE];
+
+	//add n to a global counter
+	strncpy(test_str, "counter", TEST_STR_SIZE);
+	insert(&(con.global), test_str, v_make_int(1, &err), &err);
+	CHECK(err.type == E_SUCCESS);
+	doctest::String add_def_str = "(int n) => (int) {\ncounter = counter + n\nreturn counter\n}";
+	strncpy(func_def, add_def_str.c_str(), 4*TEST_STR_SIZE);
+	function add_f = make_function(&con, func_def, &err);
+	INFO("make_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	//both the read and the write should resolve to the same slot
+	CHECK(con.global.n_slots == 1);
+	push_n(&(con.callstack), NULL, v_make_int(2, &err), &err);
+	execute_function(&con, &add_f, &err);
+	INFO("execute_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	HashedItem res = pop_n(&(con.callstack), &err);
+	CHECK(res.val.val.i == 3);
+
+	//force the global table to be rehashed, the slot must still reference the counter
+	size_t old_size = con.global.table_size;
+	for (size_t i = 0; i < 4*old_size; ++i) {
+	    snprintf(test_str, TEST_STR_SIZE, "filler_%lu", i);
+	    insert(&(con.global), test_str, v_make_int((int)i, &err), &err);
+	    CHECK(err.type == E_SUCCESS);
+	}
+	CHECK(con.global.table_size > old_size);
+	push_n(&(con.callstack), NULL, v_make_int(4, &err), &err);
+	execute_function(&con, &add_f, &err);
+	CHECK(err.type == E_SUCCESS);
+	res = pop_n(&(con.callstack), &err);
+	CHECK(res.val.val.i == 7);
+	strncpy(test_str, "counter", TEST_STR_SIZE);
+	CHECK(lookup(&(con.global), test_str)->val.val.i == 7);
+
+	//cleanup
+	free_function(&add_f);
+	free_context(&con);
+    }
+
+    SUBCASE( "Test array indexing" ) {
+	sc_error err;
+	context con = make_context(&err);
+	CHECK(err.type == E_SUCCESS);
+	char func_def[4*TEST_STR_SIZE];
+
+	//reverse the first n elements of an array in place and return the first element
+	doctest::String rev_def_str = "(array l, int n) => (float) {\nint i = 0\nwhile i < n/2 {\nfloat t = l[i]\nl[i] = l[n-i-1]\nl[n-i-1] = t\ni = i + 1\n}\nreturn l[0]\n}";
+	strncpy(func_def, rev_def_str.c_str(), 4*TEST_STR_SIZE);
+	function rev_f = make_function(&con, func_def, &err);
+	INFO("make_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+
+	char arr_str[TEST_STR_SIZE];
+	strncpy(arr_str, "[1.0, 2.0, 3.0, 4.0, 5.0]", TEST_STR_SIZE);
+	value arr = read_value_string(arr_str, VT_UNDEF, &err);
+	CHECK(err.type == E_SUCCESS);
+	push_n(&(con.callstack), NULL, arr, &err);
+	push_n(&(con.callstack), NULL, v_make_int(5, &err), &err);
+	execute_function(&con, &rev_f, &err);
+	INFO("execute_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	HashedItem res = pop_n(&(con.callstack), &err);
+	CHECK(res.val.type == VT_FLOAT);
+	CHECK(APPROX(res.val.val.f, 5.0));
+	Array* arr_ptr = (Array*)(arr.val.ptr);
+	CHECK(arr_ptr->element_type == VT_FLOAT);
+	for (size_t i = 0; i < 5; ++i) {
+	    CHECK(APPROX(_get_a(arr_ptr, i).val.f, 5.0 - i));
+	}
+
+	//cleanup
+	free_value(&arr);
+	free_function(&rev_f);
+	free_context(&con);
+    }
+
+    SUBCASE( "Test constant pool" ) {
+	sc_error err;
+	context con = make_context(&err);
+	char func_def[4*TEST_STR_SIZE];
+	doctest::String func_def_str = "(int x) => (int, string) {\nint a = 5\nint b = 5\nfloat c = 5.0\nstring s = \"hi\"\nstring t = \"hi\"\nreturn a + b + x, s + t\n}";
+	strncpy(func_def, func_def_str.c_str(), 4*TEST_STR_SIZE);
+	function pool_f = make_function(&con, func_def, &err);
+	INFO("make_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	//identical literals share a single entry in the pool
+	CHECK(pool_f.n_consts == 3);
+	CHECK(pool_f.buf.consts == NULL);
+	size_t n_pushes = 0;
+	size_t n_bad = 0;
+	size_t first_push = INONE;
+	for (size_t i = 0; i < pool_f.buf.n_insts; i += _ins_size(_ins_opcode(&(pool_f.buf), i))) {
+	    if (_ins_opcode(&(pool_f.buf), i) != (INS_PUSH | INS_HH_C)) { continue; }
+	    if (pool_f.buf.buf[i+1].i >= pool_f.n_consts) { ++n_bad; }
+	    if (first_push == INONE) { first_push = pool_f.buf.buf[i+1].i; }
+	    ++n_pushes;
+	}
+	CHECK(n_pushes == 5);
+	CHECK(n_bad == 0);
+	CHECK(pool_f.consts[first_push].type == VT_INT);
+	CHECK(pool_f.consts[first_push].val.i == 5);
+
+	push_n(&(con.callstack), NULL, v_make_int(2, &err), &err);
+	execute_function(&con, &pool_f, &err);
+	INFO("execute_function: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	HashedItem res = pop_n(&(con.callstack), &err);
+	CHECK(res.val.type == VT_STRING);
+	CHECK(strcmp(res.val.val.str->buf, "hihi") == 0);
+	free_value(&(res.val));
+	res = pop_n(&(con.callstack), &err);
+	CHECK(res.val.val.i == 12);
+	//the pool is unchanged by execution
+	CHECK(strcmp(pool_f.consts[2].val.str->buf, "hi") == 0);
+
+	free_function(&pool_f);
+	free_context(&con);
+    }
+}
+
+TEST_CASE( "Test that compiled functions may be cached [cache]" ) {
+    //images are written to a fresh directory for every subcase
+    char cache_dir[TEST_STR_SIZE];
+    strncpy(cache_dir, "/tmp/scripty_cache_XXXXXX", TEST_STR_SIZE);
+    CHECK(mkdtemp(cache_dir) != NULL);
+    char fib_name[2*TEST_STR_SIZE];
+    char main_name[2*TEST_STR_SIZE];
+    doctest::String fib_def_str = "(int n) => (int) {\nif n < 2 {\nreturn n\n}\nreturn fib(n - 1) + fib(n - 2)\n}";
+    doctest::String main_def_str = "(int x) => (int, string) {\nint y = fib(x)\nstring s = \"hi\"\nscale = scale + 1\nreturn (2*3)*y + scale, s + \"!\"\n}";
+    snprintf(fib_name, 2*TEST_STR_SIZE, "%s/%016llx%s", cache_dir, (unsigned long long)bc_hash(fib_def_str.c_str()), BC_EXT);
+    snprintf(main_name, 2*TEST_STR_SIZE, "%s/%016llx%s", cache_dir, (unsigned long long)bc_hash(main_def_str.c_str()), BC_EXT);
+    char func_def[4*TEST_STR_SIZE];
+    char test_str[TEST_STR_SIZE];
+    Valtype_e int_types[1] = {VT_INT};
+
+    SUBCASE( "Test saving and loading" ) {
+	sc_error err;
+	context con = make_context(&err);
+	strncpy(test_str, "scale", TEST_STR_SIZE);
+	insert(&(con.global), test_str, v_make_int(3, &err), &err);
+	function fib_f = {0};
+	fib_f.n_args = fib_f.n_rets = 1;
+	fib_f.argument_types = fib_f.return_types = int_types;
+	value fib_v = {0};
+	fib_v.type = VT_FUNC;
+	fib_v.val.ptr = &fib_f;
+	strncpy(test_str, "fib", TEST_STR_SIZE);
+	insert(&(con.global), test_str, fib_v, &err);
+	CHECK(err.type == E_SUCCESS);
+
+	//the first compilation writes the images
+	strncpy(func_def, fib_def_str.c_str(), 4*TEST_STR_SIZE);
+	fib_f = make_function_cached(&con, func_def, cache_dir, &err);
+	INFO("make_function_cached: ", err.msg);
+	CHECK(err.type == E_SUCCESS);
+	strncpy(func_def, main_def_str.c_str(), 4*TEST_STR_SIZE);
+	function main_f = make_function_cached(&con, func_def, cache_dir, &err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(con.n_folded > 0);
+	FILE* fp = fopen(fib_name, "rb");
+	CHECK(fp != NULL);
+	if (fp) { fclose(fp); }
+	fp = fopen(main_name, "rb");
+	CHECK(fp != NULL);
+	if (fp) { fclose(fp); }
+	push_n(&(con.callstack), NULL, v_make_int(10, &err), &err);
+	execute_function(&con, &main_f, &err);
+	CHECK(err.type == E_SUCCESS);
+	HashedItem res = pop_n(&(con.callstack), &err);
+	CHECK(res.val.type == VT_STRING);
+	CHECK(strcmp(res.val.val.str->buf, "hi!") == 0);
+	free_value(&(res.val));
+	res = pop_n(&(con.callstack), &err);
+	CHECK(res.val.val.i == 6*55 + 4);
+
+	//load into a context where the globals occupy different slots. Nothing is parsed the second time
+	context con2 = make_context(&err);
+	for (size_t i = 0; i < 10; ++i) {
+	    snprintf(test_str, TEST_STR_SIZE, "filler_%lu", i);
+	    insert(&(con2.global), test_str, v_make_int((int)i, &err), &err);
+	    h_intern_slot(&(con2.global), lookup(&(con2.global), test_str), &err);
+	}
+	function fib2_f = fib_f;
+	fib_v.val.ptr = &fib2_f;
+	strncpy(test_str, "fib", TEST_STR_SIZE);
+	insert(&(con2.global), test_str, fib_v, &err);
+	strncpy(test_str, "scale", TEST_STR_SIZE);
+	insert(&(con2.global), test_str, v_make_int(3, &err), &err);
+	strncpy(func_def, fib_def_str.c_str(), 4*TEST_STR_SIZE);
+	fib2_f = make_function_cached(&con2, func_def, cache_dir, &err);
+	CHECK(err.type == E_SUCCESS);
+	strncpy(func_def, main_def_str.c_str(), 4*TEST_STR_SIZE);
+	function main2_f = make_function_cached(&con2, func_def, cache_dir, &err);
+	CHECK(err.type == E_SUCCESS);
+	CHECK(con2.n_folded == 0);
+	CHECK(main2_f.n_args == 1);
+	CHECK(main2_f.n_rets == 2);
+	CHECK(main2_f.return_types[1] == VT_STRING);
+	CHECK(main2_f.n_consts == main_f.n_consts);
+	CHECK(main2_f.buf.n_insts == main_f.buf.n_insts);
+	size_t n_wrong = 0;
+	for (size_t i = 0; i < main_f.buf.n_insts; i += _ins_size(_ins_opcode(&(main_f.buf), i))) {
+	    if (_ins_opcode(&(main_f.buf), i) != _ins_opcode(&(main2_f.buf), i)) { ++n_wrong; }
+	}
+	CHECK(n_wrong == 0);
+	//scale is incremented by every call
+	n_wrong = 0;
+	sc_int fib_x = 0;
+	sc_int fib_next = 1;
+	for (sc_int x = 0; x < 15; ++x) {
+	    push_n(&(con2.callstack), NULL, v_make_int(x, &err), &err);
+	    execute_function(&con2, &main2_f, &err);
+	    HashedItem res_s = pop_n(&(con2.callstack), &err);
+	    HashedItem res_i = pop_n(&(con2.callstack), &err);
+	    if (err.type != E_SUCCESS || res_s.val.type != VT_STRING || strcmp(res_s.val.val.str->buf, "hi!") != 0 || res_i.val.val.i != 6*fib_x + 4 + x) { ++n_wrong; }
+	    free_value(&(res_s.val));
+	    sc_int tmp = fib_x + fib_next;
+	    fib_x = fib_next;
+	    fib_next = tmp;
+	}
+	CHECK(n_wrong == 0);
+
+	//executing a loaded function doesn't alter the file it was loaded from
+	function main3_f = load_function(&con2, main_name, bc_hash(main_def_str.c_str()), &err);
+	CHECK(err.type == E_SUCCESS);
+	push_n(&(con2.callstack), NULL, v_make_int(10, &err), &err);
+	execute_function(&con2, &main3_f, &err);
+	CHECK(err.type == E_SUCCESS);
+	res = pop_n(&(con2.callstack), &err);
+	free_value(&(res.val));
+	res = pop_n(&(con2.callstack), &err);
+	CHECK(res.val.val.i == 6*55 + 4 + 15);
+	free_function(&main3_f);
+
+	//cleanup
+	free_function(&main2_f);
+	free_function(&fib2_f);
+	free_context(&con2);
+	free_function(&main_f);
+	free_function(&fib_f);
+	free_context(&con);
+    }
+
+    SUBCASE( "Test stale and corrupted images" ) {
+	sc_error err;
+	context con = make_context(&err);
+	strncpy(test_str, "scale", TEST_STR_SIZE);
+	insert(&(con.global), test_str, v_make_int(3, &err), &err);
+	function fib_f = {0};
+	fib_f.n_args = fib_f.n_rets = 1;
+	fib_f.argument_types = fib_f.return_types = int_types;
+	value fib_v = {0};
+	fib_v.type = VT_FUNC;
+	fib_v.val.ptr = &fib_f;
+	strncpy(test_str, "fib", TEST_STR_SIZE);
+	insert(&(con.global), test_str, fib_v, &err);
+	sc_uint fib_hash = bc_hash(fib_def_str.c_str());
+
+	//missing images
+	function tmp_f = load_function(&con, fib_name, fib_hash, &err);
+	CHECK(err.type == E_UNDEF);
+	CHECK(tmp_f.buf.buf == NULL);
+	strncpy(func_def, fib_def_str.c_str(), 4*TEST_STR_SIZE);
+	fib_f = make_function_cached(&con, func_def, cache_dir, &err);
+	CHECK(err.type == E_SUCCESS);
+
+	//images are only used for the source they were compiled from
+	tmp_f = load_function(&con, fib_name, fib_hash + 1, &err);
+	CHECK(err.type == E_BADVAL);
+	tmp_f = load_function(&con, fib_name, fib_hash, &err);
+	CHECK(err.type == E_SUCCESS);
+	free_function(&tmp_f);
+
+	//truncated images are rejected and replaced
+	FILE* fp = fopen(fib_name, "wb");
+	CHECK(fp != NULL);
+	if (fp) {
+	    fwrite("scBC", 1, 4, fp);
+	    fclose(fp);
+	}
+	tmp_f = load_function(&con, fib_name, fib_hash, &err);
+	CHECK(err.type == E_BADVAL);
+	strncpy(func_def, fib_def_str.c_str(), 4*TEST_STR_SIZE);
+	tmp_f = make_function_cached(&con, func_def, cache_dir, &err);
+	CHECK(err.type == E_SUCCESS);
+	free_function(&tmp_f);
+	tmp_f = load_function(&con, fib_name, fib_hash, &err);
+	CHECK(err.type == E_SUCCESS);
+	free_function(&tmp_f);
+
+	//images with a valid header but corrupted instructions or expressions are rejected before anything is dereferenced
+	fp = fopen(fib_name, "rb");
+	CHECK(fp != NULL);
+	//images are read into words so that the header and sections are aligned
+	size_t good[BC_DEF_SIZE/sizeof(size_t)];
+	size_t bad_buf[BC_DEF_SIZE/sizeof(size_t)];
+	char* bad = (char*)bad_buf;
+	size_t img_size = (fp)? fread(good, 1, sizeof(good), fp) : 0;
+	if (fp) { fclose(fp); }
+	CHECK(img_size > sizeof(bc_header));
+	CHECK(img_size < sizeof(good));
+	const size_t n_corruptions = 12;
+	size_t n_wrong = 0;
+	for (size_t k = 0; k < n_corruptions; ++k) {
+	    memcpy(bad, good, img_size);
+	    bc_header* hdr = (bc_header*)bad;
+	    union Instruction* ins = (union Instruction*)(bad + hdr->insts);
+	    expression* e = (expression*)(bad + hdr->exprs);
+	    union Instruction* prog = (union Instruction*)(bad + (size_t)(e->buf.buf));
+	    switch (k) {
+	    case 0: ins[0].i = 0xFF;break;
+	    case 1: ins[0].i = INS_PUSH | INS_HH_C;ins[1].i = hdr->n_consts;break;
+	    case 2: ins[0].i = INS_PUSH | INS_HH_R;ins[1].i = N_REGISTERS;break;
+	    case 3: ins[0].i = INS_FN_EVAL | INS_HH_C;break;
+	    case 4: ins[0].i = INS_JUMP;ins[1].i = 1;break;
+	    case 5: ins[0].i = INS_OP_EVAL | INS_HH_C;ins[1].i = hdr->n_exprs;break;
+	    case 6: prog[0].i = EXP_PUSH_C;prog[1].i = e->n_consts;break;
+	    case 7: prog[e->buf.n_insts - 1].i = EXP_NOT + 1;break;
+	    case 8: e->depth = 1;break;
+	    //expressions may only be read from the expression table
+	    case 9: ins[0].i = INS_OP_EVAL | INS_HH_R;ins[1].i = 0;break;
+	    //constants may only hold the types that save_function() writes
+	    case 10: ((value*)(bad + (size_t)(e->consts)))[0].type = VT_FUNC;break;
+	    case 11: ((value*)(bad + (size_t)(e->consts)))[0].type = 0x7F;break;
+	    }
+	    fp = fopen(fib_name, "wb");
+	    if (fp) {
+		fwrite(bad, 1, img_size, fp);
+		fclose(fp);
+	    }
+	    tmp_f = load_function(&con, fib_name, fib_hash, &err);
+	    if (err.type != E_BADVAL || tmp_f.buf.buf != NULL) { ++n_wrong; }
+	    free_function(&tmp_f);
+	}
+	CHECK(n_wrong == 0);
+	fp = fopen(fib_name, "wb");
+	if (fp) {
+	    fwrite(good, 1, img_size, fp);
+	    fclose(fp);
+	}
+	tmp_f = load_function(&con, fib_name, fib_hash, &err);
+	CHECK(err.type == E_SUCCESS);
+	free_function(&tmp_f);
+
+	//every global referenced by the image must exist in the loading context
+	context con2 = make_context(&err);
+	tmp_f = load_function(&con2, fib_name, fib_hash, &err);
+	CHECK(err.type == E_UNDEF);
+	free_function(&tmp_f);
+	strncpy(func_def, fib_def_str.c_str(), 4*TEST_STR_SIZE);
+	tmp_f = make_function_cached(&con2, func_def, cache_dir, &err);
+	CHECK(err.type != E_SUCCESS);
+	free_function(&tmp_f);
+
+	//cleanup
+	free_context(&con2);
+	free_function(&fib_f);
+	free_context(&con);
+    }
+
+    remove(fib_name);
+    remove(main_name);
+    CHECK(remove(cache_dir) == 0);
+}
+
 /*TEST_CASE( "Test that parsing rvals works [function parsing]") {
 
 
@@ -1,5 +1,9 @@
 #include "utils.h"
 
+#ifdef SC_SIMD_X86
+#include <immintrin.h>
+#endif
+
 #ifdef __cplusplus 
 extern "C" {
 #endif
@@ -73,6 +77,145 @@ int _read_digit(char d, _uint base) {
     }
 }
 
+// ==================================== SIMD ====================================
+
+//the level of the vectorized kernels, this is set to simd_supported() the first time it is needed
+static int simd_level = -1;
+
+/**
+ * Returns the most capable SIMD level (one of the SIMD_* constants) supported by this CPU.
+ */
+int simd_supported() {
+#ifdef SC_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) { return SIMD_AVX2; }
+    if (__builtin_cpu_supports("sse4.2")) { return SIMD_SSE42; }
+    if (__builtin_cpu_supports("sse2")) { return SIMD_SSE2; }
+#endif
+    return SIMD_NONE;
+}
+
+/**
+ * Selects the vectorized kernels used for scanning strings and element-wise array operations. level is clamped to simd_supported(). This is mostly useful for testing and benchmarking since the best supported level is chosen by default.
+ * Returns: the level which will be used
+ */
+int set_simd_level(int level) {
+    int max_level = simd_supported();
+    if (level > max_level) { level = max_level; }
+    if (level < SIMD_NONE) { level = SIMD_NONE; }
+    simd_level = level;
+    return simd_level;
+}
+
+/**
+ * Returns the level selected by set_simd_level() or simd_supported() if no level has been selected yet.
+ */
+int get_simd_level() {
+    if (simd_level < 0) { set_simd_level(SIMD_AVX2); }
+    return simd_level;
+}
+
+/**
+ * Creates a scan_set containing the characters in chars, of which only the first SCAN_SET_MAX are used.
+ */
+scan_set make_scan_set(const char* chars) {
+    scan_set ret;
+    memset(&ret, 0, sizeof(scan_set));
+    ret.map[0] = 1;
+    for (size_t k = 0; k < SCAN_SET_MAX && chars[k] != 0; ++k) {
+	ret.chars[k] = chars[k];
+	ret.map[(_uint8)chars[k] >> 6] |= (uint64_t)1 << ((_uint8)chars[k] & 63);
+    }
+    return ret;
+}
+
+#ifdef SC_SIMD_X86
+/**
+ * The vectorized scanners read whole blocks which may extend past the null terminator. They never read a block which crosses a page boundary so this is safe, but the address sanitizer can't know that.
+ */
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define SC_NO_ASAN __attribute__((no_sanitize_address))
+#endif
+#elif defined(__SANITIZE_ADDRESS__)
+#define SC_NO_ASAN __attribute__((no_sanitize_address))
+#endif
+#ifndef SC_NO_ASAN
+#define SC_NO_ASAN
+#endif
+
+#define SCAN_SIDD_MODE	(_SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT)
+
+/**
+ * Helper function for the vectorized scanners which examines the 16 bytes starting at str+i with a single pcmpistri instruction. If the block would cross a page boundary only the character at str+i is examined.
+ * Returns: the number of characters which are known not to be members of set, this is less than 16 only if a member was found
+ */
+__attribute__((target("sse4.2"))) SC_NO_ASAN
+static inline size_t _scan_block_sse42(const char* str, size_t i, __m128i v_set, const scan_set* set) {
+    if (((uintptr_t)(str + i) & 4095) > 4096 - 16) { return (_in_scan_set(set, str[i]))? 0 : 1; }
+    __m128i blk = _mm_loadu_si128((const __m128i*)(str + i));
+    int k = _mm_cmpistri(v_set, blk, SCAN_SIDD_MODE);
+    //characters after a null terminator never match so any hit is inside the string
+    if (k < 16) { return k; }
+    if (_mm_cmpistrz(v_set, blk, SCAN_SIDD_MODE)) {
+	return __builtin_ctz(_mm_movemask_epi8(_mm_cmpeq_epi8(blk, _mm_setzero_si128())));
+    }
+    return 16;
+}
+
+/**
+ * SSE4.2 version of _scan_set() which compares 16 bytes of str against the whole set at a time. This must only be called if simd_supported() returns at least SIMD_SSE42.
+ */
+__attribute__((target("sse4.2"))) SC_NO_ASAN
+static size_t _scan_set_sse42(const char* str, size_t i, const scan_set* set) {
+    __m128i v_set = _mm_loadu_si128((const __m128i*)set->chars);
+    size_t n;
+    while ((n = _scan_block_sse42(str, i, v_set, set)) >= 16 || _in_scan_set(set, str[i + n]) == 0) { i += n; }
+    return i + n;
+}
+
+/**
+ * AVX2 version of _scan_set() which compares 32 bytes of str against each character in the set. Comparing against each character has a fixed setup cost, so the first block is examined with pcmpistri. This must only be called if simd_supported() returns SIMD_AVX2.
+ */
+__attribute__((target("avx2,sse4.2"))) SC_NO_ASAN
+static size_t _scan_set_avx2(const char* str, size_t i, const scan_set* set) {
+    size_t n = _scan_block_sse42(str, i, _mm_loadu_si128((const __m128i*)set->chars), set);
+    if (n < 16 && _in_scan_set(set, str[i + n])) { return i + n; }
+    i += n;
+    __m256i v_set[SCAN_SET_MAX];
+    int n_set = 0;
+    for (; n_set < SCAN_SET_MAX && set->chars[n_set] != 0; ++n_set) {
+	v_set[n_set] = _mm256_set1_epi8(set->chars[n_set]);
+    }
+    //start from the aligned block containing str+i (which can't cross a page boundary) and discard any hits before i
+    const char* blk_ptr = (const char*)((uintptr_t)(str + i) & ~(uintptr_t)31);
+    unsigned skip = (unsigned)(str + i - blk_ptr);
+    for (;; blk_ptr += 32) {
+	__m256i blk = _mm256_load_si256((const __m256i*)blk_ptr);
+	__m256i hit = _mm256_cmpeq_epi8(blk, _mm256_setzero_si256());
+	for (int k = 0; k < n_set; ++k) {
+	    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(blk, v_set[k]));
+	}
+	uint32_t mask = ((uint32_t)_mm256_movemask_epi8(hit) >> skip) << skip;
+	if (mask) { return (size_t)(blk_ptr - str) + __builtin_ctz(mask); }
+	skip = 0;
+    }
+}
+#endif
+
+/**
+ * Returns the index of the first character at or after index i in str which is a member of set using the vectorized kernels selected by set_simd_level().
+ */
+size_t _scan_set_long(const char* str, size_t i, const scan_set* set) {
+#ifdef SC_SIMD_X86
+    int level = get_simd_level();
+    if (level >= SIMD_AVX2) { return _scan_set_avx2(str, i, set); }
+    if (level >= SIMD_SSE42) { return _scan_set_sse42(str, i, set); }
+#endif
+    while (!_in_scan_set(set, str[i])) { ++i; }
+    return i;
+}
+
 // ==================================== PARSING ====================================
 
 /**
@@ -83,87 +226,34 @@ int _read_digit(char d, _uint base) {
  * Returns: the enclosed contents as described above or NULL if an error is encountered. If no matching open character is encountered then the string is returned unaltered.
  */
 char* _get_enclosed(char* str, const char* open, const char* close) {
-    if (strlen(close) != strlen(open)) { return NULL; }
-    size_t i = 0;
-    size_t start = 0;
-    //store the index of the matching character in open. For open and close containing multiple characters we set close_char to match the opening character we want.
-    char close_char = 0;
-    char open_char = 0;
-    while (close_char == 0) {
-	//see if we have a matching character from the open set
-	for (size_t j = 0; open[j] != 0; ++j) {
-	    if (str[i] == open[j]) {
-		open_char = open[j];
-		close_char = close[j];
-		start = i + 1;
-		break;
-	    }
-	}
-	++i;
-	//terminate if we reached the end of the string
-	if (str[i] == 0) { return str; }
-    }
-    //this is a special case where nest counting doesn't work (any hit is essentially a no-op) instead we just examine if the end character is escaped
-    if (open_char == close_char) {
-	int escaped = 0;
-	for (i = start; str[i] != 0; ++i) {
-	    //see if the next character should be escaped by setting escaped = NOT escaped
-	    if (str[i] == '\\') {
-		escaped = 1 - escaped;
-	    }
-	    //see if we have a matching character from the open set and try incrementing
-	    if (str[i] == close_char && !escaped) {
-		str[i] = 0;
-		return str + start;
-	    }
-	}
-    } else {
-	int nest_level = 0;
-	for (i = start; str[i] != 0; ++i) {
-	    //see if we have a matching character from the open set and try incrementing
-	    for (size_t j = 0; open[j] != 0; ++j) {
-		if (str[i] == open[j]) { ++nest_level; }
-	    }
-	    //see if we have a matching character from the open set and try incrementing
-	    if (str[i] == close_char) {
-		--nest_level;
-		//we check that the nest level is less than 0 since 0 is the nest level INSIDE the parenthesis
-		if (nest_level < 0) {
-		    str[i] = 0;
-		    return str + start;
-		}
-	    }
-	}
-    }
-    return str + start;
+    return _get_enclosed_r(str, NULL, open, close);
 }
 
+/**
+ * This function is identical to _get_enclosed but accepts one additional parameter between str and open, saveptr. If saveptr is not NULL then it is set to the first character after the close parenthesis was found. The pointer may be set to NULL if an error was encountered or the close brace was the last character in the string.
+ */
 char* _get_enclosed_r(char* str, char** saveptr, const char* open, const char* close) {
-    if (strlen(close) != strlen(open)) { return NULL; }
+    size_t n_open = strlen(open);
+    if (strlen(close) != n_open || n_open >= SCAN_SET_MAX) { return NULL; }
     if (saveptr) { *saveptr = NULL; }
-    size_t i = 0;
-    size_t start = 0;
+    //find the first match from the open set, terminate if we reached the end of the string
+    scan_set open_set = make_scan_set(open);
+    size_t i = _scan_set(str, 0, &open_set);
+    if (str[i] == 0 || str[i+1] == 0) { return str; }
+    size_t start = i + 1;
     //store the index of the matching character in open. For open and close containing multiple characters we set close_char to match the opening character we want.
-    char close_char = 0;
-    char open_char = 0;
-    while (close_char == 0) {
-	//see if we have a matching character from the open set
-	for (size_t j = 0; open[j] != 0; ++j) {
-	    if (str[i] == open[j]) {
-		open_char = open[j];
-		close_char = close[j];
-		start = i + 1;
-		break;
-	    }
-	}
-	++i;
-	//terminate if we reached the end of the string
-	if (str[i] == 0) { return str; }
-    }
+    char open_char = str[i];
+    char close_char = close[strchr(open, open_char) - open];
+    //only the close character and characters that change the nest level (or escape the close character) need to be examined, everything else is skipped over by _scan_set()
+    char set[SCAN_SET_MAX + 1];
     //this is a special case where nest counting doesn't work (any hit is essentially a no-op) instead we just examine if the end character is escaped
     if (open_char == close_char) {
+	set[0] = '\\';
+	set[1] = close_char;
+	set[2] = 0;
+	scan_set close_set = make_scan_set(set);
 	int escaped = 0;
-	for (i = start; str[i] != 0; ++i) {
+	for (i = _scan_set(str, start, &close_set); str[i] != 0; i = _scan_set(str, i + 1, &close_set)) {
 	    //see if the next character should be escaped by setting escaped = NOT escaped
 	    if (str[i] == '\\') {
 		escaped = 1 - escaped;
@@ -176,8 +266,12 @@ char* _get_enclosed_r(char* str, char** saveptr, const char* open, const char* c
 	    }
 	}
     } else {
+	memcpy(set, open, n_open);
+	set[n_open] = close_char;
+	set[n_open + 1] = 0;
+	scan_set nest_set = make_scan_set(set);
 	int nest_level = 0;
-	for (i = start; str[i] != 0; ++i) {
+	for (i = _scan_set(str, start, &nest_set); str[i] != 0; i = _scan_set(str, i + 1, &nest_set)) {
 	    //see if we have a matching character from the open set and try incrementing
 	    for (size_t j = 0; open[j] != 0; ++j) {
 		if (str[i] == open[j]) { ++nest_level; }
@@ -209,7 +303,12 @@ size_t _search_block(const char* str, const char* tok, size_t i) {
     //for a stack with fixed depth
     size_t blk_stk[MAX_BLK_RECURSE];
     size_t st_ptr = 0;
-    for (size_t j=i; str[j] != 0; ++j) {
+    //only nest characters and the first character of the token can change the result, everything else is skipped over by _scan_set(). Inside of a nest only the nest characters are relevant.
+    char root_chars[8] = " ()[]{}";
+    root_chars[0] = (tok[0])? tok[0] : '(';
+    scan_set root_set = make_scan_set(root_chars);
+    scan_set nest_set = make_scan_set(root_chars + 1);
+    for (size_t j = _scan_set(str, i, &root_set); str[j] != 0; j = _scan_set(str, j + 1, (st_ptr == 0)? &root_set : &nest_set)) {
 	//check if the stack is empty, meaning we're at the root nest level
 	if (st_ptr == 0) {
 	    //this means we've reached the end of this nest level without finding anything
@@ -264,7 +363,7 @@ char** csv_to_list(char* str, char sep, size_t* listlen, sc_error* err) {
     size_t j = 0;
     for (size_t i = 0; str[i] != 0; ++i) {
 	//if this is a separator then add the entry to the list
-	if (str[i] == sep && st_ptr == 0) {
+	if (str[i] == sep && st_ptr == 0 && !verbatim) {
 	    ret = (char**)sc_realloc(ret, sizeof(char*)*(off+1), err);
 	    if (err->type != E_SUCCESS) { return NULL; }
 
@@ -275,6 +374,7 @@ char** csv_to_list(char* str, char sep, size_t* listlen, sc_error* err) {
 	    str[j] = 0;
 	    ++j;
 	    saveptr = str + j;
+	    continue;
 	}
 	//check for escape sequences
 	if (str[i] == '\\') {
@@ -286,15 +386,19 @@ char** csv_to_list(char* str, char sep, size_t* listlen, sc_error* err) {
 	    case '\"': str[j] = '\"';++j;break;
 	    default: sc_set_error(err, E_SYNTAX, "unrecognized escape sequence");
 	    }
-	} else if (str[i] == '\"') {
+	    continue;
+	}
+	if (str[i] == '\"') {
 	    //if this is an unescaped quote then toggle verbatim mode
 	    verbatim = 1 - verbatim;
+	} else if (verbatim) {
+	    //separators and blocks inside of quotes are ignored
 	} else if (str[i] == '['/*]*/) {
 	    tp_stk[st_ptr++] = BLK_SQUARE;
 	} else if (str[i] == /*[*/']') {
 	    if (st_ptr == 0 || tp_stk[--st_ptr] != BLK_SQUARE) {
 		free(ret);
-		sc_set_error(err, E_SYNTAX, strdup(/*[*/"Unexpected ']'"));
+		sc_set_error(err, E_SYNTAX, /*[*/"Unexpected ']'");
 		return NULL;
 	    }
 	} else if (str[i] == '('/*)*/) {
@@ -302,7 +406,7 @@ char** csv_to_list(char* str, char sep, size_t* listlen, sc_error* err) {
 	} else if (str[i] == /*(*/')') {
 	    if (st_ptr == 0 || tp_stk[--st_ptr] != BLK_PAREN) {
 		free(ret);
-		sc_set_error(err, E_SYNTAX, strdup(/*(*/"Unexpected ')'"));
+		sc_set_error(err, E_SYNTAX, /*(*/"Unexpected ')'");
 		return NULL;
 	    }
 	} else if (str[i] == '{'/*}*/) {
@@ -310,21 +414,26 @@ char** csv_to_list(char* str, char sep, size_t* listlen, sc_error* err) {
 	} else if (str[i] == /*{*/'}') {
 	    if (st_ptr == 0 || tp_stk[--st_ptr] != BLK_CURLY) {
 		free(ret);
-		sc_set_error(err, E_SYNTAX, strdup(/*{*/"Unexpected '}'"));
+		sc_set_error(err, E_SYNTAX, /*{*/"Unexpected '}'");
 		return NULL;
 	    }
-	} else if (verbatim ||
-		  (str[i] != ' ' && str[i] != '\t' && str[i] != '\n')) {
-	    //if this isn't whitespace or it is verbatim mode then just copy the character
-	    str[j] = str[i];
-	    ++j;
+	} else if (str[i] == ' ' || str[i] == '\t' || str[i] == '\n') {
+	    //by default whitespace is ignored
+	    continue;
 	}
+	//copy the character, blocks and quotes are preserved so that elements may be parsed further
+	str[j] = str[i];
+	++j;
     }
     if (listlen) {
 	*listlen = off + 1;
     }
-    ret = (char**)sc_realloc(ret, sizeof(char*)*(off+1), err);
-    ret[off] = NULL;
+    //append the last element and null terminate the list
+    ret = (char**)sc_realloc(ret, sizeof(char*)*(off+2), err);
+    if (err->type != E_SUCCESS) { return NULL; }
+    str[j] = 0;
+    ret[off] = saveptr;
+    ret[off+1] = NULL;
     return ret;
 }
 
@@ -371,12 +480,19 @@ int cmpnwrd(const char* str, const char* tok) {
     return i+j;
 }
 
+//characters which end a word for read_dtg_word(), the set is constant so it is built at compile time. All of these except the brackets are below 64.
+#define SCAN_BIT(c)	((uint64_t)1 << ((c) & 63))
+static const scan_set word_end_set = {
+    {1 | SCAN_BIT(' ') | SCAN_BIT('\n') | SCAN_BIT('\t') | SCAN_BIT(';') | SCAN_BIT('=') | SCAN_BIT('(') | SCAN_BIT(')'), SCAN_BIT('[') | SCAN_BIT(']') | SCAN_BIT('{') | SCAN_BIT('}'), 0, 0},
+    " \n\t;=()[]{}"
+};
+
 /**
  * Reads the next whole word (sequence of non whitespace characters) from string str starting at offset off. Up to max_n bytes from this word are read into the string sto (sto is guaranteed to be null terminated). Returns an index (relative to str+off) to the first character AFTER the word that was just read. If there are no remaining words then 0 is returned. In the event that max_n is not large enough to hold the read word the index to the first unread character is returned and the remaining portion of the word may be accessed through one or more successive calls to read_word().
  */
 size_t read_dtg_word(const char* str, size_t off, char* sto, size_t max_n) {
      //iterate until we find the next word (indicated by a non whitespace character
-    int i = off;
+    size_t i = off;
     for (; str[i] != 0 && (str[i] == ' ' || str[i] == '\t' || str[i] == '\n'); ++i) {}
     if (str[i] == 0) { return 0; }
 
@@ -389,44 +505,39 @@ size_t read_dtg_word(const char* str, size_t off, char* sto, size_t max_n) {
 	return i+1;
     }
 
-    //read the word into sto
-    for (size_t j = 0; j < max_n; ++j) {
-	sto[j] = str[i];
-	if (str[i] == 0) { return i; }
-	if (str[i] == ' ' || str[i] == '\n' || str[i] == '\t' ||//whitespace
-	    str[i] == ';' || str[i] == '=' ||//special dtg characters
-	    str[i] == '(' || str[i] == ')' || str[i] == '{' || str[i] == '}' ||
-	    str[i] == '[' || str[i] == ']') {//parenthesis
-	    sto[j] = 0;
-	    return i+1;
-	}
-	++i;
+    //read the word into sto, it ends at whitespace, special dtg characters or parenthesis
+    size_t end = _scan_set(str, i, &word_end_set);
+    if (end - i < max_n) {
+	for (size_t k = i; k < end; ++k) { sto[k - i] = str[k]; }
+	sto[end - i] = 0;
+	return (str[end] == 0)? end : end + 1;
     }
-
+    memcpy(sto, str + i, max_n);
     sto[max_n-1] = 0;
-    return i+1;
+    return i + max_n + 1;
 }
 
 /**
  * Reads the next whole word (sequence of non whitespace characters) from string str starting at offset off. This is performed "in place" modifying the string str. The resulting string is saved to *sto if sto is not NULL. The caller must ensure that the lifespan of sto does not exceed that of str.
  */
 size_t read_word_i(char* str, size_t off, char** sto) {
-     //iterate until we find the next word (indicated by a non whitespace character
-    int i = off;
+    if (sto) { *sto = NULL; }
+    //iterate until we find the next word (indicated by a non whitespace character
+    size_t i = off;
     for (; str[i] != 0 && (str[i] == ' ' || str[i] == '\t' || str[i] == '\n'); ++i) {}
     if (str[i] == 0) { return 0; }
 
     //read the word into sto
     if (sto) { *sto = str+i; }
     for (; str[i] != 0; ++i) {
-	if (str[i] == 0) { return i; }
 	if (str[i] == ' ' || str[i] == '\n' || str[i] == '\t') {
 	    str[i] = 0;
-	    return i+1;
+	    return i + 1 - off;
 	}
     }
 
-    return i+1;
+    //don't skip past the null terminator
+    return i - off;
 }
 
 /**
@@ -457,6 +568,113 @@ char* DTG_strdup(const char* s, sc_error* err) {
     return ret;
 }
 
+// ==================================== ARENAS ====================================
+
+//the block header is padded so that the memory following it is aligned
+#define ARENA_HEADER_SIZE	((sizeof(arena_block) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/**
+ * Allocate size bytes from the arena a. The returned memory is aligned to ARENA_ALIGN bytes and remains valid until a is reset or freed.
+ */
+void* arena_alloc(arena* a, size_t size, sc_error* err) {
+    if (err) { err->type = E_SUCCESS; }
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (a->head == NULL || a->head->used + size > a->head->size) {
+	//large requests get a block of their own so that the remainder of the current block isn't wasted
+	int own_block = (size > ARENA_BLOCK_SIZE/4);
+	size_t blk_size = (own_block)? size : ARENA_BLOCK_SIZE;
+	arena_block* blk = (arena_block*)sc_malloc(ARENA_HEADER_SIZE + blk_size, err);
+	if (blk == NULL) { return NULL; }
+	blk->size = blk_size;
+	blk->used = 0;
+	if (a->head && own_block) {
+	    //insert behind the current block which still has room
+	    blk->next = a->head->next;
+	    a->head->next = blk;
+	    blk->used = size;
+	    a->n_allocs += 1;
+	    return (char*)blk + ARENA_HEADER_SIZE;
+	}
+	blk->next = a->head;
+	a->head = blk;
+    }
+    void* ret = (char*)(a->head) + ARENA_HEADER_SIZE + a->head->used;
+    a->head->used += size;
+    a->n_allocs += 1;
+    return ret;
+}
+
+/**
+ * Creates a copy of the string s with memory owned by the arena a. In the event of an error, NULL is returned.
+ */
+char* arena_strdup(arena* a, const char* s, sc_error* err) {
+    size_t len = strlen(s);
+    char* ret = (char*)arena_alloc(a, sizeof(char)*(len+1), err);
+    if (ret == NULL) { return NULL; }
+    memcpy(ret, s, len+1);
+    return ret;
+}
+
+/**
+ * Register fn to be called on ptr when a is reset or freed. Finalizers are called in the opposite order of registration.
+ */
+void arena_defer(arena* a, void (*fn)(void*), void* ptr, sc_error* err) {
+    arena_finalizer* fin = (arena_finalizer*)arena_alloc(a, sizeof(arena_finalizer), err);
+    if (fin == NULL) { return; }
+    fin->fn = fn;
+    fin->ptr = ptr;
+    fin->next = a->fins;
+    a->fins = fin;
+}
+
+/**
+ * Helper function which runs and removes every finalizer registered with a.
+ */
+void _arena_finalize(arena* a) {
+    //the finalizers themselves live in the arena so the next pointer has to be read first
+    arena_finalizer* fin = a->fins;
+    while (fin) {
+	arena_finalizer* next = fin->next;
+	fin->fn(fin->ptr);
+	fin = next;
+    }
+    a->fins = NULL;
+}
+
+/**
+ * Runs every finalizer registered with a and releases all of its allocations except for the most recent block which is kept for reuse.
+ */
+void reset_arena(arena* a) {
+    if (a->head == NULL) { return; }
+    _arena_finalize(a);
+    arena_block* blk = a->head->next;
+    while (blk) {
+	arena_block* next = blk->next;
+	sc_free(blk);
+	blk = next;
+    }
+    a->head->next = NULL;
+    a->head->used = 0;
+    a->n_allocs = 0;
+}
+
+/**
+ * Runs every finalizer registered with a and releases all memory owned by a.
+ */
+void free_arena(arena* a) {
+    if (a) {
+	_arena_finalize(a);
+	arena_block* blk = a->head;
+	while (blk) {
+	    arena_block* next = blk->next;
+	    sc_free(blk);
+	    blk = next;
+	}
+	a->head = NULL;
+	a->n_allocs = 0;
+    }
+}
+
 // ================================== LOOKUP TREES ==================================
 
 /**
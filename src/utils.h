@@ -9,6 +9,8 @@
 #define DEFAULT_STACK_SIZE	8
 #define MAX_BLK_RECURSE		255
 #define INONE			9223372036854775807
+#define ARENA_BLOCK_SIZE	4096
+#define ARENA_ALIGN		16
 
 #ifdef __cplusplus 
 extern "C" {
@@ -29,6 +31,75 @@ typedef struct stype_ind_pair {
     size_t i;
 } type_ind_pair;
 
+// ==================================== SIMD ====================================
+
+//Scanning strings and element-wise array operations use vectorized kernels chosen at runtime from the features of the CPU. Define SC_NO_SIMD to always use the scalar kernels.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(SC_NO_SIMD)
+#define SC_SIMD_X86
+#endif
+
+#define SIMD_NONE	0
+#define SIMD_SSE2	1
+#define SIMD_SSE42	2
+#define SIMD_AVX2	3
+
+//the maximum number of characters in a scan_set
+#define SCAN_SET_MAX	16
+//the number of characters _scan_set() examines inline before switching to vectorized kernels
+#define SCAN_SHORT_RUN	8
+
+/**
+ * A set of characters that _scan_set() searches for. The null terminator is always a member.
+ */
+typedef struct scan_set {
+    uint64_t map[4];
+    char chars[SCAN_SET_MAX + 1];
+} scan_set;
+
+/**
+ * Returns the most capable SIMD level (one of the SIMD_* constants) supported by this CPU.
+ */
+int simd_supported();
+
+/**
+ * Selects the vectorized kernels used for scanning strings and element-wise array operations. level is clamped to simd_supported(). This is mostly useful for testing and benchmarking since the best supported level is chosen by default.
+ * Returns: the level which will be used
+ */
+int set_simd_level(int level);
+
+/**
+ * Returns the level selected by set_simd_level() or simd_supported() if no level has been selected yet.
+ */
+int get_simd_level();
+
+/**
+ * Creates a scan_set containing the characters in chars, of which only the first SCAN_SET_MAX are used.
+ */
+scan_set make_scan_set(const char* chars);
+
+/**
+ * Helper function which tests whether c is a member of set
+ */
+static inline int _in_scan_set(const scan_set* set, char c) {
+    return (set->map[(_uint8)c >> 6] >> ((_uint8)c & 63)) & 1;
+}
+
+/**
+ * Returns the index of the first character at or after index i in str which is a member of set using the vectorized kernels selected by set_simd_level().
+ */
+size_t _scan_set_long(const char* str, size_t i, const scan_set* set);
+
+/**
+ * Returns the index of the first character at or after index i in str which is a member of set (this includes the null terminator). This lets the parsing utilities skip over runs of characters they don't care about a block at a time instead of examining each one.
+ */
+static inline size_t _scan_set(const char* str, size_t i, const scan_set* set) {
+    //runs between interesting characters are usually short, so look at the first few inline before paying for a call and the vector setup
+    for (size_t end = i + SCAN_SHORT_RUN; i < end; ++i) {
+	if (_in_scan_set(set, str[i])) { return i; }
+    }
+    return _scan_set_long(str, i, set);
+}
+
 // ==================================== PARSING ====================================
 
 /**
@@ -47,6 +118,7 @@ char* _get_enclosed(char* str, const char* open, const char* close);
 
 /**
  * This function is identical to _get_enclosed but accepts one additional parameter between str and open, saveptr. If saveptr is not NULL then it is set to the first character after the close parenthesis was found. Additionally, the matching start and end characters are replaced with 0 terminators. The pointer may be set to NULL if an error was encountered or the close brace was the last character in the string.
+ * NOTE: open and close may contain at most SCAN_SET_MAX-1 characters.
  */
 char* _get_enclosed_r(char* str, char** saveptr, const char* open, const char* close);
 
@@ -87,6 +159,7 @@ size_t read_dtg_word(const char* str, size_t off, char* sto, size_t max_n);
 
 /**
  * Reads the next whole word (sequence of non whitespace characters) from string str starting at offset off. This is performed "in place" modifying the string str. The resulting string is saved to *sto if sto is not NULL. The caller must ensure that the lifespan of sto does not exceed that of str.
+ * returns: the number of characters read from str starting at off or 0 if there was no word to read
  */
 size_t read_word_i(char* str, size_t off, char** sto);
 
@@ -95,6 +168,60 @@ size_t read_word_i(char* str, size_t off, char** sto);
  */
 char* DTG_strdup(const char* s, sc_error* err);
 
+// ==================================== ARENAS ====================================
+
+/**
+ * Header for a block of memory owned by an arena. The usable memory immediately follows the header.
+ */
+typedef struct s_arena_block {
+    struct s_arena_block* next;
+    size_t size;
+    size_t used;
+} arena_block;
+
+/**
+ * A finalizer which is called on ptr when the owning arena is reset or freed. This is used for objects placed in an arena which own heap memory of their own (e.g. string values).
+ */
+typedef struct s_arena_finalizer {
+    struct s_arena_finalizer* next;
+    void (*fn)(void*);
+    void* ptr;
+} arena_finalizer;
+
+/**
+ * A bump allocator. Allocations are carved out of large blocks and are never freed individually, instead everything is released at once by reset_arena() or free_arena(). A zero initialized arena is valid and empty.
+ */
+typedef struct s_arena {
+    arena_block* head;
+    arena_finalizer* fins;
+    size_t n_allocs;
+} arena;
+
+/**
+ * Allocate size bytes from the arena a. The returned memory is aligned to ARENA_ALIGN bytes and remains valid until a is reset or freed.
+ */
+void* arena_alloc(arena* a, size_t size, sc_error* err);
+
+/**
+ * Creates a copy of the string s with memory owned by the arena a. In the event of an error, NULL is returned.
+ */
+char* arena_strdup(arena* a, const char* s, sc_error* err);
+
+/**
+ * Register fn to be called on ptr when a is reset or freed. Finalizers are called in the opposite order of registration.
+ */
+void arena_defer(arena* a, void (*fn)(void*), void* ptr, sc_error* err);
+
+/**
+ * Runs every finalizer registered with a and releases all of its allocations except for the most recent block which is kept for reuse.
+ */
+void reset_arena(arena* a);
+
+/**
+ * Runs every finalizer registered with a and releases all memory owned by a.
+ */
+void free_arena(arena* a);
+
 // ================================== LOOKUP TREES ==================================
 
 /**
@@ -1,5 +1,10 @@
 #include "values.h"
 
+#ifdef SC_STACK_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #ifdef __cplusplus 
 extern "C" {
 #endif
@@ -19,10 +24,14 @@ size_t len(value p_val) {
  * Helper function that returns the string where contents for the string type value p_val are stored. This function is only valid for strings, for arrays use _get_buf(). In the event that this function is called for a non string type NULL is returned.
  * WARNING: calls to grow() or append() may invalidate the buffer
  */
-/*char* _get_char_buf(value p_val); {
+char* _get_char_buf(value p_val) {
     if (p_val.type != VT_STRING) { return NULL; }
-    return ((String*)p_val.val)->buf;
-}*/
+    //strings built by concatenation are only copied into a contiguous null terminated buffer once it is needed
+    sc_error err;
+    _flatten_s(p_val.val.str, &err);
+    if (err.type != E_SUCCESS) { return NULL; }
+    return p_val.val.str->buf;
+}
 
 /**
  * Frees the value pointed to by p_val. If p_val is an array like object, then free_val will properly free the stored array as well. In most cases, end users shouldn't need to call lower level functions like free_Array().
@@ -33,7 +42,7 @@ void free_value(value* p_val) {
     if (p_val->type == VT_STRING) {
 	String* tmp_str = p_val->val.str;
 	if (tmp_str) {
-	    if (tmp_str->buf) { free(tmp_str->buf); }
+	    free_String(tmp_str);
 	    sc_free(tmp_str);
 	}
     } else if (p_val->type == VT_ARRAY) {
@@ -66,11 +75,11 @@ value v_deep_copy(value p_val, sc_error* err) {
     case VT_INT: ret.val.i = p_val.val.i; break;
     case VT_FLOAT: ret.val.f = p_val.val.f; break;
     case VT_STRING:
-    ret.val.str = (String*)sc_malloc(sizeof(String), err);
-    ret.val.str->buf_size = p_val.val.str->size;
+    ret.val.str = _alloc_String(p_val.val.str->size + 1, err);
+    if (err->type != E_SUCCESS) { ret.type = VT_ERROR;break; }
     ret.val.str->size = p_val.val.str->size;
-    ret.val.str->buf = (char*)sc_malloc(sizeof(char)*(ret.val.str->buf_size), err);
-    strncpy(ret.val.str->buf, p_val.val.str->buf, ret.val.str->size);
+    memcpy(ret.val.str->buf, p_val.val.str->buf, ret.val.str->size);
+    ret.val.str->buf[ret.val.str->size] = 0;
     break;
     case VT_ARRAY:
     Array* p_arr = (Array*)p_val.val.ptr;
@@ -103,20 +112,9 @@ size_t get_format_string_size(value p_val, size_t precision) {
     if (p_val.val.i == 0) { return 5; }
     return 4;
 
-    case VT_INT:
-    int tmp_i = p_val.val.i;
-    if (tmp_i >= 0) {
-	return (size_t)floor(log10( (double)tmp_i )) + 1;
-    }
-    return (size_t)floor(log10( (double)(-tmp_i) )) + 2;
+    case VT_INT: return get_int_digits(p_val.val.i, 10);
 
-    case VT_FLOAT:
-    double tmp_f = p_val.val.f;
-    if (tmp_f >= 0) {
-	//add precision and the decimal
-	return (size_t)floor(log10( (double)tmp_f )) + precision + 2;
-    }
-    return (size_t)floor(log10( (double)tmp_f )) + precision + 3;
+    case VT_FLOAT: return get_float_digits(p_val.val.f, precision);
 
     case VT_STRING: return p_val.val.str->size + 1;
 
@@ -124,7 +122,7 @@ size_t get_format_string_size(value p_val, size_t precision) {
     size_t ret = 3;//characters for [] and null termination
     Array* arr = (Array*)p_val.val.ptr;
     for (size_t i = 0; i < arr->size; ++i) {
-	ret += get_format_string_size(arr->buf[i], precision);
+	ret += get_format_string_size(_get_a(arr, i), precision);
 	if (i < arr->size - 1) { ret += 2; }// add characters for ", " separators
     }
     return ret;
@@ -186,10 +184,12 @@ value read_value_string(char* str, Valtype_e hint, sc_error* err) {sc_reset_erro
 	    arr->buf[i] = read_value_string(token, 0, err);
 	    if (err->type != E_SUCCESS) { free_Array(arr);return ret; }
 	    ++i;
+	    //the size must be kept current so that _grow_a reallocates when needed
+	    arr->size = i;
 	    token = strtok_r(NULL, ",", &saveptr); 
 	}
-	//figure out the size of the newly created array
-	arr->size = i;
+	//arrays of a single primitive type are stored unboxed
+	_unbox_a(arr, err);
 	//tie the array to our returned value
 	ret.val.ptr = arr;
 	return ret;
@@ -231,11 +231,12 @@ value read_value_string(char* str, Valtype_e hint, sc_error* err) {sc_reset_erro
 		i += 1;
 	    }
 	}
-	int tmp = 0;
+	sc_int tmp = 0;
 	ret.val.i = 0;
 	size_t dec_place = 0;
 	int power = 0;
 	int use_power = 0;
+	int exp_sign = 1;
 	for (; str[i] != 0 && str[i] != ' '; ++i) {
 	    //read the sign and skip the rest of this iteration
 	    /*if (str[i] == '-') { sign *= -1;continue; }
@@ -250,14 +251,17 @@ value read_value_string(char* str, Valtype_e hint, sc_error* err) {sc_reset_erro
 		tmp = 0;
 		dec_place = i + 1;
 	    } else if (str[i] == 'e' && base < 15) {
-		//if we encounter an 'E' then interpret the rest of the number as a power
-		ret.type = VT_FLOAT;
-		//add the decimal precision
-		ret.val.f += (double)(sign*tmp) / pow(base, i - dec_place);
+		//if we encounter an 'E' then interpret the rest of the number as a power. The digits read so far are either the fractional part or the whole mantissa
+		if (ret.type == VT_FLOAT) {
+		    ret.val.f += (double)(sign*tmp) / pow(base, i - dec_place);
+		} else {
+		    ret.type = VT_FLOAT;
+		    ret.val.f = (double)(sign*tmp);
+		}
 		tmp = 0;
-		//set the sign accordingly if necessary
-		if (str[i+1] == '-') { sign = -1;++i; }
-		if (str[i+1] == '+') { sign = 1;++i; }
+		//the exponent has its own sign
+		if (str[i+1] == '-') { exp_sign = -1;++i; }
+		else if (str[i+1] == '+') { ++i; }
 		use_power = 1;
 	    } else {
 		tmp *= base;
@@ -279,8 +283,8 @@ value read_value_string(char* str, Valtype_e hint, sc_error* err) {sc_reset_erro
 	}
 	if (ret.type == VT_FLOAT) {
 	    if (use_power) {
-		//if a power was supplied then we just need to multiply the final result
-		ret.val.f *= pow(base, sign*tmp);
+		//if a power was supplied then we just need to scale the final result. Dividing for negative powers keeps results like 1e-3 exact
+		if (exp_sign < 0) { ret.val.f /= pow(base, tmp); } else { ret.val.f *= pow(base, tmp); }
 	    } else {
 		//otherwise add the decimal part of the float
 		ret.val.f += (double)(sign*tmp) / pow(base, i - dec_place);
@@ -350,7 +354,7 @@ HashedItem _read_valtup(char* str, sc_error* err) {
 	    }
 	    
 	    //read the value to interpret the type
-	    ret.key = DTG_strdup(type_name, err);
+	    ret.key = intern_str(type_name, err);
 	    if (err->type != E_SUCCESS) { return ret; }
 	    ret.val = read_value_string(type_name, 0, err);
 	    if (err->type != E_SUCCESS) { return ret; }
@@ -367,7 +371,7 @@ HashedItem _read_valtup(char* str, sc_error* err) {
 	sc_set_error(err, E_SYNTAX, "missing variable name");
 	return ret;
     }
-    ret.key = DTG_strdup(val_name, err);
+    ret.key = intern_str(val_name, err);
     if (err->type != E_SUCCESS) { return ret; }
     //check if there was an equal sign
     n_read += read_word_i(str, n_read, &val_name);
@@ -393,11 +397,11 @@ HashedItem _read_valtup(char* str, sc_error* err) {
 }
 
 /**
- * Frees the memory allocated for usage by h. This assumes a call to _read_valtup has been used or the key and value have both been allocated using sc_malloc().
+ * Frees the memory allocated for usage by h. This assumes a call to _read_valtup has been used or the value has been allocated using sc_malloc(). The key is interned and is not freed.
  */
 void free_HashedItem(HashedItem* h) {
     if (h) {
-	sc_free(h->key);
+	h->key = NULL;
 	free_value( &(h->val) );
     }
 }
@@ -412,6 +416,7 @@ Array* _make_Array(size_t el_size, size_t n, sc_error* err) {sc_reset_error(err)
     Array* ret = sc_malloc(sizeof(Array), err);
     if (err->type != E_SUCCESS || ret == NULL) { return NULL; }
 
+    ret->element_type = VT_UNDEF;
     ret->el_size = el_size;
     ret->buf_size = n;
     ret->size = 0;
@@ -430,8 +435,10 @@ Array* _make_Array(size_t el_size, size_t n, sc_error* err) {sc_reset_error(err)
 void free_Array(Array* arr) {
     if (arr) {	
 	if (arr->buf) {
-	    //free the elements of the array
-	    for (size_t i = 0; i < arr->size; ++i) { free_value(arr->buf + i); }
+	    //free the elements of the array, unboxed elements don't own any memory
+	    if (arr->element_type == VT_UNDEF) {
+		for (size_t i = 0; i < arr->size; ++i) { free_value(arr->buf + i); }
+	    }
 	    sc_free(arr->buf);
 	}
 	arr->buf = NULL;
@@ -444,6 +451,7 @@ void free_Array(Array* arr) {
  * Grows the array arr to accomodate n additional entries of size el_size
  */
 void _grow_a(Array* arr, size_t n, sc_error* err) {sc_reset_error(err);
+    if (arr && arr->element_type != VT_UNDEF) { _grow_pa((PrimArray*)arr, n, err);return; }
     if (arr) {
 
     if (arr->buf_size <= arr->size + n) {
@@ -476,9 +484,7 @@ void _grow_pa(PrimArray* arr, size_t n, sc_error* err) {sc_reset_error(err);
 	void* tmp = sc_malloc((arr->el_size)*(arr->buf_size), err);
 	//if there weren't any problems allocating the new block then copy the data to the new location
 	if (tmp != NULL) {
-	    for (size_t i = 0; i < (arr->el_size)*(arr->size); ++i) {
-		((char*)tmp)[i] = ((char*)(arr->buf))[i];
-	    }
+	    if (arr->size > 0) { memcpy(tmp, arr->buf, (arr->el_size)*(arr->size)); }
 	    free(arr->buf);
 	    arr->buf = tmp;
 	} else {
@@ -490,6 +496,111 @@ void _grow_pa(PrimArray* arr, size_t n, sc_error* err) {sc_reset_error(err);
     }
 }
 
+/**
+ * Returns the size of an unboxed element of type t or 0 if values of type t can't be stored in a PrimArray.
+ */
+size_t _prim_size(Valtype_e t) {
+    switch (t) {
+	case VT_CHAR:
+	case VT_BOOL: return sizeof(char);
+	case VT_INT: return sizeof(sc_int);
+	case VT_FLOAT: return sizeof(double);
+	default: return 0;
+    }
+}
+
+/**
+ * Initializes an array of n unboxed elements of the primitive type t or stores a result to the error err.
+ * Note: on an error this function may return NULL
+ */
+PrimArray* _make_PrimArray(Valtype_e t, size_t n, sc_error* err) {sc_reset_error(err);
+    size_t el_size = _prim_size(t);
+    if (el_size == 0) {
+	sc_set_error(err, E_BADTYPE, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "type %d can't be stored unboxed", t);
+	return NULL;
+    }
+    PrimArray* ret = sc_malloc(sizeof(PrimArray), err);
+    if (err->type != E_SUCCESS || ret == NULL) { return NULL; }
+
+    ret->element_type = t;
+    ret->el_size = el_size;
+    ret->buf_size = n;
+    ret->size = 0;
+    ret->buf = sc_malloc(el_size*n, err);
+    if (err->type != E_SUCCESS || ret->buf == NULL) {
+	free(ret);
+	return NULL;
+    }
+    return ret;
+}
+
+/**
+ * Returns the element at index i of arr, which may be an Array or a PrimArray. No bounds checking is performed.
+ */
+value _get_a(const Array* arr, size_t i) {
+    value ret = {0};
+    ret.type = arr->element_type;
+    switch (arr->element_type) {
+	case VT_UNDEF: return arr->buf[i];
+	case VT_CHAR:
+	case VT_BOOL: ret.val.i = ((char*)(arr->buf))[i]; break;
+	case VT_INT: ret.val.i = ((sc_int*)(arr->buf))[i]; break;
+	case VT_FLOAT: ret.val.f = ((double*)(arr->buf))[i]; break;
+    }
+    return ret;
+}
+
+/**
+ * Stores a shallow copy of v at index i of arr, which may be an Array or a PrimArray. If v can't be stored unboxed then arr is converted to an Array of boxed values first. No bounds checking is performed.
+ */
+void _set_a(Array* arr, size_t i, value v, sc_error* err) {
+    if (arr->element_type != VT_UNDEF && v.type != arr->element_type) {
+	_box_a(arr, err);
+	if (err->type != E_SUCCESS) { return; }
+    }
+    switch (arr->element_type) {
+	case VT_UNDEF: arr->buf[i] = v; break;
+	case VT_CHAR:
+	case VT_BOOL: ((char*)(arr->buf))[i] = (char)(v.val.i); break;
+	case VT_INT: ((sc_int*)(arr->buf))[i] = v.val.i; break;
+	case VT_FLOAT: ((double*)(arr->buf))[i] = v.val.f; break;
+    }
+}
+
+/**
+ * Converts arr in place from a PrimArray to an Array of boxed values. Arrays which are already boxed are left unchanged.
+ */
+void _box_a(Array* arr, sc_error* err) {sc_reset_error(err);
+    if (arr->element_type == VT_UNDEF) { return; }
+    value* tmp = (value*)sc_malloc(sizeof(value)*(arr->buf_size), err);
+    if (err->type != E_SUCCESS) { return; }
+    for (size_t i = 0; i < arr->size; ++i) { tmp[i] = _get_a(arr, i); }
+    sc_free(arr->buf);
+    arr->buf = tmp;
+    arr->element_type = VT_UNDEF;
+    arr->el_size = sizeof(value);
+}
+
+/**
+ * Converts arr in place from an Array of boxed values to a PrimArray if every element has the same primitive type. Otherwise arr is left unchanged.
+ */
+void _unbox_a(Array* arr, sc_error* err) {sc_reset_error(err);
+    if (arr->element_type != VT_UNDEF || arr->size == 0) { return; }
+    Valtype_e t = arr->buf[0].type;
+    size_t el_size = _prim_size(t);
+    if (el_size == 0) { return; }
+    for (size_t i = 1; i < arr->size; ++i) {
+	if (arr->buf[i].type != t) { return; }
+    }
+    //the buffer may only shrink, so we write over the boxed values in place
+    value* boxed = arr->buf;
+    arr->element_type = t;
+    arr->el_size = el_size;
+    for (size_t i = 0; i < arr->size; ++i) { _set_a(arr, i, boxed[i], err); }
+    arr->buf_size = arr->buf_size*sizeof(value)/el_size;
+}
+
 /**
  * Resizes the array arr to hold exactly n entries of size el_size. If n is less than the current size of the array, then elements at the end are discarded.
  */
@@ -525,6 +636,7 @@ Array _copy_a(Array arr, sc_error* err) {
     //initialize the array and the buffer and check for errors
     Array ret = {0};
     //set the size appropriately
+    ret.element_type = arr.element_type;
     ret.buf_size = arr.size;
     ret.el_size = arr.el_size;
     ret.size = ret.buf_size;
@@ -532,8 +644,13 @@ Array _copy_a(Array arr, sc_error* err) {
     if (ret.size == 0) { ret.buf = NULL;return ret; }
 
     //at last! we allocate the actual array buffer and copy data
-    ret.buf = (value*)sc_malloc(sizeof(value)*(ret.buf_size), err);
+    ret.buf = (value*)sc_malloc((arr.el_size)*(ret.buf_size), err);
     if (err->type != E_SUCCESS) { ret.buf = NULL;return ret; }
+    //unboxed elements don't own any memory so they may be copied directly
+    if (arr.element_type != VT_UNDEF) {
+	memcpy(ret.buf, arr.buf, (arr.el_size)*(arr.size));
+	return ret;
+    }
 
     for (size_t i = 0; i < arr.size; ++i) {
 	ret.buf[i] = v_deep_copy(arr.buf[i], err);
@@ -556,16 +673,15 @@ Array _copy_a(Array arr, sc_error* err) {
 Array _slice_a(Array arr, long int start_ind, long int end_ind, sc_error* err) {sc_reset_error(err);
     //set to zero to make sure errors don't return garbage values
     Array ret = {0};
+    ret.element_type = arr.element_type;
+    ret.el_size = arr.el_size;
     ret.buf_size = 0;
     ret.size = 0;
     ret.buf = NULL;
-    
-    //size_t span = arr->el_size;//save on typing
-    size_t span = sizeof(value);
 
     //translate the indices from negative or out of bounds values to valid ones
-    if (end_ind > arr.size) { end_ind = arr.size; }
-    if (start_ind > arr.size) { end_ind = arr.size; }
+    if (end_ind > (long int)arr.size) { end_ind = arr.size; }
+    if (start_ind > (long int)arr.size) { start_ind = arr.size; }
     if (end_ind < -1*(long int)(arr.size) || start_ind < -1*(long int)(arr.size)) {
 	sc_set_error(err, E_RANGE, "negative slice less than size");
 	return ret;
@@ -577,21 +693,16 @@ Array _slice_a(Array arr, long int start_ind, long int end_ind, sc_error* err) {
 	return ret;
     }
 
-    if (err->type != E_SUCCESS) { return ret; }
     //set the size appropriately
     ret.buf_size = (end_ind - start_ind);
-    ret.el_size = arr.el_size;
     ret.size = ret.buf_size;
     //in the case of an empty array we just set the buffer to be NULL
     if (ret.size == 0) { ret.buf = NULL;return ret; }
 
-    //at last! we allocate the actual array buffer and copy data
-    ret.buf = sc_malloc(sizeof(value)*(end_ind - start_ind), err);
+    //at last! we allocate the actual array buffer and copy data. This works for either representation since elements are el_size bytes apart.
+    ret.buf = sc_malloc((arr.el_size)*(ret.size), err);
     if (err->type != E_SUCCESS) { sc_free(ret.buf);ret.buf = NULL;return ret; }
-
-    for (size_t i = start_ind; i < end_ind; ++i) {
-	ret.buf[i - span*start_ind] = arr.buf[i];
-    }
+    memcpy(ret.buf, (char*)(arr.buf) + (arr.el_size)*start_ind, (arr.el_size)*(ret.size));
     //no errors, yay!
     sc_reset_error(err);
     return ret;
@@ -647,18 +758,32 @@ Array _slice_a(Array arr, long int start_ind, long int end_ind, sc_error* err) {
 /**
  * Appends the array of values of length n specified by new vals to the end of the Array pointed to by arr. A deep copy of elements is performed.
  */
-void _extend_a(Array* arr, value* new_vals, size_t n, sc_error* err) {
+void _extend_a(Array* arr, value* new_vals, size_t n, sc_error* err) {sc_reset_error(err);
+    int was_empty = (arr->size == 0 && arr->element_type == VT_UNDEF);
+    //values which can't be stored unboxed force a conversion to the boxed representation
+    if (arr->element_type != VT_UNDEF) {
+	for (size_t i = 0; i < n; ++i) {
+	    if (new_vals[i].type != arr->element_type) { _box_a(arr, err);break; }
+	}
+	if (err->type != E_SUCCESS) { return; }
+    }
     _grow_a(arr, n, err);
+    if (err->type != E_SUCCESS) { return; }
     for (size_t i = 0; i < n; ++i) {
-	arr->buf[arr->size + i] = v_deep_copy(new_vals[i], err);
+	if (arr->element_type == VT_UNDEF) {
+	    arr->buf[arr->size + i] = v_deep_copy(new_vals[i], err);
+	} else {
+	    _set_a(arr, arr->size + i, new_vals[i], err);
+	}
     }
     arr->size += n;
+    if (was_empty) { _unbox_a(arr, err); }
 }
 
 // ================================== ARRAY VALUES ==================================
 
 /**
- * Creates a new array value with contents identical to those stored in p_val (a deep copy is performed.
+ * Creates a new array value with contents identical to those stored in p_val (a deep copy is performed. If every value has the same primitive type then the elements are stored unboxed in a PrimArray.
  * NOTE: A deep copy of p_val is made. Thus, no guarantees as to the lifespan of the memory pointed to by p_val are required.
  */
 value v_make_array(const value* p_val, size_t n_vals, sc_error* err) {sc_reset_error(err);
@@ -666,12 +791,15 @@ value v_make_array(const value* p_val, size_t n_vals, sc_error* err) {sc_reset_e
     ret.type = VT_ARRAY;
     ret.val.ptr = sc_malloc(sizeof(Array), err);
     Array* arr = (Array*)ret.val.ptr;
+    arr->element_type = VT_UNDEF;
+    arr->el_size = sizeof(value);
     arr->buf_size = n_vals;
     arr->size = n_vals;
     arr->buf = sc_malloc(sizeof(value)*n_vals, err);
     for (size_t i = 0; i < n_vals; ++i) {
 	arr->buf[i] = v_deep_copy(p_val[i], err);
     }
+    _unbox_a(arr, err);
     return ret;
 }
 
@@ -683,12 +811,15 @@ value v_make_array_n(size_t p_n, value tmplt, sc_error* err) {
     ret.type = VT_ARRAY;
     ret.val.ptr = sc_malloc(sizeof(Array), err);
     Array* arr = (Array*)ret.val.ptr;
+    arr->element_type = VT_UNDEF;
+    arr->el_size = sizeof(value);
     arr->buf_size = p_n;
     arr->size = p_n;
     arr->buf = sc_malloc(sizeof(value)*p_n, err);
     for (size_t i = 0; i < p_n; ++i) {
 	arr->buf[i] = v_deep_copy(tmplt, err);
     }
+    _unbox_a(arr, err);
     return ret;
 }
 
@@ -743,20 +874,137 @@ String make_String_n(size_t n, sc_error* err) {sc_reset_error(err);
     return str;
 }
 
+/**
+ * Allocates an empty String on the heap with the capacity to hold n bytes. If n is at most STRING_SMALL_SIZE then the contents are stored inline so that only one allocation is needed. The result should be freed with free_String() followed by sc_free().
+ */
+String* _alloc_String(size_t n, sc_error* err) {
+    String* str = (String*)sc_malloc(sizeof(String), err);
+    if (str == NULL) { return NULL; }
+    str->size = 0;
+    str->bld = NULL;
+    if (n <= STRING_SMALL_SIZE) {
+	str->buf_size = STRING_SMALL_SIZE;
+	str->buf = str->small;
+    } else {
+	str->buf_size = n;
+	str->buf = (char*)sc_malloc(sizeof(char)*n, err);
+	if (str->buf == NULL) {
+	    sc_free(str);
+	    return NULL;
+	}
+    }
+    str->buf[0] = 0;
+    return str;
+}
+
 /**
  * Frees the memory used by str. after a call to free_String the String str still has not been allocated, but it is safe to call sc_free(str) if the string itself was malloced.
  */
 void free_String(String* str) {
     if (str) {
-	if (str->buf) {
+	//inline buffers are freed along with the String itself and shared buffers are freed by the last string using them
+	if (str->bld) {
+	    _release_builder(str->bld);
+	} else if (str->buf && str->buf != str->small) {
 	    sc_free(str->buf);
 	}
 	str->buf = NULL;
+	str->bld = NULL;
 	str->buf_size = 0;
 	str->size = 0;
     }
 }
 
+/**
+ * Remove one reference to the builder bld and free it if no strings use it any more.
+ */
+void _release_builder(StringBuilder* bld) {
+    bld->n_refs -= 1;
+    if (bld->n_refs == 0) { sc_free(bld); }
+}
+
+/**
+ * Copy the contents of str into a buffer owned by str which holds at least n bytes and stop using its builder.
+ */
+void _own_s(String* str, size_t n, sc_error* err) {
+    if (n < str->size + 1) { n = str->size + 1; }
+    char* tmp = str->small;
+    if (n > STRING_SMALL_SIZE) {
+	tmp = (char*)sc_malloc(sizeof(char)*n, err);
+	if (tmp == NULL) { return; }
+    } else {
+	n = STRING_SMALL_SIZE;
+    }
+    memcpy(tmp, str->buf, str->size);
+    tmp[str->size] = 0;
+    _release_builder(str->bld);
+    str->bld = NULL;
+    str->buf = tmp;
+    str->buf_size = n;
+}
+
+/**
+ * Creates a new String on the heap holding the contents of a followed by the n bytes b. a is never modified. If a was the last string appended to its builder then the result shares the builder and only b is copied. Otherwise results which don't fit inline are placed in a new builder with twice the required capacity, so repeatedly appending to the result takes amortized constant time.
+ * returns: the new string or NULL in the event of an error. The result should be freed with free_String() followed by sc_free().
+ */
+String* _concat_s(String* a, const char* b, size_t n, sc_error* err) {
+    size_t size = a->size + n;
+    StringBuilder* bld = a->bld;
+    //a may only append in place if nothing else has been appended to it and there is room for the terminator
+    if (bld == NULL || a->size != bld->used || size >= bld->cap) {
+	if (size < STRING_SMALL_SIZE) {
+	    String* ret = _alloc_String(size + 1, err);
+	    if (ret == NULL) { return NULL; }
+	    memcpy(ret->buf, a->buf, a->size);
+	    memcpy(ret->buf + a->size, b, n);
+	    ret->buf[size] = 0;
+	    ret->size = size;
+	    return ret;
+	}
+	//the builder and its data share a single allocation
+	size_t cap = 2*(size + 1);
+	bld = (StringBuilder*)sc_malloc(sizeof(StringBuilder) + sizeof(char)*cap, err);
+	if (bld == NULL) { return NULL; }
+	bld->n_refs = 0;
+	bld->cap = cap;
+	bld->data = (char*)(bld + 1);
+	memcpy(bld->data, a->buf, a->size);
+    }
+    String* ret = (String*)sc_malloc(sizeof(String), err);
+    if (ret == NULL) {
+	if (bld->n_refs == 0) { sc_free(bld); }
+	return NULL;
+    }
+    bld->n_refs += 1;
+    //b is either unrelated to bld or a prefix of it, so it can't overlap the bytes past the end of a
+    memcpy(bld->data + a->size, b, n);
+    bld->data[size] = 0;
+    bld->used = size;
+    ret->bld = bld;
+    ret->buf = bld->data;
+    ret->buf_size = bld->cap;
+    ret->size = size;
+    return ret;
+}
+
+/**
+ * Ensure that str->buf is a null terminated copy of the contents of str which may be used as a C string. Strings which share a builder are only copied if another string has been appended to them. The buffer remains valid until the next call to _concat_s() with str as the first argument.
+ */
+void _flatten_s(String* str, sc_error* err) {
+    sc_reset_error(err);
+    if (str && str->bld && str->size != str->bld->used) { _own_s(str, str->size + 1, err); }
+}
+
+/**
+ * Lexicographically compare the Strings a and b. The result has the same sign as strcmp() would, but the strings don't need to be null terminated.
+ */
+int _compare_s(const String* a, const String* b) {
+    size_t n = (a->size < b->size)? a->size : b->size;
+    int ret = memcmp(a->buf, b->buf, n);
+    if (ret != 0) { return ret; }
+    return (a->size > b->size) - (a->size < b->size);
+}
+
 /**
  * Grows the string value val to accomodate n additional bytes.
  * NOTE: the size and contents of this operation are unchanged. Call this before writing any data to ensure that there is sufficient allocated space.
@@ -764,6 +1012,12 @@ void free_String(String* str) {
 void _grow_s(String* str, size_t n, sc_error* err) {sc_reset_error(err);
     if (str) {
 
+    //strings which share a builder can't write in place, so they take their own copy first
+    if (str->bld) {
+	_own_s(str, 2*(str->size) + n, err);
+	if (err->type != E_SUCCESS) { return; }
+    }
+
     if (str->buf_size <= str->size + n) {
 	str->buf_size = 2*(str->buf_size) + n;
 	char* tmp = (char*)sc_malloc(str->buf_size, err);
@@ -772,7 +1026,7 @@ void _grow_s(String* str, size_t n, sc_error* err) {sc_reset_error(err);
 	    strncpy(tmp, str->buf, str->size+1);
 	}
 	//tmp[str->size] = 0;
-	sc_free(str->buf);
+	if (str->buf != str->small) { sc_free(str->buf); }
 	str->buf = tmp;
 	if (err) { sc_reset_error(err); }
     }
@@ -787,6 +1041,11 @@ void _grow_s(String* str, size_t n, sc_error* err) {sc_reset_error(err);
 void _resize_s(String* str, size_t n, sc_error* err) {sc_reset_error(err);
     if (str) {
 
+    if (str->bld) {
+	_own_s(str, str->size + 1, err);
+	if (err->type != E_SUCCESS) { return; }
+    }
+
     if (str->buf_size != n) {
 	str->buf_size = n+1;
 	char* tmp = (char*)sc_malloc(str->buf_size, err);
@@ -794,7 +1053,7 @@ void _resize_s(String* str, size_t n, sc_error* err) {sc_reset_error(err);
 	if (err->type == E_SUCCESS) {
 	    strncpy(tmp, str->buf, n);
 	    tmp[n] = 0;
-	    sc_free(str->buf);
+	    if (str->buf != str->small) { sc_free(str->buf); }
 	    str->buf = tmp;
 	}
     }
@@ -838,6 +1097,8 @@ char* get_string(value* p_val, sc_error* err) {
     if (p_val->type != VT_STRING) {
 	sc_set_error(err, E_BADTYPE, "tried to fetch array from non string");
     } else {
+	_flatten_s(p_val->val.str, err);
+	if (err->type != E_SUCCESS) { return NULL; }
 	return p_val->val.str->buf;
     }
 
@@ -852,20 +1113,15 @@ char* get_string(value* p_val, sc_error* err) {
 value v_make_string(const char* p_val, sc_error* err) {sc_reset_error(err);
     value ret = {0};
     ret.type = VT_STRING;
-    //initialize the array
-    ret.val.str = (String*)sc_malloc(sizeof(String), err);
-    if (err && err->type != E_SUCCESS) {
-	ret.val.str = NULL;
+    //allocate exactly enough memory for the string, short strings are stored inline
+    size_t n = strlen(p_val);
+    ret.val.str = _alloc_String(n + 1, err);
+    if (ret.val.str == NULL) {
 	ret.type = VT_ERROR;
 	return ret;
     }
-    *(ret.val.str) = make_String(p_val, err);
-    if (err && err->type != E_SUCCESS) {
-	free(ret.val.str);
-	ret.val.str = NULL;
-	ret.type = VT_ERROR;
-    }
-
+    memcpy(ret.val.str->buf, p_val, n + 1);
+    ret.val.str->size = n;
     return ret;
 }
 
@@ -877,19 +1133,8 @@ value v_make_string_n(size_t n, sc_error* err) {sc_reset_error(err);
     //create the value and the string, check for errors
     value ret = {0};
     ret.type = VT_STRING;
-    ret.val.str = sc_malloc(sizeof(String), err);
-    if (err->type != E_SUCCESS) {
-	ret.val.str = NULL;
-	ret.type = VT_ERROR;
-	return ret;
-    }
-    *(ret.val.str) = make_String_n(n, err);
-    if (err && err->type != E_SUCCESS) {
-	free(ret.val.str);
-	ret.val.str = NULL;
-	ret.type = VT_ERROR;
-    }
-
+    ret.val.str = _alloc_String(n, err);
+    if (ret.val.str == NULL) { ret.type = VT_ERROR; }
     return ret;
 }
 
@@ -1017,6 +1262,8 @@ value v_make_bool(int p_val, sc_error* err) {sc_reset_error(err);
 int v_fetch_bool(value p_val, sc_error* err) {sc_reset_error(err);
     switch (p_val.type) {
 	case VT_STRING:
+	    _flatten_s(p_val.val.str, err);
+	    if (err->type != E_SUCCESS) { return 0; }
 	    if (strcmp(p_val.val.str->buf, "false") == 0 ||
 		strcmp(p_val.val.str->buf, "0") == 0) {
 		return 0;
@@ -1035,7 +1282,7 @@ int v_fetch_bool(value p_val, sc_error* err) {sc_reset_error(err);
 /**
  * Creates a new integer value with val p_val.
  */
-value v_make_int(int p_val, sc_error* err) {sc_reset_error(err);
+value v_make_int(sc_int p_val, sc_error* err) {sc_reset_error(err);
     value ret = {0};
     ret.type = VT_INT;
     if (err) { sc_reset_error(err); }
@@ -1046,16 +1293,19 @@ value v_make_int(int p_val, sc_error* err) {sc_reset_error(err);
 /**
  * Fetches the integer stored in p_val and performs casts if necessary.
  */
-int v_fetch_int(value p_val, sc_error* err) {sc_reset_error(err);
+sc_int v_fetch_int(value p_val, sc_error* err) {sc_reset_error(err);
     switch (p_val.type) {
 	case VT_STRING:
 	    if (p_val.val.str == NULL || p_val.val.str->buf == NULL) {
 		sc_set_error(err, E_BADVAL, "tried to fetch value of null string");
+		return 0;
 	    }
+	    _flatten_s(p_val.val.str, err);
+	    if (err->type != E_SUCCESS) { return 0; }
 	    return sc_atoi(p_val.val.str->buf, err);
 	case VT_BOOL: return p_val.val.i;
 	case VT_INT: return p_val.val.i;
-	case VT_FLOAT: return (int)(p_val.val.f);
+	case VT_FLOAT: return (sc_int)(p_val.val.f);
 	default: sc_set_error(err, E_UNDEF, ""); return 0;
     }
 }
@@ -1081,7 +1331,10 @@ double v_fetch_float(value p_val, sc_error* err) {sc_reset_error(err);
 	case VT_STRING:
 	  if (p_val.val.str == NULL || p_val.val.str->buf == NULL) {
 	      sc_set_error(err, E_BADVAL, "tried to fetch value of null string");
+	      return 0;
 	  }
+	  _flatten_s(p_val.val.str, err);
+	  if (err->type != E_SUCCESS) { return 0; }
 	  return sc_atof(p_val.val.str->buf, err);
 	case VT_INT: return (double)(p_val.val.i);
 	case VT_FLOAT: return p_val.val.f;
@@ -1139,51 +1392,232 @@ void release(Reference* r) {
     }
 }
 
-// ================================== MEMORY MANAGEMENT AND HASHING ==================================
+// ================================== INTERNED STRINGS ==================================
+
+#define ISTR_DEF_SIZE	64
+
+//the pool is an open addressing table of pointers to strings which are stored in istr_mem. The hash and length of each string are stored in an interned_header immediately before its characters.
+static arena istr_mem;
+static const char** istr_table = NULL;
+static size_t istr_size = 0;
+static size_t istr_n = 0;
 
 /**
- * Uses FNV-1a with the bias and prime defined previously to compute the hash of the specified key. This function is used internally by lookup(), insert_deep() and insert(). This hash is not cryptographically secure.
+ * FNV-1a over the first n characters of s. This matches hash() for strings of length n.
  */
-_uint32 hash(const char* key) {
+static inline _uint32 _istr_hash(const char* s, size_t n) {
     _uint32 ret = FNV_OFFSET_BIAS;
-    for (size_t i = 0; key[i] != 0 && i < MAX_KEY_SIZE; ++i) {
-	ret = ret ^ key[i];
+    for (size_t i = 0; i < n; ++i) {
+	ret = ret ^ (unsigned char)s[i];
 	ret *= FNV_PRIME;
     }
     return ret;
 }
 
+/**
+ * Find the index of the string s with length n and hash h in the pool. If s isn't present, the index of the empty entry where it should be placed is returned instead.
+ */
+static inline size_t _istr_probe(const char* s, size_t n, _uint32 h) {
+    size_t mask = istr_size - 1;
+    size_t ind = h & mask;
+    while (istr_table[ind]) {
+	const char* cur = istr_table[ind];
+	if (interned_hash(cur) == h && interned_len(cur) == n && memcmp(cur, s, n) == 0) { return ind; }
+	ind = (ind + 1) & mask;
+    }
+    return ind;
+}
+
+/**
+ * Double the size of the pool. Since every string stores its hash nothing needs to be rehashed.
+ */
+static void _istr_grow(sc_error* err) {
+    size_t new_size = (istr_size == 0)? ISTR_DEF_SIZE : 2*istr_size;
+    const char** tmp = (const char**)sc_malloc(sizeof(const char*)*new_size, err);
+    if (err->type != E_SUCCESS) { return; }
+    memset(tmp, 0, sizeof(const char*)*new_size);
+    for (size_t i = 0; i < istr_size; ++i) {
+	if (istr_table[i]) {
+	    size_t ind = interned_hash(istr_table[i]) & (new_size - 1);
+	    while (tmp[ind]) { ind = (ind + 1) & (new_size - 1); }
+	    tmp[ind] = istr_table[i];
+	}
+    }
+    sc_free(istr_table);
+    istr_table = tmp;
+    istr_size = new_size;
+}
+
+/**
+ * Identical to intern_str() except that the first n characters of s are used.
+ */
+const char* intern_str_n(const char* s, size_t n, sc_error* err) {
+    sc_reset_error(err);
+    if (n > (_uint32)(-1)) {
+	sc_set_error(err, E_BADVAL, "string is too long to intern");
+	return NULL;
+    }
+    //keep the load factor at most one half so that probe sequences stay short
+    if (2*(istr_n + 1) > istr_size) {
+	_istr_grow(err);
+	if (err->type != E_SUCCESS) { return NULL; }
+    }
+    _uint32 h = _istr_hash(s, n);
+    size_t ind = _istr_probe(s, n, h);
+    if (istr_table[ind]) { return istr_table[ind]; }
+
+    //this is a new string, so copy it into the pool behind its header
+    interned_header* head = (interned_header*)arena_alloc(&istr_mem, sizeof(interned_header) + n + 1, err);
+    if (head == NULL) { return NULL; }
+    head->hash = h;
+    head->len = (_uint32)n;
+    char* ret = (char*)(head + 1);
+    memcpy(ret, s, n);
+    ret[n] = 0;
+    istr_table[ind] = ret;
+    istr_n += 1;
+    return ret;
+}
+
+/**
+ * Returns the canonical copy of the string s from the global intern pool, adding it if it isn't already present. Equal strings always yield the same pointer and the returned memory is never freed until free_interned_strs() is called. The pool isn't thread safe.
+ * returns: the interned string or NULL in the event of an error
+ */
+const char* intern_str(const char* s, sc_error* err) {
+    return intern_str_n(s, strlen(s), err);
+}
+
+/**
+ * Find the canonical copy of the string s without adding it to the pool. If s has never been interned then NULL is returned.
+ */
+const char* find_interned(const char* s) {
+    if (istr_n == 0) { return NULL; }
+    //compute the length and hash in a single pass
+    size_t n;
+    _uint32 h = hash_l(s, &n);
+    return istr_table[_istr_probe(s, n, h)];
+}
+
+/**
+ * Returns the number of distinct strings in the intern pool.
+ */
+size_t n_interned_strs() {
+    return istr_n;
+}
+
+/**
+ * Returns the number of bytes of memory allocated for the intern pool.
+ */
+size_t interned_bytes() {
+    size_t ret = istr_size*sizeof(const char*);
+    for (arena_block* blk = istr_mem.head; blk; blk = blk->next) {
+	ret += sizeof(arena_block) + blk->size;
+    }
+    return ret;
+}
+
+/**
+ * Release every interned string. Any pointer previously returned by intern_str() is invalidated.
+ */
+void free_interned_strs() {
+    free_arena(&istr_mem);
+    sc_free(istr_table);
+    istr_table = NULL;
+    istr_size = 0;
+    istr_n = 0;
+}
+
+// ================================== MEMORY MANAGEMENT AND HASHING ==================================
+
+/**
+ * Uses FNV-1a with the bias and prime defined previously to compute the hash of every character of the specified key. This is the hash stored for interned strings and used by HashTable. This hash is not cryptographically secure.
+ */
+_uint32 hash(const char* key) {
+    return hash_l(key, NULL);
+}
+
 /**
  * This function is identical to hash(), but it also stores the length of the key string into keylen if keylen is not NULL.
  */
 _uint32 hash_l(const char* key, size_t* keylen) {
     _uint32 ret = FNV_OFFSET_BIAS;
     size_t i = 0;
-    for (; key[i] != 0 && i < MAX_KEY_SIZE; ++i) {
-	ret = ret ^ key[i];
+    for (; key[i] != 0; ++i) {
+	ret = ret ^ (unsigned char)key[i];
 	ret *= FNV_PRIME;
     }
     if (keylen) { *keylen = i; }
     return ret;
 }
 
+/**
+ * Allocate an empty table with n entries for h. n must be a power of two.
+ */
+static void _h_alloc(HashTable* h, size_t n, sc_error* err) {
+    h->table = (HashedItem*)sc_malloc(sizeof(HashedItem)*n, err);
+    if (err->type != E_SUCCESS) {
+	h->table = NULL;
+	h->table_size = 0;
+	return;
+    }
+    h->table_size = n;
+    //clear the contents of the table to indicate that entries are uninitialized
+    for (size_t i = 0; i < n; ++i) {
+	h->table[i].key = NULL;
+	h->table[i].val.type = VT_UNDEF;
+	h->table[i].slot = INONE;
+    }
+}
+
+/**
+ * Returns the distance of the entry at index ind of h with hash hsh from its home index.
+ */
+static inline size_t _h_dist(const HashTable* h, _uint32 hsh, size_t ind) {
+    return (ind - hsh) & (h->table_size - 1);
+}
+
+/**
+ * Write item into position dst of h and keep its slot (if any) pointing at it.
+ */
+static inline void _h_move(HashTable* h, HashedItem* dst, const HashedItem* item) {
+    *dst = *item;
+    if (dst->slot != INONE) { h->slots[dst->slot] = dst; }
+}
+
+/**
+ * Place item into the table of h, which must have at least one empty entry. Entries which are closer to their home index than the item being placed are displaced and placed further along in turn.
+ */
+static void _h_place(HashTable* h, HashedItem item) {
+    size_t mask = h->table_size - 1;
+    size_t ind = item.hash & mask;
+    size_t dist = 0;
+    while (h->table[ind].key != NULL) {
+	size_t cur_dist = _h_dist(h, h->table[ind].hash, ind);
+	if (cur_dist < dist) {
+	    //take from the rich and give to the poor
+	    HashedItem tmp = h->table[ind];
+	    _h_move(h, h->table + ind, &item);
+	    item = tmp;
+	    dist = cur_dist;
+	}
+	ind = (ind + 1) & mask;
+	++dist;
+    }
+    _h_move(h, h->table + ind, &item);
+}
+
 /**
  * Creates a new HashTable and sets appropriate values. You can remove it when you are done using free_HashTable.
  */
 HashTable make_HashTable(sc_error* err) {sc_reset_error(err);
     //make the hash table
     HashTable ret = {0};
-    ret.table_size = DEF_TABLE_SIZE;
     ret.n_els = 0;
-    //allocate memory for the table
-    ret.table = (HashedItem*)sc_malloc(sizeof(HashedItem)*ret.table_size, err);
-    if (err->type != E_SUCCESS) { ret.table = NULL; }
-
-    //clear the contents of the table to indicate that entries are uninitialized
-    for (size_t i = 0; i < ret.table_size; ++i) {
-	ret.table[i].key = NULL;
-	ret.table[i].val.type = VT_UNDEF;
-    }
+    ret.max_load = GROW_THRESH;
+    _h_alloc(&ret, DEF_TABLE_SIZE, err);
+    ret.n_slots = 0;
+    ret.slots_cap = 0;
+    ret.slots = NULL;
 
     return ret;
 }
@@ -1194,20 +1628,24 @@ HashTable make_HashTable(sc_error* err) {sc_reset_error(err);
 void free_HashTable(HashTable* h) {
     if (h) {
 	if (h->table) {
-	    //free memory allocated for keys then free the table
+	    //free memory allocated for values then free the table
 	    for (size_t i = 0; i < h->table_size; ++i) {
+		//keys are interned so only the values are freed
 		if (h->table[i].key) {
 		    free_value( &(h->table[i].val) );
-		    sc_free(h->table[i].key);
 		}
 	    }
 	    free(h->table);
 	}
+	sc_free(h->slots);
 
 	//make the contents of the table invalid
 	h->table = NULL;
 	h->table_size = 0;
 	h->n_els = 0;
+	h->slots = NULL;
+	h->n_slots = 0;
+	h->slots_cap = 0;
     }
 }
 
@@ -1218,20 +1656,25 @@ void free_HashTable(HashTable* h) {
  * returns: a pointer to the associated value or NULL if the specified value wasn't found. The user should not attempt to free this value.
  */
 HashedItem* lookup(HashTable* h, const char* key) {
-    _uint32 ind = hash(key) % (h->table_size);
-    //search through the table until we find a match
-    /*while (strcmp(key, h->table[ind].key) != 0) {
-	if (h->table[ind].key == NULL) { return NULL; }
-	++ind;
-	if (ind == h->table_size) { ind = 0; }
-    }*/
-    while (h->table[ind].key != NULL) {
-	if (strcmp(key, h->table[ind].key) == 0) {
+    //every key in the table is interned, so a string which was never interned can't be present
+    const char* ikey = find_interned(key);
+    if (ikey == NULL) { return NULL; }
+    return lookup_interned(h, ikey);
+}
+
+/**
+ * Identical to lookup() except that key must be interned (see intern_str()). The stored hash of key is used and entries are compared by pointer so no characters are read.
+ */
+HashedItem* lookup_interned(HashTable* h, const char* key) {
+    size_t mask = h->table_size - 1;
+    _uint32 hsh = interned_hash(key);
+    size_t ind = hsh & mask;
+    //once we reach an entry closer to its home than key would be, key can't be further along
+    for (size_t dist = 0; h->table[ind].key != NULL && _h_dist(h, h->table[ind].hash, ind) >= dist; ++dist) {
+	if (h->table[ind].key == key) {
 	    return h->table + ind;
 	}
-	//increment and wrap around
-	++ind;
-	if (ind == h->table_size) {ind = 0; }
+	ind = (ind + 1) & mask;
     }
     return NULL;
 }
@@ -1240,63 +1683,86 @@ HashedItem* lookup(HashTable* h, const char* key) {
  * Expands the HashTable pointed to by h to accomodate the insertion of an additional element
  */
 void h_grow(HashTable* h, sc_error* err) {
-    size_t new_size = h->table_size*2;
-    HashedItem* tmp = (HashedItem*)sc_malloc(sizeof(HashedItem)*new_size, err);
-    //to safely check for unallocated elements we need to make sure the new table contains empty keys
-    for (size_t i = 0; i < new_size; ++i) { tmp[i].key = NULL; }
-
-    //shallow copy data from the old table to the new
-    for (size_t i = 0; i < h->table_size; ++i) {
-	//we only need to copy entries with contents
-	if (h->table[i].key != NULL) {
-	    //since we use modulo table_size we need to recalculate the index of each element
-	    _uint32 new_ind = hash(h->table[i].key) % new_size;
-	    while (tmp[new_ind].key != NULL) {
-		++new_ind;
-		if (new_ind == new_size) { new_ind = 0; }
-	    }
-	    //move the contents from the old table to the new
-	    tmp[new_ind] = h->table[i];
-	}
+    HashedItem* old = h->table;
+    size_t old_size = h->table_size;
+    _h_alloc(h, 2*old_size, err);
+    if (err->type != E_SUCCESS) {
+	h->table = old;
+	h->table_size = old_size;
+	return;
+    }
+    //the hash of each entry is cached so we only need to recompute indices
+    for (size_t i = 0; i < old_size; ++i) {
+	if (old[i].key != NULL) { _h_place(h, old[i]); }
     }
-    //deallocate the old and replace it with the new
-    sc_free(h->table);
-    h->table_size = new_size;
-    h->table = tmp;
+    sc_free(old);
 }
 
 /**
- * Insert a new item into the hash table with the specified key and value. Note that a shallow copy of the contents of val are performed. In order to produce a deep copy use insert_deep instead.
- * param h: the hash table to look through
- * param key: the key of the entry to create
- * param val: the value to be inserted
+ * Set the largest allowed load factor n_els/table_size of h, growing the table if it is already exceeded. Higher load factors use less memory at the cost of longer probes. max_load must be between 0 and 1 exclusive.
  */
-void insert(HashTable* h, const char* key, value p_val, sc_error* err) {
-    //make sure we have enough room to insert the new element
-    if (h->n_els >= GROW_THRESH*(h->table_size)) {
-	h_grow(h, err);
+void h_set_max_load(HashTable* h, double max_load, sc_error* err) {
+    sc_reset_error(err);
+    if (max_load <= 0.0 || max_load >= 1.0) {
+	sc_set_error(err, E_BADVAL, "maximum load factor must be between 0 and 1");
+	return;
     }
+    h->max_load = max_load;
+    while (h->n_els > max_load*(h->table_size) && err->type == E_SUCCESS) { h_grow(h, err); }
+}
 
-    //figure out the length of the key and the hash
-    size_t key_len;
-    _uint32 ind = hash_l(key, &key_len) % (h->table_size);
+/**
+ * Interns the item (which must be stored in h) into the slot table of h so that it may be accessed in constant time through h->slots. Interning the same item more than once returns the same slot.
+ * param h: the hash table which stores item
+ * param item: the item to intern, this is typically found with a call to lookup()
+ * returns: the index of the slot which points to item
+ */
+size_t h_intern_slot(HashTable* h, HashedItem* item, sc_error* err) {
+    if (item->slot != INONE) { return item->slot; }
+    //grow the slot table if necessary
+    if (h->n_slots == h->slots_cap) {
+	size_t new_cap = (h->slots_cap == 0)? DEF_TABLE_SIZE : 2*(h->slots_cap);
+	HashedItem** tmp = (HashedItem**)sc_realloc(h->slots, sizeof(HashedItem*)*new_cap, err);
+	if (err->type != E_SUCCESS) { return INONE; }
+	h->slots = tmp;
+	h->slots_cap = new_cap;
+    }
+    h->slots[h->n_slots] = item;
+    item->slot = h->n_slots;
+    return h->n_slots++;
+}
 
-    //search through the table until we find a match
-    while (h->table[ind].key != NULL) {
-	++ind;
-	if (ind == h->table_size) { ind = 0; }
+/**
+ * Helper function for insert() and insert_deep() which adds an entry with the key key and the value p_val to h.
+ */
+static void _h_insert(HashTable* h, const char* key, value p_val, sc_error* err) {
+    //make sure we have enough room to insert the new element
+    while (h->n_els + 1 > h->max_load*(h->table_size)) {
+	h_grow(h, err);
+	if (err->type != E_SUCCESS) { return; }
     }
 
-    //allocate memory for the key and copy contents
-    h->table[ind].key = (char*)sc_malloc(sizeof(char)*(key_len+1), err);
-    strncpy(h->table[ind].key, key, key_len+1);
-    h->table[ind].key[key_len] = 0;
-    //copy the value
-    h->table[ind].val = p_val;
-    //h->table[ind].ind = h->n_els;
+    //the table only stores the canonical copy of each key
+    HashedItem item;
+    item.key = intern_str(key, err);
+    if (err->type != E_SUCCESS) { return; }
+    item.hash = interned_hash(item.key);
+    item.val = p_val;
+    item.slot = INONE;
+    _h_place(h, item);
     h->n_els += 1;
 }
 
+/**
+ * Insert a new item into the hash table with the specified key and value. Note that a shallow copy of the contents of val are performed. In order to produce a deep copy use insert_deep instead.
+ * param h: the hash table to look through
+ * param key: the key of the entry to create
+ * param val: the value to be inserted
+ */
+void insert(HashTable* h, const char* key, value p_val, sc_error* err) {
+    _h_insert(h, key, p_val, err);
+}
+
 /**
  * Insert a new item into the hash table with the specified key and value. Note that a deep copy of the contents of val are performed if the value is of a non primitive type. This may be slower than using insert() so using a call to that function may be prudent.
  * param h: the hash table to look through
@@ -1304,44 +1770,154 @@ void insert(HashTable* h, const char* key, value p_val, sc_error* err) {
  * param val: the value to be inserted
  */
 void insert_deep(HashTable* h, const char* key, value p_val, sc_error* err) {
-    //make sure we have enough room to insert the new element
-    if (h->n_els >= GROW_THRESH*(h->table_size)) {
-	h_grow(h, err);
+    sc_reset_error(err);
+    value cpy = v_deep_copy(p_val, err);
+    if (err->type != E_SUCCESS) { return; }
+    _h_insert(h, key, cpy, err);
+    if (err->type != E_SUCCESS) { free_value(&cpy); }
+}
+
+/**
+ * Remove the entry with the specified key from the hash table and free its value. If the entry was interned by h_intern_slot() then its slot is set to NULL.
+ * returns: 1 if an entry was removed or 0 if there was no entry with the key
+ */
+int h_remove(HashTable* h, const char* key) {
+    HashedItem* item = lookup(h, key);
+    if (item == NULL) { return 0; }
+    free_value( &(item->val) );
+    if (item->slot != INONE) { h->slots[item->slot] = NULL; }
+
+    //shift every following entry which isn't at its home index back by one. This keeps probe sequences unbroken without tombstones.
+    size_t mask = h->table_size - 1;
+    size_t ind = item - h->table;
+    size_t next = (ind + 1) & mask;
+    while (h->table[next].key != NULL && _h_dist(h, h->table[next].hash, next) > 0) {
+	_h_move(h, h->table + ind, h->table + next);
+	ind = next;
+	next = (next + 1) & mask;
     }
+    h->table[ind].key = NULL;
+    h->table[ind].val.type = VT_UNDEF;
+    h->table[ind].slot = INONE;
+    h->n_els -= 1;
+    return 1;
+}
 
-    //figure out the length of the key and the hash
-    size_t key_len;
-    _uint32 ind = hash_l(key, &key_len) % (h->table_size);
+// ================================== STACK ==================================
 
-    //search through the table until we find a match
-    while (h->table[ind].key != NULL) {
-	++ind;
-	if (ind == h->table_size) { ind = 0; }
+/**
+ * Helper function which rounds n bytes up to the granularity that stacks are committed in.
+ */
+static size_t _st_round(size_t n) {
+#ifdef SC_STACK_MMAP
+    static size_t page = 0;
+    if (page == 0) { page = (size_t)sysconf(_SC_PAGESIZE); }
+    return (n + page - 1) / page * page;
+#else
+    return n;
+#endif
+}
+
+/**
+ * Helper function which returns the maximum number of entries for a stack created with an initial capacity of cap and a requested maximum of max, see make_Stack_n().
+ */
+static size_t _st_def_max(size_t cap, size_t max) {
+    if (max > 0) { return max; }
+    return (cap > ST_DEF_MAX)? cap : ST_DEF_MAX;
+}
+
+/**
+ * Helper function which allocates the memory for a stack holding at least *cap_bytes and at most *max_bytes bytes. Both sizes are rounded up and the actual values are saved.
+ * returns: a pointer to the end of the allocated block (i.e. the bottom of the stack) or NULL on failure
+ */
+static char* _st_reserve(size_t* cap_bytes, size_t* max_bytes, sc_error* err) {
+    *max_bytes = _st_round(*max_bytes);
+    *cap_bytes = _st_round((*cap_bytes > 0)? *cap_bytes : 1);
+    if (*cap_bytes > *max_bytes) { *cap_bytes = *max_bytes; }
+#ifdef SC_STACK_MMAP
+    //only address space is reserved for the full stack, pages are made accessible as they are needed
+    char* map = (char*)mmap(NULL, *max_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == (char*)MAP_FAILED) {
+	sc_set_error(err, E_NOMEM, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "couldn't reserve %lu bytes for stack", *max_bytes);
+	return NULL;
     }
+    char* bottom = map + *max_bytes;
+    if (mprotect(bottom - *cap_bytes, *cap_bytes, PROT_READ | PROT_WRITE) != 0) {
+	munmap(map, *max_bytes);
+	sc_set_error(err, E_NOMEM, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "couldn't commit %lu bytes for stack", *cap_bytes);
+	return NULL;
+    }
+    sc_reset_error(err);
+    return bottom;
+#else
+    char* block = (char*)sc_malloc(*cap_bytes, err);
+    if (err->type != E_SUCCESS) { return NULL; }
+    return block + *cap_bytes;
+#endif
+}
 
-    //allocate memory for the key and copy contents
-    h->table[ind].key = (char*)sc_malloc(sizeof(char)*(key_len+1), err);
-    strncpy(h->table[ind].key, key, key_len+1);
-    h->table[ind].key[key_len] = 0;
-    //copy the value
-    h->table[ind].val = v_deep_copy(p_val, err);
-    //h->table[ind].ind = h->n_els;
-    h->n_els += 1;
+/**
+ * Helper function which doubles the size of the stack ending at bottom which currently holds *cap_bytes, up to a total of max_bytes. The new size is saved to cap_bytes.
+ * returns: the new bottom of the stack or NULL on failure. If SC_STACK_MMAP is defined then the bottom never changes.
+ */
+static char* _st_grow(char* bottom, size_t* cap_bytes, size_t max_bytes, sc_error* err) {
+    //sizes are passed as a whole number of entries which may not fill the last page
+    max_bytes = _st_round(max_bytes);
+    if (_st_round(*cap_bytes) >= max_bytes) {
+	sc_set_error(err, E_STACK_OVERFLOW, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "stack exceeded its maximum size of %lu bytes", max_bytes);
+	return NULL;
+    }
+    size_t new_bytes = (*cap_bytes > max_bytes/2)? max_bytes : _st_round(2*(*cap_bytes));
+#ifdef SC_STACK_MMAP
+    //commit the pages directly beneath the current block, existing entries are left untouched
+    if (mprotect(bottom - new_bytes, new_bytes - _st_round(*cap_bytes), PROT_READ | PROT_WRITE) != 0) {
+	sc_set_error(err, E_NOMEM, "");
+	snprintf(err->msg, DTG_MAX_MSG_SIZE, "couldn't commit %lu bytes for stack", new_bytes);
+	return NULL;
+    }
+#else
+    char* new_buf = (char*)sc_malloc(new_bytes, err);
+    if (err->type != E_SUCCESS) { return NULL; }
+    //the bottom of the stack is the end of the block so entries are copied to the end of the new block
+    memcpy(new_buf + new_bytes - *cap_bytes, bottom - *cap_bytes, *cap_bytes);
+    sc_free(bottom - *cap_bytes);
+    bottom = new_buf + new_bytes;
+#endif
+    *cap_bytes = new_bytes;
+    return bottom;
 }
 
-// ================================== STACK ==================================
+/**
+ * Helper function which releases the memory for a stack allocated by _st_reserve().
+ */
+static void _st_release(char* bottom, size_t cap_bytes, size_t max_bytes) {
+    if (bottom == NULL) { return; }
+#ifdef SC_STACK_MMAP
+    (void)cap_bytes;
+    max_bytes = _st_round(max_bytes);
+    munmap(bottom - max_bytes, max_bytes);
+#else
+    (void)max_bytes;
+    sc_free(bottom - cap_bytes);
+#endif
+}
 
 Stack make_Stack(sc_error* err) {
+    return make_Stack_n(DEF_STACK_SIZE, 0, err);
+}
+
+Stack make_Stack_n(size_t cap, size_t max, sc_error* err) {
     Stack ret = {0};
-    ret.block = (value*)sc_malloc(sizeof(value)*DEF_STACK_SIZE, err);
-    if (err->type != E_SUCCESS) {
-	ret.bottom = NULL;
-	ret.top = NULL;
-	ret.block = NULL;
-	return ret;
-    }
-    ret.cap = DEF_STACK_SIZE;
-    ret.bottom = ret.block + ret.cap;
+    size_t cap_bytes = sizeof(value)*cap;
+    size_t max_bytes = sizeof(value)*_st_def_max(cap, max);
+    ret.bottom = (value*)_st_reserve(&cap_bytes, &max_bytes, err);
+    if (ret.bottom == NULL) { return ret; }
+    ret.cap = cap_bytes / sizeof(value);
+    ret.max = max_bytes / sizeof(value);
+    ret.block = ret.bottom - ret.cap;
     ret.top = ret.bottom;
     return ret;
 }
@@ -1351,74 +1927,50 @@ void free_Stack(Stack* st) {
 	for (value* v = st->top; v != st->bottom; v += 1) {
 	    free_value(v);
 	}
-	free(st->block);
+	_st_release((char*)(st->bottom), sizeof(value)*(st->cap), sizeof(value)*(st->max));
 	st->cap = 0;
+	st->max = 0;
 	st->bottom = NULL;
 	st->top = NULL;
 	st->block = NULL;
     }
 }
 
+/**
+ * Helper function which makes room for at least one more entry on the full stack st. Entries are only moved if SC_STACK_MMAP is not defined.
+ * returns: 0 on success or -1 on failure
+ */
+static int _st_grow_Stack(Stack* st, sc_error* err) {
+    size_t n = get_size(*st);
+    size_t cap_bytes = sizeof(value)*(st->cap);
+    char* bottom = _st_grow((char*)(st->bottom), &cap_bytes, sizeof(value)*(st->max), err);
+    if (bottom == NULL) { return -1; }
+    st->bottom = (value*)bottom;
+    st->cap = cap_bytes / sizeof(value);
+    st->block = st->bottom - st->cap;
+    st->top = st->bottom - n;
+    return 0;
+}
+
 /**
  * Pushes the value p_val onto the stack pointed to by st. Note that this function performs a deep copy of p_val unless p_val is of the type reference. In which case the address of the value pointed to by the top stack entry will be the same as p_val before assignment.
  */
 void push(Stack* st, value p_val, sc_error* err) {
-    //reallocate memory if necessary
-    if (st->top <= st->block) {
-	//allocate new block with twice the size
-	size_t tmp_size = (st->cap)*2;
-	value* new_buf = (value*)sc_malloc(sizeof(value)*tmp_size, err);
-	value* old_block = st->block;
-
-	if (err->type == E_SUCCESS) {
-	    //perform a shallow copy of entries from the old to the new stacks
-	    for (size_t i = 0; i < st->cap; ++i) {
-		new_buf[i + st->cap] = st->block[i];
-	    }
-	    //assign the new pointers
-	    st->block = new_buf;
-	    st->top = st->block + st->cap;
-	    st->bottom = st->block + tmp_size;
-	    st->cap = tmp_size;
-	} else {
-	    sc_set_error(err, E_STACK_OVERFLOW, "");
-	}
-	free(old_block);
-    }
-    //only proceed if there were no errors
-    if (err->type == E_SUCCESS) {
-	st->top -= 1;
-	*(st->top) = p_val;
-    }
+    //grow the stack if necessary
+    if (st->top <= st->block && _st_grow_Stack(st, err) < 0) { return; }
+    st->top -= 1;
+    *(st->top) = p_val;
 }
 
 /**
  * Pushes an uninitialized value of type t onto the stack pointed to by st. Note that this function performs a deep copy of p_val unless p_val is of the type reference. In which case the address of the value pointed to by the top stack entry will be the same as p_val before assignment.
  */
 void push_uninit(Stack* st, Valtype_e t, sc_error* err) {
-    //reallocate memory if necessary
-    if (st->top <= st->block) {
-	size_t tmp_size = (st->cap)*2;
-	value* new_buf = (value*)sc_malloc(sizeof(value)*tmp_size, err);
-	if (err->type == E_SUCCESS) {
-	    for (size_t i = 0; i < st->cap; ++i) {
-		new_buf[i + st->cap] = st->block[i];
-	    }
-	    st->block = new_buf;
-	    st->top = st->block + st->cap;
-	    st->bottom = st->block + tmp_size;
-	    st->cap = tmp_size;
-	} else {
-	    sc_set_error(err, E_STACK_OVERFLOW, "");
-	}
-	free(st->block);
-    }
-    //only proceed if there were no errors
-    if (err->type == E_SUCCESS) {
-	st->top -= 1;
-	st->top->type = t;
-	st->top->val.i = 0;
-    }
+    //grow the stack if necessary
+    if (st->top <= st->block && _st_grow_Stack(st, err) < 0) { return; }
+    st->top -= 1;
+    st->top->type = t;
+    st->top->val.i = 0;
 }
 
 /**
@@ -1427,7 +1979,7 @@ void push_uninit(Stack* st, Valtype_e t, sc_error* err) {
 value pop(Stack* st, sc_error* err) {
     value ret = {0};
     if (st) {
-	if (st->top > st->bottom) {
+	if (st->top >= st->bottom) {
 	    sc_set_error(err, E_STACK_UNDERFLOW, "tried to pop from empty stack");
 	    return ret;
 	}
@@ -1461,16 +2013,21 @@ size_t get_size(Stack st) {
  * Creates a new (empty) stack. The returned Stack has a pointer to the invalid index -1 and a call to push() must be made before any calls to pop()
  */
 NamedStack make_NamedStack(sc_error* err) {
+    return make_NamedStack_n(DEF_STACK_SIZE, 0, err);
+}
+
+/**
+ * Creates a new (empty) stack with room for at least cap entries before it needs to grow, see make_Stack_n().
+ */
+NamedStack make_NamedStack_n(size_t cap, size_t max, sc_error* err) {
     NamedStack ret = {0};
-    ret.block = (HashedItem*)sc_malloc(sizeof(HashedItem)*DEF_STACK_SIZE, err);
-    if (err->type != E_SUCCESS) {
-	ret.bottom = NULL;
-	ret.top = NULL;
-	ret.block = NULL;
-	return ret;
-    }
-    ret.cap = DEF_STACK_SIZE;
-    ret.bottom = ret.block + ret.cap;
+    size_t cap_bytes = sizeof(HashedItem)*cap;
+    size_t max_bytes = sizeof(HashedItem)*_st_def_max(cap, max);
+    ret.bottom = (HashedItem*)_st_reserve(&cap_bytes, &max_bytes, err);
+    if (ret.bottom == NULL) { return ret; }
+    ret.cap = cap_bytes / sizeof(HashedItem);
+    ret.max = max_bytes / sizeof(HashedItem);
+    ret.block = ret.bottom - ret.cap;
     ret.top = ret.bottom;
     return ret;
 }
@@ -1483,8 +2040,9 @@ void free_NamedStack(NamedStack* st) {
 	for (HashedItem* v = st->top; v != st->bottom; v += 1) {
 	    free_value( &(v->val) );
 	}
-	free(st->block);
+	_st_release((char*)(st->bottom), sizeof(HashedItem)*(st->cap), sizeof(HashedItem)*(st->max));
 	st->cap = 0;
+	st->max = 0;
 	st->bottom = NULL;
 	st->top = NULL;
 	st->block = NULL;
@@ -1494,31 +2052,25 @@ void free_NamedStack(NamedStack* st) {
 /**
  * Pushes the value p_val onto the stack pointed to by st. Note that this function performs a deep copy of p_val unless p_val is of the type reference. In which case the address of the value pointed to by the top stack entry will be the same as p_val before assignment.
  */
-void push_n(NamedStack* st, char* name, value v, sc_error* err) {
-    //reallocate memory if necessary
+void push_n(NamedStack* st, const char* name, value v, sc_error* err) {
+    //grow the stack if necessary, see _st_grow_Stack()
     if (st->top <= st->block) {
-	//allocate new block with twice the size
-	size_t tmp_size = (st->cap)*2;
-	HashedItem* new_buf = (HashedItem*)sc_malloc(sizeof(HashedItem)*tmp_size, err);
-	HashedItem* old_block = st->block;
-
-	if (err->type == E_SUCCESS) {
-	    //perform a shallow copy of entries from the old to the new stacks
-	    for (size_t i = 0; i < st->cap; ++i) {
-		new_buf[i + st->cap] = st->block[i];
-	    }
-	    //assign the new pointers
-	    st->block = new_buf;
-	    st->top = st->block + st->cap;
-	    st->bottom = st->block + tmp_size;
-	    st->cap = tmp_size;
-	}
-	free(old_block);
-    }
+	size_t n = get_size_n(*st);
+	size_t cap_bytes = sizeof(HashedItem)*(st->cap);
+	char* bottom = _st_grow((char*)(st->bottom), &cap_bytes, sizeof(HashedItem)*(st->max), err);
+	if (bottom == NULL) { return; }
+	st->bottom = (HashedItem*)bottom;
+	st->cap = cap_bytes / sizeof(HashedItem);
+	st->block = st->bottom - st->cap;
+	st->top = st->bottom - n;
+    }
+    //names are interned so that they may be compared by pointer
+    const char* key = NULL;
+    if (name && err->type == E_SUCCESS) { key = intern_str(name, err); }
     //only proceed if there were no errors
     if (err->type == E_SUCCESS) {
 	st->top -= 1;
-	st->top->key = name;
+	st->top->key = key;
 	st->top->val = v;
     }
 }
@@ -1529,7 +2081,7 @@ void push_n(NamedStack* st, char* name, value v, sc_error* err) {
 HashedItem pop_n(NamedStack* st, sc_error* err) {
     HashedItem ret = {0};
     if (st) {
-	if (st->top > st->bottom) {
+	if (st->top >= st->bottom) {
 	    sc_set_error(err, E_STACK_UNDERFLOW, "tried to pop from empty stack");
 	    return ret;
 	}
@@ -1553,9 +2105,9 @@ int is_empty_n(NamedStack* st) {
 /**
  * Access the key of the stack element at index ind. If ind is out of bounds, NULL is returned.
  */
-char* read_key(NamedStack* st, size_t ind) {
+const char* read_key(NamedStack* st, size_t ind) {
     if (st) {
-	if (st->top + ind <= st->bottom) {
+	if (st->top + ind < st->bottom) {
 	    return st->top[ind].key;
 	} else {
 	    return NULL;
@@ -1568,7 +2120,7 @@ char* read_key(NamedStack* st, size_t ind) {
  */
 value read_value(NamedStack* st, size_t ind) {
     if (st) {
-	if (st->top + ind <= st->bottom) {
+	if (st->top + ind < st->bottom) {
 	    return st->top[ind].val;
 	} else {
 	    value ret = {0};
@@ -1602,6 +2154,12 @@ context make_context(sc_error* err) {
 	//ret.global = {0};
 	return ret;
     }
+    ret.scope = make_HashTable(err);
+    if (err->type != E_SUCCESS) {
+	free_NamedStack(&(ret.callstack));
+	free_HashTable(&(ret.global));
+	return ret;
+    }
     return ret;
 }
 
@@ -1612,29 +2170,38 @@ void free_context(context* c) {
     if (c) {
 	free_NamedStack( &(c->callstack) );
 	free_HashTable( &(c->global) );
+	free_HashTable( &(c->scope) );
+	free_arena( &(c->scratch) );
+	if (c->exec_stack.bottom) { free_Stack( &(c->exec_stack) ); }
 	/*c->callstack = {0};
 	c->global = {0};*/
     }
 }
 
 /**
- * Search for the value with the name name. The hashtable is searched first and if the value is found there, then -1 is returned. In the event that the entry is not found in the table, the stack is searched. If the entry with the matching name is found, then the index (relative to th bottom of the stack) is stored into off. If the entry is not found, -2 is returned.
+ * Search for the value with the name name. The hashtable is searched first and if the value is found there, then -1 is returned. In the event that the entry is not found in the table, the innermost binding in the scope table is used. Only values bound with bind_top() are visible. If the entry with the matching name is found, then its index (relative to the top of the stack) is returned. If the entry is not found, -2 is returned.
  */
 int search_val(context* c, const char* name, HashedItem** val) {
+    //every declared name is interned, so only a single pass over the characters of name is needed for both tables
+    const char* iname = find_interned(name);
+    if (iname == NULL) {
+	if (val) { *val = NULL; }
+	return -2;
+    }
     //lookup the name in the hashtable
-    HashedItem* tmp = lookup(&(c->global), name);
+    HashedItem* tmp = lookup_interned(&(c->global), iname);
 
     if (!tmp) {
 	//try looking up the value from the callstack
-	HashedItem* curr = c->callstack.top;
-	size_t i = 0;
-	for (; curr < c->callstack.bottom; ++curr) {
-	    if (strcmp(curr->key, name) == 0) {
-		//store the resulting hashed value
-		if (val) { *val = curr; }
-		return i;
+	HashedItem* sym = lookup_interned(&(c->scope), iname);
+	size_t size = get_size_n(c->callstack);
+	if (sym && sym->val.val.i >= 0 && (size_t)(sym->val.val.i) < size) {
+	    size_t ind = size - 1 - (size_t)(sym->val.val.i);
+	    //a value popped without unbind_top() leaves a stale binding, so make sure the entry at that depth is still the one that was bound
+	    if (c->callstack.top[ind].key == iname) {
+		if (val) { *val = c->callstack.top + ind; }
+		return ind;
 	    }
-	    ++i;
 	}
 	if (val) { *val = NULL; }
 	return -2;
@@ -1645,6 +2212,36 @@ int search_val(context* c, const char* name, HashedItem** val) {
     return -1;
 }
 
+/**
+ * Bind the name of the value on top of the callstack of c so that it may be found by search_val(). Any value lower on the stack with the same name is shadowed until unbind_top() is called.
+ */
+void bind_top(context* c, sc_error* err) {
+    HashedItem* top = c->callstack.top;
+    if (top >= c->callstack.bottom || top->key == NULL) { return; }
+    int depth = (int)get_size_n(c->callstack) - 1;
+    HashedItem* sym = lookup_interned(&(c->scope), top->key);
+    if (sym) {
+	top->slot = (size_t)(sym->val.val.i);
+	sym->val.val.i = depth;
+    } else {
+	top->slot = (size_t)(-1);
+	insert(&(c->scope), top->key, v_make_int(depth, err), err);
+    }
+}
+
+/**
+ * Remove the binding for the value on top of the callstack of c, restoring the binding it shadowed (if any). This should be called before popping a named value.
+ */
+void unbind_top(context* c) {
+    HashedItem* top = c->callstack.top;
+    if (top >= c->callstack.bottom || top->key == NULL) { return; }
+    HashedItem* sym = lookup_interned(&(c->scope), top->key);
+    //only the innermost binding may be removed
+    if (sym && sym->val.val.i == (int)get_size_n(c->callstack) - 1) {
+	sym->val.val.i = (int)(top->slot);
+    }
+}
+
 /**
  * Add a value to the context c with the name name
  */
@@ -44,6 +44,7 @@ extern "C" {
 #define SZ_FLT	8
 
 #define DEFAULT_STRING_SIZE	32
+#define STRING_SMALL_SIZE	24//strings with at most this many bytes (including the null terminator) are stored inline, see _alloc_String()
 #define DEF_ARR_N		4
 #define STRING_GROW_SIZE 	4
 
@@ -54,14 +55,23 @@ extern "C" {
 
 //constants used for hash tables
 #define DEF_TABLE_SIZE		4
-#define GROW_THRESH		0.6//specify the threshold of n_els/capacity above which growth is required
-#define MAX_KEY_SIZE		32
+#define GROW_THRESH		0.8//the default maximum load factor of hash tables, see h_set_max_load()
 #define FNV_OFFSET_BIAS		0x53c27916
 #define FNV_PRIME		0x811c9dc5 
 
 //constants used for program stacks
 #define DEF_STACK_SIZE		4
-#define ST_GROW_THRESH		0.6//specify the threshold of n_els/capacity above which growth is required
+#ifndef ST_MAX_SIZE
+#define ST_MAX_SIZE		(1ul << 24)//the maximum number of entries in the execution stack, see _ex_begin()
+#endif
+#ifndef ST_DEF_MAX
+#define ST_DEF_MAX		(1ul << 16)//the default maximum number of entries in any other stack, see make_Stack_n()
+#endif
+
+//POSIX systems reserve the address space for the largest allowed stack up front and commit pages as the stack grows so that existing entries never move. Define SC_NO_MMAP to grow stacks by copying them into a larger block instead.
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(SC_NO_MMAP)
+#define SC_STACK_MMAP
+#endif
 
 extern int errno;
 
@@ -74,32 +84,50 @@ typedef char Valtype_e;
 //typedef enum {INS_ASSN, INS_MATH, INS_BRANCH, VT_INT, VT_FLOAT, VT_STRING, VT_ARRAY, VT_FUNC, VT_VALUE} Instruction;
 
 /**
- * The PrimArray struct is an alternative implementation of the Array which is theoretically faster than Array.
+ * The PrimArray struct is an alternative implementation of the Array which stores elements of a single primitive type (char, bool, int or float) unboxed and contiguously. PrimArray shares its layout with Array so that VT_ARRAY values may point to either. The two are distinguished by element_type which is VT_UNDEF for an Array of boxed values.
+ * element_type: the type of every element
  * el_size: the size of each element
  * buf_size: the size of the allocated buffer in the number of elements. The total number of bytes allocated for the buffer is el_size*buf_size
  * size: the size of the array that has been written to with valid contents
  */
 typedef struct PrimArray {
     Valtype_e element_type;
+    size_t el_size;
     size_t buf_size;
     size_t size;
     void* buf;
-    size_t el_size;
 } PrimArray;
 
+/**
+ * Storage shared by strings which were built by repeatedly appending to the same string, see _concat_s(). Each String using the builder holds a prefix of data. Only the string whose size equals used (the most recently appended one) may append to the builder without copying, so the contents of every other string are never changed.
+ * n_refs: the number of Strings using the builder. The builder is freed when this reaches zero.
+ * used: the number of bytes of data which belong to some String. data[used] is always a null terminator.
+ * cap: the number of bytes allocated for data
+ */
+typedef struct s_StringBuilder {
+    size_t n_refs;
+    size_t used;
+    size_t cap;
+    char* data;
+} StringBuilder;
+
 /**
  * The String struct is similar to Array, but specifically for holding a buffer of chars.
  * buf_size: the size of the allocated buffer in the number of elements. The total number of bytes allocated for the buffer is el_size*buf_size
  * size: the size of the array that has been written to with valid contents
+ * bld: if this is not NULL then buf is the data of a builder shared with other strings and buf[size] is only guaranteed to be a null terminator if size == bld->used. Use _flatten_s() before treating buf as a C string and note that _grow_s() copies the contents into a buffer owned by the string.
+ * small: inline storage for short strings. If buf points to small then there is no separate allocation for the buffer, see _alloc_String(). Such strings must not be copied by value.
  */
 typedef struct String {
     size_t buf_size;
     size_t size;
     char* buf;
+    StringBuilder* bld;
+    char small[STRING_SMALL_SIZE];
 } String;
 
 union Primtype {
-    int i;
+    sc_int i;
     double f;
     String* str;
     void* ptr;
@@ -118,6 +146,7 @@ typedef struct value {
 
 /**
  * The Array struct holds dynamically sized arrays of values.
+ * element_type: VT_UNDEF for arrays of boxed values. Any other type means that this is really a PrimArray, see _get_a() and _set_a() for access which works with either.
  * buf_size: the size of the allocated buffer in the number of elements. The total number of bytes allocated for the buffer is sizeof(value)*buf_size
  * size: the size of the array that has been written to with valid contents
  */
@@ -140,36 +169,59 @@ typedef struct Reference {
 } Reference;
 
 /**
- * This is a helper struct which is used by MemoryManager's hash table for value names
+ * Every interned string is immediately preceded in memory by this header so that its hash and length may be read without scanning the characters. See intern_str().
+ */
+typedef struct s_interned_header {
+    _uint32 hash;
+    _uint32 len;
+} interned_header;
+
+/**
+ * This is a helper struct which is used by MemoryManager's hash table for value names. Keys are always interned (see intern_str()) so two keys are equal if and only if they are the same pointer.
+ * hash: the hash of key. This is cached so that the probe distance of an entry may be computed without reading the key.
  */
 typedef struct HashedItem {
-    char* key;
+    const char* key;
     value val;
-    //size_t ind;
+    size_t slot;//index into the slot table of the owning HashTable or INONE if the item hasn't been interned. For named values on the callstack of a context this is the depth of the binding with the same name that this value shadows.
+    _uint32 hash;
 } HashedItem;
 
+/**
+ * Open addressing hash table mapping names to values. Collisions are resolved by Robin Hood linear probing: an entry which is further from its home index than the entry occupying a position takes that position, so probe lengths stay short even at high load factors and a lookup may stop as soon as it reaches an entry closer to home than the key would be. Removal shifts the following entries back so no tombstones are needed.
+ * table_size: the number of entries in table. This is always a power of two.
+ * max_load: the largest allowed ratio n_els/table_size before the table grows, see h_set_max_load()
+ * slots: items which have been interned by h_intern_slot(). Compiled code refers to globals by their index in this table so that they may be accessed without hashing. Moving an entry keeps these pointers valid, and removing an entry sets its slot to NULL.
+ */
 typedef struct s_HashTable {
     size_t table_size;
     size_t n_els;
+    double max_load;
     HashedItem* table;
+    size_t n_slots;
+    size_t slots_cap;
+    HashedItem** slots;
 } HashTable;
 
 /**
  * The stack is a FILO data structure that supports the operations push() and pop() operations.
  * Note that the bottom of the stack is HIGHER in memory than the top and push instructions append values to lower memory.
+ * If SC_STACK_MMAP is defined then the stack occupies the top of a reserved region of max entries which is committed as the stack grows. Pointers to entries therefore remain valid until they are popped.
  */
 typedef struct s_Stack {
     size_t cap;//size of the stack (not in bytes but number of value entries)
+    size_t max;//the number of entries that the stack may grow to before pushes fail with E_STACK_OVERFLOW
     value* bottom;//pointer to the bottom of the stack
     value* top;//pointer to the top of the stack
     value* block;//the block of memory allocated for the stack
 } Stack;
 
 /**
- * The stack is a FILO data structure that supports the operations push() and pop() operations.
+ * The stack is a FILO data structure that supports the operations push() and pop() operations. Memory is managed in the same way as for Stack.
  */
 typedef struct s_NamedStack {
     size_t cap;//size of the stack (not in bytes but number of value entries)
+    size_t max;
     HashedItem* bottom;
     HashedItem* top;
     HashedItem* block;
@@ -177,10 +229,20 @@ typedef struct s_NamedStack {
 
 /**
  * The context struct describes the state of the program at a given point in time. Its primary purpose is to hold the program stack and translate "heap" variable names into usable value structs.
+ * scope: maps the name of each value on the callstack to the depth (measured from the bottom of the stack) of its innermost binding or -1 if it is no longer bound. Shadowed bindings are chained through the slot member of the callstack entries.
+ * n_folded: the total number of optree nodes eliminated by constant folding in functions compiled with this context
+ * scratch: holds temporaries (e.g. optrees) while a single expression is compiled. This is reset after every expression.
+ * exec_stack: the unnamed stack that functions are executed on, see execute_function(). This is created on first use and kept so that later calls don't need to allocate it again.
+ * frame: the size of the named callstack when the function currently being compiled was entered. Stack values are addressed by their slot above this depth.
  */
 typedef struct context {
     NamedStack callstack;
     HashTable global;
+    HashTable scope;
+    size_t n_folded;
+    arena scratch;
+    Stack exec_stack;
+    size_t frame;
 } context;
 
 // ================================== GENERAL VALUE FUNCTIONS ==================================
@@ -235,7 +297,7 @@ Valtype_e read_valtype(char* str, sc_error* err);
 HashedItem _read_valtup(char* str, sc_error* err);
 
 /**
- * Frees the memory allocated for usage by h. This assumes a call to _read_valtup has been used or the key and value have both been allocated using DTG_malloc().
+ * Frees the memory allocated for usage by h. This assumes a call to _read_valtup has been used or the value has been allocated using DTG_malloc(). The key is interned and is not freed.
  */
 void free_HashedItem(HashedItem* h);
 
@@ -262,6 +324,37 @@ void _grow_a(Array* arr, size_t n, sc_error* err);
  */
 void _grow_pa(PrimArray* arr, size_t n, sc_error* err);
 
+/**
+ * Initializes an array of n unboxed elements of the primitive type t or stores a result to the error err.
+ * Note: on an error this function may return NULL
+ */
+PrimArray* _make_PrimArray(Valtype_e t, size_t n, sc_error* err);
+
+/**
+ * Returns the size of an unboxed element of type t or 0 if values of type t can't be stored in a PrimArray.
+ */
+size_t _prim_size(Valtype_e t);
+
+/**
+ * Returns the element at index i of arr, which may be an Array or a PrimArray. No bounds checking is performed.
+ */
+value _get_a(const Array* arr, size_t i);
+
+/**
+ * Stores a shallow copy of v at index i of arr, which may be an Array or a PrimArray. If v can't be stored unboxed then arr is converted to an Array of boxed values first. No bounds checking is performed.
+ */
+void _set_a(Array* arr, size_t i, value v, sc_error* err);
+
+/**
+ * Converts arr in place from a PrimArray to an Array of boxed values. Arrays which are already boxed are left unchanged.
+ */
+void _box_a(Array* arr, sc_error* err);
+
+/**
+ * Converts arr in place from an Array of boxed values to a PrimArray if every element has the same primitive type. Otherwise arr is left unchanged.
+ */
+void _unbox_a(Array* arr, sc_error* err);
+
 /**
  * Resizes the array arr to hold exactly n entries of size el_size. If n is less than the current size of the array, then elements at the end are discarded.
  */
@@ -273,7 +366,7 @@ void _resize(Array* arr, size_t n, sc_error* err);
 Array _copy_a(Array arr, sc_error* err);
 
 /**
- * Returns a new array with elements ranging from start_ind to end_ind of the original array. A shallow copy is made, and the contents of the returned array only have a lifespan matching arr. Call _copy_a() before this function if you need a deep copy.
+ * Returns a new array with elements ranging from start_ind to end_ind of the original array. A shallow copy is made, and the contents of the returned array only have a lifespan matching arr. Call _copy_a() before this function if you need a deep copy. The result uses the same representation (Array or PrimArray) as arr.
  * Note negative values "wrap around", so _slice(arr, -2, -1, NULL) would return the second to last element in the array. Indices greater than the size of the array are fixed to be equal to the size of the array.
  */
 Array _slice_a(Array arr, long int start_ind, long int end_ind, sc_error* err);
@@ -284,14 +377,14 @@ Array _slice_a(Array arr, long int start_ind, long int end_ind, sc_error* err);
 //PrimArray _slice_pa(PrimArray arr, long int start_ind, long int end_ind, sc_error* err);
 
 /**
- * Appends the array of values of length n specified by new vals to the end of the Array pointed to by arr. A deep copy of elements is performed.
+ * Appends the array of values of length n specified by new vals to the end of the Array pointed to by arr. A deep copy of elements is performed. PrimArrays stay unboxed if every new value has their element type and empty Arrays become unboxed if every new value has the same primitive type.
  */
 void _extend_a(Array* arr, value* new_vals, size_t n, sc_error* err);
 
 // ================================== ARRAY VALUES ==================================
 
 /**
- * Creates a new array value with contents identical to those stored in p_val (a deep copy is performed.
+ * Creates a new array value with contents identical to those stored in p_val (a deep copy is performed. If every value has the same primitive type then the elements are stored unboxed in a PrimArray.
  * NOTE: A deep copy of p_val is made. Thus, no guarantees as to the lifespan of the memory pointed to by p_val are required.
  */
 value v_make_array(const value* p_val, size_t n_vals, sc_error* err);
@@ -318,11 +411,42 @@ String make_String(const char* p_str, sc_error* err);
  */
 String make_String_n(size_t n, sc_error* err);
 
+/**
+ * Allocates an empty String on the heap with the capacity to hold n bytes. If n is at most STRING_SMALL_SIZE then the contents are stored inline so that only one allocation is needed. The result should be freed with free_String() followed by sc_free().
+ */
+String* _alloc_String(size_t n, sc_error* err);
+
 /**
  * Frees the memory used by str. after a call to free_String the String str still has not been allocated, but it is safe to call DTG_free(str) if the string itself was malloced.
  */
 void free_String(String* str);
 
+/**
+ * Remove one reference to the builder bld and free it if no strings use it any more.
+ */
+void _release_builder(StringBuilder* bld);
+
+/**
+ * Copy the contents of str into a buffer owned by str which holds at least n bytes and stop using its builder.
+ */
+void _own_s(String* str, size_t n, sc_error* err);
+
+/**
+ * Creates a new String on the heap holding the contents of a followed by the n bytes b. a is never modified. If a was the last string appended to its builder then the result shares the builder and only b is copied. Otherwise results which don't fit inline are placed in a new builder with twice the required capacity, so repeatedly appending to the result takes amortized constant time.
+ * returns: the new string or NULL in the event of an error. The result should be freed with free_String() followed by sc_free().
+ */
+String* _concat_s(String* a, const char* b, size_t n, sc_error* err);
+
+/**
+ * Ensure that str->buf is a null terminated copy of the contents of str which may be used as a C string. Strings which share a builder are only copied if another string has been appended to them. The buffer remains valid until the next call to _concat_s() with str as the first argument.
+ */
+void _flatten_s(String* str, sc_error* err);
+
+/**
+ * Lexicographically compare the Strings a and b. The result has the same sign as strcmp() would, but the strings don't need to be null terminated.
+ */
+int _compare_s(const String* a, const String* b);
+
 /**
  * Grows the string value val to accomodate n additional bytes.
  */
@@ -398,12 +522,12 @@ int v_fetch_char(value p_val, sc_error* err);
 /**
  * Creates a new integer value with val p_val.
  */
-value v_make_int(int p_val, sc_error* err);
+value v_make_int(sc_int p_val, sc_error* err);
 
 /**
  * Fetches the integer stored in p_val and performs casts if necessary.
  */
-int v_fetch_int(value p_val, sc_error* err);
+sc_int v_fetch_int(value p_val, sc_error* err);
 
 // ================================== FLOATS ==================================
 
@@ -417,8 +541,6 @@ value v_make_float(double p_val, sc_error* err);
  */
 double v_fetch_float(value p_val, sc_error* err);
 
-//char* _get_enclosed(char* str, const char* open, const char* close);
-
 // ================================== REFERENCES ==================================
 
 /**
@@ -431,10 +553,57 @@ void _free_Reference(Reference* r);
  */
 void release(Reference* r);
 
+// ================================== INTERNED STRINGS ==================================
+
+/**
+ * Returns the canonical copy of the string s from the global intern pool, adding it if it isn't already present. Equal strings always yield the same pointer and the returned memory is never freed until free_interned_strs() is called. The pool isn't thread safe.
+ * returns: the interned string or NULL in the event of an error
+ */
+const char* intern_str(const char* s, sc_error* err);
+
+/**
+ * Identical to intern_str() except that the first n characters of s are used.
+ */
+const char* intern_str_n(const char* s, size_t n, sc_error* err);
+
+/**
+ * Find the canonical copy of the string s without adding it to the pool. If s has never been interned then NULL is returned. Since every name is interned when it is declared, a NULL return means that no value with the name s can exist.
+ */
+const char* find_interned(const char* s);
+
+/**
+ * Returns the hash of the interned string s. s must have been returned by intern_str().
+ */
+static inline _uint32 interned_hash(const char* s) {
+    return ((const interned_header*)s - 1)->hash;
+}
+
+/**
+ * Returns the length of the interned string s. s must have been returned by intern_str().
+ */
+static inline size_t interned_len(const char* s) {
+    return ((const interned_header*)s - 1)->len;
+}
+
+/**
+ * Returns the number of distinct strings in the intern pool.
+ */
+size_t n_interned_strs();
+
+/**
+ * Returns the number of bytes of memory allocated for the intern pool.
+ */
+size_t interned_bytes();
+
+/**
+ * Release every interned string. Any pointer previously returned by intern_str() is invalidated so this should only be called once no HashTable or NamedStack remains.
+ */
+void free_interned_strs();
+
 // ================================== MEMORY MANAGEMENT AND HASHING ==================================
 
 /**
- * Uses FNV-1a with the bias and prime defined previously to compute the hash of the specified key. This function is used internally by lookup(), insert_deep() and insert(). This hash is not cryptographically secure.
+ * Uses FNV-1a with the bias and prime defined previously to compute the hash of every character of the specified key. This is the hash stored for interned strings and used by HashTable. This hash is not cryptographically secure.
  */
 _uint32 hash(const char* key);
 
@@ -453,6 +622,11 @@ HashTable make_HashTable(sc_error* err);
  */
 void free_HashTable(HashTable* h);
 
+/**
+ * Set the largest allowed load factor n_els/table_size of h, growing the table if it is already exceeded. Higher load factors use less memory at the cost of longer probes. max_load must be between 0 and 1 exclusive.
+ */
+void h_set_max_load(HashTable* h, double max_load, sc_error* err);
+
 /**
  * Look through the hash table for an entry that matches the supplied key
  * param h: the hash table to look through
@@ -461,6 +635,19 @@ void free_HashTable(HashTable* h);
  */
 HashedItem* lookup(HashTable* h, const char* key);
 
+/**
+ * Identical to lookup() except that key must be interned (see intern_str()). The stored hash of key is used and entries are compared by pointer so no characters are read.
+ */
+HashedItem* lookup_interned(HashTable* h, const char* key);
+
+/**
+ * Interns the item (which must be stored in h) into the slot table of h so that it may be accessed in constant time through h->slots. Interning the same item more than once returns the same slot.
+ * param h: the hash table which stores item
+ * param item: the item to intern, this is typically found with a call to lookup()
+ * returns: the index of the slot which points to item
+ */
+size_t h_intern_slot(HashTable* h, HashedItem* item, sc_error* err);
+
 /**
  * Insert a new item into the hash table with the specified key and value. Note that a shallow copy of the contents of val are performed. In order to produce a deep copy use insert_deep instead.
  * param h: the hash table to look through
@@ -477,6 +664,12 @@ void insert(HashTable* h, const char* key, value val, sc_error* err);
  */
 void insert_deep(HashTable* h, const char* key, value val, sc_error* err);
 
+/**
+ * Remove the entry with the specified key from the hash table and free its value. If the entry was interned by h_intern_slot() then its slot is set to NULL.
+ * returns: 1 if an entry was removed or 0 if there was no entry with the key
+ */
+int h_remove(HashTable* h, const char* key);
+
 // ================================== STACK ==================================
 
 /**
@@ -484,6 +677,11 @@ void insert_deep(HashTable* h, const char* key, value val, sc_error* err);
  */
 Stack make_Stack(sc_error* err);
 
+/**
+ * Creates a new (empty) stack with room for at least cap entries before it needs to grow. Pushing fails with E_STACK_OVERFLOW once the stack holds max entries. If max is 0 then the larger of cap and ST_DEF_MAX is used, so that stacks which are never pushed to much only reserve a small amount of address space. Both sizes may be rounded up to a whole number of pages.
+ */
+Stack make_Stack_n(size_t cap, size_t max, sc_error* err);
+
 /**
  * Frees the stack pointed to by st and any memory allocated for its contained members.
  */
@@ -521,18 +719,24 @@ size_t get_size(Stack st);
  */
 NamedStack make_NamedStack(sc_error* err);
 
+/**
+ * Creates a new (empty) stack with room for at least cap entries before it needs to grow, see make_Stack_n().
+ */
+NamedStack make_NamedStack_n(size_t cap, size_t max, sc_error* err);
+
 /**
  * Frees the stack pointed to by st and any memory allocated for its contained members.
  */
 void free_NamedStack(NamedStack* st);
 
 /**
- * Pushes the value p_val onto the stack pointed to by st. Note that this function performs a deep copy of p_val unless p_val is of the type reference. In which case the address of the value pointed to by the top stack entry will be the same as p_val before assignment.
+ * Pushes the value p_val onto the stack pointed to by st. Note that this function performs a deep copy of p_val unless p_val is of the type reference. In which case the address of the value pointed to by the top stack entry will be the same as p_val before assignment. If name is not NULL then it is interned (see intern_str()) so the caller retains ownership of the string it passed.
+ * NOTE: a value pushed onto the callstack of a context can't be found by search_val() until bind_top() is called, and unbind_top() must be called before it is popped
  */
-void push_n(NamedStack* st, char* name, value v, sc_error* err);
+void push_n(NamedStack* st, const char* name, value v, sc_error* err);
 
 /**
- * Pops the last value off of the stack and returns the result. After a call to pop a shallow copy is made and the caller is responsible for freeing any memory which may have been allocated.
+ * Pops the last value off of the stack and returns the result. After a call to pop a shallow copy is made and the caller is responsible for freeing any memory which may have been allocated. If the value was bound with bind_top() then unbind_top() should be called first, otherwise search_val() treats the name as undefined.
  */
 HashedItem pop_n(NamedStack* st, sc_error* err);
 
@@ -544,7 +748,7 @@ int is_empty_n(NamedStack* st);
 /**
  * Access the key of the stack element at index ind. If ind is out of bounds, NULL is returned.
  */
-char* read_key(NamedStack* st, size_t ind);
+const char* read_key(NamedStack* st, size_t ind);
 
 /**
  * Access the value of the stack element at index ind. If ind is out of bounds, an invalid value is returned.
@@ -569,10 +773,20 @@ context make_context(sc_error* err);
 void free_context(context* c);
 
 /**
- * Search for the value with the name name. The hashtable is searched first and if the value is found there, then -1 is returned. In the event that the entry is not found in the table, the stack is searched. If the entry with the matching name is found, then the index (relative to th bottom of the stack) is stored into off. If the entry is not found, -2 is returned. If val is not NULL, then the resulting value will be stored there or NULL if no matching value was found
+ * Search for the value with the name name. The hashtable is searched first and if the value is found there, then -1 is returned. In the event that the entry is not found in the table, the innermost binding in the scope table is used. Only values bound with bind_top() are visible. If the entry with the matching name is found, then its index (relative to the top of the stack) is returned. If the entry is not found, or its binding is stale because the value was popped without calling unbind_top(), -2 is returned. If val is not NULL, then the resulting value will be stored there or NULL if no matching value was found
  */
 int search_val(context* c, const char* name, HashedItem** val);
 
+/**
+ * Bind the name of the value on top of the callstack of c so that it may be found by search_val(). Any value lower on the stack with the same name is shadowed until unbind_top() is called.
+ */
+void bind_top(context* c, sc_error* err);
+
+/**
+ * Remove the binding for the value on top of the callstack of c, restoring the binding it shadowed (if any). This should be called before popping a named value.
+ */
+void unbind_top(context* c);
+
 /**
  * Add a value to the context c with the name name
  */